@@ -0,0 +1,658 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include <windows.h>
+#include "NRagePluginV2.h"
+#include "DirectInput.h"
+#include "FileAccess.h"
+#include "PakIO.h"
+#include "PakJournal.h"
+#include "PakStore.h"
+#include "GBCart.h"
+#include "PakPlatform.h"
+#include "ControllerPak.h"
+
+// PAK_MEM (Memory Pak)
+
+static bool MemPakInit( const int iControl )
+{
+	g_pcControllers[iControl].pPakData = P_malloc( sizeof(MEMPAK));
+	MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
+	mPak->bPakType = PAK_MEM;
+	mPak->fReadonly = false;
+	mPak->aMemPakData = mPak->aMemPakBanks = NULL;
+	mPak->pStore = NULL;
+
+	TCHAR szBuffer[MAX_PATH+1],
+		  szFullPath[MAX_PATH+1],
+		  *pcFile;
+
+	GetAbsoluteFileName( szBuffer, g_pcControllers[iControl].szMempakFile, DIRECTORY_MEMPAK );
+	pcFile = PakFullPathName( szBuffer, szFullPath );
+
+	if( pcFile == NULL )
+	{ // no Filename specified
+		WarningMessage( IDS_ERR_MEM_NOSPEC, MB_OK | MB_ICONWARNING );
+		g_pcControllers[iControl].PakType = PAK_NONE;
+		return false; // InitControllerPak frees the memory
+	}
+
+	if( !OpenMemPak( mPak, szFullPath, pcFile ))
+	{
+		g_pcControllers[iControl].PakType = PAK_NONE;	// set so that CloseControllerPak doesn't try to close a file that isn't open
+		return false; // InitControllerPak frees the memory
+	}
+	if( g_strEmuInfo.fRepairMemPaks && RepairMemPakBanks( mPak ))
+		DebugWrite( _T("Repaired MemPak file %s.\n"), pcFile );
+	return true;
+}
+
+static BYTE MemPakRead( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	return ReadMemPak( (MEMPAK*)g_pcControllers[iControl].pPakData, dwAddress, Data, &g_ctrlStats[iControl] );
+}
+
+static BYTE MemPakWrite( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	return WriteMemPak( (MEMPAK*)g_pcControllers[iControl].pPakData, dwAddress, Data );
+}
+
+static void MemPakSave( const int iControl )
+{
+	PakHoldWriteback();		// keeps the writeback thread from storing or flushing pages at the same time
+	SaveMemPak( (MEMPAK*)g_pcControllers[iControl].pPakData );
+	PakReleaseWriteback();
+}
+
+static void MemPakClose( const int iControl )
+{
+	PakHoldWriteback();		// the writeback thread may be flushing this view right now
+	CloseMemPak( (MEMPAK*)g_pcControllers[iControl].pPakData );
+	PakReleaseWriteback();
+}
+
+// Swaps the Memory Pak on iControl for bank iBank of its bank file, without touching the disk.
+// The game is told the pak was pulled on its next status request.
+// Caller holds the controller lock.  Returns false if there's no bank to switch to.
+bool SwitchMemPakBank( const int iControl, const int iBank )
+{
+	MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
+	if( !mPak || mPak->bPakType != PAK_MEM )
+		return false;
+
+	const ULONGLONG qwStart = PakMicroseconds();
+	if( !SelectMemPakBank( mPak, iBank ))
+		return false;
+	g_pcControllers[iControl].fPakSwapped = 1;
+
+	const DWORD dwMicros = (DWORD)( PakMicroseconds() - qwStart );
+	g_ctrlStats[iControl].dwBankSwaps++;
+	g_ctrlStats[iControl].dwBankSwapMicros += dwMicros;
+	g_ctrlStats[iControl].dwMaxBankSwapMicros = max( g_ctrlStats[iControl].dwMaxBankSwapMicros, dwMicros );
+	LogDebugA( LOG_MEMPAK, "Mempak %d: switched to bank %d in %u us\n", iControl + 1, mPak->iBank, dwMicros );
+	return true;
+}
+
+// PAK_RUMBLE (Rumble Pak)
+
+static bool RumblePakInit( const int iControl )
+{
+	g_pcControllers[iControl].pPakData = P_malloc( sizeof(RUMBLEPAK));
+	RUMBLEPAK *rPak = (RUMBLEPAK*)g_pcControllers[iControl].pPakData;
+	rPak->bPakType = PAK_RUMBLE;
+
+	rPak->fLastData = true;		// statistically, if uninitted it would return true --rabid
+//	rPak->bRumbleTyp = g_pcControllers[iControl].bRumbleTyp;
+//	rPak->bRumbleStrength = g_pcControllers[iControl].bRumbleStrength;
+//	rPak->fVisualRumble = g_pcControllers[iControl].fVisualRumble;
+	if( !g_pcControllers[iControl].xiController.bConnected )	//used to make sure only xinput cotroller rumbles --tecnicors
+		CreateEffectHandle( iControl, g_pcControllers[iControl].bRumbleTyp, g_pcControllers[iControl].bRumbleStrength );
+	return true;
+}
+
+static BYTE RumblePakRead( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	if(( dwAddress >= 0x8000 ) && ( dwAddress < 0x9000 ) )
+	{
+		RUMBLEPAK *rPak = (RUMBLEPAK*)g_pcControllers[iControl].pPakData;
+
+		if (rPak->fLastData)
+			FillMemory( Data, 32, 0x80 );
+		else
+			ZeroMemory( Data, 32 );
+		
+		if( g_pcControllers[iControl].xiController.bConnected && g_pcControllers[iControl].fXInput )	// xinput controller rumble --tecnicors
+			VibrateXInputController( g_pcControllers[iControl].xiController.nControl, 0, 0);
+		else if (g_apFFDevice[iControl])
+			g_apFFDevice[iControl]->Acquire();
+	}
+	else
+		ZeroMemory( Data, 32 );
+
+	Data[32] = DataCRC( Data, 32 );
+	return RD_OK;
+}
+
+static BYTE RumblePakWrite( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	if( dwAddress == PAK_IO_RUMBLE )
+	{
+		if( g_pcControllers[iControl].xiController.bConnected  && g_pcControllers[iControl].fXInput )	// xinput controller rumble --tecnicors
+		{
+			if( *Data )
+				VibrateXInputController( g_pcControllers[iControl].xiController.nControl );
+			else
+				VibrateXInputController( g_pcControllers[iControl].xiController.nControl, 0, 0 );
+			goto end_rumble;
+		}
+
+		if( g_pcControllers[iControl].fVisualRumble )
+			FlashWindow( g_strEmuInfo.hMainWindow, ( *Data != 0 ) ? TRUE : FALSE );
+		if( g_pcControllers[iControl].bRumbleTyp == RUMBLE_DIRECT )
+		{  // Adaptoid Direct Rumble
+			if( g_pcControllers[iControl].fIsAdaptoid )
+				DirectRumbleCommand( iControl, *Data );
+		}
+		else
+		{  // FF-FeedBack Rumble
+			if( g_apdiEffect[iControl] )
+			{
+				g_apFFDevice[iControl]->Acquire();
+				if( *Data )
+				{
+					// g_apdiEffect[iControl]->Start( 1, DIES_SOLO );
+					HRESULT hr; 
+					hr = g_apdiEffect[iControl]->Start( 1, DIES_NODOWNLOAD );
+					if( hr != DI_OK )// just download if needed( seems to work smoother)
+					{
+						hr = g_apdiEffect[iControl]->Start( 1, 0 );
+						if (hr != DI_OK)
+						{
+							DebugWriteA("Rumble: Can't rumble %d: %lX\n", iControl, hr);
+						}
+						else
+							DebugWriteA("Rumble: DIES_NODOWNLOAD failed, regular OK on control %d\n", iControl);
+					}
+					else
+						DebugWriteA("Rumble: DIES_NODOWNLOAD OK on control %d\n", iControl);
+				}
+				else
+				{
+					g_apdiEffect[iControl]->Stop();
+				}
+			}
+		}
+	}
+	else if (dwAddress >= 0x8000 && dwAddress < 0x9000)
+	{
+		RUMBLEPAK *rPak = (RUMBLEPAK*)g_pcControllers[iControl].pPakData;
+		rPak->fLastData = (*Data) ? true : false;
+	}
+
+end_rumble:		// added so after xinput controller rumbles, gets here --tecnicors
+	Data[32] = DataCRC( Data, 32 );
+	return RD_OK;
+}
+
+static void RumblePakClose( const int iControl )
+{
+	ReleaseEffect( g_apdiEffect[iControl] );
+	g_apdiEffect[iControl] = NULL;
+}
+
+// PAK_TRANSFER (Transfer Pak)
+
+static bool TransferPakInit( const int iControl )
+{
+	g_pcControllers[iControl].pPakData = P_malloc( sizeof(TRANSFERPAK));
+	InitTransferPak( (LPTRANSFERPAK)g_pcControllers[iControl].pPakData, g_pcControllers[iControl].szTransferRom, g_pcControllers[iControl].szTransferSave );
+	return true;
+}
+
+static BYTE TransferPakRead( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	return ReadTransferPak( (LPTRANSFERPAK)g_pcControllers[iControl].pPakData, dwAddress, Data );
+}
+
+static BYTE TransferPakWrite( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
+	const BYTE bReturn = WriteTransferPak( tPak, dwAddress, Data );
+	if( dwAddress >= 0xC000 && tPak->gbCart.pRamMapping != NULL )
+		PakScheduleWriteback( PAK_TRANSFER ); // if we go 2 seconds without a write, call PakWriteback (which will flush the cache)
+	return bReturn;
+}
+
+static void TransferPakSave( const int iControl )
+{
+	LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
+	// here the changes( if any ) in the SRAM should be saved
+
+	if (tPak->gbCart.pRamMapping != NULL || tPak->gbCart.sGoombaRamPath != NULL)
+	{
+		SaveCart(&tPak->gbCart, g_pcControllers[iControl].szTransferSave, _T(""));
+		DebugWriteA( "*** Save Transfer Pak ***\n" );
+	}
+}
+
+static void TransferPakClose( const int iControl )
+{
+	LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
+	UnloadCart(&tPak->gbCart);
+	DebugWriteA( "*** Close Transfer Pak ***\n" );
+	// close files and free any additionally ressources
+}
+
+// PAK_ADAPTOID (Adaptoid pass-through pak)
+
+static bool AdaptoidPakInit( const int iControl )
+{
+	bool bReturn = false;
+
+	if( !g_pcControllers[iControl].fIsAdaptoid )
+		g_pcControllers[iControl].PakType = PAK_NONE;
+	else
+	{
+		g_pcControllers[iControl].pPakData = P_malloc( sizeof(ADAPTOIDPAK));
+		ADAPTOIDPAK *aPak = (ADAPTOIDPAK*)g_pcControllers[iControl].pPakData;
+		aPak->bPakType = PAK_ADAPTOID;
+
+		aPak->bIdentifier = 0x80;
+#ifdef ADAPTOIDPAK_RUMBLEFIX
+		aPak->fRumblePak = true;
+#pragma message( "Driver-fix for Rumble with Adaptoid enabled" )
+#else
+		aPak->fRumblePak = false;
+#endif
+		bReturn = true;
+	}
+
+	return bReturn;
+}
+
+static BYTE AdaptoidPakRead( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	BYTE bReturn = RD_ERROR;
+
+	if( ReadAdaptoidPak( iControl, dwAddress, Data ) == DI_OK )
+	{
+		Data[32] = DataCRC( Data, 32 );
+		bReturn = RD_OK;
+		
+		if( ((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->fRumblePak )
+		{
+			BYTE bId = ((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->bIdentifier;
+			if(	(( dwAddress == 0x8000 ) && ( bId == 0x80 ) && ( Data[0] != 0x80 ))
+				|| (( dwAddress == 0x8000 ) && ( bId != 0x80 ) && ( Data[0] != 0x00 ))
+				|| (( dwAddress < 0x8000 ) && ( Data[0] != 0x00 )))
+			{
+				((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->fRumblePak = false;
+				DebugWriteA( "\nAssuming the inserted Pak AINT a RumblePak\nDisabling Rumblefix\n" );
+			}	
+		}
+	}
+
+	return bReturn;
+}
+
+static BYTE AdaptoidPakWrite( const int iControl, const WORD dwAddress, LPBYTE Data )
+{
+	BYTE bReturn = RD_ERROR;
+
+	if(( dwAddress == PAK_IO_RUMBLE ) && ((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->fRumblePak )
+	{
+		if( DirectRumbleCommand( iControl, *Data ) == DI_OK )
+		{
+			Data[32] = DataCRC( Data, 32 );
+			bReturn = RD_OK;
+		}
+	}
+	else
+	{
+		if( WriteAdaptoidPak( iControl, dwAddress, Data ) == DI_OK )
+		{
+			Data[32] = DataCRC( Data, 32 );
+			if( dwAddress == 0x8000 )
+				((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->bIdentifier = Data[0];
+
+			bReturn = RD_OK;
+		}
+	}
+
+	return bReturn;
+}
+
+static const PAKHANDLERS g_MemPakHandlers		= { MemPakInit, MemPakRead, MemPakWrite, MemPakSave, MemPakClose };
+static const PAKHANDLERS g_RumblePakHandlers	= { RumblePakInit, RumblePakRead, RumblePakWrite, NULL, RumblePakClose };
+static const PAKHANDLERS g_TransferPakHandlers	= { TransferPakInit, TransferPakRead, TransferPakWrite, TransferPakSave, TransferPakClose };
+static const PAKHANDLERS g_AdaptoidPakHandlers	= { AdaptoidPakInit, AdaptoidPakRead, AdaptoidPakWrite, NULL, NULL };
+
+// indexed by PakType; NULL for PAK_NONE and the paks we can't emulate (PAK_VOICE)
+static const PAKHANDLERS * const g_apPakHandlers[] =
+{
+	NULL,					// PAK_NONE
+	&g_MemPakHandlers,		// PAK_MEM
+	&g_RumblePakHandlers,	// PAK_RUMBLE
+	&g_TransferPakHandlers,	// PAK_TRANSFER
+	NULL,					// PAK_VOICE
+	NULL,
+	NULL,
+	&g_AdaptoidPakHandlers	// PAK_ADAPTOID
+};
+
+bool InitControllerPak( const int iControl )
+// Prepares the Pak
+{
+	if( !g_pcControllers[iControl].fPlugged )
+		return false;
+	if( g_pcControllers[iControl].pPakData )
+	{
+		SaveControllerPak( iControl );
+		CloseControllerPak( iControl );
+	}
+
+	// bind the handlers once here; the transfers below never look at the pak type again
+	const unsigned PakType = g_pcControllers[iControl].PakType;
+	const PAKHANDLERS *pHandlers = ( PakType < ARRAYSIZE(g_apPakHandlers) ) ? g_apPakHandlers[PakType] : NULL;
+	g_pcControllers[iControl].pPakHandlers = pHandlers;
+	if( pHandlers == NULL )
+		return false;
+
+	bool bReturn = pHandlers->ptrfnInit( iControl );
+
+	// if there were any unrecoverable errors and we have allocated pPakData, free it and set paktype to NONE
+	if( !bReturn && g_pcControllers[iControl].pPakData )
+		CloseControllerPak( iControl );
+
+	return bReturn;
+}
+
+// Validates the 5 bit CRC the N64 sends along with every pak address.
+// A bad CRC doesn't stop the transfer; it's flagged so the next status request reports RD_ADDRCRCERR.
+inline void CheckAddressCRC( const int iControl, LPCBYTE Command )
+{
+	if( !IsAddressCRCValid( Command ))
+	{
+		g_pcControllers[iControl].fPakCRCError = true;
+		g_ctrlStats[iControl].dwAddrCRCErrors++;
+		LogWarnA( LOG_MEMPAK, "Bad address CRC on controller %d: %02X%02X\n", iControl + 1, Command[0], Command[1] );
+	}
+}
+
+BYTE ReadControllerPak( const int iControl, LPBYTE Command )
+{
+	CheckAddressCRC( iControl, Command );
+
+	if( !g_pcControllers[iControl].pPakData )
+		return RD_ERROR;
+
+	WORD dwAddress = (Command[0] << 8) + (Command[1] & 0xE0);
+
+	return g_pcControllers[iControl].pPakHandlers->ptrfnRead( iControl, dwAddress, &Command[2] );
+}
+
+// Called when the N64 tries to write to the controller pak, e.g. a mempak
+BYTE WriteControllerPak( const int iControl, LPBYTE Command )
+{
+	CheckAddressCRC( iControl, Command );
+
+	if( !g_pcControllers[iControl].pPakData )
+		return RD_ERROR;
+
+	WORD dwAddress = (Command[0] << 8) + (Command[1] & 0xE0);
+
+	return g_pcControllers[iControl].pPakHandlers->ptrfnWrite( iControl, dwAddress, &Command[2] );
+}
+
+void SaveControllerPak( const int iControl )
+{
+	if( !g_pcControllers[iControl].pPakData )
+		return;
+
+	if( g_pcControllers[iControl].pPakHandlers->ptrfnSave )
+		g_pcControllers[iControl].pPakHandlers->ptrfnSave( iControl );
+}
+
+// if there is pPakData for the controller, does any closing of handles before freeing the pPakData struct and setting it to NULL
+// also sets fPakInitialized to false
+void CloseControllerPak( const int iControl )
+{
+	if( !g_pcControllers[iControl].pPakData )
+		return;
+
+	g_pcControllers[iControl].fPakInitialized = 0;
+	ResetPakSnapshotPages( iControl );
+
+	if( g_pcControllers[iControl].pPakHandlers->ptrfnClose )
+		g_pcControllers[iControl].pPakHandlers->ptrfnClose( iControl );
+
+	freePakData( &g_pcControllers[iControl] );
+	return;
+}
+
+// Writeback
+
+static VOID CALLBACK WritebackTimerProc( HWND hWnd, UINT msg, UINT_PTR idEvent, DWORD dwTime )
+{
+	KillTimer( hWnd, idEvent ); // timer suicide
+	PakWriteback( (int)idEvent );
+}
+
+// the timer id is the pak type, so calling this again just pushes the existing timer back
+void PakScheduleWriteback( const int iPakType )
+{
+	SetTimer( g_strEmuInfo.hMainWindow, iPakType, g_strEmuInfo.dwWritebackDelay, WritebackTimerProc );
+}
+
+static CRITICAL_SECTION g_csWriteback;
+static HANDLE g_hWritebackThread = NULL;
+static HANDLE g_hWritebackStop = NULL;
+
+void InitPakWriteback()
+{
+	InitializeCriticalSection( &g_csWriteback );
+}
+
+void FreePakWriteback()
+{
+	DeleteCriticalSection( &g_csWriteback );
+}
+
+static DWORD WINAPI WritebackThread( LPVOID lpParam )
+{
+	while( WaitForSingleObject( g_hWritebackStop, PAK_WRITEBACK_POLL ) == WAIT_TIMEOUT )
+	{
+		EnterCriticalSection( &g_csWriteback );
+		PakFlushDirty();
+		LeaveCriticalSection( &g_csWriteback );
+	}
+	return 0;
+}
+
+void PakStartWriteback()
+{
+	if( g_hWritebackThread != NULL )
+		return;
+
+	g_hWritebackStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+	if( g_hWritebackStop == NULL )
+		return;
+	g_hWritebackThread = CreateThread( NULL, 0, WritebackThread, NULL, 0, NULL );
+	if( g_hWritebackThread == NULL )
+	{
+		DebugWriteA( "PakStartWriteback: CreateThread failed: %08x\n", GetLastError() );
+		CloseHandle( g_hWritebackStop );
+		g_hWritebackStop = NULL;
+	}
+}
+
+// waits for the worker to finish; fine with controller locks held, since the worker only try-locks them
+void PakStopWriteback()
+{
+	if( g_hWritebackThread == NULL )
+		return;
+
+	SetEvent( g_hWritebackStop );
+	WaitForSingleObject( g_hWritebackThread, INFINITE );
+	CloseHandle( g_hWritebackThread );
+	CloseHandle( g_hWritebackStop );
+	g_hWritebackThread = NULL;
+	g_hWritebackStop = NULL;
+}
+
+void PakHoldWriteback()
+{
+	EnterCriticalSection( &g_csWriteback );
+}
+
+void PakReleaseWriteback()
+{
+	LeaveCriticalSection( &g_csWriteback );
+}
+
+// Runs dwWritebackDelay ms after the last PakScheduleWriteback for this pak type and flushes the mapped files.
+void PakWriteback( const int iPakType )
+{
+	switch (iPakType)
+	{
+	case PAK_TRANSFER:
+		DebugWriteA("TPak: PakWriteback flushed file writes\n");
+		for( int i = 0; i < 4; i++ )
+		{
+			EnterControllerLock( i );
+			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[i].pPakData;
+
+			if (tPak && tPak->bPakType == PAK_TRANSFER && tPak->bPakInserted && tPak->gbCart.pRamMapping != NULL && tPak->gbCart.dwDirtyPages )
+			{
+				const DWORD dwBytes = FlushCart( &tPak->gbCart );
+				g_ctrlStats[i].dwWritebackFlushes++;
+				g_ctrlStats[i].dwWritebackBytes += dwBytes;
+			}
+			LeaveControllerLock( i );
+		}
+		return;
+	}
+}
+
+// Runs on the writeback thread with the writeback lock held.
+// Flushes the dirty pages of every mempak that has settled or has been dirty too long, one PakFlushFile per run of dirty pages,
+// and anything whose journal is filling up, so that the journal can checkpoint.
+void PakFlushDirty()
+{
+	const DWORD dwNow = PakTickCount();
+	const DWORD dwDelay = g_strEmuInfo.dwWritebackDelay, dwMaxAge = g_strEmuInfo.dwWritebackMaxAge;
+
+	for( int i = 0; i < 4; i++ )
+	{
+		// never wait on the emulation thread; a busy controller just gets picked up on the next pass
+		if( !TryEnterCriticalSection( &g_ctrlCritical[i] ))
+			continue;
+
+		MEMPAK *mPak = (MEMPAK*)g_pcControllers[i].pPakData;
+		LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[i].pPakData;
+		DWORD dwPages = 0;
+		LPBYTE aMemPakData = NULL;
+		LPPAKJOURNAL pJournal = NULL;
+		LPPAKSTORE pStore = NULL;
+		DWORD dwJournalMark = 0;
+
+		if( mPak && mPak->bPakType == PAK_MEM && ( PakJournalWantsCheckpoint( mPak->pJournal ) || (( mPak->dwDirtyPages || mPak->dwRetryPages )
+			&& ( dwNow - mPak->dwLastWriteTick >= dwDelay || dwNow - mPak->dwFirstDirtyTick >= dwMaxAge ))))
+		{
+			// take the pages now; writes that land during the flush mark them dirty again
+			dwPages = mPak->dwDirtyPages | mPak->dwRetryPages;
+			mPak->dwDirtyPages = 0;
+			aMemPakData = mPak->aMemPakBanks;
+			pJournal = mPak->pJournal;
+			pStore = mPak->pStore;
+			dwJournalMark = PakJournalMark( pJournal );
+		}
+		else if( tPak && tPak->bPakType == PAK_TRANSFER && tPak->bPakInserted && PakJournalWantsCheckpoint( tPak->gbCart.pJournal ))
+		{
+			// cart RAM is flushed under the controller lock anyway, see PakWriteback
+			const DWORD dwBytes = FlushCart( &tPak->gbCart );
+			g_ctrlStats[i].dwWritebackFlushes++;
+			g_ctrlStats[i].dwWritebackBytes += dwBytes;
+		}
+		LeaveCriticalSection( &g_ctrlCritical[i] );
+
+		if( pStore )
+		{
+			// only pages whose content changed get written; the buffer stays allocated while we hold the writeback lock,
+			// and so does mPak, whose dwRetryPages keeps what failed for the next pass or SaveMemPak
+			const DWORD dwBytes = WritePakStore( pStore, aMemPakData, dwPages, &mPak->dwRetryPages );
+			g_ctrlStats[i].dwWritebackFlushes++;
+			g_ctrlStats[i].dwWritebackBytes += dwBytes;
+			LogDebugA( LOG_MEMPAK, "Mempak %d: stored %u bytes\n", i + 1, dwBytes );
+			dwPages = 0;
+		}
+
+		// the view stays mapped while we hold the writeback lock, see MemPakClose
+		FlushMemPakPages( aMemPakData, dwPages, &g_ctrlStats[i] );
+		// every write up to the mark is on disk now
+		PakJournalCheckpoint( pJournal, dwJournalMark );
+	}
+}
+
+// Closes the current journal group of every pak; called once per emulated frame.
+void CommitPakJournals()
+{
+	for( int i = 0; i < 4; i++ )
+	{
+		if( !g_pcControllers[i].pPakData )
+			continue;
+
+		EnterControllerLock( i );
+		if( g_pcControllers[i].pPakData )
+		{
+			switch( *(BYTE*)g_pcControllers[i].pPakData )
+			{
+			case PAK_MEM:
+				PakJournalCommit( ((MEMPAK*)g_pcControllers[i].pPakData)->pJournal );
+				break;
+			case PAK_TRANSFER:
+				PakJournalCommit( ((LPTRANSFERPAK)g_pcControllers[i].pPakData)->gbCart.pJournal );
+				break;
+			}
+		}
+		LeaveControllerLock( i );
+	}
+}
+
+// PakSnapshot.h: the emulator's snapshots see the paks of the 4 controllers
+void *LockPakSlot( const int iSlot )
+{
+	EnterControllerLock( iSlot );
+	return g_pcControllers[iSlot].pPakData;
+}
+
+void UnlockPakSlot( const int iSlot, const DWORD dwChanges )
+{
+	LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iSlot].pPakData;
+	if(( dwChanges & PAKSLOT_MEMORY ) && tPak && tPak->bPakType == PAK_TRANSFER && tPak->gbCart.pRamMapping != NULL )
+		PakScheduleWriteback( PAK_TRANSFER );
+	if( dwChanges & PAKSLOT_SWAPPED )
+		g_pcControllers[iSlot].fPakSwapped = 1;
+	LeaveControllerLock( iSlot );
+}
@@ -0,0 +1,76 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _CONTROLLERPAK_H_
+#define _CONTROLLERPAK_H_
+
+// The plugin side of the paks: binds the pak core (PakIO.h) to the controllers, adds the paks that need
+// DirectInput (rumble, Adaptoid) and runs the writeback of the mapped files.  Win32 only.
+
+bool InitControllerPak( const int iControl );
+void SaveControllerPak( const int iControl );
+BYTE ReadControllerPak( const int iControl, LPBYTE Command );
+BYTE WriteControllerPak( const int iControl, LPBYTE Command );
+void CloseControllerPak( const int iControl );
+// Swaps the Memory Pak on iControl for bank iBank of its bank file, see SelectMemPakBank.
+// Caller holds the controller lock.
+bool SwitchMemPakBank( const int iControl, const int iBank );
+void CommitPakJournals();
+
+// Pak handlers //
+// One table per emulated pak type, bound to the controller by InitControllerPak.
+// Reads and writes go straight through the bound table instead of switching on the pak type each transfer.
+typedef struct _PAKHANDLERS
+{
+	bool (*ptrfnInit)(const int iControl);										// allocates and fills pPakData
+	BYTE (*ptrfnRead)(const int iControl, const WORD dwAddress, LPBYTE Data);	// 32 byte read, returns the data CRC
+	BYTE (*ptrfnWrite)(const int iControl, const WORD dwAddress, LPBYTE Data);	// 32 byte write, returns the data CRC
+	void (*ptrfnSave)(const int iControl);										// may be NULL
+	void (*ptrfnClose)(const int iControl);										// may be NULL; pPakData is freed afterwards
+} PAKHANDLERS, *LPPAKHANDLERS;
+
+// Writeback //
+
+// (Re)starts the writeback timer for a pak type; PakWriteback( iPakType ) runs once there have been
+// no further calls for g_strEmuInfo.dwWritebackDelay milliseconds (WritebackDelay in NRage.ini).
+#define PAK_WRITEBACK_DELAY		2000	// the default
+void PakScheduleWriteback( const int iPakType );
+void PakWriteback( const int iPakType );
+
+// Background writeback for paks that track their own dirty pages (the mempak).
+// Between PakStartWriteback and PakStopWriteback a worker thread calls PakFlushDirty every
+// PAK_WRITEBACK_POLL ms.  A dirty pak is flushed once it has gone dwWritebackDelay ms without writes,
+// or at the latest dwWritebackMaxAge ms (WritebackMaxAge in NRage.ini) after it first became dirty.
+#define PAK_WRITEBACK_POLL		250
+#define PAK_WRITEBACK_MAXAGE	10000	// the default
+void InitPakWriteback();
+void FreePakWriteback();
+void PakStartWriteback();
+void PakStopWriteback();
+void PakFlushDirty();
+// Keeps PakFlushDirty from running while held; take it before unmapping a view it might be flushing.
+// Lock order is controller lock first, then this.  PakFlushDirty only ever try-locks controllers.
+void PakHoldWriteback();
+void PakReleaseWriteback();
+
+#endif // #ifndef _CONTROLLERPAK_H_
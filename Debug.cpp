@@ -27,13 +27,46 @@
 
 bool bDebug = true;
 
+// runtime log filter, see the LogXxxA macros in Debug.h
+int g_iLogLevel = DEBUG_LOG_LEVEL;
+DWORD g_dwLogCategories = LOG_ALL;
+
 
 HANDLE hDebug = INVALID_HANDLE_VALUE;
 
+// Debug output goes through a lock-free ring of fixed size slots.  Any thread may add messages;
+// a background thread drains them to NRage-Debug.txt in large writes, so the emulation thread never waits on the disk.
+// If the ring is full the message is dropped and counted instead of blocking.
+#define LOG_RING_SLOTS	2048					// must be a power of 2
+#define LOG_SLOT_TEXT	120						// longer messages are split over several slots
+#define LOG_BATCH_SIZE	( 64 * 1024 )
+#define LOG_WAKE_MS		50						// writer thread wakes at least this often
 
-void _DebugAnsiFileWrite( LPCSTR szRemark )
+typedef struct _LOGSLOT
 {
-	if( !bDebug )
+	volatile LONG lTurn;		// slot is free for position i when lTurn + index == i, ready to read when it's i + 1
+	int iLength;
+	char szText[LOG_SLOT_TEXT];
+} LOGSLOT;
+
+static LOGSLOT g_aLogRing[LOG_RING_SLOTS];		// zero-initialized, which makes every slot free for its first round
+static volatile LONG g_lLogHead = 0;			// next position to fill
+static LONG g_lLogTail = 0;						// next position to drain, only touched while holding g_lLogDraining
+static volatile LONG g_lLogDraining = 0;		// lets the writer thread and _DebugFlush take turns as the single consumer
+static volatile LONG g_lLogDropped = 0;
+static LONG g_lLogDroppedReported = 0;
+
+static volatile LONG g_lLogThreadStarted = 0;
+static volatile bool g_fLogStop = false;		// set while shutting down; new messages are queued but start no writer
+static HANDLE g_hLogWakeup = NULL;
+static HANDLE g_hLogThread = NULL;
+
+static char g_aLogBatch[LOG_BATCH_SIZE + 2];	// +2 so a "\r\n" always fits
+static DWORD g_dwLogBatch = 0;
+
+static void FlushLogBatch()
+{
+	if( g_dwLogBatch == 0 )
 		return;
 
 	if (hDebug == INVALID_HANDLE_VALUE)
@@ -50,29 +83,146 @@ void _DebugAnsiFileWrite( LPCSTR szRemark )
 	if( hDebug != INVALID_HANDLE_VALUE )
 	{
 		DWORD dwWritten;
-		LPCSTR szText = szRemark;
-		if( szText == NULL )
-			szText = "\r\n";
+		WriteFile( hDebug, g_aLogBatch, g_dwLogBatch, &dwWritten, NULL );
+	}
+	g_dwLogBatch = 0;
+}
 
-		LPCSTR szCurrPos = szText;
+// Copies text into the batch, turning lone '\n' into "\r\n" on the way.
+static void AddToLogBatch( LPCSTR szText, int iLength )
+{
+	for( int i = 0; i < iLength; ++i )
+	{
+		if( g_dwLogBatch >= LOG_BATCH_SIZE )
+			FlushLogBatch();
+		if( szText[i] == '\n' && ( i == 0 || szText[i-1] != '\r' ))
+			g_aLogBatch[g_dwLogBatch++] = '\r';
+		g_aLogBatch[g_dwLogBatch++] = szText[i];
+	}
+}
 
-		while( ( szCurrPos = strchr( szCurrPos, '\n' )) != NULL )
-		{
-			DWORD length = szCurrPos - szText;
-			if( length > 0 && szCurrPos[-1] == '\r' )
-				--length;
+// Waits a bounded time for the consumer side; the writer thread might have been killed holding it during process exit.
+static bool LockLogDrain()
+{
+	for( int i = 0; i < 200; ++i )
+	{
+		if( InterlockedExchange( &g_lLogDraining, 1 ) == 0 )
+			return true;
+		Sleep( 1 );
+	}
+	return false;
+}
 
-			if( length > 0 )
-				WriteFile( hDebug, (LPCVOID)szText, length, &dwWritten, NULL );
-			WriteFile( hDebug, "\r\n", 2, &dwWritten, NULL );
+// Empties the ring into the file.  Only one thread drains at a time.
+static void DrainLogRing()
+{
+	if( !LockLogDrain() )
+		return;
 
-			szText = ++szCurrPos;
+	for( ;; )
+	{
+		LOGSLOT *pSlot = &g_aLogRing[g_lLogTail & ( LOG_RING_SLOTS - 1 )];
+		const LONG lIndex = g_lLogTail & ( LOG_RING_SLOTS - 1 );
+		if( (LONG)( pSlot->lTurn + lIndex ) != (LONG)( g_lLogTail + 1 ))
+			break;	// nothing more was published
+
+		AddToLogBatch( pSlot->szText, pSlot->iLength );
+
+		// free the slot for the producer one lap ahead
+		InterlockedExchange( &pSlot->lTurn, g_lLogTail + LOG_RING_SLOTS - lIndex );
+		++g_lLogTail;
+	}
+
+	const LONG lDropped = g_lLogDropped;
+	if( lDropped != g_lLogDroppedReported )
+	{
+		char szBuffer[64];
+		int iLength = wsprintfA( szBuffer, "--- %u debug messages dropped ---\n", (unsigned)( lDropped - g_lLogDroppedReported ));
+		AddToLogBatch( szBuffer, iLength );
+		g_lLogDroppedReported = lDropped;
+	}
+
+	FlushLogBatch();
+	InterlockedExchange( &g_lLogDraining, 0 );
+}
+
+static DWORD WINAPI LogWriterThread( LPVOID lpParam )
+{
+	while( !g_fLogStop )
+	{
+		WaitForSingleObject( g_hLogWakeup, LOG_WAKE_MS );
+		DrainLogRing();
+	}
+	return 0;
+}
+
+static void StartLogWriter()
+{
+	if( InterlockedCompareExchange( &g_lLogThreadStarted, 1, 0 ) != 0 )
+		return;
+
+	g_hLogWakeup = CreateEvent( NULL, FALSE, FALSE, NULL );
+	g_hLogThread = CreateThread( NULL, 0, LogWriterThread, NULL, 0, NULL );
+}
+
+// Claims the next slot and copies up to LOG_SLOT_TEXT chars into it.  Returns false if the ring is full.
+static bool PushLogSlot( LPCSTR szText, int iLength )
+{
+	LONG lPos = g_lLogHead;
+	LOGSLOT *pSlot;
+
+	for( ;; )
+	{
+		const LONG lIndex = lPos & ( LOG_RING_SLOTS - 1 );
+		pSlot = &g_aLogRing[lIndex];
+		const LONG lDiff = (LONG)( pSlot->lTurn + lIndex - lPos );
+
+		if( lDiff == 0 )
+		{
+			const LONG lSeen = InterlockedCompareExchange( &g_lLogHead, lPos + 1, lPos );
+			if( lSeen == lPos )
+				break;
+			lPos = lSeen;
 		}
+		else if( lDiff < 0 )
+			return false;	// the writer hasn't caught up with this slot yet
+		else
+			lPos = g_lLogHead;
+	}
+
+	CopyMemory( pSlot->szText, szText, iLength );
+	pSlot->iLength = iLength;
+	// publish; the interlocked write keeps the copy above from being reordered after it
+	InterlockedExchange( &pSlot->lTurn, lPos + 1 - ( lPos & ( LOG_RING_SLOTS - 1 )));
+
+	if( (LONG)( lPos - g_lLogTail ) == LOG_RING_SLOTS / 2 && g_hLogWakeup )
+		SetEvent( g_hLogWakeup );	// half full, don't wait for the timeout
+	return true;
+}
+
+void _DebugAnsiFileWrite( LPCSTR szRemark )
+{
+	if( !bDebug )
+		return;
 
-		DWORD length = lstrlenA( szText );
+	if( g_lLogThreadStarted == 0 && !g_fLogStop )
+		StartLogWriter();
 
-		if( length > 0 )
-            WriteFile( hDebug, (LPCVOID)szText, length, &dwWritten, NULL );
+	LPCSTR szText = szRemark;
+	if( szText == NULL )
+		szText = "\n";
+
+	int iLength = lstrlenA( szText );
+	while( iLength > 0 )
+	{
+		const int iChunk = min( iLength, LOG_SLOT_TEXT );
+		if( !PushLogSlot( szText, iChunk ))
+		{
+			InterlockedIncrement( &g_lLogDropped );
+			return;
+		}
+		szText += iChunk;
+		iLength -= iChunk;
 	}
 	return;
 }
@@ -139,17 +289,60 @@ void _WriteDatasA( LPCSTR Header, const int Control, LPCBYTE Data, const HRESULT
 	return;
 }
 
+// Stops the writer thread and waits for it, then writes out what's left on this thread.
+// Called from CloseDLL, since we can't wait for a thread in DllMain.  Logging after this starts a new writer.
+void _StopDebugLog()
+{
+	if( g_lLogThreadStarted == 0 )
+		return;
+
+	g_fLogStop = true;
+	if( g_hLogThread )
+	{
+		SetEvent( g_hLogWakeup );
+		WaitForSingleObject( g_hLogThread, INFINITE );
+		CloseHandle( g_hLogThread );
+		g_hLogThread = NULL;
+	}
+	HANDLE hWakeup = g_hLogWakeup;
+	g_hLogWakeup = NULL;
+	if( hWakeup )
+		CloseHandle( hWakeup );
+
+	_DebugFlush();
+	g_fLogStop = false;
+	InterlockedExchange( &g_lLogThreadStarted, 0 );
+}
+
 void _CloseDebugFile()
 {
-	if( hDebug != INVALID_HANDLE_VALUE )
+	if( g_lLogThreadStarted == 0 && hDebug == INVALID_HANDLE_VALUE )
+		return;		// nothing was ever logged
+
+	// We may be in DllMain here, so don't wait for the writer thread (CloseDLL normally stopped it already),
+	// and don't start a new one for the line below; drain on this thread instead.
+	g_fLogStop = true;
+	_DebugWriteA("---DEBUG FILE CLOSED---\n");
+	if( g_hLogWakeup )
+		SetEvent( g_hLogWakeup );
+	DrainLogRing();
+
+	bDebug = false;		// nothing would drain it any more
+	if( LockLogDrain() )
 	{
-		_DebugWriteA("---DEBUG FILE CLOSED---\n");
-		CloseHandle( hDebug );
+		if( hDebug != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle( hDebug );
+			hDebug = INVALID_HANDLE_VALUE;
+		}
+		InterlockedExchange( &g_lLogDraining, 0 );
 	}
 }
 
+// Writes out everything queued so far and flushes the file.
 void _DebugFlush()
 {
+	DrainLogRing();
 	if( hDebug != INVALID_HANDLE_VALUE )
 	{
 		FlushFileBuffers(hDebug);
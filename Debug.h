@@ -24,7 +24,28 @@
 #ifndef _DEBUG_H_
 #define _DEBUG_H_
 
+#ifdef _WIN32
 #include <wtypes.h>
+#else
+#include "PakTypes.h"
+#endif
+
+// Log levels for the LogXxxA macros.  Levels above DEBUG_LOG_LEVEL (see settings.h) compile to nothing,
+// so their arguments are never evaluated; g_iLogLevel and g_dwLogCategories filter the rest at runtime.
+// Both are read from LogLevel and LogCategories in the [General] section of NRage.ini.
+#define LOG_WARN	1
+#define LOG_DEBUG	2
+#define LOG_TRACE	3
+
+// Log categories, may be or'd together in g_dwLogCategories
+#define LOG_INPUT	0x01	// GetKeys, ReadController, button processing
+#define LOG_MEMPAK	0x02	// Memory Pak and the generic pak protocol
+#define LOG_TPAK	0x04	// Transfer Pak and the GB cart behind it
+#define LOG_ALL		0xFF
+
+#ifndef DEBUG_LOG_LEVEL
+#define DEBUG_LOG_LEVEL	LOG_DEBUG
+#endif
 
 #ifdef _DEBUG
 
@@ -35,6 +56,7 @@ void _WriteDatasA( LPCSTR Header, const int Control, LPCBYTE Data, const HRESULT
 void _cdecl _DebugWriteA( LPCSTR szFormat, ... );
 void _cdecl _DebugWriteW( LPCWSTR szFormat, ... );
 void _CloseDebugFile();
+void _StopDebugLog();
 void _DebugFlush();
 
 #define DebugWriteA	_DebugWriteA
@@ -44,15 +66,47 @@ void _DebugFlush();
 #define DebugWriteByteA(str) DebugWriteA("%02X", str)
 #define DebugWriteWordA(str) DebugWriteA("%04X", str)
 #define DebugFlush() _DebugFlush()
+#define StopDebugLog() _StopDebugLog()
+
+extern int g_iLogLevel;
+extern DWORD g_dwLogCategories;
+
+#define _DebugLogA( level, cat, ... ) do { if( (level) <= g_iLogLevel && ( g_dwLogCategories & (cat) )) _DebugWriteA( __VA_ARGS__ ); } while( 0 )
+
+#if DEBUG_LOG_LEVEL >= LOG_WARN
+#define LogWarnA( cat, ... ) _DebugLogA( LOG_WARN, cat, __VA_ARGS__ )
+#else
+#define LogWarnA( cat, ... )
+#endif
+#if DEBUG_LOG_LEVEL >= LOG_DEBUG
+#define LogDebugA( cat, ... ) _DebugLogA( LOG_DEBUG, cat, __VA_ARGS__ )
+#else
+#define LogDebugA( cat, ... )
+#endif
+#if DEBUG_LOG_LEVEL >= LOG_TRACE
+#define LogTraceA( cat, ... ) _DebugLogA( LOG_TRACE, cat, __VA_ARGS__ )
+#else
+#define LogTraceA( cat, ... )
+#endif
 
 #else // #ifndef _DEBUG
 #define DebugWriteByteA(str)
 #define DebugWriteWordA(str)
+#ifdef _MSC_VER
 #define DebugWriteA	;//
 #define DebugWriteW	;//
+#else
+	// other compilers strip the comment out of the definition above
+#define DebugWriteA( ... )
+#define DebugWriteW( ... )
+#endif
 #define	WriteDatasA(header,control,data,hr)
 #define CloseDebugFile()
 #define DebugFlush()
+#define StopDebugLog()
+#define LogWarnA( cat, ... )
+#define LogDebugA( cat, ... )
+#define LogTraceA( cat, ... )
 
 #endif // #ifdef _DEBUG
 
@@ -227,13 +227,13 @@ bool GetNControllerInput ( const int indexController, LPDWORD pdwData )
 						if (!args->fPrevFireState2)
 						{
 							args->fPrevFireState = (args->fPrevFireState + 1) & 1;
-							DebugWriteA("Slow Rapid Fire - Mark 2\n");
+							LogTraceA( LOG_INPUT, "Slow Rapid Fire - Mark 2\n" );
 						}
 					}
 					else // Do a fast rapid fire
 					{
 						args->fPrevFireState = (args->fPrevFireState + 1) & 1;
-						DebugWriteA("Fast Rapid Fire\n");
+						LogTraceA( LOG_INPUT, "Fast Rapid Fire\n" );
 					}
 				}
 				else
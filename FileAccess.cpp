@@ -28,6 +28,9 @@
 #include <shlobj.h>
 #include "NRagePluginV2.h"
 #include "PakIO.h"
+#include "PakStore.h"
+#include "MemPakFormat.h"
+#include "PakPlatform.h"
 #include "Interface.h"
 #include "FileAccess.h"
 #include "DirectInput.h"
@@ -209,6 +212,38 @@ bool ProcessKey( DWORD dwKey, DWORD dwSection, LPCSTR pszLine, LPTSTR pszFFDevic
 			else
 				g_strEmuInfo.fDisplayShortPop = (atoi(pszLine) != 0);
 		break;
+	case CHK_WRITEBACKDELAY:
+		if (dwSection == CHK_GENERAL)
+			if (bIsInterface)
+				g_ivConfig->dwWritebackDelay = strtoul(pszLine, NULL, 10);
+			else
+				g_strEmuInfo.dwWritebackDelay = strtoul(pszLine, NULL, 10);
+		break;
+	case CHK_WRITEBACKMAXAGE:
+		if (dwSection == CHK_GENERAL)
+			if (bIsInterface)
+				g_ivConfig->dwWritebackMaxAge = strtoul(pszLine, NULL, 10);
+			else
+				g_strEmuInfo.dwWritebackMaxAge = strtoul(pszLine, NULL, 10);
+		break;
+	case CHK_REPAIRMEMPAKS:
+		if (dwSection == CHK_GENERAL)
+			if (bIsInterface)
+				g_ivConfig->fRepairMemPaks = (atoi(pszLine) != 0);
+			else
+				g_strEmuInfo.fRepairMemPaks = (atoi(pszLine) != 0);
+		break;
+#ifdef _DEBUG
+	// the debug log filter isn't in the config dialog, so both sides go straight to the globals
+	case CHK_LOGLEVEL:
+		if (dwSection == CHK_GENERAL)
+			g_iLogLevel = atoi(pszLine);
+		break;
+	case CHK_LOGCATEGORIES:
+		if (dwSection == CHK_GENERAL)
+			g_dwLogCategories = strtoul(pszLine, NULL, 0);
+		break;
+#endif
 
 	case CHK_MEMPAK:
 		if (dwSection == CHK_LASTBROWSERDIR)
@@ -942,12 +977,12 @@ BOOL SendFilestoList( HWND hDlgItem, WORD wType )
 	case FILIST_MEM:
 		GetDirectory( szPattern, DIRECTORY_MEMPAK );
 		lstrcat( szPattern, _T("*.*") );
-		pszExtensions = _T(".mpk\0.n64\0");
+		pszExtensions = _T(".mpk\0.n64\0.mpm\0.mpb\0");
 		break;
 	case FILIST_TRANSFER:
 		GetDirectory( szPattern, DIRECTORY_GBROMS );
-		lstrcat( szPattern, _T("*.gb?") );
-		pszExtensions = _T(".gb\0.gbc\0");
+		lstrcat( szPattern, _T("*.*") );
+		pszExtensions = _T(".gb\0.gbc\0.gz\0.zip\0");
 		break;
 	default:
 		return FALSE;
@@ -1209,26 +1244,38 @@ bool BrowseFile( HWND hDlg, TCHAR *pszFileName, DWORD dwType, bool fSave )
 
 bool ReadMemPakFile( TCHAR *pszMemPakFile, BYTE *aMemPak, bool fCreate )
 {
-	DWORD dwCreationDisposition = fCreate ? OPEN_ALWAYS : OPEN_EXISTING;
+	if( IsPakManifest( pszMemPakFile ))
+	{
+		LPPAKSTORE pStore = OpenPakStore( pszMemPakFile, aMemPak, fCreate );
+		if( !pStore )
+		{
+			ErrorMessage( IDS_ERR_MPREAD, GetLastError(), false );
+			return false;
+		}
+		ClosePakStore( pStore );
+		return true;
+	}
 
-	HANDLE hFile = CreateFile( pszMemPakFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, dwCreationDisposition, 0, NULL);
-	if ( hFile != INVALID_HANDLE_VALUE )
+	LPPAKFILE pFile = PakOpenFile( pszMemPakFile, fCreate ? PAK_FILE_WRITE : PAK_FILE_READ );
+	if ( pFile != NULL )
 	{
 		ZeroMemory( aMemPak, PAK_MEM_SIZE );
-		TCHAR *pcPoint = _tcsrchr( pszMemPakFile, '.' );
-		if( !lstrcmpi( pcPoint, _T(".n64") ) )
-			SetFilePointer( hFile, 0x1040, NULL, FILE_BEGIN );
-		else
-			SetFilePointer( hFile, 0L, NULL, FILE_BEGIN );
-		
-		DWORD dwBytesRead;
-		bool Success = ( ReadFile( hFile, aMemPak, PAK_MEM_SIZE, &dwBytesRead, NULL) != 0 );
+		const int iFormat = DetectMemPakFileFormat( pFile, pszMemPakFile );
+		if( iFormat == MPF_NOTE )
+		{
+			PakCloseFile( pFile );
+			ErrorMessage( IDS_ERR_MPREAD, ERROR_BAD_FORMAT, false );
+			return false;
+		}
+		bool Success = PakSeekFile( pFile, MemPakFormatOffset( iFormat ));
+		if( Success )
+			PakReadFile( pFile, aMemPak, PAK_MEM_SIZE );
 
-		CloseHandle( hFile );
+		PakCloseFile( pFile );
 		return Success;
 	}
 	else
-		ErrorMessage( IDS_ERR_MPREAD, GetLastError(), false );
+		ErrorMessage( IDS_ERR_MPREAD, PakLastError(), false );
 	return false;
 }
 
@@ -1236,35 +1283,49 @@ bool ReadMemPakFile( TCHAR *pszMemPakFile, BYTE *aMemPak, bool fCreate )
 // pszMemPakFile is a filename, aMemPak is the data, fCreate tells whether to create a new file
 bool WriteMemPakFile( TCHAR *pszMemPakFile, BYTE *aMemPak, bool fCreate )
 {
-	DWORD dwCreationDisposition = fCreate ? OPEN_ALWAYS : OPEN_EXISTING;
+	if( IsPakManifest( pszMemPakFile ))
+	{
+		// only the page list is needed to tell which pages are new
+		LPPAKSTORE pStore = OpenPakStore( pszMemPakFile, NULL, fCreate );
+		if( !pStore )
+		{
+			ErrorMessage( IDS_ERR_MPCREATE, GetLastError(), false );
+			return false;
+		}
+		WritePakStore( pStore, aMemPak, 0xFFFFFFFF, NULL );
+		bool Success = ( GetFileAttributes( pszMemPakFile ) != INVALID_FILE_ATTRIBUTES );
+		ClosePakStore( pStore );
+		return Success;
+	}
 
-	HANDLE hFile = CreateFile( pszMemPakFile, GENERIC_WRITE, FILE_SHARE_READ, NULL, dwCreationDisposition, 0, NULL);
-	if ( hFile != INVALID_HANDLE_VALUE )
+	// read access too, so an existing file can tell what format it is in
+	LPPAKFILE pFile = PakOpenFile( pszMemPakFile, fCreate ? PAK_FILE_WRITE : PAK_FILE_EXISTING );
+	if ( pFile != NULL )
 	{
-		DWORD dwBytesWritten = 0;
-		TCHAR *pcPoint = _tcsrchr( pszMemPakFile, _T('.') );
-		if( !lstrcmpi( pcPoint, _T(".n64") ) )
+		const int iFormat = DetectMemPakFileFormat( pFile, pszMemPakFile );
+		if( iFormat == MPF_NOTE )
 		{
-			if( fCreate && !GetFileSize( hFile, NULL ))
-			{
-				char szHeader[] = "123-456-STD";
-				SetFilePointer( hFile, 0L, NULL, FILE_BEGIN );
-				WriteFile( hFile, szHeader, sizeof(szHeader), &dwBytesWritten, NULL );
-			}
-			SetFilePointer( hFile, 0x1040, NULL, FILE_BEGIN );
+			PakCloseFile( pFile );
+			ErrorMessage( IDS_ERR_MPCREATE, ERROR_BAD_FORMAT, false );
+			return false;
+		}
+		const DWORD dwImageOffset = MemPakFormatOffset( iFormat );
+		if( dwImageOffset && !PakGetFileSize( pFile ))
+		{
+			BYTE aHeader[PAK_MEM_DEXOFFSET];
+			WriteMemPakFormatHeader( iFormat, aHeader );
+			PakWriteFile( pFile, aHeader, dwImageOffset );
 		}
-		else
-			SetFilePointer( hFile, 0L, NULL, FILE_BEGIN );
 		
-		bool Success = ( WriteFile( hFile, aMemPak, PAK_MEM_SIZE, &dwBytesWritten, NULL ) != 0 );
-		if( Success )
-			SetEndOfFile( hFile );
+		bool Success = PakSeekFile( pFile, dwImageOffset ) && PakWriteFile( pFile, aMemPak, PAK_MEM_SIZE );
+		if( Success && iFormat != MPF_BANKS )	// the other banks of a bank file follow the first
+			PakSetFileSize( pFile, dwImageOffset + PAK_MEM_SIZE );
 		
-		CloseHandle( hFile );
+		PakCloseFile( pFile );
 		return Success;
 	}
 	else
-		ErrorMessage( IDS_ERR_MPCREATE, GetLastError(), false );
+		ErrorMessage( IDS_ERR_MPCREATE, PakLastError(), false );
 
 	return false;
 }
@@ -1296,6 +1357,13 @@ bool StoreConfigToINI()
 	fputs("\n[" STRING_INI_GENERAL "]\n", fFile);
 	fprintf(fFile, STRING_INI_LANGUAGE "=%d\n", g_ivConfig->Language);
 	fprintf(fFile, STRING_INI_SHOWMESSAGES "=%d\n", (int)(g_ivConfig->fDisplayShortPop));
+	fprintf(fFile, STRING_INI_WRITEBACKDELAY "=%u\n", g_ivConfig->dwWritebackDelay);
+	fprintf(fFile, STRING_INI_WRITEBACKMAXAGE "=%u\n", g_ivConfig->dwWritebackMaxAge);
+	fprintf(fFile, STRING_INI_REPAIRMEMPAKS "=%d\n", (int)(g_ivConfig->fRepairMemPaks));
+#ifdef _DEBUG
+	fprintf(fFile, STRING_INI_LOGLEVEL "=%d\n", g_iLogLevel);
+	fprintf(fFile, STRING_INI_LOGCATEGORIES "=0x%02X\n", g_dwLogCategories);
+#endif
 
 	// Folders
 	fputs("\n[" STRING_INI_FOLDERS "]\n", fFile);
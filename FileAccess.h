@@ -75,6 +75,11 @@ unsigned long djbHash(const char *str);
 
 #define STRING_INI_LANGUAGE		"Language"
 #define STRING_INI_SHOWMESSAGES	"ShowMessages"
+#define STRING_INI_WRITEBACKDELAY	"WritebackDelay"
+#define STRING_INI_WRITEBACKMAXAGE	"WritebackMaxAge"
+#define STRING_INI_REPAIRMEMPAKS	"RepairMemPaks"
+#define STRING_INI_LOGLEVEL		"LogLevel"
+#define STRING_INI_LOGCATEGORIES	"LogCategories"
 
 #define STRING_INI_BRPROFILE	"Profile"
 #define STRING_INI_BRNOTE		"Note"
@@ -143,6 +148,11 @@ unsigned long djbHash(const char *str);
 // assignments (to the left of the '=' sign)
 #define CHK_LANGUAGE		3857633481
 #define CHK_SHOWMESSAGES	638097246
+#define CHK_WRITEBACKDELAY	1216836656
+#define CHK_WRITEBACKMAXAGE	1848809556
+#define CHK_REPAIRMEMPAKS	1897203638
+#define CHK_LOGLEVEL		194778239
+#define CHK_LOGCATEGORIES	2815242093
 
 #define CHK_MEMPAK			3230166560
 #define CHK_GBXROM			2992194388
@@ -11,11 +11,13 @@
 */
 
 #include "commonIncludes.h"
-#include <windows.h>
 #include "goombasav/goombasav.h"
-#include "NRagePluginV2.h"
 #include "PakIO.h"
 #include "GBCart.h"
+#include "GBRomCache.h"
+#include "GBRomIndex.h"
+#include "PakPlatform.h"
+#include "PakJournal.h"
 
 void ClearData(BYTE *Data, int Length);
 
@@ -30,6 +32,16 @@ bool WriteCartMBC3(LPGBCART Cart, WORD dwAddress, BYTE *Data);
 bool ReadCartMBC5(LPGBCART Cart, WORD dwAddress, BYTE *Data);
 bool WriteCartMBC5(LPGBCART Cart, WORD dwAddress, BYTE *Data);
 
+static const BYTE g_aOpenBus[0x2000] = { 0 };	// what a missing ROM bank or absent RAM reads as
+
+// Every write to RamData is marked here, for the pak snapshots and for FlushCart and SaveCart.
+static inline void MarkCartWritten(LPGBCART Cart, DWORD dwOffset)
+{
+	MarkSnapshotPage(Cart->aSnapWritten, dwOffset);
+	Cart->dwDirtyPages |= 1u << (dwOffset / GB_DIRTY_PAGE_SIZE);
+	Cart->bSaveDirty = true;
+}
+
 // Tries to read RTC data from separate file (not integrated into SAV)
 //		success sets the useTDF flag
 //		failure inits the RTC at zero and maybe throws a warning
@@ -69,36 +81,27 @@ void UpdateRTC(LPGBCART Cart) {
 
 	Cart->timerLastUpdate = now;
 
-	DebugWriteA("Update RTC: ");
-	DebugWriteByteA(Cart->TimerData[0]);
-	DebugWriteA(":");
-	DebugWriteByteA(Cart->TimerData[1]);
-	DebugWriteA(":");
-	DebugWriteByteA(Cart->TimerData[2]);
-	DebugWriteA(":");
-	DebugWriteByteA(Cart->TimerData[3]);
-	DebugWriteA(":");
-	DebugWriteByteA(Cart->TimerData[4]);
-	DebugWriteA("\n");
+	LogTraceA( LOG_TPAK, "Update RTC: %02X:%02X:%02X:%02X:%02X\n", Cart->TimerData[0], Cart->TimerData[1], Cart->TimerData[2], Cart->TimerData[3], Cart->TimerData[4] );
 }
 
 /*
-Cart --> the LPGBCART structure to operate on. RamData must already be loaded - if Goomba is detected it will be reloaded from hTemp.
-hTemp --> An open file handle. File pointer will be reset to the beginning of the file when the function starts.
+Cart --> the LPGBCART structure to operate on. RamData must already be loaded - if Goomba is detected it will be reloaded from pTemp.
+pTemp --> An open file. File pointer will be reset to the beginning of the file when the function starts.
 NumQuarterBlocks --> Used to calculate the expected RAM size for this ROM.
 RamFileName --> If loading Goomba is successful, this string will be copied to Cart->hGoombaRamPath, unless it is NULL. Use NULL here if you want the save file to be read-only.
 */
-void GoombaCheckAndLoad(LPGBCART Cart, HANDLE hTemp, DWORD NumQuarterBlocks, LPCTSTR RamFileName) {
+void GoombaCheckAndLoad(LPGBCART Cart, LPPAKFILE pTemp, DWORD NumQuarterBlocks, LPCTSTR RamFileName) {
 	if (((uint32_t*)Cart->RamData)[0] == GOOMBA_STATEID) {
-		UnmapViewOfFile(Cart->RamData);
-		CloseHandle(Cart->hRamFile);
-		Cart->hRamFile = NULL;
+		if (Cart->pRamMapping != NULL)
+			PakUnmapFile(Cart->RamData, Cart->pRamMapping);
+		else
+			P_free(Cart->RamData);
+		Cart->pRamMapping = NULL;
 		Cart->RamData = NULL;
 
 		char tmpbuffer[GOOMBA_COLOR_SRAM_SIZE];
-		DWORD b_read;
-		SetFilePointer(hTemp, 0, NULL, FILE_BEGIN);
-		ReadFile(hTemp, tmpbuffer, GOOMBA_COLOR_SRAM_SIZE, &b_read, NULL);
+		PakSeekFile(pTemp, 0);
+		PakReadFile(pTemp, tmpbuffer, GOOMBA_COLOR_SRAM_SIZE);
 
 		memcpy(Cart->GoombaHeaderTitle, &Cart->RomData[0x134], 0x0F);
 		Cart->GoombaHeaderTitle[0x0F] = '\0';
@@ -110,7 +113,7 @@ void GoombaCheckAndLoad(LPGBCART Cart, HANDLE hTemp, DWORD NumQuarterBlocks, LPC
 		stateheader* sh = stateheader_for(tmpbuffer, Cart->GoombaHeaderTitle);
 		if (sh == NULL) {
 			ClearData(Cart->RamData, size_needed);
-			WarningMessage(IDS_ERR_GBSRAMERR, MB_OK | MB_ICONWARNING);
+			PakNotify(IDS_ERR_GBSRAMERR, NULL);
 		} else {
 			goomba_size_t extracted_size;
 			void* gbc_data = goomba_extract(tmpbuffer, sh, &extracted_size);
@@ -119,23 +122,25 @@ void GoombaCheckAndLoad(LPGBCART Cart, HANDLE hTemp, DWORD NumQuarterBlocks, LPC
 				Cart->iGoombaRamSize = extracted_size;
 				if (extracted_size > size_needed) {
 					ClearData(Cart->RamData, size_needed);
-					WarningMessage(IDS_ERR_GBSRAMERR, MB_OK | MB_ICONWARNING);
+					PakNotify(IDS_ERR_GBSRAMERR, NULL);
 				} else {
 					memcpy(Cart->RamData, gbc_data, extracted_size);
 					// if we were going to fake the rtc data we would probably do it here
 				}
+				free(gbc_data);	// goombasav allocates with malloc
 			}
 		}
 	}
 }
 
 bool UpdateGoombaFile(LPGBCART Cart) {
-	HANDLE h = NULL;
+	LPPAKFILE h = NULL;
 	LPVOID gba_data = NULL;
 	void* new_gba_data = NULL;
+	stateheader* sh = NULL;
 
-	h = CreateFile(Cart->sGoombaRamPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
-	if (h == INVALID_HANDLE_VALUE) {
+	h = PakOpenFile(Cart->sGoombaRamPath, PAK_FILE_EXISTING);
+	if (h == NULL) {
 		DebugWriteA("Invalid handle for %s\n", Cart->sGoombaRamPath);
 		goto dispose;
 	}
@@ -150,10 +155,9 @@ bool UpdateGoombaFile(LPGBCART Cart) {
 	}*/
 
 	gba_data = P_malloc(GOOMBA_COLOR_SRAM_SIZE);
-	DWORD b_read;
-	ReadFile(h, gba_data, GOOMBA_COLOR_SRAM_SIZE, &b_read, NULL);
+	PakReadFile(h, gba_data, GOOMBA_COLOR_SRAM_SIZE);
 
-	stateheader* sh = stateheader_for(gba_data, Cart->GoombaHeaderTitle);
+	sh = stateheader_for(gba_data, Cart->GoombaHeaderTitle);
 	if (sh == NULL) {
 		DebugWriteA("[goombasav] %s\n", goomba_last_error());
 		goto dispose;
@@ -166,235 +170,315 @@ bool UpdateGoombaFile(LPGBCART Cart) {
 		DebugWriteA("[goombasav] %s\n", goomba_last_error());
 		goto dispose;
 	}
-	if (SetFilePointer(h, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER && GetLastError() != NO_ERROR) {
-		DebugWriteA("SetFilePointer error %d\n", GetLastError());
+	if (!PakSeekFile(h, 0)) {
+		DebugWriteA("Seek error %d\n", PakLastError());
 		goto dispose;
 	}
-	if (!WriteFile(h, new_gba_data, GOOMBA_COLOR_SRAM_SIZE, &b_read, NULL)) {
-		DebugWriteA("File write error %d\n", GetLastError());
+	if (!PakWriteFile(h, new_gba_data, GOOMBA_COLOR_SRAM_SIZE)) {
+		DebugWriteA("File write error %d\n", PakLastError());
 		goto dispose;
 	}
 	DebugWriteA("Wrote Goomba save file\n");
 	free(new_gba_data);
 	//UnlockFileEx(h, 0, GOOMBA_COLOR_SRAM_SIZE, 0, &o1);
-	CloseHandle(h);
+	PakCloseFile(h);
 	return true;
 dispose:
 	// This error is very rare - usually if the file cannot be saved to, the program will detect that it's read-only
-	MessageBoxA(NULL, "Unable to update the Goomba save file. Your progress will not be saved.", "Error", MB_OK | MB_ICONERROR);
+	PakNotifyError(IDS_ERR_GOOMBASAVE, 0);
 	if (new_gba_data != NULL) free(new_gba_data);
 	if (gba_data != NULL) P_free(gba_data);
 	if (h != NULL) {
 		//UnlockFileEx(h, 0, GOOMBA_COLOR_SRAM_SIZE, 0, &o1);
-		CloseHandle(h);
+		PakCloseFile(h);
 	}
 	return false;
 }
 
-// returns true if the ROM was loaded OK
-bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR TdfFileName)
+// Reads cart type, ROM and RAM size from a ROM's header; Info->iStatus says whether LoadCart can use it.
+// Called once per ROM by AcquireGBRom, every cart holding the ROM shares the result.
+void ParseGBRomHeader(LPCBYTE RomData, DWORD dwFilesize, LPGBROMINFO Info)
 {
-	HANDLE hTemp;
-	DWORD dwFilesize;
-	DWORD NumQuarterBlocks = 0;
-
-	UnloadCart(Cart);	// first, make sure any previous carts have been unloaded
-
-	Cart->iCurrentRamBankNo = 0;
-	Cart->iCurrentRomBankNo = 1;
-	Cart->bRamEnableState = 0;
-	Cart->bMBC1RAMbanking = 0;
-
-	// Attempt to load the ROM file.
-	hTemp = CreateFile(RomFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
-	if (hTemp != INVALID_HANDLE_VALUE && (Cart->hRomFile = CreateFileMapping(hTemp, NULL, PAGE_READONLY, 0, 0, NULL) ) )
-	{
-		// if the first case fails, the file doesn't exist. The second case can fail if the file size is zero.
-		dwFilesize = GetFileSize(hTemp, NULL);
-		CloseHandle(hTemp);
-		Cart->RomData = (LPCBYTE)MapViewOfFile( Cart->hRomFile, FILE_MAP_READ, 0, 0, 0 );
-	} else {
-		DebugWriteA("Couldn't load the ROM file, GetLastError returned %08x\n", GetLastError());
-		if (hTemp != INVALID_HANDLE_VALUE)
-			CloseHandle(hTemp);	// if file size was zero, make sure we don't leak the handle
-
-		ErrorMessage(IDS_ERR_GBROM, 0, false);
-		return false;
-	}
-
+	ZeroMemory(Info, sizeof(GBROMINFO));
 	if (dwFilesize < 0x8000) // a Rom file has to be at least 32kb
 	{
-		DebugWriteA("ROM file wasn't big enough to be a GB ROM!\n");
-		ErrorMessage(IDS_ERR_GBROM, 0, false);
-
-		UnloadCart(Cart);
-		return false;
+		Info->iStatus = GBROM_TOOSMALL;
+		return;
 	}
 
-	DebugWriteA(" Cartridge Type #:");
-	DebugWriteByteA(Cart->RomData[0x147]);
-	DebugWriteA("\n");
-	switch (Cart->RomData[0x147]) {	// if we hadn't checked the file size before, this might have caused an access violation
+	switch (RomData[0x147]) {	// if we hadn't checked the file size before, this might have caused an access violation
 	case 0x00:
-		Cart->iCartType = GB_NORM;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_NORM;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x01:
-		Cart->iCartType = GB_MBC1;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC1;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x02:
-		Cart->iCartType = GB_MBC1;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC1;
+		Info->bHasRam = true;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x03:
-		Cart->iCartType = GB_MBC1;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC1;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x05:
-		Cart->iCartType = GB_MBC2;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC2;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x06:
-		Cart->iCartType = GB_MBC2;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC2;
+		Info->bHasRam = false;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x08:
-		Cart->iCartType = GB_NORM;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_NORM;
+		Info->bHasRam = true;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x09:
-		Cart->iCartType = GB_NORM;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_NORM;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x0B:
-		Cart->iCartType = GB_MMMO1;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MMMO1;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x0C:
-		Cart->iCartType = GB_MMMO1;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MMMO1;
+		Info->bHasRam = true;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x0D:
-		Cart->iCartType = GB_MMMO1;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MMMO1;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x0F:
-		Cart->iCartType = GB_MBC3;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = true;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC3;
+		Info->bHasRam = false;
+		Info->bHasBattery = true;
+		Info->bHasTimer = true;
+		Info->bHasRumble = false;
 		break;
 	case 0x10:
-		Cart->iCartType = GB_MBC3;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = true;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC3;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = true;
+		Info->bHasRumble = false;
 		break;
 	case 0x11:
-		Cart->iCartType = GB_MBC3;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC3;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x12:
-		Cart->iCartType = GB_MBC3;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC3;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x13:
-		Cart->iCartType = GB_MBC3;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC3;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x19:
-		Cart->iCartType = GB_MBC5;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC5;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x1A:
-		Cart->iCartType = GB_MBC5;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC5;
+		Info->bHasRam = true;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x1B:
-		Cart->iCartType = GB_MBC5;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = false;
+		Info->iCartType = GB_MBC5;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = false;
 		break;
 	case 0x1C:
-		Cart->iCartType = GB_MBC5;
-		Cart->bHasRam = false;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = true;
+		Info->iCartType = GB_MBC5;
+		Info->bHasRam = false;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = true;
 		break;
 	case 0x1D:
-		Cart->iCartType = GB_MBC5;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = false;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = true;
+		Info->iCartType = GB_MBC5;
+		Info->bHasRam = true;
+		Info->bHasBattery = false;
+		Info->bHasTimer = false;
+		Info->bHasRumble = true;
 		break;
 	case 0x1E:
-		Cart->iCartType = GB_MBC5;
-		Cart->bHasRam = true;
-		Cart->bHasBattery = true;
-		Cart->bHasTimer = false;
-		Cart->bHasRumble = true;
+		Info->iCartType = GB_MBC5;
+		Info->bHasRam = true;
+		Info->bHasBattery = true;
+		Info->bHasTimer = false;
+		Info->bHasRumble = true;
 		break;
 	default:
-		WarningMessage( IDS_ERR_GBROM, MB_OK | MB_ICONWARNING);
+		Info->iStatus = GBROM_UNSUPPORTED;
+		return;
+	}
+
+	// Determine ROM size for paging checks
+	Info->iNumRomBanks = 2;
+	switch (RomData[0x148]) {
+	case 0x01:
+		Info->iNumRomBanks = 4;
+		break;
+	case 0x02:
+		Info->iNumRomBanks = 8;
+		break;
+	case 0x03:
+		Info->iNumRomBanks = 16;
+		break;
+	case 0x04:
+		Info->iNumRomBanks = 32;
+		break;
+	case 0x05:
+		Info->iNumRomBanks = 64;
+		break;
+	case 0x06:
+		Info->iNumRomBanks = 128;
+		break;
+	case 0x52:
+		Info->iNumRomBanks = 72;
+		break;
+	case 0x53:
+		Info->iNumRomBanks = 80;
+		break;
+	case 0x54:
+		Info->iNumRomBanks = 96;
+		break;
+	}
+
+	if (dwFilesize != 0x4000 * Info->iNumRomBanks) // Now that we know how big the ROM is supposed to be, check it again
+		Info->iStatus = GBROM_BADSIZE;
+
+	// Determine RAM size for paging checks
+	Info->iNumRamBanks = 0;
+	switch (RomData[0x149]) {
+	case 0x01:
+		Info->iNumRamBanks = 1;
+		Info->NumQuarterBlocks = 1;
+		break;
+	case 0x02:
+		Info->iNumRamBanks = 1;
+		Info->NumQuarterBlocks = 4;
+		break;
+	case 0x03:
+		Info->iNumRamBanks = 4;
+		Info->NumQuarterBlocks = 16;
+		break;
+	case 0x04:
+		Info->iNumRamBanks = 16;
+		Info->NumQuarterBlocks = 64;
+		break;
+	case 0x05:
+		Info->iNumRamBanks = 8;
+		Info->NumQuarterBlocks = 32;
+		break;
+	}
+}
+
+// returns true if the ROM was loaded OK
+bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR TdfFileName)
+{
+	LPPAKFILE pTemp;
+	DWORD dwFilesize;
+	DWORD NumQuarterBlocks = 0;
+	GBROMINDEXENTRY IndexEntry;
+	const GBROMINFO *pInfo = &IndexEntry.Info;
+
+	UnloadCart(Cart);	// first, make sure any previous carts have been unloaded
+
+	Cart->iCurrentRamBankNo = 0;
+	Cart->iCurrentRomBankNo = 1;
+	Cart->bRamEnableState = 0;
+	Cart->bMBC1RAMbanking = 0;
+	Cart->iRamSize = 0;
+	ZeroMemory( Cart->aSnapWritten, sizeof(Cart->aSnapWritten) );
+	Cart->dwDirtyPages = 0;
+	Cart->bSaveDirty = false;
+
+	// Check the ROM by its indexed header first, nothing gets mapped for a ROM we can't use.
+	if (!GetGBRomIndexEntry(RomFileName, &IndexEntry))
+	{
+		DebugWriteA("Couldn't load the ROM file, error %08x\n", PakLastError());
+		PakNotifyError(IDS_ERR_GBROM, 0);
+		return false;
+	}
+
+	if (pInfo->iStatus == GBROM_TOOSMALL)
+	{
+		DebugWriteA("ROM file wasn't big enough to be a GB ROM!\n");
+		PakNotifyError(IDS_ERR_GBROM, 0);
+
+		UnloadCart(Cart);
+		return false;
+	}
+
+	DebugWriteA(" Cartridge Type #:");
+	DebugWriteByteA(IndexEntry.bCartType);
+	DebugWriteA(" (%s)\n", IndexEntry.szTitle);
+	if (pInfo->iStatus == GBROM_UNSUPPORTED)
+	{
+		PakNotify( IDS_ERR_GBROM, NULL );
 		DebugWriteA("TPak: unsupported paktype\n");
 		UnloadCart(Cart);
 		return false;
 	}
+	Cart->iCartType = pInfo->iCartType;
+	Cart->bHasRam = pInfo->bHasRam;
+	Cart->bHasBattery = pInfo->bHasBattery;
+	Cart->bHasTimer = pInfo->bHasTimer;
+	Cart->bHasRumble = pInfo->bHasRumble;
 
 	// assign read/write handlers
 	switch (Cart->iCartType) {
@@ -426,69 +510,29 @@ bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR T
 		return false;
 	}
 
-	// Determine ROM size for paging checks
-	Cart->iNumRomBanks = 2;
-	switch (Cart->RomData[0x148]) {
-	case 0x01:
-		Cart->iNumRomBanks = 4;
-		break;
-	case 0x02:
-		Cart->iNumRomBanks = 8;
-		break;
-	case 0x03:
-		Cart->iNumRomBanks = 16;
-		break;
-	case 0x04:
-		Cart->iNumRomBanks = 32;
-		break;
-	case 0x05:
-		Cart->iNumRomBanks = 64;
-		break;
-	case 0x06:
-		Cart->iNumRomBanks = 128;
-		break;
-	case 0x52:
-		Cart->iNumRomBanks = 72;
-		break;
-	case 0x53:
-		Cart->iNumRomBanks = 80;
-		break;
-	case 0x54:
-		Cart->iNumRomBanks = 96;
-		break;
-	}
-
-	if (dwFilesize != 0x4000 * Cart->iNumRomBanks) // Now that we know how big the ROM is supposed to be, check it again
+	if (pInfo->iStatus == GBROM_BADSIZE) // the ROM is smaller or bigger than its header says
 	{
-		ErrorMessage(IDS_ERR_GBROM, 0, false);
+		PakNotifyError(IDS_ERR_GBROM, 0);
 
 		UnloadCart(Cart);
 		return false;
 	}
+	Cart->iNumRomBanks = pInfo->iNumRomBanks;
+	Cart->iNumRamBanks = pInfo->iNumRamBanks;
+	NumQuarterBlocks = pInfo->NumQuarterBlocks;
+	if (Cart->bHasRam)
+		Cart->iRamSize = Cart->bHasBattery ? NumQuarterBlocks * 0x0800 : Cart->iNumRamBanks * 0x2000;
 
-	// Determine RAM size for paging checks
-	Cart->iNumRamBanks = 0;
-	switch (Cart->RomData[0x149]) {
-	case 0x01:
-		Cart->iNumRamBanks = 1;
-		NumQuarterBlocks = 1;
-		break;
-	case 0x02:
-		Cart->iNumRamBanks = 1;
-		NumQuarterBlocks = 4;
-		break;
-	case 0x03:
-		Cart->iNumRamBanks = 4;
-		NumQuarterBlocks = 16;
-		break;
-	case 0x04:
-		Cart->iNumRamBanks = 16;
-		NumQuarterBlocks = 64;
-		break;
-	case 0x05:
-		Cart->iNumRamBanks = 8;
-		NumQuarterBlocks = 32;
-		break;
+	// Attempt to load the ROM file, or share the one another cart already has.
+	Cart->RomData = AcquireGBRom(RomFileName, &pInfo);
+	if (Cart->RomData == NULL || memcmp(pInfo, &IndexEntry.Info, sizeof(GBROMINFO)))
+	{
+		// gone, or changed since we looked at its header a moment ago
+		DebugWriteA("Couldn't load the ROM file, error %08x\n", PakLastError());
+		PakNotifyError(IDS_ERR_GBROM, 0);
+
+		UnloadCart(Cart);
+		return false;
 	}
 
 	DebugWriteA("GB cart has %d ROM banks, %d RAM quarter banks\n", Cart->iNumRomBanks, NumQuarterBlocks);
@@ -503,10 +547,10 @@ bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR T
 	{
 		if (Cart->bHasBattery)
 		{
-			hTemp = CreateFile( RamFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL );
-			if( hTemp == INVALID_HANDLE_VALUE )
+			pTemp = PakOpenFile( RamFileName, PAK_FILE_WRITE );
+			if( pTemp == NULL )
 			{// test if Read-only access is possible
-				hTemp = CreateFile( RamFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL );
+				pTemp = PakOpenFile( RamFileName, PAK_FILE_READ );
 				if (Cart->bHasTimer && Cart->bHasBattery) {
 					Cart->RamData = (LPBYTE)P_malloc(NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC));
 					ClearData(Cart->RamData, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC));
@@ -516,50 +560,50 @@ bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR T
 					ClearData(Cart->RamData, NumQuarterBlocks * 0x0800);
 				}
 
-				if( hTemp != INVALID_HANDLE_VALUE )
+				if( pTemp != NULL )
 				{
-					DWORD dwBytesRead;
-
 					if (Cart->bHasTimer && Cart->bHasBattery)
-						ReadFile(hTemp, Cart->RamData, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC), &dwBytesRead, NULL);
+						PakReadFile(pTemp, Cart->RamData, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC));
 					else
-						ReadFile(hTemp, Cart->RamData, NumQuarterBlocks * 0x0800, &dwBytesRead, NULL);
-					GoombaCheckAndLoad(Cart, hTemp, NumQuarterBlocks, NULL);
-					WarningMessage( IDS_DLG_TPAK_READONLY, MB_OK | MB_ICONWARNING);
+						PakReadFile(pTemp, Cart->RamData, NumQuarterBlocks * 0x0800);
+					GoombaCheckAndLoad(Cart, pTemp, NumQuarterBlocks, NULL);
+					PakNotify( IDS_DLG_TPAK_READONLY, NULL );
 				}
 				else
 				{
-					WarningMessage( IDS_ERR_GBSRAMERR, MB_OK | MB_ICONWARNING);
+					PakNotify( IDS_ERR_GBSRAMERR, NULL );
+					UpdateCartMap(Cart);
 					return true;
 				}
 			} else { // file is OK, use a mapping
 				if (Cart->bHasTimer && Cart->bHasBattery)
-					Cart->hRamFile = CreateFileMapping( hTemp, NULL, PAGE_READWRITE, 0, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC), NULL);
+					Cart->RamData = PakMapFile( pTemp, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC), false, &Cart->pRamMapping );
 				else
-					Cart->hRamFile = CreateFileMapping( hTemp, NULL, PAGE_READWRITE, 0, NumQuarterBlocks * 0x0800, NULL);
+					Cart->RamData = PakMapFile( pTemp, NumQuarterBlocks * 0x0800, false, &Cart->pRamMapping );
 
-				if (Cart->hRamFile != NULL)
+				if (Cart->RamData != NULL)
 				{
-					Cart->RamData = (LPBYTE)MapViewOfFile( Cart->hRamFile, FILE_MAP_ALL_ACCESS, 0, 0, 0 );
-					GoombaCheckAndLoad(Cart, hTemp, NumQuarterBlocks, RamFileName);
+					GoombaCheckAndLoad(Cart, pTemp, NumQuarterBlocks, RamFileName);
+					if (Cart->pRamMapping != NULL) // still the plain mapped save, not a Goomba one
+						Cart->pJournal = OpenPakJournal(RamFileName, Cart->RamData, NumQuarterBlocks * 0x0800, false);
 				} else { // could happen, if the file isn't big enough AND can't be grown to fit
 					DWORD dwBytesRead;
 					if (Cart->bHasTimer && Cart->bHasBattery) {
 						Cart->RamData = (LPBYTE)P_malloc(NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC));
-						ReadFile(hTemp, Cart->RamData, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC), &dwBytesRead, NULL);
+						dwBytesRead = PakReadFile(pTemp, Cart->RamData, NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC));
 					} else {
 						Cart->RamData = (LPBYTE)P_malloc(NumQuarterBlocks * 0x0800);
-						ReadFile(hTemp, Cart->RamData, NumQuarterBlocks * 0x0800, &dwBytesRead, NULL);
+						dwBytesRead = PakReadFile(pTemp, Cart->RamData, NumQuarterBlocks * 0x0800);
 					}
 					if (dwBytesRead < NumQuarterBlocks * 0x0800 + ((Cart->bHasTimer && Cart->bHasBattery) ? sizeof(gbCartRTC) : 0))
 					{
 						ClearData(Cart->RamData, NumQuarterBlocks * 0x0800 + ((Cart->bHasTimer && Cart->bHasBattery) ? sizeof(gbCartRTC) : 0));
-						WarningMessage( IDS_ERR_GBSRAMERR, MB_OK | MB_ICONWARNING);
+						PakNotify( IDS_ERR_GBSRAMERR, NULL );
 					}
 					else
 					{
-						GoombaCheckAndLoad(Cart, hTemp, NumQuarterBlocks, NULL);
-						WarningMessage( IDS_DLG_TPAK_READONLY, MB_OK | MB_ICONWARNING);
+						GoombaCheckAndLoad(Cart, pTemp, NumQuarterBlocks, NULL);
+						PakNotify( IDS_DLG_TPAK_READONLY, NULL );
 					}
 				}
 			}
@@ -567,7 +611,7 @@ bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR T
 			if (Cart->bHasTimer && Cart->bHasBattery) {
 				dwFilesize = Cart->sGoombaRamPath != NULL
 					? Cart->iGoombaRamSize
-					: GetFileSize(hTemp, 0);
+					: PakGetFileSize(pTemp);
 				if (dwFilesize >= (NumQuarterBlocks * 0x0800 + sizeof(gbCartRTC) ) ) {
 					// Looks like there is extra data in the SAV file than just RAM data... assume it is RTC data.
 					gbCartRTC RTCTimer;
@@ -590,7 +634,7 @@ bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR T
 				}
 			}
 
-			CloseHandle(hTemp);
+			PakCloseFile(pTemp);
 		} else {
 			// no battery; just allocate some RAM
 			Cart->RamData = (LPBYTE)P_malloc(Cart->iNumRamBanks * 0x2000);
@@ -598,10 +642,93 @@ bool LoadCart(LPGBCART Cart, LPCTSTR RomFileName, LPCTSTR RamFileName, LPCTSTR T
 	}
 
 	Cart->TimerDataLatched = false;
+	UpdateCartMap(Cart);
 
 	return true;
 }
 
+// Works out where each 8 KB region of GB address space reads from and writes to with the current
+// banking state, so a transfer is one lookup and one copy.  Only needs calling when an MBC register
+// may have changed; regions with side effects (RTC registers, partial RAM) stay with the handlers.
+void UpdateCartMap(LPGBCART Cart)
+{
+	ZeroMemory(Cart->aReadMap, sizeof(Cart->aReadMap));
+	ZeroMemory(Cart->aWriteMap, sizeof(Cart->aWriteMap));
+	if (Cart->RomData == NULL || Cart->ptrfnReadCart == NULL)
+		return;
+
+	// 0x0000 - 0x3FFF is always ROM bank 0
+	Cart->aReadMap[0] = Cart->RomData;
+	Cart->aReadMap[1] = Cart->RomData + 0x2000;
+
+	// 0x4000 - 0x7FFF
+	if (Cart->iCartType == GB_NORM) {
+		Cart->aReadMap[2] = Cart->RomData + 0x4000;
+		Cart->aReadMap[3] = Cart->RomData + 0x6000;
+	} else if (Cart->iCurrentRomBankNo < Cart->iNumRomBanks) {
+		Cart->aReadMap[2] = Cart->RomData + (Cart->iCurrentRomBankNo << 14);
+		Cart->aReadMap[3] = Cart->aReadMap[2] + 0x2000;
+	} else {
+		Cart->aReadMap[2] = Cart->aReadMap[3] = g_aOpenBus;
+		LogWarnA( LOG_TPAK, "Banked ROM read: (Banking Error) Bank %02X\n", Cart->iCurrentRomBankNo );
+	}
+
+	// 0xA000 - 0xBFFF
+	switch (Cart->iCartType) {
+	case GB_NORM:
+		if (Cart->bHasRam && Cart->RomData[0x149] == 1)
+			return;	// only the first 2 KB exist
+		break;
+	case GB_MBC2:
+		return;	// reads ignore the RAM bank but writes don't, leave it to the handler
+	case GB_MBC3:
+		if (Cart->bHasTimer && Cart->iCurrentRamBankNo >= 0x08 && Cart->iCurrentRamBankNo <= 0x0c)
+			return;	// RTC registers
+		break;
+	}
+
+	if (!Cart->bHasRam || Cart->RamData == NULL) {
+		Cart->aReadMap[5] = g_aOpenBus;
+	} else if (Cart->iCurrentRamBankNo >= Cart->iNumRamBanks) {
+		Cart->aReadMap[5] = g_aOpenBus;
+		LogWarnA( LOG_TPAK, "Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo );
+	} else {
+		Cart->aWriteMap[5] = Cart->RamData + (Cart->iCurrentRamBankNo << 13);
+		Cart->aReadMap[5] = Cart->aWriteMap[5];
+	}
+}
+
+bool ReadCart(LPGBCART Cart, WORD dwAddress, BYTE *Data)
+{
+	LPCBYTE pBase = Cart->aReadMap[dwAddress >> 13];
+	if (pBase != NULL) {
+		CopyMemory(Data, pBase + (dwAddress & 0x1FFF), 32);
+		return true;
+	}
+	if (Cart->ptrfnReadCart == NULL)
+		return false;
+	return Cart->ptrfnReadCart(Cart, dwAddress, Data);
+}
+
+bool WriteCart(LPGBCART Cart, WORD dwAddress, BYTE *Data)
+{
+	LPBYTE pBase = Cart->aWriteMap[dwAddress >> 13];
+	if (pBase != NULL) {
+		const DWORD dwOffset = (DWORD)(pBase - Cart->RamData) + (dwAddress & 0x1FFF);
+		LogTraceA( LOG_TPAK, "RAM write: Bank %02X\n", Cart->iCurrentRamBankNo );
+		PakJournalWrite(Cart->pJournal, Cart->RamData, dwOffset, Data);
+		MarkCartWritten(Cart, dwOffset);
+		return true;
+	}
+	if (Cart->ptrfnWriteCart == NULL)
+		return false;
+
+	bool bReturn = Cart->ptrfnWriteCart(Cart, dwAddress, Data);
+	if (dwAddress < 0x8000)	// the MBC registers are all in the ROM half
+		UpdateCartMap(Cart);
+	return bReturn;
+}
+
 // Done
 bool ReadCartNorm(LPGBCART Cart, WORD dwAddress, BYTE *Data) // For all non-MBC carts; fixed 0x8000 ROM; fixed, optional 0x2000 RAM
 {
@@ -612,30 +739,30 @@ bool ReadCartNorm(LPGBCART Cart, WORD dwAddress, BYTE *Data) // For all non-MBC
 	case 2:
 	case 3:	//	if ((dwAddress >= 0) && (dwAddress <= 0x7FFF))
 		CopyMemory(Data, &Cart->RomData[dwAddress], 32);
-		DebugWriteA("Nonbanked ROM read - RAW\n");
+		LogTraceA( LOG_TPAK, "Nonbanked ROM read - RAW\n" );
 		break;
 	case 5:
 		if (Cart->bHasRam)	// no MBC, so no enable state to check
 		{
 			if (Cart->RomData[0x149] == 1 && (dwAddress - 0xA000) / 0x0800 ) // Only 1/4 of the RAM space is used, and we're out of bounds
 			{
-				DebugWriteA("Failed RAM read: Unbanked (out of bounds)");
+				LogWarnA( LOG_TPAK, "Failed RAM read: Unbanked (out of bounds)" );
 				ZeroMemory(Data, 32);
 			}
 			else
 			{
 				CopyMemory(Data, &Cart->RamData[dwAddress - 0xA000], 32);
-				DebugWriteA("RAM read: Unbanked\n");
+				LogTraceA( LOG_TPAK, "RAM read: Unbanked\n" );
 			}
 		}
 		else
 		{
 			ZeroMemory(Data, 32);
-			DebugWriteA("Failed RAM read: Unbanked (RAM not present)\n");
+			LogWarnA( LOG_TPAK, "Failed RAM read: Unbanked (RAM not present)\n" );
 		}
 		break;
 	default:
-		DebugWriteA("Bad read from RAW cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad read from RAW cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -646,23 +773,25 @@ bool WriteCartNorm(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 {
 	if (!Cart->bHasRam)
 	{
-		DebugWriteA("RAM write: no RAM\n");
+		LogWarnA( LOG_TPAK, "RAM write: no RAM\n" );
 		return true;
 	}
 
 	if (Cart->RomData[0x149] == 1) { // Whoops... Only 1/4 of the RAM space is used.
 		if ((dwAddress >= 0xA000) && (dwAddress <= 0xA7FF)) { // Write to RAM
-			DebugWriteA("RAM write: Unbanked\n");
-			CopyMemory(&Cart->RamData[dwAddress - 0xA000], Data, 32);
+			LogTraceA( LOG_TPAK, "RAM write: Unbanked\n" );
+			PakJournalWrite(Cart->pJournal, Cart->RamData, dwAddress - 0xA000, Data);
+			MarkCartWritten(Cart, dwAddress - 0xA000);
 		}
 		else
 		{
-			DebugWriteA("RAM write: Unbanked (out of range!)\n");
+			LogWarnA( LOG_TPAK, "RAM write: Unbanked (out of range!)\n" );
 		}
 	} else {
 		if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF)) { // Write to RAM
-			DebugWriteA("RAM write: Unbanked\n");
-			CopyMemory(&Cart->RamData[dwAddress - 0xA000], Data, 32);
+			LogTraceA( LOG_TPAK, "RAM write: Unbanked\n" );
+			PakJournalWrite(Cart->pJournal, Cart->RamData, dwAddress - 0xA000, Data);
+			MarkCartWritten(Cart, dwAddress - 0xA000);
 		}
 	}
 	return true;
@@ -676,38 +805,38 @@ bool ReadCartMBC1(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	case 0:
 	case 1:	//	if ((dwAddress >= 0) && (dwAddress <= 0x3FFF))
 		CopyMemory(Data, &Cart->RomData[dwAddress], 32);
-		DebugWriteA("Nonbanked ROM read - MBC1\n");
+		LogTraceA( LOG_TPAK, "Nonbanked ROM read - MBC1\n" );
 		break;
 	case 2:
 	case 3:	//	else if ((dwAddress >= 0x4000) && (dwAddress <= 0x7FFF))
 		if (Cart->iCurrentRomBankNo >= Cart->iNumRomBanks)
 		{
 			ZeroMemory(Data, 32);
-			DebugWriteA("Banked ROM read: (Banking Error) Bank %02X\n", Cart->iCurrentRomBankNo);
+			LogWarnA( LOG_TPAK, "Banked ROM read: (Banking Error) Bank %02X\n", Cart->iCurrentRomBankNo );
 		}
 		else
 		{
 			// for (i=0; i<32; i++) Data[i] = Cart->RomData[(dwAddress - 0x4000) + i + (Cart->iCurrentRomBankNo * 0x4000)];
 			CopyMemory(Data, &Cart->RomData[dwAddress - 0x4000 + (Cart->iCurrentRomBankNo << 14)], 32);
-			DebugWriteA("Banked ROM read: Bank %02X\n", Cart->iCurrentRomBankNo);
+			LogTraceA( LOG_TPAK, "Banked ROM read: Bank %02X\n", Cart->iCurrentRomBankNo );
 		}
 		break;
 	case 5:	//	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF))
 		if (Cart->bHasRam){ // && Cart->bRamEnableState) {
 			if (Cart->iCurrentRamBankNo >= Cart->iNumRamBanks) {
 				ZeroMemory(Data, 32);
-				DebugWriteA("Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo);
+				LogWarnA( LOG_TPAK, "Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo );
 			} else {
 				CopyMemory(Data, &Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13)], 32);
-				DebugWriteA("RAM read: Bank %02X\n", Cart->iCurrentRamBankNo);
+				LogTraceA( LOG_TPAK, "RAM read: Bank %02X\n", Cart->iCurrentRamBankNo );
 			}
 		} else {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Failed RAM read: (RAM not present)\n");
+			LogWarnA( LOG_TPAK, "Failed RAM read: (RAM not present)\n" );
 		}
 		break;
 	default:
-		DebugWriteA("Bad read from MBC1 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad read from MBC1 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -720,7 +849,7 @@ bool WriteCartMBC1(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	{
 	case 0:	//	if ((dwAddress >= 0) && (dwAddress <= 0x1FFF)) // RAM enable
 		Cart->bRamEnableState = (Data[0] == 0x0A);
-		DebugWriteA("Set RAM enable: %d\n", Cart->bRamEnableState);
+		LogDebugA( LOG_TPAK, "Set RAM enable: %d\n", Cart->bRamEnableState );
 		break;
 	case 1:	//	else if ((dwAddress >= 0x2000) && (dwAddress <= 0x3FFF)) // ROM bank select
 		Cart->iCurrentRomBankNo &= 0x60;	// keep MSB
@@ -730,17 +859,17 @@ bool WriteCartMBC1(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 		if ((Cart->iCurrentRomBankNo & 0x1F) == 0) {
 			Cart->iCurrentRomBankNo |= 0x01;
 		}
-		DebugWriteA("Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo);
+		LogDebugA( LOG_TPAK, "Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo );
 		break;
 	case 2:	//	else if ((dwAddress >= 0x4000) && (dwAddress <= 0x5FFF)) // RAM bank select
 		if (Cart->bMBC1RAMbanking)	{
 			Cart->iCurrentRamBankNo = Data[0] & 0x03;
-			DebugWriteA("Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo);
+			LogDebugA( LOG_TPAK, "Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo );
 		}
 		else {
 			Cart->iCurrentRomBankNo &= 0x1F;
 			Cart->iCurrentRomBankNo |= ((Data[0] & 0x03) << 5); // set bits 5 and 6 of ROM bank
-			DebugWriteA("Set ROM Bank MSB, ROM bank now: %02X\n", Cart->iCurrentRomBankNo);
+			LogDebugA( LOG_TPAK, "Set ROM Bank MSB, ROM bank now: %02X\n", Cart->iCurrentRomBankNo );
 		}
 		break;
 	case 3:	//	else if ((dwAddress >= 0x6000) && (dwAddress <= 0x7FFF)) // MBC1 mode select
@@ -760,27 +889,28 @@ bool WriteCartMBC1(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 				Cart->iCurrentRomBankNo |= (Cart->iCurrentRamBankNo << 5);
 				Cart->iCurrentRamBankNo = 0x00;	// we can only reach RAM page 0
 			}
-			DebugWriteA("Set MBC1 mode: %s\n", Cart->bMBC1RAMbanking ? "ROMbanking" : "RAMbanking" );
+			LogDebugA( LOG_TPAK, "Set MBC1 mode: %s\n", Cart->bMBC1RAMbanking ? "ROMbanking" : "RAMbanking" );
 		}
 		else
 		{
-			DebugWriteA("Already in MBC1 mode: %s\n", Cart->bMBC1RAMbanking ? "ROMbanking" : "RAMbanking" );
+			LogDebugA( LOG_TPAK, "Already in MBC1 mode: %s\n", Cart->bMBC1RAMbanking ? "ROMbanking" : "RAMbanking" );
 		}
 
 		break;
 	case 5:	// else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF)) // Write to RAM
 		if (Cart->bHasRam) // && Cart->bRamEnableState)
 		{
-			DebugWriteA("RAM write: Bank %02X\n", Cart->iCurrentRamBankNo);
-			CopyMemory(&Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13)], Data, 32);
+			LogTraceA( LOG_TPAK, "RAM write: Bank %02X\n", Cart->iCurrentRamBankNo );
+			PakJournalWrite(Cart->pJournal, Cart->RamData, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13), Data);
+			MarkCartWritten(Cart, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13));
 		}
 		else
 		{
-			DebugWriteA("Failed RAM write: (RAM not present)\n");
+			LogWarnA( LOG_TPAK, "Failed RAM write: (RAM not present)\n" );
 		}
 		break;
 	default:
-		DebugWriteA("Bad write to MBC1 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad write to MBC1 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -794,29 +924,29 @@ bool ReadCartMBC2(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	case 0:
 	case 1: // if ((dwAddress <= 0x3FFF))
 		CopyMemory(Data, &Cart->RomData[dwAddress], 32);
-		DebugWriteA("Nonbanked ROM read - MBC2\n");
+		LogTraceA( LOG_TPAK, "Nonbanked ROM read - MBC2\n" );
 		break;
 	case 2:
 	case 3:	//	else if ((dwAddress >= 0x4000) && (dwAddress <= 0x7FFF))
 		if (Cart->iCurrentRomBankNo >= Cart->iNumRomBanks) {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Banked ROM read: (Banking Error) %02X\n", Cart->iCurrentRomBankNo);
+			LogWarnA( LOG_TPAK, "Banked ROM read: (Banking Error) %02X\n", Cart->iCurrentRomBankNo );
 		} else {
 			CopyMemory(Data, &Cart->RomData[dwAddress - 0x4000 + (Cart->iCurrentRomBankNo << 14)], 32);
-			DebugWriteA("Banked ROM read: Bank %02X\n", Cart->iCurrentRomBankNo);
+			LogTraceA( LOG_TPAK, "Banked ROM read: Bank %02X\n", Cart->iCurrentRomBankNo );
 		}
 		break;
 	case 5:	//	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF))
 		if (Cart->bHasRam && Cart->bRamEnableState) {
 			CopyMemory(Data, &Cart->RamData[dwAddress - 0xA000], 32);
-			DebugWriteA("RAM read: Unbanked\n");
+			LogTraceA( LOG_TPAK, "RAM read: Unbanked\n" );
 		} else {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Failed RAM read: (RAM not present or not active)\n");
+			LogWarnA( LOG_TPAK, "Failed RAM read: (RAM not present or not active)\n" );
 		}
 		break;
 	default:
-		DebugWriteA("Bad read from MBC2 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad read from MBC2 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -829,29 +959,30 @@ bool WriteCartMBC2(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	{
 	case 0: //	if ((dwAddress <= 0x1FFF)) // We shouldn't be able to read/write to RAM unless this is toggled on
 		Cart->bRamEnableState = (Data[0] == 0x0A);
-		DebugWriteA("Set RAM enable: %d\n", Cart->bRamEnableState);
+		LogDebugA( LOG_TPAK, "Set RAM enable: %d\n", Cart->bRamEnableState );
 		break;
 	case 1: //	else if ((dwAddress >= 0x2000) && (dwAddress <= 0x3FFF)) // ROM bank select
 		Cart->iCurrentRomBankNo = Data[0] & 0x0F;
 		if (Cart->iCurrentRomBankNo == 0) {
 			Cart->iCurrentRomBankNo = 1;
 		}
-		DebugWriteA("Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo);
+		LogDebugA( LOG_TPAK, "Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo );
 		break;
 	case 2: //	if ((dwAddress >= 0x4000) && (dwAddress <= 0x5FFF)) // RAM bank select
 		if (Cart->bHasRam) {
 			Cart->iCurrentRamBankNo = Data[0] & 0x07;
-			DebugWriteA("Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo);
+			LogDebugA( LOG_TPAK, "Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo );
 		}
 		break;
 	case 5: //	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF) && Cart->bRamEnableState) // Write to RAM
 		if (Cart->bHasRam) {
-			DebugWriteA("RAM write: Bank %02X\n", Cart->iCurrentRamBankNo);
-			CopyMemory(&Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13)], Data, 32);
+			LogTraceA( LOG_TPAK, "RAM write: Bank %02X\n", Cart->iCurrentRamBankNo );
+			PakJournalWrite(Cart->pJournal, Cart->RamData, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13), Data);
+			MarkCartWritten(Cart, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13));
 		}
 		break;
 	default:
-		DebugWriteA("Bad write to MBC2 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad write to MBC2 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -867,16 +998,16 @@ bool ReadCartMBC3(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	case 0:
 	case 1: //	if ((dwAddress <= 0x3FFF))
 		CopyMemory(Data, &Cart->RomData[dwAddress], 32);
-		DebugWriteA("Nonbanked ROM read - MBC3\n");
+		LogTraceA( LOG_TPAK, "Nonbanked ROM read - MBC3\n" );
 		break;
 	case 2:
 	case 3: //	else if ((dwAddress >= 0x4000) && (dwAddress <= 0x7FFF))
 		if (Cart->iCurrentRomBankNo >= Cart->iNumRomBanks) {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Banked ROM read: (Banking Error) %02X\n", Cart->iCurrentRomBankNo);
+			LogWarnA( LOG_TPAK, "Banked ROM read: (Banking Error) %02X\n", Cart->iCurrentRomBankNo );
 		} else {
 			CopyMemory(Data, &Cart->RomData[dwAddress - 0x4000 + (Cart->iCurrentRomBankNo * 0x4000)], 32);
-			DebugWriteA("Banked ROM read: Bank %02X\n", Cart->iCurrentRomBankNo);
+			LogTraceA( LOG_TPAK, "Banked ROM read: Bank %02X\n", Cart->iCurrentRomBankNo );
 		}
 		break;
 	case 5: //	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF))
@@ -894,11 +1025,11 @@ bool ReadCartMBC3(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 		else if (Cart->bHasRam) {
 			if (Cart->iCurrentRamBankNo >= Cart->iNumRamBanks) {
 				ZeroMemory(Data, 32);
-				DebugWriteA("Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo);
+				LogWarnA( LOG_TPAK, "Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo );
 			}
 			else {
 				CopyMemory(Data, &Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo * 0x2000)], 32);
-				DebugWriteA("RAM read: Bank %02X\n", Cart->iCurrentRamBankNo);
+				LogTraceA( LOG_TPAK, "RAM read: Bank %02X\n", Cart->iCurrentRamBankNo );
 			}
 			//else {
 			//	ZeroMemory(Data, 32);
@@ -907,11 +1038,11 @@ bool ReadCartMBC3(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 			//}
 		} else {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Failed RAM read: (RAM not present)\n");
+			LogWarnA( LOG_TPAK, "Failed RAM read: (RAM not present)\n" );
 		}
 		break;
 	default:
-		DebugWriteA("Bad read from MBC3 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad read from MBC3 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -926,19 +1057,19 @@ bool WriteCartMBC3(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	{
 	case 0: //	if ((dwAddress <= 0x1FFF)) // We shouldn't be able to read/write to RAM unless this is toggled on
 		Cart->bRamEnableState = (Data[0] == 0x0A);
-		DebugWriteA("Set RAM enable: %d\n", Cart->bRamEnableState);
+		LogDebugA( LOG_TPAK, "Set RAM enable: %d\n", Cart->bRamEnableState );
 		break;
 	case 1: //	else if ((dwAddress >= 0x2000) && (dwAddress <= 0x3FFF)) // ROM bank select
 		Cart->iCurrentRomBankNo = Data[0] & 0x7F;
 		if (Cart->iCurrentRomBankNo == 0) {
 			Cart->iCurrentRomBankNo = 1;
 		}
-		DebugWriteA("Set Rom Bank: %02X\n", Cart->iCurrentRomBankNo);
+		LogDebugA( LOG_TPAK, "Set Rom Bank: %02X\n", Cart->iCurrentRomBankNo );
 		break;
 	case 2: //	if ((dwAddress >= 0x4000) && (dwAddress <= 0x5FFF)) // RAM/Clock bank select
 		if (Cart->bHasRam) {
 			Cart->iCurrentRamBankNo = Data[0] & 0x03;
-			DebugWriteA("Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo);
+			LogDebugA( LOG_TPAK, "Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo );
 			if (Cart->bHasTimer && (Data[0] >= 0x08 && Data[0] <= 0x0c)) {
 				// Set the bank for the timer
 				Cart->iCurrentRamBankNo = Data[0];
@@ -953,26 +1084,28 @@ bool WriteCartMBC3(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 			for (i=0; i<4; i++)
 				Cart->LatchedTimerData[i] = Cart->TimerData[i];
 			Cart->TimerDataLatched = true;
-			DebugWriteA("Timer Data Latch: Enable\n");
+			LogDebugA( LOG_TPAK, "Timer Data Latch: Enable\n" );
 		} else {
 			Cart->TimerDataLatched = false;
-			DebugWriteA("Timer Data Latch: Disable\n");
+			LogDebugA( LOG_TPAK, "Timer Data Latch: Disable\n" );
 		}
 		break;
 	case 5: //	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF)) // Write to RAM
 		if (Cart->bHasRam) {
 			if (Cart->iCurrentRamBankNo >= 0x08 && Cart->iCurrentRamBankNo <= 0x0c) {
 				// Write to the timer
-				DebugWriteA("Timer write: Bank %02X\n", Cart->iCurrentRamBankNo);
+				LogTraceA( LOG_TPAK, "Timer write: Bank %02X\n", Cart->iCurrentRamBankNo );
 				Cart->TimerData[Cart->iCurrentRamBankNo - 0x08] = Data[0];
+				Cart->bSaveDirty = true;
 			} else {
-				DebugWriteA("RAM write: Bank %02X%s\n", Cart->iCurrentRamBankNo, Cart->bRamEnableState ? "" : " -- NOT ENABLED (but wrote anyway)");
-				CopyMemory(&Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo * 0x2000)], Data, 32);
+				LogTraceA( LOG_TPAK, "RAM write: Bank %02X%s\n", Cart->iCurrentRamBankNo, Cart->bRamEnableState ? "" : " -- NOT ENABLED (but wrote anyway)" );
+				PakJournalWrite(Cart->pJournal, Cart->RamData, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo * 0x2000), Data);
+				MarkCartWritten(Cart, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo * 0x2000));
 			}
 		}
 		break;
 	default:
-		DebugWriteA("Bad write to MBC3 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad write to MBC3 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -986,38 +1119,34 @@ bool ReadCartMBC5(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	case 0:
 	case 1: //	if ((dwAddress <= 0x3FFF))
 		CopyMemory(Data, &Cart->RomData[dwAddress], 32);
-		DebugWriteA("Nonbanked ROM read - MBC5\n");
+		LogTraceA( LOG_TPAK, "Nonbanked ROM read - MBC5\n" );
 		break;
 	case 2:
 	case 3: //	else if ((dwAddress >= 0x4000) && (dwAddress <= 0x7FFF))
 		if (Cart->iCurrentRomBankNo >= Cart->iNumRomBanks) {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Banked ROM read: (Banking Error)");
-			DebugWriteByteA(Cart->iCurrentRomBankNo);
-			DebugWriteA("\n");
+			LogWarnA( LOG_TPAK, "Banked ROM read: (Banking Error) %02X\n", Cart->iCurrentRomBankNo );
 		} else {
 			CopyMemory(Data, &Cart->RomData[dwAddress - 0x4000 + (Cart->iCurrentRomBankNo << 14)], 32);
-			DebugWriteA("Banked ROM read: Bank=");
-			DebugWriteByteA(Cart->iCurrentRomBankNo);
-			DebugWriteA("\n");
+			LogTraceA( LOG_TPAK, "Banked ROM read: Bank=%02X\n", Cart->iCurrentRomBankNo );
 		}
 		break;
 	case 5: //	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF))
 		if (Cart->bHasRam) {
 			if (Cart->iCurrentRamBankNo >= Cart->iNumRamBanks) {
 				ZeroMemory(Data, 32);
-				DebugWriteA("Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo);
+				LogWarnA( LOG_TPAK, "Failed RAM read: (Banking Error) %02X\n", Cart->iCurrentRamBankNo );
 			} else {
 				CopyMemory(Data, &Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13)], 32);
-				DebugWriteA("RAM read: Bank %02X\n", Cart->iCurrentRamBankNo);
+				LogTraceA( LOG_TPAK, "RAM read: Bank %02X\n", Cart->iCurrentRamBankNo );
 			}
 		} else {
 			ZeroMemory(Data, 32);
-			DebugWriteA("Failed RAM read: (RAM Not Present)\n");
+			LogWarnA( LOG_TPAK, "Failed RAM read: (RAM Not Present)\n" );
 		}
 		break;
 	default:
-		DebugWriteA("Bad read from MBC5 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad read from MBC5 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
@@ -1031,71 +1160,96 @@ bool WriteCartMBC5(LPGBCART Cart, WORD dwAddress, BYTE *Data)
 	case 0: //	if ((dwAddress <= 0x1FFF)) // We shouldn't be able to read/write to RAM unless this is toggled on
 	case 1:
 		Cart->bRamEnableState = (Data[0] == 0x0A);
-		DebugWriteA("Set RAM enable: %d\n", Cart->bRamEnableState);
+		LogDebugA( LOG_TPAK, "Set RAM enable: %d\n", Cart->bRamEnableState );
 		break;
 	case 2: //	else if ((dwAddress >= 0x2000) && (dwAddress <= 0x2FFF)) // ROM bank select, low bits
 		Cart->iCurrentRomBankNo &= 0xFF00;
 		Cart->iCurrentRomBankNo |= Data[0];
 		// Cart->iCurrentRomBankNo = ((int) Data[0]) | (Cart->iCurrentRomBankNo & 0x100);
-		DebugWriteA("Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo);
+		LogDebugA( LOG_TPAK, "Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo );
 		break;
 	case 3: //	else if ((dwAddress >= 0x3000) && (dwAddress <= 0x3FFF)) // ROM bank select, high bit
 		Cart->iCurrentRomBankNo &= 0x00FF;
 		Cart->iCurrentRomBankNo |= (Data[0] & 0x01) << 8;
 		// Cart->iCurrentRomBankNo = (Cart->iCurrentRomBankNo & 0xFF) | ((((int) Data[0]) & 1) * 0x100);
-		DebugWriteA("Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo);
+		LogDebugA( LOG_TPAK, "Set ROM Bank: %02X\n", Cart->iCurrentRomBankNo );
 		break;
 	case 4: //	if ((dwAddress >= 0x4000) && (dwAddress <= 0x5FFF)) // RAM bank select
 	case 5:
 		if (Cart->bHasRam) {
 			Cart->iCurrentRamBankNo = Data[0] & 0x0F;
-			DebugWriteA("Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo);
+			LogDebugA( LOG_TPAK, "Set RAM Bank: %02X\n", Cart->iCurrentRamBankNo );
 		}
 		break;
 	case 10: //	else if ((dwAddress >= 0xA000) && (dwAddress <= 0xBFFF)) // Write to RAM
 	case 11:
 		if (Cart->bHasRam) {
 			if (Cart->iCurrentRamBankNo >= Cart->iNumRamBanks) {
-				DebugWriteA("RAM write: Buffer error on ");
-				DebugWriteByteA(Cart->iCurrentRamBankNo);
-				DebugWriteA("\n");
+				LogWarnA( LOG_TPAK, "RAM write: Buffer error on %02X\n", Cart->iCurrentRamBankNo );
 			} else {
-				DebugWriteA("RAM write: Bank %02X\n", Cart->iCurrentRamBankNo);
-				CopyMemory(&Cart->RamData[dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13)], Data, 32);
+				LogTraceA( LOG_TPAK, "RAM write: Bank %02X\n", Cart->iCurrentRamBankNo );
+				PakJournalWrite(Cart->pJournal, Cart->RamData, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13), Data);
+				MarkCartWritten(Cart, dwAddress - 0xA000 + (Cart->iCurrentRamBankNo << 13));
 			}
 		}
 		break;
 	default:
-		DebugWriteA("Bad write to MBC5 cart, address %04X\n", dwAddress);
+		LogWarnA( LOG_TPAK, "Bad write to MBC5 cart, address %04X\n", dwAddress );
 	}
 
 	return true;
 }
 
+// Flushes the dirty pages of a mapped RamData, one PakFlushFile per run of them, and checkpoints the journal.
+// Returns the number of bytes flushed.
+DWORD FlushCart(LPGBCART Cart)
+{
+	DWORD dwPages = Cart->dwDirtyPages;
+	DWORD dwFlushed = 0;
+	Cart->dwDirtyPages = 0;
+	if (Cart->pRamMapping == NULL)
+		return 0;	// allocated RAM, read-only or Goomba; there is nothing mapped to flush
+
+	int iPage = 0;
+	while (dwPages) {
+		if (!(dwPages & (1u << iPage))) {
+			++iPage;
+			continue;
+		}
+		int iEnd = iPage;
+		while (iEnd < 32 && (dwPages & (1u << iEnd))) {
+			dwPages &= ~(1u << iEnd);
+			++iEnd;
+		}
+
+		const DWORD dwOffset = iPage * GB_DIRTY_PAGE_SIZE;
+		const DWORD dwEnd = min((DWORD)iEnd * GB_DIRTY_PAGE_SIZE, (DWORD)Cart->iRamSize);	// 2 KB carts use part of a page
+		if (dwOffset < dwEnd) {
+			PakFlushFile(&Cart->RamData[dwOffset], dwEnd - dwOffset);
+			LogDebugA( LOG_TPAK, "Flushed %u bytes of cart RAM at %05X\n", dwEnd - dwOffset, dwOffset );
+			dwFlushed += dwEnd - dwOffset;
+		}
+		iPage = iEnd;
+	}
+	// every write up to the mark is on disk now, including any flushed by an earlier call
+	PakJournalCheckpoint( Cart->pJournal, PakJournalMark( Cart->pJournal ));
+	return dwFlushed;
+}
+
 bool SaveCart(LPGBCART Cart, LPTSTR SaveFile, LPTSTR TimeFile)
 {
-	DWORD NumQuarterBlocks = 0;
 	gbCartRTC RTCTimer;
 
+	// nothing written since the last save, such as a session of Pokemon Stadium's GB Tower, which only reads
+	if (!Cart->bSaveDirty)
+		return true;
+	Cart->bSaveDirty = false;
+
 	if (Cart->sGoombaRamPath != NULL) {
 		UpdateGoombaFile(Cart); // Save data is compressed - we have to write the whole file
-	} else if(Cart->bHasRam && Cart->bHasBattery) {
-		// Write only the bytes that NEED writing!
-		switch (Cart->RomData[0x149]) {
-		case 1:
-			NumQuarterBlocks = 1;
-			break;
-		case 2:
-			NumQuarterBlocks = 4;
-			break;
-		case 3:
-			NumQuarterBlocks = 16;
-			break;
-		case 4:
-			NumQuarterBlocks = 64;
-			break;
-		}
-		FlushViewOfFile( Cart->RamData, NumQuarterBlocks * 0x0800 );
+	} else if (Cart->pRamMapping != NULL) {
+		// Write only the pages that NEED writing!
+		FlushCart(Cart);
 		if (Cart->bHasTimer) {
 			// Save RTC in VisualBoy Advance format
 			// TODO: Check if VBA saves are compatible with other emus.
@@ -1112,9 +1266,9 @@ bool SaveCart(LPGBCART Cart, LPTSTR SaveFile, LPTSTR TimeFile)
 			RTCTimer.mapperLControl = Cart->LatchedTimerData[4];
 			RTCTimer.mapperLastTime = Cart->timerLastUpdate;
 
-			CopyMemory(Cart->RamData + NumQuarterBlocks * 0x0800, &RTCTimer, sizeof(RTCTimer));
+			CopyMemory(Cart->RamData + Cart->iRamSize, &RTCTimer, sizeof(RTCTimer));
 
-			FlushViewOfFile( Cart->RamData + NumQuarterBlocks * 0x0800, sizeof(gbCartRTC));
+			PakFlushFile( Cart->RamData + Cart->iRamSize, sizeof(gbCartRTC));
 		}
 	}
 	return true;
@@ -1122,23 +1276,28 @@ bool SaveCart(LPGBCART Cart, LPTSTR SaveFile, LPTSTR TimeFile)
 
 bool UnloadCart(LPGBCART Cart)
 {
-	if (Cart->hRomFile != NULL)
-	{
-		UnmapViewOfFile(Cart->RomData);
-		CloseHandle(Cart->hRomFile);
-		Cart->hRomFile = NULL;
-	}
-	else if (Cart->RomData != NULL)
+	ZeroMemory(Cart->aReadMap, sizeof(Cart->aReadMap));
+	ZeroMemory(Cart->aWriteMap, sizeof(Cart->aWriteMap));
+	Cart->ptrfnReadCart = NULL;
+	Cart->ptrfnWriteCart = NULL;
+
+	if (Cart->RomData != NULL)
 	{
-		P_free((LPVOID)(Cart->RomData));
+		ReleaseGBRom(Cart->RomData);
 		Cart->RomData = NULL;
 	}
 
-	if (Cart->hRamFile != NULL)
+	if (Cart->pRamMapping != NULL)
 	{
-		UnmapViewOfFile(Cart->RamData);
-		CloseHandle(Cart->hRamFile);
-		Cart->hRamFile = NULL;
+		if (Cart->pJournal != NULL)
+		{
+			FlushCart(Cart);	// the journal goes away with the close, the data has to be on disk first
+			ClosePakJournal( Cart->pJournal );
+			Cart->pJournal = NULL;
+		}
+		PakUnmapFile(Cart->RamData, Cart->pRamMapping);
+		Cart->pRamMapping = NULL;
+		Cart->RamData = NULL;
 	}
 	else if (Cart->sGoombaRamPath != NULL)
 		 {
@@ -1,8 +1,8 @@
 #ifndef _GBCART_H_
 #define _GBCART_H_
 
-#include <windows.h>
 #include <time.h>
+#include "PakSnapshot.h"
 
 typedef struct _gbCartRTC {
   UINT mapperSeconds;
@@ -18,6 +18,28 @@ typedef struct _gbCartRTC {
   time_t mapperLastTime;
 } gbCartRTC, *lpgbCartRTC;
 
+#define GB_MAP_REGIONS	8	// 8 KB regions of GB address space, indexed by dwAddress >> 13
+#define GB_DIRTY_PAGE_SIZE	0x1000	// writeback granularity; RamData is at most 0x20000 bytes, so GBCART::dwDirtyPages has a bit for every page
+
+// What LoadCart needs to know from a ROM's header; parsed once per ROM and shared by every cart holding it
+typedef struct _GBROMINFO
+{
+	int iStatus;			// GBROM_OK, or why the ROM can't be used
+	int iCartType;
+	bool bHasRam;
+	bool bHasBattery;
+	bool bHasTimer;
+	bool bHasRumble;
+	unsigned int iNumRomBanks;
+	unsigned int iNumRamBanks;
+	DWORD NumQuarterBlocks;	// RAM size in 2 KB units, as saved to the battery file
+} GBROMINFO, *LPGBROMINFO;
+
+#define GBROM_OK			0
+#define GBROM_TOOSMALL		1	// under 32 KB, the header can't be trusted
+#define GBROM_UNSUPPORTED	2	// unknown cart type
+#define GBROM_BADSIZE		3	// file size doesn't match the header's ROM size
+
 typedef struct _GBCART
 {
 	unsigned int iCurrentRomBankNo;
@@ -35,20 +57,29 @@ typedef struct _GBCART
 	BYTE LatchedTimerData[5];
 	time_t timerLastUpdate;
 	bool TimerDataLatched;
-	HANDLE hRomFile;		// a file mapping handle
-	HANDLE hRamFile;		// a file mapping handle, must be NULL if malloc'd ram is being used instead of a valid memory mapped file
+	struct _PAKMAPPING *pRamMapping;	// mapping of the save file, must be NULL if malloc'd ram is being used instead of a valid memory mapped file
 	LPTSTR sGoombaRamPath;  // (TCHAR) path to the Goomba / Goomba Color file that the RAM was loaded from, must be NULL if Goomba is not being used
 	unsigned int iGoombaRamSize; // size of uncompressed GB/GBC RAM loaded from Goomba file
 	char GoombaHeaderTitle[16]; // (ASCII) title field of the Goomba header that should be replaced upon saving
-	LPCBYTE RomData;		// max [0x200 * 0x4000];
+	LPCBYTE RomData;		// max [0x200 * 0x4000]; from AcquireGBRom, shared with every other cart holding the same ROM
 	LPBYTE RamData;			// max [0x10 * 0x2000];
+	unsigned int iRamSize;	// bytes of RamData the cart can address, without the RTC block behind it
+	DWORD aSnapWritten[PAK_SNAP_PAGES / 32];	// PAK_SNAP_PAGE_SIZE pages of RamData written since the last TakePakSnapshot
+	DWORD dwDirtyPages;		// GB_DIRTY_PAGE_SIZE pages of RamData written since the last FlushCart, one bit each
+	bool bSaveDirty;		// RAM or clock written since the last SaveCart; a cart that is only read is never saved
 	bool (*ptrfnReadCart)(_GBCART * Cart, WORD dwAddress, BYTE *Data);	// ReadCart handler
 	bool (*ptrfnWriteCart)(_GBCART * Cart, WORD dwAddress, BYTE *Data);	// WriteCart handler
+	LPCBYTE aReadMap[GB_MAP_REGIONS];	// base of the bytes a read in each region returns, NULL if only the handler knows
+	LPBYTE aWriteMap[GB_MAP_REGIONS];	// base of the RAM a write in each region lands in, NULL if it goes to the handler
+	struct _PAKJOURNAL *pJournal;	// write-ahead journal for a mapped RamData, otherwise NULL
 } GBCART, *LPGBCART;
 
+void ParseGBRomHeader(LPCBYTE RomData, DWORD dwFilesize, LPGBROMINFO Info);
 bool LoadCart(LPGBCART Cart, LPCTSTR RomFile, LPCTSTR RamFile, LPCTSTR TdfFile);
-// bool ReadCart(LPGBCART Cart, WORD dwAddress, BYTE *Data);
-// bool WriteCart(LPGBCART Cart, WORD dwAddress, BYTE *Data);
+bool ReadCart(LPGBCART Cart, WORD dwAddress, BYTE *Data);
+bool WriteCart(LPGBCART Cart, WORD dwAddress, BYTE *Data);
+void UpdateCartMap(LPGBCART Cart);
+DWORD FlushCart(LPGBCART Cart);
 bool SaveCart(LPGBCART Cart, LPTSTR SaveFile, LPTSTR TimeFile);
 bool UnloadCart(LPGBCART Cart);
 
@@ -0,0 +1,314 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include "PakIO.h"
+#include "GBCart.h"
+#include "GBRomCache.h"
+#include "PakPlatform.h"
+#include "PackedFile.h"
+
+#define GBROM_MAX_SIZE		0x800000			// 512 banks, the most an MBC5 can switch between; caps what we'll unpack
+#define GBROM_ARENA_ALIGN	0x10000				// Windows' allocation granularity, and a whole number of pages anywhere
+#define GBROM_IDLE_LIMIT	( 16 * 1024 * 1024 )	// unpacked ROMs no cart holds, kept for the next load
+
+typedef struct _GBROMENTRY
+{
+	struct _GBROMENTRY *pNext;
+	LONG nRefs;					// carts holding RomData
+	ULONGLONG qwVolume;			// identity of the file it was first mapped from
+	ULONGLONG qwFileID;
+	ULONGLONG qwLastWrite;
+	DWORD dwFileSize;			// on disk, packed or not
+	DWORD dwSize;				// of the ROM
+	LPCBYTE RomData;
+	LPPAKMAPPING pMapping;		// NULL for a ROM unpacked into an arena
+	DWORD dwArenaSize;
+	DWORD dwLastUsed;			// when an unpacked ROM lost its last cart; the oldest is evicted first
+	GBROMINFO Info;
+} GBROMENTRY, *LPGBROMENTRY;
+
+static LPPAKLOCK g_pRomCacheLock = NULL;	// carts on different controllers load and unload under their own locks
+static LPGBROMENTRY g_pRomCache = NULL;
+static LPBYTE g_pSpareArena = NULL;		// the last arena given back, reused by the next ROM that fits in it
+static DWORD g_dwSpareArena = 0;
+static DWORD g_dwRomCacheClock = 0;
+
+// Arenas are page aligned and sized up to the allocation granularity, so one freed by an evicted ROM
+// usually fits the next.  Call these with g_pRomCacheLock held.
+static LPBYTE AllocRomArena( const DWORD dwSize, LPDWORD pdwArenaSize )
+{
+	const DWORD dwArenaSize = ( dwSize + GBROM_ARENA_ALIGN - 1 ) & ~( GBROM_ARENA_ALIGN - 1 );
+	if( g_pSpareArena != NULL && g_dwSpareArena >= dwArenaSize )
+	{
+		LPBYTE pArena = g_pSpareArena;
+		*pdwArenaSize = g_dwSpareArena;
+		g_pSpareArena = NULL;
+		PakProtectPages( pArena, *pdwArenaSize, false );
+		return pArena;
+	}
+	*pdwArenaSize = dwArenaSize;
+	return (LPBYTE)PakAllocPages( dwArenaSize );
+}
+
+static void FreeRomArena( LPBYTE pArena, const DWORD dwArenaSize )
+{
+	// the bigger one stays as the spare
+	if( g_pSpareArena != NULL && g_dwSpareArena >= dwArenaSize )
+	{
+		PakFreePages( pArena, dwArenaSize );
+		return;
+	}
+	if( g_pSpareArena != NULL )
+		PakFreePages( g_pSpareArena, g_dwSpareArena );
+	g_pSpareArena = pArena;
+	g_dwSpareArena = dwArenaSize;
+}
+
+static void FreeRomData( LPCBYTE RomData, LPPAKMAPPING pMapping, const DWORD dwArenaSize )
+{
+	if( pMapping != NULL )
+		PakUnmapFile( RomData, pMapping );
+	else
+		FreeRomArena( (LPBYTE)RomData, dwArenaSize );
+}
+
+// Unpacks a gzip or zip ROM into an arena, streaming it straight from the file.
+static LPCBYTE UnpackGBRom( LPPAKFILE pFile, const PACKEDFILE *pPacked, LPDWORD pdwArenaSize )
+{
+	if( pPacked->dwSize == 0 || pPacked->dwSize > GBROM_MAX_SIZE )
+	{
+		DebugWriteA( "GB ROM cache: packed ROM claims to be %u bytes, not unpacking it\n", pPacked->dwSize );
+		return NULL;
+	}
+	LPBYTE pArena = AllocRomArena( pPacked->dwSize, pdwArenaSize );
+	if( pArena == NULL )
+		return NULL;
+
+	const DWORD dwStart = PakTickCount();
+	if( UnpackFile( pFile, pPacked, pArena, pPacked->dwSize ) != pPacked->dwSize || CRC32( 0, pArena, pPacked->dwSize ) != pPacked->dwCRC )
+	{
+		DebugWriteA( "GB ROM cache: packed ROM is damaged\n" );
+		FreeRomArena( pArena, *pdwArenaSize );
+		return NULL;
+	}
+	DebugWriteA( "GB ROM cache: unpacked %u KB in %u ms\n", pPacked->dwSize / 1024, PakTickCount() - dwStart );
+
+	PakProtectPages( pArena, *pdwArenaSize, true );	// as read-only as a mapped ROM
+	return pArena;
+}
+
+// Evicts unpacked ROMs no cart holds, least recently used first, until they fit in GBROM_IDLE_LIMIT.
+static void TrimGBRomCache()
+{
+	for( ;; )
+	{
+		LPGBROMENTRY *ppOldest = NULL;
+		DWORD dwIdle = 0;
+		for( LPGBROMENTRY *ppEntry = &g_pRomCache; *ppEntry != NULL; ppEntry = &(*ppEntry)->pNext )
+		{
+			if( (*ppEntry)->nRefs != 0 || (*ppEntry)->pMapping != NULL )
+				continue;
+			dwIdle += (*ppEntry)->dwArenaSize;
+			if( ppOldest == NULL || (LONG)( (*ppEntry)->dwLastUsed - (*ppOldest)->dwLastUsed ) < 0 )
+				ppOldest = ppEntry;
+		}
+		if( dwIdle <= GBROM_IDLE_LIMIT )
+			return;
+
+		LPGBROMENTRY pOldest = *ppOldest;
+		*ppOldest = pOldest->pNext;
+		DebugWriteA( "GB ROM cache: evicting an unpacked %u KB ROM\n", pOldest->dwSize / 1024 );
+		FreeRomData( pOldest->RomData, pOldest->pMapping, pOldest->dwArenaSize );
+		P_free( pOldest );
+	}
+}
+
+void InitGBRomCache()
+{
+	g_pRomCacheLock = PakCreateLock();
+}
+
+void FreeGBRomCache()
+{
+	// all carts are unloaded by now, anything left belongs to a pak that was never closed
+	while( g_pRomCache != NULL )
+	{
+		LPGBROMENTRY pEntry = g_pRomCache;
+		g_pRomCache = pEntry->pNext;
+		if( pEntry->nRefs != 0 )
+			DebugWriteA( "GB ROM cache: entry with %d references left at shutdown\n", pEntry->nRefs );
+		FreeRomData( pEntry->RomData, pEntry->pMapping, pEntry->dwArenaSize );
+		P_free( pEntry );
+	}
+	if( g_pSpareArena != NULL )
+		PakFreePages( g_pSpareArena, g_dwSpareArena );
+	g_pSpareArena = NULL;
+	g_dwSpareArena = 0;
+	PakDeleteLock( g_pRomCacheLock );
+	g_pRomCacheLock = NULL;
+}
+
+// the checksums make a cheap first test before comparing a whole ROM
+static bool SameGBRom( const LPGBROMENTRY pEntry, LPCBYTE RomData, const DWORD dwSize )
+{
+	if( pEntry->dwSize != dwSize || dwSize < 0x150 )
+		return false;
+	if( pEntry->RomData[0x14D] != RomData[0x14D] || *(WORD UNALIGNED *)&pEntry->RomData[0x14E] != *(WORD UNALIGNED *)&RomData[0x14E] )
+		return false;
+	return !memcmp( pEntry->RomData, RomData, dwSize );
+}
+
+static void LogGBRomCache()
+{
+	DWORD dwResident = 0, dwLoaded = 0, dwIdle = 0;
+	int nRoms = 0;
+	for( LPGBROMENTRY pEntry = g_pRomCache; pEntry != NULL; pEntry = pEntry->pNext )
+	{
+		if( pEntry->nRefs == 0 )
+		{
+			dwIdle += pEntry->dwSize;
+			continue;
+		}
+		nRoms++;
+		dwResident += pEntry->dwSize;
+		dwLoaded += pEntry->dwSize * pEntry->nRefs;
+	}
+	DebugWriteA( "GB ROM cache: %d ROMs, %u KB held for %u KB of loaded carts (%u KB saved), %u KB unpacked and idle\n", nRoms, dwResident / 1024, dwLoaded / 1024, ( dwLoaded - dwResident ) / 1024, dwIdle / 1024 );
+}
+
+LPCBYTE AcquireGBRom( LPCTSTR RomFileName, const GBROMINFO **ppInfo )
+{
+	PAKFILEINFO FileInfo;
+	LPGBROMENTRY pEntry;
+
+	LPPAKFILE pFile = PakOpenFile( RomFileName, PAK_FILE_READ );
+	if( pFile == NULL )
+		return NULL;
+	if( !PakGetFileInfo( pFile, &FileInfo ) || FileInfo.qwSize > 0xFFFFFFFF )
+	{
+		PakCloseFile( pFile );
+		return NULL;
+	}
+	const DWORD dwFileSize = (DWORD)FileInfo.qwSize;
+
+	PakEnterLock( g_pRomCacheLock );
+
+	for( pEntry = g_pRomCache; pEntry != NULL; pEntry = pEntry->pNext )
+	{
+		if( pEntry->qwVolume == FileInfo.qwVolume && pEntry->qwFileID == FileInfo.qwFileID
+			&& pEntry->dwFileSize == dwFileSize && pEntry->qwLastWrite == FileInfo.qwLastWrite )
+			break;
+	}
+
+	if( pEntry == NULL )
+	{
+		PACKEDFILE Packed;
+		LPPAKMAPPING pMapping = NULL;
+		LPCBYTE RomData = NULL;
+		DWORD dwSize = dwFileSize, dwArenaSize = 0;
+
+		if( !GetPackedFile( pFile, &Packed ))
+			DebugWriteA( "GB ROM cache: damaged or unsupported gzip/zip file\n" );
+		else if( Packed.iFormat == PACKED_NONE )
+			RomData = ( dwFileSize != 0 ) ? PakMapFile( pFile, 0, true, &pMapping ) : NULL;
+		else
+		{
+			dwSize = Packed.dwSize;
+			RomData = UnpackGBRom( pFile, &Packed, &dwArenaSize );
+		}
+
+		if( RomData != NULL )
+		{
+			for( pEntry = g_pRomCache; pEntry != NULL; pEntry = pEntry->pNext )
+				if( SameGBRom( pEntry, RomData, dwSize ))
+					break;
+
+			if( pEntry != NULL )
+			{
+				// a copy of a ROM we already have
+				FreeRomData( RomData, pMapping, dwArenaSize );
+			}
+			else if(( pEntry = (LPGBROMENTRY)P_malloc( sizeof(GBROMENTRY) )) != NULL )
+			{
+				pEntry->nRefs = 0;
+				pEntry->qwVolume = FileInfo.qwVolume;
+				pEntry->qwFileID = FileInfo.qwFileID;
+				pEntry->qwLastWrite = FileInfo.qwLastWrite;
+				pEntry->dwFileSize = dwFileSize;
+				pEntry->dwSize = dwSize;
+				pEntry->RomData = RomData;
+				pEntry->pMapping = pMapping;
+				pEntry->dwArenaSize = dwArenaSize;
+				pEntry->dwLastUsed = 0;
+				ParseGBRomHeader( RomData, pEntry->dwSize, &pEntry->Info );
+				pEntry->pNext = g_pRomCache;
+				g_pRomCache = pEntry;
+			}
+			else
+				FreeRomData( RomData, pMapping, dwArenaSize );
+		}
+	}
+
+	LPCBYTE RomData = NULL;
+	if( pEntry != NULL )
+	{
+		pEntry->nRefs++;
+		*ppInfo = &pEntry->Info;
+		RomData = pEntry->RomData;
+		LogGBRomCache();
+	}
+
+	PakLeaveLock( g_pRomCacheLock );
+	PakCloseFile( pFile );
+	return RomData;
+}
+
+void ReleaseGBRom( LPCBYTE RomData )
+{
+	PakEnterLock( g_pRomCacheLock );
+	for( LPGBROMENTRY *ppEntry = &g_pRomCache; *ppEntry != NULL; ppEntry = &(*ppEntry)->pNext )
+	{
+		LPGBROMENTRY pEntry = *ppEntry;
+		if( pEntry->RomData != RomData )
+			continue;
+
+		if( --pEntry->nRefs == 0 )
+		{
+			if( pEntry->pMapping != NULL )
+			{
+				*ppEntry = pEntry->pNext;
+				PakUnmapFile( pEntry->RomData, pEntry->pMapping );
+				P_free( pEntry );
+			}
+			else
+			{
+				// mapping again is cheap, unpacking isn't; keep it around for the next cart
+				pEntry->dwLastUsed = ++g_dwRomCacheClock;
+				TrimGBRomCache();
+			}
+		}
+		break;
+	}
+	PakLeaveLock( g_pRomCacheLock );
+}
@@ -0,0 +1,48 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _GBROMCACHE_H_
+#define _GBROMCACHE_H_
+
+// GB ROMs mapped for Transfer Paks, shared by every cart that holds the same ROM.
+//
+// Entries are found by file identity (volume, file index, size and last write time), so the same file
+// reached through another path still hits.  A different file is compared against the loaded ROMs with
+// the same size and checksums, so identical copies end up sharing one mapping as well.
+// Each entry keeps the ROM's parsed header, so it is read once no matter how many paks load the ROM.
+//
+// A ROM packed with gzip or zip is unpacked into a page aligned arena instead of being mapped.  Once no
+// cart holds it, it stays cached until GBROM_IDLE_LIMIT worth of newer ones push it out, so swapping carts
+// back and forth doesn't unpack the same ROM again; an evicted arena is reused for the next ROM to unpack.
+
+void InitGBRomCache();
+void FreeGBRomCache();
+
+// Maps (or unpacks) RomFileName read-only, or takes another reference to the mapping that already holds its contents.
+// *ppInfo points at the shared header record.  Returns NULL if the file can't be opened or mapped.
+LPCBYTE AcquireGBRom(LPCTSTR RomFileName, const GBROMINFO **ppInfo);
+
+// Drops a reference taken by AcquireGBRom; the last one unmaps the ROM, or leaves an unpacked one cached.
+void ReleaseGBRom(LPCBYTE RomData);
+
+#endif // #ifndef _GBROMCACHE_H_
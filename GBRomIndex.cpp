@@ -0,0 +1,471 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include <stdlib.h>
+#include "PakIO.h"
+#include "GBCart.h"
+#include "GBRomIndex.h"
+#include "PakPlatform.h"
+#include "PackedFile.h"
+
+static LPPAKLOCK g_pRomIndexLock = NULL;		// the picker refreshes while carts may be loading
+static LPGBROMINDEXENTRY g_aRomIndex = NULL;
+static int g_nRomIndex = 0;
+static bool g_bRomIndexLoaded = false;
+static TCHAR g_szRomIndexFile[MAX_PATH+1];
+
+// StartGBRomIndexRefresh's thread, and the directory it refreshes
+static LPPAKTHREAD g_pRefreshThread = NULL;
+static volatile LONG g_lRefreshing = 0;
+static TCHAR g_szRefreshDirectory[MAX_PATH+1];
+
+void InitGBRomIndex( LPCTSTR pszIndexFile )
+{
+	g_pRomIndexLock = PakCreateLock();
+	lstrcpyn( g_szRomIndexFile, pszIndexFile, ARRAYSIZE(g_szRomIndexFile) );
+}
+
+void FreeGBRomIndex()
+{
+	WaitGBRomIndexRefresh();
+	if( g_aRomIndex != NULL )
+		P_free( g_aRomIndex );
+	g_aRomIndex = NULL;
+	g_nRomIndex = 0;
+	g_bRomIndexLoaded = false;
+	PakDeleteLock( g_pRomIndexLock );
+	g_pRomIndexLock = NULL;
+}
+
+static bool IsGBRomFile( LPCTSTR pszFile )
+{
+	LPCTSTR pcPoint = _tcsrchr( pszFile, _T('.') );
+	return pcPoint && ( !lstrcmpi( pcPoint, _T(".gb") ) || !lstrcmpi( pcPoint, _T(".gbc") )
+						|| !lstrcmpi( pcPoint, _T(".gz") ) || !lstrcmpi( pcPoint, _T(".zip") ));
+}
+
+static int CompareGBRomIndexEntries( const void *pLeft, const void *pRight )
+{
+	return lstrcmpi( ((LPGBROMINDEXENTRY)pLeft)->szFile, ((LPGBROMINDEXENTRY)pRight)->szFile );
+}
+
+// aIndex (g_aRomIndex, or a copy of it) is kept sorted by path
+static LPGBROMINDEXENTRY FindGBRomIndexEntry( LPGBROMINDEXENTRY aIndex, const int nIndex, LPCTSTR pszFile )
+{
+	int iLow = 0, iHigh = nIndex - 1;
+	while( iLow <= iHigh )
+	{
+		const int iMiddle = ( iLow + iHigh ) / 2;
+		const int iCompare = lstrcmpi( pszFile, aIndex[iMiddle].szFile );
+		if( iCompare == 0 )
+			return &aIndex[iMiddle];
+		if( iCompare < 0 )
+			iHigh = iMiddle - 1;
+		else
+			iLow = iMiddle + 1;
+	}
+	return NULL;
+}
+
+inline LPGBROMINDEXENTRY FindGBRomIndexEntry( LPCTSTR pszFile )
+{
+	return FindGBRomIndexEntry( g_aRomIndex, g_nRomIndex, pszFile );
+}
+
+// adds or updates an entry, keeping the index sorted; call with g_pRomIndexLock held
+static bool PutGBRomIndexEntry( const GBROMINDEXENTRY *pEntry )
+{
+	LPGBROMINDEXENTRY pIndexed = FindGBRomIndexEntry( pEntry->szFile );
+	if( pIndexed )
+	{
+		*pIndexed = *pEntry;
+		return true;
+	}
+
+	LPGBROMINDEXENTRY aGrown = (LPGBROMINDEXENTRY)P_realloc( g_aRomIndex, ( g_nRomIndex + 1 ) * sizeof(GBROMINDEXENTRY) );
+	if( !aGrown )
+		return false;
+	g_aRomIndex = aGrown;
+	int i = g_nRomIndex++;
+	while( i > 0 && lstrcmpi( g_aRomIndex[i - 1].szFile, pEntry->szFile ) > 0 )
+	{
+		g_aRomIndex[i] = g_aRomIndex[i - 1];
+		i--;
+	}
+	g_aRomIndex[i] = *pEntry;
+	return true;
+}
+
+// The file holds the index as SaveGBRomIndex wrote it, sorted, followed by whatever AppendGBRomIndexEntry
+// added since, which can repeat a path; the later entry wins.
+// call with g_pRomIndexLock held
+static void LoadGBRomIndex()
+{
+	if( g_bRomIndexLoaded )
+		return;
+	g_bRomIndexLoaded = true;
+
+	LPPAKFILE pFile = PakOpenFile( g_szRomIndexFile, PAK_FILE_READ );
+	if( pFile == NULL )
+		return;
+
+	GBROMINDEXHEADER Header;
+	if( PakReadFile( pFile, &Header, sizeof(Header) ) == sizeof(Header)
+		&& Header.dwMagic == GBROMINDEX_MAGIC && Header.dwEntrySize == sizeof(GBROMINDEXENTRY) && Header.nEntries > 0
+		&& Header.nEntries <= ( PakGetFileSize( pFile ) - sizeof(Header) ) / sizeof(GBROMINDEXENTRY) )
+	{
+		g_aRomIndex = (LPGBROMINDEXENTRY)P_malloc( Header.nEntries * sizeof(GBROMINDEXENTRY) );
+		if( g_aRomIndex && PakReadFile( pFile, g_aRomIndex, Header.nEntries * sizeof(GBROMINDEXENTRY) ) == Header.nEntries * sizeof(GBROMINDEXENTRY) )
+		{
+			int nSorted = 1;
+			while( nSorted < (int)Header.nEntries && lstrcmpi( g_aRomIndex[nSorted - 1].szFile, g_aRomIndex[nSorted].szFile ) < 0 )
+				nSorted++;
+			g_nRomIndex = nSorted;
+
+			// the appended ones go in one by one, out of a copy since inserting moves the array
+			const int nAppended = Header.nEntries - nSorted;
+			LPGBROMINDEXENTRY aAppended = nAppended ? (LPGBROMINDEXENTRY)P_malloc( nAppended * sizeof(GBROMINDEXENTRY) ) : NULL;
+			if( aAppended )
+			{
+				CopyMemory( aAppended, &g_aRomIndex[nSorted], nAppended * sizeof(GBROMINDEXENTRY) );
+				for( int i = 0; i < nAppended; i++ )
+					PutGBRomIndexEntry( &aAppended[i] );
+				P_free( aAppended );
+			}
+		}
+		else if( g_aRomIndex )
+		{
+			P_free( g_aRomIndex );
+			g_aRomIndex = NULL;
+		}
+	}
+	else
+		DebugWriteA( "GB ROM index: stale or damaged, starting over\n" );
+	PakCloseFile( pFile );
+}
+
+// call with g_pRomIndexLock held
+static void SaveGBRomIndex()
+{
+	LPPAKFILE pFile = PakOpenFile( g_szRomIndexFile, PAK_FILE_CREATE );
+	if( pFile == NULL )
+	{
+		DebugWriteA( "GB ROM index: couldn't write the index, error %08x\n", PakLastError() );
+		return;
+	}
+
+	GBROMINDEXHEADER Header = { GBROMINDEX_MAGIC, sizeof(GBROMINDEXENTRY), (DWORD)g_nRomIndex };
+	PakWriteFile( pFile, &Header, sizeof(Header) );
+	if( g_nRomIndex )
+		PakWriteFile( pFile, g_aRomIndex, g_nRomIndex * sizeof(GBROMINDEXENTRY) );
+	PakCloseFile( pFile );
+}
+
+// Adds one entry to the end of the saved index instead of writing all of it again.  The count in the header
+// goes up last, so an interrupted append only leaves bytes the next load ignores.
+// call with g_pRomIndexLock held
+static void AppendGBRomIndexEntry( const GBROMINDEXENTRY *pEntry )
+{
+	LPPAKFILE pFile = PakOpenFile( g_szRomIndexFile, PAK_FILE_EXISTING );
+	GBROMINDEXHEADER Header;
+	if( pFile == NULL || PakReadFile( pFile, &Header, sizeof(Header) ) != sizeof(Header)
+		|| Header.dwMagic != GBROMINDEX_MAGIC || Header.dwEntrySize != sizeof(GBROMINDEXENTRY) )
+	{
+		// nothing usable to append to
+		if( pFile )
+			PakCloseFile( pFile );
+		SaveGBRomIndex();
+		return;
+	}
+
+	bool bWritten = PakSeekFile( pFile, sizeof(Header) + Header.nEntries * sizeof(GBROMINDEXENTRY) )
+					&& PakWriteFile( pFile, pEntry, sizeof(GBROMINDEXENTRY) );
+	Header.nEntries++;
+	bWritten = bWritten && PakSeekFile( pFile, 0 ) && PakWriteFile( pFile, &Header, sizeof(Header) );
+	PakCloseFile( pFile );
+	if( !bWritten )
+		DebugWriteA( "GB ROM index: couldn't append to the index, error %08x\n", PakLastError() );
+}
+
+// Reads the header of pEntry->szFile into the rest of pEntry; no mapping, just the first 0x150 bytes,
+// unpacking no more than that of a packed ROM.
+static bool ReadGBRomIndexEntry( LPGBROMINDEXENTRY pEntry )
+{
+	BYTE aHeader[0x150];
+	PAKFILEINFO FileInfo;
+	PACKEDFILE Packed;
+	DWORD dwRead = 0;
+
+	LPPAKFILE pFile = PakOpenFile( pEntry->szFile, PAK_FILE_READ );
+	if( pFile == NULL )
+		return false;
+	bool bReturn = PakGetFileInfo( pFile, &FileInfo ) && FileInfo.qwSize <= 0xFFFFFFFF && GetPackedFile( pFile, &Packed );
+	if( bReturn && Packed.iFormat == PACKED_NONE )
+		bReturn = PakSeekFile( pFile, 0 ) && (( dwRead = PakReadFile( pFile, aHeader, sizeof(aHeader) )) != 0 || FileInfo.qwSize == 0 );
+	else if( bReturn )
+		bReturn = (( dwRead = UnpackFile( pFile, &Packed, aHeader, sizeof(aHeader) )) != 0 );
+	PakCloseFile( pFile );
+	if( !bReturn )
+		return false;
+
+	ZeroMemory( &aHeader[dwRead], sizeof(aHeader) - dwRead );
+	pEntry->dwDiskSize = (DWORD)FileInfo.qwSize;
+	pEntry->dwFileSize = ( Packed.iFormat == PACKED_NONE ) ? (DWORD)FileInfo.qwSize : Packed.dwSize;
+	pEntry->qwLastWrite = FileInfo.qwLastWrite;
+	ParseGBRomHeader( aHeader, pEntry->dwFileSize, &pEntry->Info );	// too small to trust, if we didn't get the whole header
+
+	CopyMemory( pEntry->szTitle, &aHeader[0x134], 16 );
+	pEntry->szTitle[16] = '\0';
+	pEntry->bCartType = aHeader[0x147];
+	pEntry->bHeaderChecksum = aHeader[0x14D];
+	BYTE bSum = 0;
+	for( int i = 0x134; i <= 0x14C; i++ )
+		bSum = bSum - aHeader[i] - 1;
+	pEntry->bHeaderValid = ( bSum == aHeader[0x14D] );
+	pEntry->wGlobalChecksum = ( aHeader[0x14E] << 8 ) | aHeader[0x14F];
+	return true;
+}
+
+bool GetGBRomIndexEntry( LPCTSTR pszRomFile, LPGBROMINDEXENTRY pEntry )
+{
+	PAKFILEINFO FileInfo;
+
+	if( !PakFullPathName( pszRomFile, pEntry->szFile ) || !PakGetPathInfo( pEntry->szFile, &FileInfo ))
+		return false;
+
+	PakEnterLock( g_pRomIndexLock );
+	LoadGBRomIndex();
+	LPGBROMINDEXENTRY pIndexed = FindGBRomIndexEntry( pEntry->szFile );
+	bool bFound = pIndexed && pIndexed->dwDiskSize == FileInfo.qwSize && pIndexed->qwLastWrite == FileInfo.qwLastWrite;
+	if( bFound )
+		*pEntry = *pIndexed;
+	PakLeaveLock( g_pRomIndexLock );
+	if( bFound )
+		return true;
+
+	if( !ReadGBRomIndexEntry( pEntry ))
+		return false;
+
+	PakEnterLock( g_pRomIndexLock );
+	if( PutGBRomIndexEntry( pEntry ))
+		AppendGBRomIndexEntry( pEntry );
+	PakLeaveLock( g_pRomIndexLock );
+	return true;
+}
+
+typedef struct _INDEXJOB
+{
+	LPGBROMINDEXENTRY aEntries;
+	int *aiToRead;			// entries whose header has to be read
+	LONG nToRead;
+	LONG iNext;				// next one to take, shared by the workers
+} INDEXJOB, *LPINDEXJOB;
+
+static void IndexGBRomWorker( void *pParam )
+{
+	LPINDEXJOB pJob = (LPINDEXJOB)pParam;
+	LONG i;
+	while(( i = PakAtomicIncrement( &pJob->iNext ) - 1 ) < pJob->nToRead )
+	{
+		LPGBROMINDEXENTRY pEntry = &pJob->aEntries[pJob->aiToRead[i]];
+		if( !ReadGBRomIndexEntry( pEntry ))
+			pEntry->szFile[0] = _T('\0');	// gone or unreadable, dropped afterwards
+	}
+}
+
+// adds pszFile to the candidates, carrying over what the old index (aIndex, a copy) knows if the file hasn't changed
+static bool AddGBRomCandidate( LPGBROMINDEXENTRY aIndex, const int nIndex, LPGBROMINDEXENTRY *paEntries, int *pnEntries, int **paiToRead, int *pnToRead, LPCTSTR pszFile )
+{
+	PAKFILEINFO FileInfo;
+	if( !PakGetPathInfo( pszFile, &FileInfo ) || FileInfo.fDirectory )
+		return true;	// gone
+
+	if( !( *pnEntries & 255 ))
+	{
+		LPGBROMINDEXENTRY aGrown = (LPGBROMINDEXENTRY)P_realloc( *paEntries, ( *pnEntries + 256 ) * sizeof(GBROMINDEXENTRY) );
+		int *aiGrown = (int*)P_realloc( *paiToRead, ( *pnEntries + 256 ) * sizeof(int) );
+		if( aGrown )
+			*paEntries = aGrown;
+		if( aiGrown )
+			*paiToRead = aiGrown;
+		if( !aGrown || !aiGrown )
+			return false;
+	}
+
+	LPGBROMINDEXENTRY pEntry = &(*paEntries)[*pnEntries];
+	LPGBROMINDEXENTRY pIndexed = FindGBRomIndexEntry( aIndex, nIndex, pszFile );
+	if( pIndexed && pIndexed->dwDiskSize == FileInfo.qwSize && pIndexed->qwLastWrite == FileInfo.qwLastWrite )
+		*pEntry = *pIndexed;
+	else
+	{
+		lstrcpyn( pEntry->szFile, pszFile, ARRAYSIZE(pEntry->szFile) );
+		(*paiToRead)[(*pnToRead)++] = *pnEntries;
+	}
+	(*pnEntries)++;
+	return true;
+}
+
+typedef struct _ROMSCAN
+{
+	LPCTSTR pszDirectory;
+	int nDirectory;
+	LPGBROMINDEXENTRY aIndex;
+	int nIndex;
+	LPGBROMINDEXENTRY *paEntries;
+	int *pnEntries;
+	int **paiToRead;
+	int *pnToRead;
+	bool bOK;
+} ROMSCAN, *LPROMSCAN;
+
+static bool ScanGBRomFile( const TCHAR *pszName, void *pParam )
+{
+	LPROMSCAN pScan = (LPROMSCAN)pParam;
+	TCHAR szFile[MAX_PATH+1];
+	if( !IsGBRomFile( pszName ) || pScan->nDirectory + lstrlen( pszName ) > MAX_PATH )
+		return true;
+	lstrcpy( szFile, pScan->pszDirectory );
+	lstrcat( szFile, pszName );
+	pScan->bOK = AddGBRomCandidate( pScan->aIndex, pScan->nIndex, pScan->paEntries, pScan->pnEntries, pScan->paiToRead, pScan->pnToRead, szFile );
+	return pScan->bOK;
+}
+
+int RefreshGBRomIndex( LPCTSTR pszDirectory )
+{
+	LPGBROMINDEXENTRY aEntries = NULL, aIndex = NULL;
+	int *aiToRead = NULL;
+	int nEntries = 0, nToRead = 0, nThreads = 0, nIndex = 0;
+	const DWORD dwStart = PakTickCount();
+	const int nDirectory = lstrlen( pszDirectory );
+
+	// the scan works from a copy, so carts can load (and add to the index) while it reads the headers
+	PakEnterLock( g_pRomIndexLock );
+	LoadGBRomIndex();
+	bool bOK = true;
+	if( g_nRomIndex )
+	{
+		aIndex = (LPGBROMINDEXENTRY)P_malloc( g_nRomIndex * sizeof(GBROMINDEXENTRY) );
+		bOK = ( aIndex != NULL );
+		if( bOK )
+		{
+			CopyMemory( aIndex, g_aRomIndex, g_nRomIndex * sizeof(GBROMINDEXENTRY) );
+			nIndex = g_nRomIndex;
+		}
+	}
+	PakLeaveLock( g_pRomIndexLock );
+
+	ROMSCAN Scan = { pszDirectory, nDirectory, aIndex, nIndex, &aEntries, &nEntries, &aiToRead, &nToRead, true };
+	if( bOK )
+	{
+		PakFindFiles( pszDirectory, NULL, ScanGBRomFile, &Scan );
+		bOK = Scan.bOK;
+	}
+
+	// ROMs loaded from elsewhere stay indexed as long as they exist
+	for( int i = 0; bOK && i < nIndex; i++ )
+	{
+		LPCTSTR pszFile = aIndex[i].szFile;
+		if( !_tcsnicmp( pszFile, pszDirectory, nDirectory ) && !_tcschr( pszFile + nDirectory, PAK_PATH_SEPARATOR ))
+			continue;	// in the directory, the scan has seen it if it's still there
+		bOK = AddGBRomCandidate( aIndex, nIndex, &aEntries, &nEntries, &aiToRead, &nToRead, pszFile );
+	}
+
+	if( bOK && nToRead )
+	{
+		INDEXJOB Job = { aEntries, aiToRead, nToRead, 0 };
+		nThreads = PakRunWorkers( nToRead, IndexGBRomWorker, &Job );
+
+		// drop the ones that couldn't be read
+		int j = 0;
+		for( int i = 0; i < nEntries; i++ )
+			if( aEntries[i].szFile[0] )
+				aEntries[j++] = aEntries[i];
+		nEntries = j;
+	}
+
+	PakEnterLock( g_pRomIndexLock );
+	if( bOK )
+	{
+		qsort( aEntries, nEntries, sizeof(GBROMINDEXENTRY), CompareGBRomIndexEntries );
+
+		// what GetGBRomIndexEntry added or updated since the copy was taken is at least as fresh as the scan
+		LPGBROMINDEXENTRY aNew = g_aRomIndex;
+		const int nNew = g_nRomIndex;
+		g_aRomIndex = aEntries;
+		g_nRomIndex = nEntries;
+		aEntries = NULL;
+		for( int i = 0; i < nNew; i++ )
+		{
+			LPGBROMINDEXENTRY pCopied = FindGBRomIndexEntry( aIndex, nIndex, aNew[i].szFile );
+			if( !pCopied || pCopied->dwDiskSize != aNew[i].dwDiskSize || pCopied->qwLastWrite != aNew[i].qwLastWrite )
+				PutGBRomIndexEntry( &aNew[i] );
+		}
+		if( aNew )
+			P_free( aNew );
+
+		SaveGBRomIndex();
+		DebugWriteA( "GB ROM index: %d ROMs, %d headers read on %d threads in %u ms\n", g_nRomIndex, nToRead, nThreads, PakTickCount() - dwStart );
+	}
+	else
+		DebugWriteA( "GB ROM index: out of memory, index left as it was\n" );
+	PakLeaveLock( g_pRomIndexLock );
+
+	if( aIndex )
+		P_free( aIndex );
+	if( aEntries )
+		P_free( aEntries );
+	if( aiToRead )
+		P_free( aiToRead );
+	return bOK ? nToRead : 0;
+}
+
+static void RefreshGBRomIndexThread( void *pParam )
+{
+	RefreshGBRomIndex( g_szRefreshDirectory );
+	PakAtomicDecrement( &g_lRefreshing );
+}
+
+bool StartGBRomIndexRefresh( LPCTSTR pszDirectory )
+{
+	if( PakAtomicCompareExchange( &g_lRefreshing, 1, 0 ) != 0 )
+		return false;	// still busy with the last one
+
+	WaitGBRomIndexRefresh();	// done, but not joined yet
+	lstrcpyn( g_szRefreshDirectory, pszDirectory, ARRAYSIZE(g_szRefreshDirectory) );
+	g_pRefreshThread = PakStartThread( RefreshGBRomIndexThread, NULL );
+	if( g_pRefreshThread == NULL )
+	{
+		PakAtomicDecrement( &g_lRefreshing );
+		return false;
+	}
+	return true;
+}
+
+void WaitGBRomIndexRefresh()
+{
+	if( g_pRefreshThread == NULL )
+		return;
+	PakJoinThread( g_pRefreshThread );
+	g_pRefreshThread = NULL;
+}
@@ -0,0 +1,80 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _GBROMINDEX_H_
+#define _GBROMINDEX_H_
+
+// Header metadata of every GB ROM we've seen, so a ROM can be checked and its RAM sized without mapping it.
+//
+// Entries are keyed by full path and are current as long as the file's size and last write time match.
+// ROMs packed with gzip or zip are indexed by what they unpack to; only the header is unpacked for it.
+// RefreshGBRomIndex rescans the GB ROM directory and every indexed file, reading headers on as many
+// threads as there are CPUs, but only for files that are new or changed; the lock is only held to copy the
+// index at the start and to merge the results at the end.  Lookups that miss read and add the one header
+// they need.  The index is saved to the file given to InitGBRomIndex; the plugin keeps it as
+// GBROMINDEX_FILENAME in the application directory.
+//
+// File layout: GBROMINDEXHEADER, then nEntries GBROMINDEXENTRY records as they are in memory: the sorted
+// index a refresh wrote, then one record for every lookup that missed since, which may repeat a path.
+
+#define GBROMINDEX_FILENAME		_T("NRage-GBRomIndex.bin")
+#define GBROMINDEX_MAGIC		0x4947524E	// "NRGI"
+
+typedef struct _GBROMINDEXHEADER
+{
+	DWORD dwMagic;
+	DWORD dwEntrySize;		// sizeof(GBROMINDEXENTRY); also keeps ANSI and Unicode builds off each other's index
+	DWORD nEntries;
+} GBROMINDEXHEADER;
+
+typedef struct _GBROMINDEXENTRY
+{
+	TCHAR szFile[MAX_PATH+1];	// full path
+	DWORD dwDiskSize;			// size of the file, packed or not; what decides whether the entry is current
+	DWORD dwFileSize;			// size of the ROM
+	ULONGLONG qwLastWrite;		// from PakGetFileInfo
+	char szTitle[17];			// 0x134 - 0x143, NUL terminated
+	BYTE bCartType;				// 0x147 as it is in the header
+	BYTE bHeaderChecksum;		// 0x14D
+	bool bHeaderValid;			// whether 0x14D matches the header bytes it covers
+	WORD wGlobalChecksum;		// 0x14E - 0x14F; not verified, that would mean reading the whole ROM
+	GBROMINFO Info;				// what LoadCart makes of the header
+} GBROMINDEXENTRY, *LPGBROMINDEXENTRY;
+
+void InitGBRomIndex( LPCTSTR pszIndexFile );
+void FreeGBRomIndex();
+
+// Fills pEntry for pszRomFile from the index, reading the ROM's header first if it isn't indexed or has changed.
+// Returns false if the file can't be read.
+bool GetGBRomIndexEntry( LPCTSTR pszRomFile, LPGBROMINDEXENTRY pEntry );
+
+// Brings the index up to date with pszDirectory (ending in PAK_PATH_SEPARATOR) and saves it.  Returns the number
+// of headers read.
+int RefreshGBRomIndex( LPCTSTR pszDirectory );
+// Runs RefreshGBRomIndex on a thread of its own.  Returns false if the last one is still running or no thread
+// could be started.  Both this and WaitGBRomIndexRefresh are for one thread only (the plugin's UI); FreeGBRomIndex
+// waits as well, but the plugin waits in CloseDLL already, since a thread can't be joined under the loader lock.
+bool StartGBRomIndexRefresh( LPCTSTR pszDirectory );
+void WaitGBRomIndexRefresh();
+
+#endif // #ifndef _GBROMINDEX_H_
@@ -30,6 +30,11 @@
 #include "XInputController.h"
 #include "FileAccess.h"
 #include "PakIO.h"
+#include "PakStore.h"
+#include "MemPakFormat.h"
+#include "GBRomIndex.h"
+#include "PakPlatform.h"
+#include "ControllerPak.h"
 #include "Interface.h"
 #include "International.h"
 
@@ -84,7 +89,7 @@ BOOL CALLBACK MainDlgProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 			for( i = 0; i < 4; ++i )
 				DeleteControllerSettings( i );
 
-			EnterCriticalSection( &g_critical );	// block because the InitiateControllers code may still be running.
+			EnterConfigLock();	// block because the InitiateControllers code may still be running.
 			if( !g_strEmuInfo.fInitialisedPlugin )
 			{
 				LoadConfigFromINI();
@@ -92,7 +97,7 @@ BOOL CALLBACK MainDlgProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 
 			GetCurrentConfiguration();
 
-			LeaveCriticalSection( &g_critical );
+			LeaveConfigLock();
 
 
 			g_hMainDialog = hDlg;
@@ -2035,6 +2040,131 @@ BOOL CALLBACK PakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 	}
 }
 
+// only the first 0x500 bytes of bMemPakBinary are needed
+WORD ShowMemPakContent( LPCBYTE bMemPakBinary, HWND hListWindow )
+{
+	MEMPAKMODEL Model;
+	BuildMemPakModel( &Model, bMemPakBinary );
+	return ShowMemPakModel( &Model, hListWindow );
+}
+
+WORD ShowMemPakModel( LPMEMPAKMODEL pModel, HWND hListWindow )
+{
+	BYTE bMemPakValid = MPAK_OK;
+	TCHAR szBuffer[40];
+	bool bFirstChar;
+
+
+	LVITEM lvItem;
+	lvItem.mask = LVIF_TEXT | LVIF_PARAM;
+	lvItem.iItem = 0;
+	lvItem.iSubItem = 0;
+	lvItem.pszText = szBuffer;
+
+	int i = 0,
+		nNotes = 0,
+		iRemainingBlocks = 0;
+
+	if( IsMemPakIndexValid( pModel ))
+	{
+		iRemainingBlocks = MemPakRemainingBlocks( pModel );
+
+		if( iRemainingBlocks <= 123 )
+		{
+			for( lvItem.lParam = 0; lvItem.lParam < 16; lvItem.lParam++ )
+			{
+				const MEMPAKNOTE *pNote = &pModel->aNotes[lvItem.lParam];
+				if( pNote->fUsed )
+				{
+					int iChars = TranslateNotes( pNote->aName, szBuffer, 16 );
+
+					if( TranslateNotes( pNote->aExtension, &szBuffer[iChars + 1], 1 ) )
+						szBuffer[iChars] = _T('_');
+
+					bFirstChar = true;
+					for( i = 0; i < (int)lstrlen(szBuffer); i++ )
+					{
+						if( szBuffer[i] == ' ' )
+							bFirstChar = true;
+						else
+						{
+							if( bFirstChar && ( szBuffer[i] >= 'a') && ( szBuffer[i] <= 'z'))
+							{
+								bFirstChar = false;
+								szBuffer[i] -= 0x20;
+							}
+						}
+
+					}
+	
+					i = ListView_InsertItem( hListWindow, &lvItem );
+
+					switch( pNote->aGameCode[3] )
+					{
+					case 0x00:
+						LoadString( g_hResourceDLL, IDS_P_MEM_NOREGION, szBuffer, 40 );
+						break;
+					case 0x37:
+						LoadString( g_hResourceDLL, IDS_P_MEM_BETA, szBuffer, 40 );
+						break;
+					case 0x41:
+						LoadString( g_hResourceDLL, IDS_P_MEM_NTSC, szBuffer, 40 );
+						break;
+					case 0x44:
+						LoadString( g_hResourceDLL, IDS_P_MEM_GERMANY, szBuffer, 40 );
+						break;
+					case 0x45:
+						LoadString( g_hResourceDLL, IDS_P_MEM_USA, szBuffer, 40 );
+						break;
+					case 0x46:
+						LoadString( g_hResourceDLL, IDS_P_MEM_FRANCE, szBuffer, 40 );
+						break;
+					case 0x49:
+						LoadString( g_hResourceDLL, IDS_P_MEM_ITALY, szBuffer, 40 );
+						break;
+					case 0x4A:
+						LoadString( g_hResourceDLL, IDS_P_MEM_JAPAN, szBuffer, 40 );
+						break;
+					case 0x50:
+						LoadString( g_hResourceDLL, IDS_P_MEM_EUROPE, szBuffer, 40 );
+						break;
+					case 0x53:
+						LoadString( g_hResourceDLL, IDS_P_MEM_SPAIN, szBuffer, 40 );
+						break;
+					case 0x55:
+						LoadString( g_hResourceDLL, IDS_P_MEM_AUSTRALIA, szBuffer, 40 );
+						break;
+					case 0x58:
+					case 0x59:
+						LoadString( g_hResourceDLL, IDS_P_MEM_PAL, szBuffer, 40 );
+						break;
+					default:
+						{
+							TCHAR szTemp[40];
+							LoadString( g_hResourceDLL, IDS_P_MEM_UNKNOWNREGION, szTemp, 40 );
+							wsprintf( szBuffer, szTemp, pNote->aGameCode[3] );
+						}
+					}
+
+					ListView_SetItemText( hListWindow, i, 1, szBuffer );
+
+					wsprintf( szBuffer, _T("%i"), pModel->aNoteBlocks[lvItem.lParam] );
+					ListView_SetItemText( hListWindow, i, 2, szBuffer );
+					nNotes++;
+				}
+			}
+			
+		}
+		else
+			bMemPakValid = MPAK_DAMAGED;
+
+	}
+	else
+		bMemPakValid = MPAK_DAMAGED;
+
+	return MAKEWORD( (BYTE)iRemainingBlocks, bMemPakValid );
+}
+
 BOOL CALLBACK MemPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 {
 	static TCHAR *pszMemPakFile;
@@ -2156,9 +2286,9 @@ BOOL CALLBACK MemPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 					&& g_pcControllers[g_ivConfig->ChosenTab].pPakData
 					&& ( *(BYTE*)g_pcControllers[g_ivConfig->ChosenTab].pPakData == PAK_MEM ))
 				{
-					EnterCriticalSection( &g_critical );
+					EnterControllerLock( g_ivConfig->ChosenTab );
 					CopyMemory( aMemPak, ((MEMPAK*)g_pcControllers[g_ivConfig->ChosenTab].pPakData)->aMemPakData, PAK_MEM_SIZE );
-					LeaveCriticalSection( &g_critical );
+					LeaveControllerLock( g_ivConfig->ChosenTab );
 				}
 				else
 				{
@@ -2285,8 +2415,7 @@ BOOL CALLBACK MemPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 
 		// MemPak Browser
 		ListView_DeleteAllItems( GetDlgItem( hDlg, IDC_MEMPAKBROWSER ));
-		if(	(!lstrcmpi( &szBuffer[lstrlen(szBuffer)-4], _T(".mpk") ))
-			|| (!lstrcmpi( &szBuffer[lstrlen(szBuffer)-4], _T(".n64") )))
+		if(	MemPakFormatFromName( szBuffer ) != MPF_UNKNOWN && MemPakFormatFromName( szBuffer ) != MPF_NOTE )
 		{
 			BYTE aMemPakHeader[0x500];
 
@@ -2302,10 +2431,10 @@ BOOL CALLBACK MemPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 						GetAbsoluteFileName( szMemPakFile, g_pcControllers[i].szMempakFile, DIRECTORY_MEMPAK );
 						if( !lstrcmp( szMemPakFile, szBuffer ))
 						{
-							// grab the file info from memory instead of the file... but keep in mind we can't do anything dangerous with it
-							EnterCriticalSection( &g_critical );
-							wMemPakState = ShowMemPakContent( ((MEMPAK*)g_pcControllers[i].pPakData)->aMemPakData, GetDlgItem( hDlg, IDC_MEMPAKBROWSER ));
-							LeaveCriticalSection( &g_critical );
+							// grab the file info from the live pak's model instead of the file... but keep in mind we can't do anything dangerous with it
+							EnterControllerLock( i );
+							wMemPakState = ShowMemPakModel( ((MEMPAK*)g_pcControllers[i].pPakData)->pModel, GetDlgItem( hDlg, IDC_MEMPAKBROWSER ));
+							LeaveControllerLock( i );
 							if (HIBYTE(wMemPakState) == MPAK_OK)
 							{
 								LoadString( g_hResourceDLL, IDS_P_MEM_INUSE, szTemp, MAX_PATH + 1 );
@@ -2318,29 +2447,32 @@ BOOL CALLBACK MemPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 				}
 			}
 
-			if( !bMemPakUsed )
+			if( !bMemPakUsed && IsPakManifest( szBuffer ))
 			{
-				HANDLE hFile;
-				hFile = CreateFile( szBuffer, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL );
-				if ( hFile != INVALID_HANDLE_VALUE )
+				// a manifest has to be put together from the store first
+				BYTE aMemPak[PAK_MEM_SIZE];
+				if( ReadMemPakFile( szBuffer, aMemPak, false ))
+					wMemPakState = ShowMemPakContent( aMemPak, GetDlgItem( hDlg, IDC_MEMPAKBROWSER ));
+				else
+					wMemPakState = MAKEWORD( 0, MPAK_ERROR );
+			}
+			else if( !bMemPakUsed )
+			{
+				LPPAKFILE pFile = PakOpenFile( szBuffer, PAK_FILE_READ );
+				if ( pFile != NULL )
 				{
-					DWORD dwFileSize = GetFileSize( hFile, NULL );
-					DWORD dwCorrectFileSize = PAK_MEM_SIZE;
+					DWORD dwFileSize = PakGetFileSize( pFile );
+					const int iFormat = DetectMemPakFileFormat( pFile, szBuffer );
+					DWORD dwCorrectFileSize = MemPakFormatSize( iFormat, 1 );
 
-					TCHAR *pcPoint = _tcsrchr( szBuffer, _T('.') );
-					if( !lstrcmpi( pcPoint, _T(".n64") ) )
-					{
-						SetFilePointer( hFile, PAK_MEM_DEXOFFSET, NULL, FILE_BEGIN );
-						dwCorrectFileSize += PAK_MEM_DEXOFFSET;
-					}
-					else
-						SetFilePointer( hFile, 0L, NULL, FILE_BEGIN );
+					// a bank file shows its first bank
+					if( iFormat == MPF_BANKS )
+						dwCorrectFileSize = max( dwCorrectFileSize, dwFileSize - dwFileSize % ( PAK_MEM_SIZE ));
+					PakSeekFile( pFile, MemPakFormatOffset( iFormat ));
 
-					if( dwFileSize > ( dwCorrectFileSize - 0x7500 ))
+					if( iFormat != MPF_NOTE && dwFileSize > ( dwCorrectFileSize - 0x7500 ))
 					{
-						DWORD dwBytesRead;
-
-						ReadFile( hFile, aMemPakHeader, 0x500, &dwBytesRead, NULL);
+						PakReadFile( pFile, aMemPakHeader, 0x500 );
 						ListView_DeleteAllItems( GetDlgItem( hDlg, IDC_MEMPAKBROWSER ));
 						wMemPakState = ShowMemPakContent( aMemPakHeader, GetDlgItem( hDlg, IDC_MEMPAKBROWSER ));
 					}
@@ -2351,7 +2483,7 @@ BOOL CALLBACK MemPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam )
 						dwFileSize != dwCorrectFileSize )
 						wMemPakState = MAKEWORD( LOBYTE( wMemPakState ), MPAK_WRONGSIZE );
 
-					CloseHandle( hFile );
+					PakCloseFile( pFile );
 				}
 				else
 					wMemPakState = MAKEWORD( 0, MPAK_ERROR );
@@ -2705,6 +2837,11 @@ BOOL CALLBACK TransferPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lPara
 			LoadString( g_hResourceDLL, IDS_P_TRANS_NOCHANGE, tszMsg, DEFAULT_BUFFER );
 			SendMessage( GetDlgItem( hDlg, IDC_CHGDIR ), WM_SETTEXT, 0, (LPARAM)tszMsg );
 		}
+		{
+			TCHAR szRomDirectory[MAX_PATH+1];
+			GetDirectory( szRomDirectory, DIRECTORY_GBROMS );
+			StartGBRomIndexRefresh( szRomDirectory );	// in the background; only reads headers of ROMs that are new or changed
+		}
 
 		TransferPakProc( hDlg, WM_USER_UPDATE, 0, 0 ); // setting values
 		return FALSE; // don't give it focus
@@ -2725,9 +2862,16 @@ BOOL CALLBACK TransferPakProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lPara
 		case IDC_GBROM_BROWSE:
 			{
 				TCHAR szBuffer[MAX_PATH+1];
+				GBROMINDEXENTRY IndexEntry;
 				GetAbsoluteFileName( szBuffer, pszGBRomFile, DIRECTORY_GBROMS );
 				if( BrowseFile( hDlg, szBuffer, BF_GBROM, BF_LOAD ))
 				{
+					// turn down a ROM the Transfer Pak couldn't load, from its indexed header
+					if( !GetGBRomIndexEntry( szBuffer, &IndexEntry ) || IndexEntry.Info.iStatus != GBROM_OK )
+					{
+						ErrorMessage( IDS_ERR_GBROM, 0, false );
+						return TRUE;
+					}
 					lstrcpyn( pszGBRomFile, szBuffer, ARRAYSIZE(g_ivConfig->Controllers->szTransferRom) );
 					TransferPakProc( hDlg, WM_USER_UPDATE, 0, 0 );
 				}
@@ -2807,6 +2951,7 @@ BOOL CALLBACK ShortcutsTabProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lPar
 		case IDC_SETADAPTOIDPAK_P1:
 		case IDC_SWMEMRUMBLE_P1:
 		case IDC_SWMEMADAPTOID_P1:
+		case IDC_CYCLEBANK_P1:
 			if (iPlayer > -1)
 				iPlayer = 0;
 
@@ -2817,6 +2962,7 @@ BOOL CALLBACK ShortcutsTabProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lPar
 		case IDC_SETADAPTOIDPAK_P2:
 		case IDC_SWMEMRUMBLE_P2:
 		case IDC_SWMEMADAPTOID_P2:
+		case IDC_CYCLEBANK_P2:
 			if (iPlayer > 0)
 				iPlayer = 1;
 
@@ -2827,6 +2973,7 @@ BOOL CALLBACK ShortcutsTabProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lPar
 		case IDC_SETADAPTOIDPAK_P3:
 		case IDC_SWMEMRUMBLE_P3:
 		case IDC_SWMEMADAPTOID_P3:
+		case IDC_CYCLEBANK_P3:
 			if (iPlayer > 1)
 				iPlayer = 2;
 
@@ -2837,6 +2984,7 @@ BOOL CALLBACK ShortcutsTabProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lPar
 		case IDC_SETADAPTOIDPAK_P4:
 		case IDC_SWMEMRUMBLE_P4:
 		case IDC_SWMEMADAPTOID_P4:
+		case IDC_CYCLEBANK_P4:
 			if (iPlayer > 2)
 				iPlayer = 3;
 
@@ -3360,6 +3508,7 @@ bool GetButtonID( LPDWORD ButtonID, const BYTE bIndex, const BYTE bButtonSet )
 							{ IDC_SETADAPTOIDPAK_P1	, IDC_SETADAPTOIDPAK_P1	, SC_ADAPTPAK },
 							{ IDC_SWMEMRUMBLE_P1	, IDC_SWMEMRUMBLE_P1	, SC_SWMEMRUMB },
 							{ IDC_SWMEMADAPTOID_P1	, IDC_SWMEMADAPTOID_P1	, SC_SWMEMADAPT },
+							{ IDC_CYCLEBANK_P1		, IDC_CYCLEBANK_P1		, SC_CYCLEBANK },
 
 							{ IDC_SETNOPAK_P2		, IDC_SETNOPAK_P2		, SC_NOPAK + SC_TOTAL },
 							{ IDC_SETMEMPAK_P2		, IDC_SETMEMPAK_P2		, SC_MEMPAK + SC_TOTAL },
@@ -3368,6 +3517,7 @@ bool GetButtonID( LPDWORD ButtonID, const BYTE bIndex, const BYTE bButtonSet )
 							{ IDC_SETADAPTOIDPAK_P2	, IDC_SETADAPTOIDPAK_P2	, SC_ADAPTPAK + SC_TOTAL },
 							{ IDC_SWMEMRUMBLE_P2	, IDC_SWMEMRUMBLE_P2	, SC_SWMEMRUMB + SC_TOTAL },
 							{ IDC_SWMEMADAPTOID_P2	, IDC_SWMEMADAPTOID_P2	, SC_SWMEMADAPT + SC_TOTAL },
+							{ IDC_CYCLEBANK_P2		, IDC_CYCLEBANK_P2		, SC_CYCLEBANK + SC_TOTAL },
 
 							{ IDC_SETNOPAK_P3		, IDC_SETNOPAK_P3		, SC_NOPAK + SC_TOTAL * 2 },
 							{ IDC_SETMEMPAK_P3		, IDC_SETMEMPAK_P3		, SC_MEMPAK + SC_TOTAL * 2 },
@@ -3376,6 +3526,7 @@ bool GetButtonID( LPDWORD ButtonID, const BYTE bIndex, const BYTE bButtonSet )
 							{ IDC_SETADAPTOIDPAK_P3	, IDC_SETADAPTOIDPAK_P3	, SC_ADAPTPAK + SC_TOTAL * 2 },
 							{ IDC_SWMEMRUMBLE_P3	, IDC_SWMEMRUMBLE_P3	, SC_SWMEMRUMB + SC_TOTAL * 2 },
 							{ IDC_SWMEMADAPTOID_P3	, IDC_SWMEMADAPTOID_P3	, SC_SWMEMADAPT + SC_TOTAL * 2 },
+							{ IDC_CYCLEBANK_P3		, IDC_CYCLEBANK_P3		, SC_CYCLEBANK + SC_TOTAL * 2 },
 
 							{ IDC_SETNOPAK_P4		, IDC_SETNOPAK_P4		, SC_NOPAK + SC_TOTAL * 3 },
 							{ IDC_SETMEMPAK_P4		, IDC_SETMEMPAK_P4		, SC_MEMPAK + SC_TOTAL * 3 },
@@ -3384,6 +3535,7 @@ bool GetButtonID( LPDWORD ButtonID, const BYTE bIndex, const BYTE bButtonSet )
 							{ IDC_SETADAPTOIDPAK_P4	, IDC_SETADAPTOIDPAK_P4	, SC_ADAPTPAK + SC_TOTAL * 3 },
 							{ IDC_SWMEMRUMBLE_P4	, IDC_SWMEMRUMBLE_P4	, SC_SWMEMRUMB + SC_TOTAL * 3 },
 							{ IDC_SWMEMADAPTOID_P4	, IDC_SWMEMADAPTOID_P4	, SC_SWMEMADAPT + SC_TOTAL * 3 },
+							{ IDC_CYCLEBANK_P4		, IDC_CYCLEBANK_P4		, SC_CYCLEBANK + SC_TOTAL * 3 },
 
 							{ IDC_LOCKMOUSE			, IDC_LOCKMOUSE			, (DWORD)(-1) }
 								};
@@ -3748,6 +3900,9 @@ DWORD ScanGamePad ( LPDEVICE lpDevice, LPDWORD lpdwCounter, LPBUTTON pButton, in
 // *apDirectInputDevices is an array of only 2 devices; sys keyboard, sys mouse
 DWORD ScanDevices( LPDWORD lpdwCounter, LPBUTTON pButton )
 {
+	// the scanners write into the same device state GetDeviceDatas fills, so keep the pollers out
+	EnterCriticalSection( &g_devCritical );
+
 	// Do ALL our polling first-- this ensures consistency (i.e. every device always gets polled at same interval)
 /*	if( g_sysKeyboard.didHandle )
 	{
@@ -3793,6 +3948,7 @@ DWORD ScanDevices( LPDWORD lpdwCounter, LPBUTTON pButton )
 			}
 		}
 
+	LeaveCriticalSection( &g_devCritical );
 	return dwReturn;
 }
 
@@ -3876,10 +4032,13 @@ void SetModifier( LPCONTROLLER pcController )
 // Copies over the existing g_pcControllers' idea of configuration over to the interface.
 void GetCurrentConfiguration()
 {
-	EnterCriticalSection( &g_critical );
+	EnterConfigLock();
 
 	g_ivConfig->Language = g_strEmuInfo.Language;
 	g_ivConfig->fDisplayShortPop = g_strEmuInfo.fDisplayShortPop;
+	g_ivConfig->dwWritebackDelay = g_strEmuInfo.dwWritebackDelay;
+	g_ivConfig->dwWritebackMaxAge = g_strEmuInfo.dwWritebackMaxAge;
+	g_ivConfig->fRepairMemPaks = g_strEmuInfo.fRepairMemPaks;
 
 	LPCONTROLLER pcController;
 	for( int i = 0; i < 4; i++ )
@@ -3897,6 +4056,7 @@ void GetCurrentConfiguration()
 			pcController->pModifiers = NULL;
 
 		pcController->pPakData = NULL;
+		pcController->pPakHandlers = NULL;
 
 		for( int iDevice = 0; iDevice < ARRAYSIZE(g_devList) && g_devList[iDevice].dwDevType; ++iDevice )
 		{
@@ -3909,7 +4069,7 @@ void GetCurrentConfiguration()
 		}
 	}
 
-	LeaveCriticalSection( &g_critical );
+	LeaveConfigLock();
 	return;
 }
 
@@ -3917,7 +4077,7 @@ void GetCurrentConfiguration()
 void UpdateControllerStructures()
 {
 	// bDebug = g_ivConfig->bAutoConfig;
-	EnterCriticalSection( &g_critical );
+	EnterConfigLock();
 
 	g_iFirstController = -1;
 
@@ -3936,6 +4096,9 @@ void UpdateControllerStructures()
 #endif // #ifdef _UNICODE
 
 	g_strEmuInfo.fDisplayShortPop = g_ivConfig->fDisplayShortPop;
+	g_strEmuInfo.dwWritebackDelay = g_ivConfig->dwWritebackDelay;
+	g_strEmuInfo.dwWritebackMaxAge = g_ivConfig->dwWritebackMaxAge;
+	g_strEmuInfo.fRepairMemPaks = g_ivConfig->fRepairMemPaks;
 
 	LPCONTROLLER pcController;
 	for( int i = 3; i >= 0; i-- )
@@ -3949,6 +4112,7 @@ void UpdateControllerStructures()
 
 		CopyMemory( &g_pcControllers[i], pcController, sizeof(CONTROLLER));
 		g_pcControllers[i].pPakData = NULL;
+		g_pcControllers[i].pPakHandlers = NULL;
 		g_pcControllers[i].pModifiers = NULL;
 
 		if( g_pcControllers[i].nModifiers > 0 )
@@ -3971,12 +4135,13 @@ void UpdateControllerStructures()
 
 
 		g_pcControllers[i].fPakCRCError = 0;
+		g_pcControllers[i].fPakSwapped = 0;
 		g_pcControllers[i].fPakInitialized = 0;
 
 		if (g_pcControllers[i].fPlugged)
 			g_iFirstController = i;
 	}
-	LeaveCriticalSection( &g_critical );
+	LeaveConfigLock();
 	return;
 }
 
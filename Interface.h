@@ -27,6 +27,8 @@
 BOOL CALLBACK MainDlgProc( HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam );
 void SetModifier( CONTROLLER *pcController );
 void SetControllerDefaults( CONTROLLER *pcController );
+WORD ShowMemPakContent( LPCBYTE bMemPakBinary, HWND hListWindow );
+WORD ShowMemPakModel( LPMEMPAKMODEL pModel, HWND hListWindow );
 
  // application internal message
 #define WM_USER_UPDATE		WM_USER + 1
@@ -74,6 +76,9 @@ typedef struct _INTERFACEVALUES
 	SHORTCUTS Shortcuts;
 	LANGID Language;
 	bool fDisplayShortPop;
+	DWORD dwWritebackDelay;
+	DWORD dwWritebackMaxAge;
+	bool fRepairMemPaks;
 } INTERFACEVALUES, *LPINTERFACEVALUES;
 
 #define TAB_CONTROLLER1		0
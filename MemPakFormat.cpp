@@ -0,0 +1,538 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PakStore.h"
+#include "MemPakFormat.h"
+
+static const char g_szDexHeader[] = "123-456-STD";	// "OMG-WTF-BBQ"? --rabid
+
+int MemPakFormatFromName( LPCTSTR pszFile )
+{
+	LPCTSTR pcPoint = _tcsrchr( pszFile, _T('.') );
+	if( !pcPoint )
+		return MPF_UNKNOWN;
+	if( !lstrcmpi( pcPoint, _T(".mpk") ))
+		return MPF_RAW;
+	if( !lstrcmpi( pcPoint, _T(".n64") ))
+		return MPF_DEXDRIVE;
+	if( !lstrcmpi( pcPoint, _T(".mpb") ))
+		return MPF_BANKS;
+	if( !lstrcmpi( pcPoint, _T(".mpm") ))
+		return MPF_MANIFEST;
+	if( !lstrcmpi( pcPoint, _T(".a64") ))
+		return MPF_NOTE;
+	return MPF_UNKNOWN;
+}
+
+int DetectMemPakFormat( LPCBYTE pProbe, const DWORD dwProbeSize, const DWORD dwFileSize, LPCTSTR pszFile )
+{
+	const int iNamed = MemPakFormatFromName( pszFile );
+
+	// a manifest only means something together with its store, and a new file is whatever it's called
+	if( iNamed == MPF_MANIFEST || dwFileSize == 0 )
+		return ( iNamed == MPF_UNKNOWN ) ? MPF_RAW : iNamed;
+
+	if( dwProbeSize >= sizeof(g_szDexHeader) - 1 && !memcmp( pProbe, g_szDexHeader, sizeof(g_szDexHeader) - 1 ))
+		return MPF_DEXDRIVE;
+	if( dwProbeSize >= 8 && ( !memcmp( pProbe, "a64-note", 8 ) || !memcmp( pProbe, "a64-data", 8 )))
+		return MPF_NOTE;
+
+	switch( iNamed )
+	{
+	case MPF_DEXDRIVE:
+		// no DexDrive header; a bare image that was merely named .n64
+		return ( dwFileSize <= PAK_MEM_SIZE ) ? MPF_RAW : MPF_DEXDRIVE;
+	case MPF_BANKS:
+	case MPF_NOTE:
+		return iNamed;
+	default:
+		// can't tell a raw pak with junk behind it from a bank file by content, so only the name makes a bank file
+		return MPF_RAW;
+	}
+}
+
+int DetectMemPakFileFormat( LPPAKFILE pFile, LPCTSTR pszFile )
+{
+	BYTE aProbe[MPF_PROBE_SIZE];
+
+	PakSeekFile( pFile, 0 );
+	const DWORD dwRead = PakReadFile( pFile, aProbe, sizeof(aProbe) );
+	PakSeekFile( pFile, 0 );
+
+	return DetectMemPakFormat( aProbe, dwRead, PakGetFileSize( pFile ), pszFile );
+}
+
+DWORD MemPakFormatOffset( const int iFormat )
+{
+	return ( iFormat == MPF_DEXDRIVE ) ? PAK_MEM_DEXOFFSET : 0;
+}
+
+int MemPakFormatBanks( const int iFormat, const DWORD dwFileSize )
+{
+	if( iFormat != MPF_BANKS )
+		return 1;
+	if( dwFileSize < PAK_MEM_SIZE )
+		return PAK_MEM_BANKS_DEFAULT;
+	return min( (int)( dwFileSize / ( PAK_MEM_SIZE )), PAK_MEM_BANKS_MAX );
+}
+
+DWORD MemPakFormatSize( const int iFormat, const int nBanks )
+{
+	return MemPakFormatOffset( iFormat ) + nBanks * PAK_MEM_SIZE;
+}
+
+void WriteMemPakFormatHeader( const int iFormat, LPBYTE pHeader )
+{
+	if( iFormat == MPF_DEXDRIVE )
+	{
+		ZeroMemory( pHeader, PAK_MEM_DEXOFFSET );
+		CopyMemory( pHeader, g_szDexHeader, sizeof(g_szDexHeader) );
+	}
+}
+
+bool ConvertMemPakFile( LPCTSTR pszFrom, LPCTSTR pszTo )
+{
+	int iTo = MemPakFormatFromName( pszTo );
+	if( iTo == MPF_UNKNOWN )
+		iTo = MPF_RAW;
+	if( iTo == MPF_NOTE || !lstrcmpi( pszFrom, pszTo ))
+		return false;
+
+	int iFrom = MPF_MANIFEST;
+	DWORD dwImageBytes = PAK_MEM_SIZE;		// what the source holds from its first image on
+	LPBYTE pFromView = NULL;
+	LPPAKMAPPING pFromMapping = NULL;
+
+	if( !IsPakManifest( pszFrom ))
+	{
+		LPPAKFILE pFrom = PakOpenFile( pszFrom, PAK_FILE_READ );
+		if( pFrom == NULL )
+			return false;
+		iFrom = DetectMemPakFileFormat( pFrom, pszFrom );
+		const DWORD dwFromSize = PakGetFileSize( pFrom );
+		if( iFrom != MPF_NOTE && dwFromSize > MemPakFormatOffset( iFrom ))
+			pFromView = PakMapFile( pFrom, 0, true, &pFromMapping );
+		PakCloseFile( pFrom );
+		if( !pFromView )
+		{
+			DebugWrite( _T("ConvertMemPakFile: %s is not a Memory Pak\n"), pszFrom );
+			return false;
+		}
+		dwImageBytes = dwFromSize - MemPakFormatOffset( iFrom );
+	}
+
+	// a single pak can't hold the other banks, and silently dropping them loses saves
+	if( iFrom == MPF_BANKS && iTo != MPF_BANKS && dwImageBytes > PAK_MEM_SIZE )
+	{
+		DebugWrite( _T("ConvertMemPakFile: %s holds more than one bank, refusing to convert it to %s\n"), pszFrom, pszTo );
+		PakUnmapFile( pFromView, pFromMapping );
+		return false;
+	}
+
+	const int nBanks = ( iTo == MPF_BANKS ) ? MemPakFormatBanks( iFrom, dwImageBytes ) : 1;
+	LPCBYTE pFromImage = pFromView ? pFromView + MemPakFormatOffset( iFrom ) : NULL;
+	bool bReturn = false;
+
+	if( iTo == MPF_MANIFEST )
+	{
+		// the store hashes straight out of the source view, unless there is no complete image to hash
+		LPBYTE aImage = NULL;
+		if( !pFromImage || dwImageBytes < PAK_MEM_SIZE )
+		{
+			aImage = (LPBYTE)P_malloc( PAK_MEM_SIZE );
+			if( aImage )
+			{
+				FillMemory( aImage, PAK_MEM_SIZE, 0xFF );
+				if( pFromImage )
+					CopyMemory( aImage, pFromImage, dwImageBytes );
+				else
+				{
+					LPPAKSTORE pFromStore = OpenPakStore( pszFrom, aImage, false );
+					if( pFromStore )
+						ClosePakStore( pFromStore );
+					else
+					{
+						P_free( aImage );
+						aImage = NULL;
+					}
+				}
+			}
+		}
+
+		LPCBYTE aSource = aImage ? aImage : pFromImage;
+		LPPAKSTORE pStore = aSource ? OpenPakStore( pszTo, NULL, true ) : NULL;
+		if( pStore )
+		{
+			WritePakStore( pStore, aSource, 0xFFFFFFFF, NULL );
+			bReturn = PakFileExists( pszTo );
+			ClosePakStore( pStore );
+		}
+		if( aImage )
+			P_free( aImage );
+	}
+	else
+	{
+		// created empty first, so a stale larger target doesn't keep its tail
+		LPPAKFILE pTo = PakOpenFile( pszTo, PAK_FILE_CREATE );
+		if( pTo )
+			PakCloseFile( pTo );
+		pTo = pTo ? PakOpenFile( pszTo, PAK_FILE_EXISTING ) : NULL;
+		if( pTo )
+		{
+			const DWORD dwToSize = MemPakFormatSize( iTo, nBanks );
+			LPPAKMAPPING pToMapping = NULL;
+			LPBYTE pToView = PakMapFile( pTo, dwToSize, false, &pToMapping );
+			PakCloseFile( pTo );
+
+			if( pToView )
+			{
+				WriteMemPakFormatHeader( iTo, pToView );
+				LPBYTE pToImage = pToView + MemPakFormatOffset( iTo );
+				if( pFromImage )
+				{
+					// one copy, view to view; a short source reads as unused (0xFF) space like it does when mounted
+					const DWORD dwCopy = min( dwImageBytes, nBanks * PAK_MEM_SIZE );
+					CopyMemory( pToImage, pFromImage, dwCopy );
+					FillMemory( pToImage + dwCopy, nBanks * PAK_MEM_SIZE - dwCopy, 0xFF );
+					bReturn = true;
+				}
+				else
+				{
+					// assembled from the store right into the target
+					LPPAKSTORE pFromStore = OpenPakStore( pszFrom, pToImage, false );
+					bReturn = ( pFromStore != NULL );
+					ClosePakStore( pFromStore );
+				}
+				PakFlushFile( pToView, dwToSize );
+				PakUnmapFile( pToView, pToMapping );
+			}
+			if( !bReturn )
+				PakDeleteFile( pszTo );
+		}
+	}
+
+	if( pFromView )
+		PakUnmapFile( pFromView, pFromMapping );
+
+	DebugWrite( _T("ConvertMemPakFile: %s -> %s %s\n"), pszFrom, pszTo, bReturn ? _T("OK") : _T("FAILED") );
+	return bReturn;
+}
+
+typedef struct _CONVERTJOB
+{
+	LPCTSTR pszDirectory;		// ends in PAK_PATH_SEPARATOR
+	LPCTSTR pszToExt;
+	LPTSTR pszFiles;			// nFiles names of MAX_PATH+1 TCHARs
+	LONG nFiles;
+	LONG iNext;					// next file to take, shared by the workers
+	LONG nConverted;
+} CONVERTJOB, *LPCONVERTJOB;
+
+static void ConvertMemPakWorker( void *pParam )
+{
+	LPCONVERTJOB pJob = (LPCONVERTJOB)pParam;
+	TCHAR szFrom[MAX_PATH+1], szTo[MAX_PATH+1];
+
+	LONG i;
+	while(( i = PakAtomicIncrement( &pJob->iNext ) - 1 ) < pJob->nFiles )
+	{
+		LPCTSTR pszName = &pJob->pszFiles[i * ( MAX_PATH + 1 )];
+		if( lstrlen( pJob->pszDirectory ) + lstrlen( pszName ) + lstrlen( pJob->pszToExt ) >= MAX_PATH )
+			continue;
+
+		wsprintf( szFrom, _T("%s%s"), pJob->pszDirectory, pszName );
+		lstrcpy( szTo, szFrom );
+		TCHAR *pcPoint = _tcsrchr( szTo, _T('.') );
+		if( pcPoint )
+			*pcPoint = _T('\0');
+		lstrcat( szTo, pJob->pszToExt );
+
+		if( !PakFileExists( szTo ) && ConvertMemPakFile( szFrom, szTo ))
+			PakAtomicIncrement( &pJob->nConverted );
+	}
+}
+
+// collects the names first, so the workers never share a directory search
+static bool AddConvertFile( const TCHAR *pszName, void *pParam )
+{
+	LPCONVERTJOB pJob = (LPCONVERTJOB)pParam;
+	if( !( pJob->nFiles & 63 ))
+	{
+		LPTSTR pszGrown = (LPTSTR)P_realloc( pJob->pszFiles, ( pJob->nFiles + 64 ) * ( MAX_PATH + 1 ) * sizeof(TCHAR) );
+		if( !pszGrown )
+			return false;
+		pJob->pszFiles = pszGrown;
+	}
+	lstrcpyn( &pJob->pszFiles[pJob->nFiles * ( MAX_PATH + 1 )], pszName, MAX_PATH + 1 );
+	pJob->nFiles++;
+	return true;
+}
+
+EXPORT int CALL ConvertMemPakFiles( LPCTSTR pszDirectory, LPCTSTR pszFromExt, LPCTSTR pszToExt )
+{
+	TCHAR szDirectory[MAX_PATH+1];
+	if( !pszDirectory || !pszFromExt || !pszToExt || lstrlen( pszDirectory ) + lstrlen( pszFromExt ) + 3 > MAX_PATH )
+		return 0;
+
+	lstrcpy( szDirectory, pszDirectory );
+	const int nLength = lstrlen( szDirectory );
+	if( nLength && szDirectory[nLength - 1] != PAK_PATH_SEPARATOR )
+	{
+		szDirectory[nLength] = PAK_PATH_SEPARATOR;
+		szDirectory[nLength + 1] = _T('\0');
+	}
+
+	CONVERTJOB Job;
+	Job.pszDirectory = szDirectory;
+	Job.pszToExt = pszToExt;
+	Job.pszFiles = NULL;
+	Job.nFiles = 0;
+	Job.iNext = 0;
+	Job.nConverted = 0;
+
+	PakFindFiles( szDirectory, pszFromExt, AddConvertFile, &Job );
+
+	if( Job.nFiles )
+	{
+		int nThreads = PakRunWorkers( Job.nFiles, ConvertMemPakWorker, &Job );
+		DebugWriteA("ConvertMemPakFiles: %d of %d files converted on %d threads\n", Job.nConverted, Job.nFiles, nThreads );
+	}
+
+	if( Job.pszFiles )
+		P_free( Job.pszFiles );
+	return Job.nConverted;
+}
+
+bool CheckMemPakFile( LPCTSTR pszFile, const bool fRepair, LPMEMPAKFILECHECK pCheck )
+{
+	ZeroMemory( pCheck, sizeof(MEMPAKFILECHECK) );
+
+	if( IsPakManifest( pszFile ))
+	{
+		BYTE aImage[PAK_MEM_SIZE];
+		LPPAKSTORE pStore = OpenPakStore( pszFile, aImage, false );
+		if( !pStore )
+			return false;
+		ClosePakStore( pStore );
+		pCheck->iFormat = MPF_MANIFEST;
+		pCheck->nBanks = 1;
+		pCheck->aLeft[0] = ValidateMemPak( aImage, &pCheck->aBanks[0] );
+		return true;
+	}
+
+	LPPAKFILE pFile = PakOpenFile( pszFile, fRepair ? PAK_FILE_EXISTING : PAK_FILE_READ );
+	if( pFile == NULL )
+		return false;
+	pCheck->iFormat = DetectMemPakFileFormat( pFile, pszFile );
+	const DWORD dwFileSize = PakGetFileSize( pFile );
+	const DWORD dwOffset = MemPakFormatOffset( pCheck->iFormat );
+	if( pCheck->iFormat == MPF_NOTE || dwFileSize == 0xFFFFFFFF )
+	{
+		PakCloseFile( pFile );
+		return false;
+	}
+
+	const DWORD dwImageBytes = ( dwFileSize > dwOffset ) ? dwFileSize - dwOffset : 0;
+	if( pCheck->iFormat == MPF_BANKS )
+	{
+		pCheck->nBanks = min( (int)( dwImageBytes / PAK_MEM_SIZE ), PAK_MEM_BANKS_MAX );
+		pCheck->fShort = ( dwImageBytes % PAK_MEM_SIZE ) != 0 && pCheck->nBanks < PAK_MEM_BANKS_MAX;
+	}
+	else
+	{
+		pCheck->nBanks = ( dwImageBytes >= PAK_MEM_SIZE ) ? 1 : 0;
+		pCheck->fShort = !pCheck->nBanks;
+	}
+
+	LPPAKMAPPING pMapping = NULL;
+	LPBYTE pView = pCheck->nBanks ? PakMapFile( pFile, MemPakFormatSize( pCheck->iFormat, pCheck->nBanks ), !fRepair, &pMapping ) : NULL;
+	PakCloseFile( pFile );
+	if( pCheck->nBanks && !pView )
+		return false;
+
+	for( int i = 0; i < pCheck->nBanks; i++ )
+	{
+		LPBYTE aImage = pView + dwOffset + i * PAK_MEM_SIZE;
+		const DWORD dwErrors = ValidateMemPak( aImage, &pCheck->aBanks[i] );
+		pCheck->aLeft[i] = dwErrors;
+		if( !fRepair || !( dwErrors & MPERR_DAMAGED ))
+			continue;
+
+		// like RepairMemPakBanks: a copy first, and only if that leaves a usable pak
+		BYTE aHeader[0x500];
+		MEMPAKCHECK Check = pCheck->aBanks[i];
+		CopyMemory( aHeader, aImage, sizeof(aHeader) );
+		pCheck->aLeft[i] = RepairMemPak( aHeader, &Check );
+		if( !( pCheck->aLeft[i] & MPERR_DAMAGED ))
+		{
+			CopyMemory( aImage, aHeader, 0x300 );
+			PakFlushFile( aImage, 0x300 );
+			pCheck->aRepaired[i] = true;
+		}
+	}
+
+	if( pView )
+		PakUnmapFile( pView, pMapping );
+	return true;
+}
+
+typedef struct _CHECKJOB
+{
+	TCHAR szDirectory[MAX_PATH+1];	// ends in PAK_PATH_SEPARATOR
+	TCHAR szSubdir[MAX_PATH+1];		// below szDirectory, while collecting; empty or ends in PAK_PATH_SEPARATOR
+	bool fRecurse;
+	bool fRepair;
+	LPTSTR pszFiles;			// nFiles paths of MAX_PATH+1 TCHARs, below szDirectory
+	LONG nFiles;
+	LONG nCapacity;
+	LPMEMPAKFILECHECK pChecks;	// one for each file, and whether CheckMemPakFile managed
+	bool *pfChecked;
+	LONG iNext;					// next file to take, shared by the workers
+} CHECKJOB, *LPCHECKJOB;
+
+static bool AddCheckFile( const TCHAR *pszName, void *pParam )
+{
+	LPCHECKJOB pJob = (LPCHECKJOB)pParam;
+	const int iFormat = MemPakFormatFromName( pszName );
+	if( iFormat == MPF_UNKNOWN || iFormat == MPF_NOTE
+		|| lstrlen( pJob->szDirectory ) + lstrlen( pJob->szSubdir ) + lstrlen( pszName ) > MAX_PATH )
+		return true;
+
+	// doubling, since a tree can hold a lot of paks
+	if( pJob->nFiles == pJob->nCapacity )
+	{
+		const LONG nCapacity = pJob->nCapacity ? pJob->nCapacity * 2 : 64;
+		LPTSTR pszGrown = (LPTSTR)P_realloc( pJob->pszFiles, nCapacity * ( MAX_PATH + 1 ) * sizeof(TCHAR) );
+		if( !pszGrown )
+			return false;
+		pJob->pszFiles = pszGrown;
+		pJob->nCapacity = nCapacity;
+	}
+	LPTSTR pszFile = &pJob->pszFiles[pJob->nFiles * ( MAX_PATH + 1 )];
+	lstrcpy( pszFile, pJob->szSubdir );
+	lstrcat( pszFile, pszName );
+	pJob->nFiles++;
+	return true;
+}
+
+static void CollectCheckFiles( LPCHECKJOB pJob );
+
+static bool AddCheckDirectory( const TCHAR *pszName, void *pParam )
+{
+	LPCHECKJOB pJob = (LPCHECKJOB)pParam;
+	const int nSubdir = lstrlen( pJob->szSubdir );
+	// the store's pages aren't paks, and there can be a great many of them
+	if( !lstrcmpi( pszName, _T("pakstore") ) || lstrlen( pJob->szDirectory ) + nSubdir + lstrlen( pszName ) + 1 >= MAX_PATH )
+		return true;
+
+	const TCHAR szSeparator[] = { PAK_PATH_SEPARATOR, _T('\0') };
+	lstrcat( pJob->szSubdir, pszName );
+	lstrcat( pJob->szSubdir, szSeparator );
+	CollectCheckFiles( pJob );
+	pJob->szSubdir[nSubdir] = _T('\0');
+	return true;
+}
+
+// the names of the current directory first, then the ones below it, so the workers never share a directory search
+static void CollectCheckFiles( LPCHECKJOB pJob )
+{
+	TCHAR szDirectory[MAX_PATH+1];
+	lstrcpy( szDirectory, pJob->szDirectory );
+	lstrcat( szDirectory, pJob->szSubdir );
+	PakFindFiles( szDirectory, NULL, AddCheckFile, pJob );
+	if( pJob->fRecurse )
+		PakFindDirectories( szDirectory, AddCheckDirectory, pJob );
+}
+
+static void CheckMemPakWorker( void *pParam )
+{
+	LPCHECKJOB pJob = (LPCHECKJOB)pParam;
+	TCHAR szFile[2 * MAX_PATH + 1];
+
+	LONG i;
+	while(( i = PakAtomicIncrement( &pJob->iNext ) - 1 ) < pJob->nFiles )
+	{
+		lstrcpy( szFile, pJob->szDirectory );
+		lstrcat( szFile, &pJob->pszFiles[i * ( MAX_PATH + 1 )] );
+		pJob->pfChecked[i] = CheckMemPakFile( szFile, pJob->fRepair, &pJob->pChecks[i] );
+	}
+}
+
+int CheckMemPakFiles( LPCTSTR pszDirectory, const bool fRecurse, const bool fRepair, MEMPAKREPORTPROC pfnReport, void *pParam )
+{
+	if( !pszDirectory || lstrlen( pszDirectory ) + 2 > MAX_PATH )
+		return 0;
+
+	LPCHECKJOB pJob = (LPCHECKJOB)P_malloc( sizeof(CHECKJOB) );
+	if( !pJob )
+		return 0;
+	ZeroMemory( pJob, sizeof(CHECKJOB) );
+	lstrcpy( pJob->szDirectory, pszDirectory );
+	const int nLength = lstrlen( pJob->szDirectory );
+	if( nLength && pJob->szDirectory[nLength - 1] != PAK_PATH_SEPARATOR )
+	{
+		pJob->szDirectory[nLength] = PAK_PATH_SEPARATOR;
+		pJob->szDirectory[nLength + 1] = _T('\0');
+	}
+	pJob->fRecurse = fRecurse;
+	pJob->fRepair = fRepair;
+
+	CollectCheckFiles( pJob );
+
+	int nFiles = pJob->nFiles;
+	if( nFiles )
+	{
+		pJob->pChecks = (LPMEMPAKFILECHECK)P_malloc( nFiles * sizeof(MEMPAKFILECHECK) );
+		pJob->pfChecked = (bool*)P_malloc( nFiles * sizeof(bool) );
+	}
+	if( pJob->pChecks && pJob->pfChecked )
+	{
+		int nThreads = PakRunWorkers( nFiles, CheckMemPakWorker, pJob );
+		DebugWriteA("CheckMemPakFiles: %d files checked on %d threads\n", nFiles, nThreads );
+
+		TCHAR szFile[2 * MAX_PATH + 1];
+		for( int i = 0; i < nFiles && pfnReport; i++ )
+		{
+			lstrcpy( szFile, pJob->szDirectory );
+			lstrcat( szFile, &pJob->pszFiles[i * ( MAX_PATH + 1 )] );
+			pfnReport( szFile, pJob->pfChecked[i] ? &pJob->pChecks[i] : NULL, pParam );
+		}
+	}
+	else
+		nFiles = 0;
+
+	if( pJob->pChecks )
+		P_free( pJob->pChecks );
+	if( pJob->pfChecked )
+		P_free( pJob->pfChecked );
+	if( pJob->pszFiles )
+		P_free( pJob->pszFiles );
+	P_free( pJob );
+	return nFiles;
+}
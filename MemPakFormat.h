@@ -0,0 +1,88 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MEMPAKFORMAT_H_
+#define _MEMPAKFORMAT_H_
+
+// Memory Pak file formats.  Everything that needs to know where the pak image sits in a file asks here,
+// and files are recognized by their content first and their extension second.
+
+#define MPF_UNKNOWN		0
+#define MPF_RAW			1	// .mpk: the bare 32 KB image; also what an unknown file is taken for
+#define MPF_DEXDRIVE	2	// .n64: PAK_MEM_DEXOFFSET bytes of DexDrive header, then the image
+#define MPF_BANKS		3	// .mpb: up to PAK_MEM_BANKS_MAX images back to back, see SwitchMemPakBank
+#define MPF_MANIFEST	4	// .mpm: page list of a content-addressed store, see PakStore.h
+#define MPF_NOTE		5	// .a64: a single note as text, not a whole pak
+
+	// bytes from the start of a file that DetectMemPakFormat looks at
+#define MPF_PROBE_SIZE	16
+
+// by extension only; MPF_UNKNOWN if it isn't one of ours
+int MemPakFormatFromName( LPCTSTR pszFile );
+// By content where it's conclusive, otherwise by name.  pProbe holds the first dwProbeSize bytes of the file.
+// An empty (new) file goes by its name; a file nothing matches is MPF_RAW.
+int DetectMemPakFormat( LPCBYTE pProbe, const DWORD dwProbeSize, const DWORD dwFileSize, LPCTSTR pszFile );
+// The same for an open file; the file pointer is left at the start.
+int DetectMemPakFileFormat( struct _PAKFILE *pFile, LPCTSTR pszFile );
+
+// where the (first) image starts in a file of this format
+DWORD MemPakFormatOffset( const int iFormat );
+// images a file of dwFileSize bytes holds; a new bank file gets PAK_MEM_BANKS_DEFAULT
+int MemPakFormatBanks( const int iFormat, const DWORD dwFileSize );
+// size of a complete file of this format
+DWORD MemPakFormatSize( const int iFormat, const int nBanks );
+// fills in whatever sits in front of the image (MemPakFormatOffset bytes)
+void WriteMemPakFormatHeader( const int iFormat, LPBYTE pHeader );
+
+// Converts one whole pak file into another format, picked by pszTo's extension.  Both files are mapped and
+// the image goes straight from one view to the other; a manifest is assembled right into the target view.
+// A bank file holding more than one bank is refused as the source of a single pak.
+bool ConvertMemPakFile( LPCTSTR pszFrom, LPCTSTR pszTo );
+// Converts every *pszFromExt file in pszDirectory to pszToExt next to it, one worker thread per processor.
+// Existing targets are left alone.  Returns the number of files converted.
+EXPORT int CALL ConvertMemPakFiles( LPCTSTR pszDirectory, LPCTSTR pszFromExt, LPCTSTR pszToExt );
+
+// What CheckMemPakFile found in one file.
+typedef struct _MEMPAKFILECHECK
+{
+	int iFormat;							// what the file was recognized as
+	int nBanks;								// complete images in the file; only those are checked
+	bool fShort;							// the file ends partway into an image
+	MEMPAKCHECK aBanks[PAK_MEM_BANKS_MAX];	// ValidateMemPak's findings for each image
+	DWORD aLeft[PAK_MEM_BANKS_MAX];			// MPERR_ bits left after a repair; what was found if there was none
+	bool aRepaired[PAK_MEM_BANKS_MAX];		// the image was repaired and written back
+} MEMPAKFILECHECK, *LPMEMPAKFILECHECK;
+
+// Checks every image of a pak file through a read-only mapping; a manifest is assembled from its store.  With
+// fRepair the file is mapped for writing instead, and images RepairMemPak leaves usable are written back
+// (manifests are only checked).  Returns false if the file isn't a Memory Pak or can't be read.
+bool CheckMemPakFile( LPCTSTR pszFile, const bool fRepair, LPMEMPAKFILECHECK pCheck );
+// Called by CheckMemPakFiles for every file it looked at, in the order they were found; pCheck is NULL if
+// CheckMemPakFile failed on it.
+typedef void (*MEMPAKREPORTPROC)( LPCTSTR pszFile, const MEMPAKFILECHECK *pCheck, void *pParam );
+// Runs CheckMemPakFile on every .mpk, .n64, .mpb and .mpm file in pszDirectory and, with fRecurse, the
+// directories below it (not the stores), one worker thread per processor.  The results go to pfnReport on
+// the calling thread once all are in.  Returns the number of files found.
+int CheckMemPakFiles( LPCTSTR pszDirectory, const bool fRecurse, const bool fRepair, MEMPAKREPORTPROC pfnReport, void *pParam );
+
+#endif // #ifndef _MEMPAKFORMAT_H_
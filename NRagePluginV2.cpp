@@ -29,8 +29,15 @@
 #include "Interface.h"
 #include "FileAccess.h"
 #include "PakIO.h"
+#include "PakPlatform.h"
+#include "ControllerPak.h"
+#include "GBRomCache.h"
+#include "GBRomIndex.h"
+#include "PakSnapshot.h"
+#include "PakStore.h"
 #include "DirectInput.h"
 #include "International.h"
+#include "SITrace.h"
 
 // ProtoTypes //
 bool prepareHeap();
@@ -53,7 +60,11 @@ EMULATOR_INFO g_strEmuInfo;			// emulator info?  Stores stuff like our hWnd hand
 TCHAR g_aszDefFolders[3][MAX_PATH];	// default folders: DIRECTORY_MEMPAK, DIRECTORY_GBROMS, DIRECTORY_GBSAVES
 TCHAR g_aszLastBrowse[6][MAX_PATH];	// last browsed folders: BF_MEMPAK, BF_GBROM, BF_GBSAVE, BF_PROFILE, BF_NOTE, BF_SHORTCUTS
 
-CRITICAL_SECTION g_critical;		// our critical section semaphore
+CRITICAL_SECTION g_critical;		// configuration lock: device list, sysmouse, shortcuts and swapping controller configs
+CRITICAL_SECTION g_ctrlCritical[4];	// one lock per controller, guards g_pcControllers[i] and its pak
+CRITICAL_SECTION g_devCritical;		// device state lock: polled state of g_devList and g_sysMouse, and sysmouse acquisition
+									// Lock order: g_critical first, then controller locks in ascending order, then g_devCritical.
+									// Holding any controller lock keeps configuration swaps out, since those take all of them.
 int g_iFirstController = -1;		// The first controller which is plugged in
 									// Normally controllers are scanned all at once in sequence, 1-4.  We only want to scan devices once per pass;
 									// this is so we get consistent sample rates on our mouse.
@@ -62,6 +73,7 @@ bool g_bRunning = false;			// Is the emulator running (i.e. have we opened a ROM
 bool g_bConfiguring = false;		// Are we currently in a config menu?
 bool g_bExclusiveMouse = true;		// Do we have an exclusive mouse lock? defaults to true unless we have no bound mouse buttons/axes
 CONTROLLER g_pcControllers[4];		// Our four N64 controllers, connected or otherwise
+CONTROLLERSTATS g_ctrlStats[4];		// runtime counters for each controller, reset on RomOpen
 SHORTCUTS g_scShortcuts;
 LPDIRECTINPUTDEVICE8 g_apFFDevice[4] = { NULL, NULL, NULL, NULL };					// added by rabid
 LPDIRECTINPUTEFFECT  g_apdiEffect[4] = { NULL, NULL, NULL, NULL };					// array of handles for FF-Effects, one for each controller
@@ -83,6 +95,9 @@ BOOL APIENTRY DllMain( HINSTANCE hModule, DWORD  ul_reason_for_call, LPVOID lpRe
 		ZeroMemory( g_aszLastBrowse, sizeof(g_aszLastBrowse) );
 		g_strEmuInfo.hinst = hModule;
 		g_strEmuInfo.fDisplayShortPop = true;	// display pak switching message windows by default
+		g_strEmuInfo.dwWritebackDelay = PAK_WRITEBACK_DELAY;
+		g_strEmuInfo.dwWritebackMaxAge = PAK_WRITEBACK_MAXAGE;
+		g_strEmuInfo.fRepairMemPaks = false;	// mounting never writes to a save unless asked to
 #ifdef _UNICODE
 		{
 			g_strEmuInfo.Language = GetLanguageFromINI();
@@ -105,6 +120,20 @@ BOOL APIENTRY DllMain( HINSTANCE hModule, DWORD  ul_reason_for_call, LPVOID lpRe
 		g_hResourceDLL = hModule;
 #endif // #ifndef _UNICODE
 		InitializeCriticalSection( &g_critical );
+		for( int i = 0; i < ARRAYSIZE(g_ctrlCritical); ++i )
+			InitializeCriticalSection( &g_ctrlCritical[i] );
+		InitializeCriticalSection( &g_devCritical );
+		InitPakCRCTables();
+		InitPakWriteback();
+		InitSITrace();
+		InitGBRomCache();
+		InitPakSnapshots();
+		InitPakStore();
+		{
+			TCHAR szRomIndexFile[MAX_PATH+1];
+			GetAbsoluteFileName( szRomIndexFile, GBROMINDEX_FILENAME, DIRECTORY_APPLICATION );
+			InitGBRomIndex( szRomIndexFile );
+		}
 		break;
 
 	case DLL_THREAD_ATTACH:
@@ -120,7 +149,16 @@ BOOL APIENTRY DllMain( HINSTANCE hModule, DWORD  ul_reason_for_call, LPVOID lpRe
 
 		DebugWriteA("*** DLL Detach\n");
 
+		FreeSITrace();
+		FreeGBRomCache();
+		FreePakSnapshots();
+		FreePakStore();
+		FreeGBRomIndex();
+		FreePakWriteback();
 		CloseDebugFile(); // Moved here from CloseDll
+		DeleteCriticalSection( &g_devCritical );
+		for( int i = 0; i < ARRAYSIZE(g_ctrlCritical); ++i )
+			DeleteCriticalSection( &g_ctrlCritical[i] );
 		DeleteCriticalSection( &g_critical );
 
 		// Moved here from CloseDll... Heap is created from DllMain,
@@ -209,10 +247,10 @@ EXPORT void CALL DllConfig ( HWND hParent )
 	{
 		if( InitDirectInput( hParent ))
 		{
-			EnterCriticalSection ( &g_critical );
+			EnterConfigLock();
 			InitMouse();
 			g_pDIHandle->EnumDevices( DI8DEVCLASS_ALL, EnumMakeDeviceList, NULL, DIEDFL_ATTACHEDONLY );
-			LeaveCriticalSection ( &g_critical );
+			LeaveConfigLock();
 			DebugWriteA("InitDirectInput run in DllConfig, g_nDevices=%d\n", g_nDevices);
 		}
 	}
@@ -227,12 +265,12 @@ EXPORT void CALL DllConfig ( HWND hParent )
 			InitCommonControlsEx( &ccCtrls ); // needed for TrackBars & Tabs
 		}
 		
-		EnterCriticalSection( &g_critical );
+		EnterConfigLock();
 		if( g_sysMouse.didHandle ) { // unlock mouse while configuring
 			g_sysMouse.didHandle->SetCooperativeLevel( g_strEmuInfo.hMainWindow, DIB_DEVICE );
 			g_sysMouse.didHandle->Acquire();
 		}
-		LeaveCriticalSection( &g_critical );
+		LeaveConfigLock();
 
 		int iOK = DialogBox( g_hResourceDLL, MAKEINTRESOURCE( IDD_MAINCFGDIALOG ), hParent, MainDlgProc );
 
@@ -240,7 +278,7 @@ EXPORT void CALL DllConfig ( HWND hParent )
 		// So let's reinit them now if we're running, just to be safe --rabid
 		if( g_bRunning )
 		{
-			EnterCriticalSection( &g_critical );
+			EnterConfigLock();
 			// PrepareInputDevices resets g_bExclusiveMouse to false if no mouse keys are bound, and the only way to
 			// re-enable exclusive mouse is with a shortcut.
 			// This is undesirable behavior, but it beats the alternative (and we REALLY need to re-init FF devices here)
@@ -267,7 +305,7 @@ EXPORT void CALL DllConfig ( HWND hParent )
 					g_sysMouse.didHandle->Acquire();
 				}
 			}
-			LeaveCriticalSection( &g_critical );
+			LeaveConfigLock();
 		}
 
 		g_bConfiguring = false;
@@ -338,10 +376,10 @@ EXPORT void CALL InitiateControllers (CONTROL_INFO ControlInfo)
 	{
 		if( InitDirectInput( g_strEmuInfo.hMainWindow ))
 		{
-			EnterCriticalSection ( &g_critical );
+			EnterConfigLock();
 			InitMouse();
 			g_pDIHandle->EnumDevices( DI8DEVCLASS_ALL, EnumMakeDeviceList, NULL, DIEDFL_ATTACHEDONLY );
-			LeaveCriticalSection ( &g_critical );
+			LeaveConfigLock();
 			DebugWriteA("InitDirectInput run in InitiateControllers, g_nDevices=%d\n", g_nDevices);
 		}
 		else
@@ -350,7 +388,7 @@ EXPORT void CALL InitiateControllers (CONTROL_INFO ControlInfo)
 
 	int iDevice;
 
-	EnterCriticalSection( &g_critical );
+	EnterConfigLock();
 
 	// ZeroMemory( g_apFFDevice, sizeof(g_apFFDevice) ); // NO, we'll reinit the existing reference if it's already loaded
 	// ZeroMemory( g_apdiEffect, sizeof(g_apdiEffect) ); // NO, we'll release it with CloseControllerPak
@@ -431,7 +469,7 @@ EXPORT void CALL InitiateControllers (CONTROL_INFO ControlInfo)
 
 	g_strEmuInfo.fInitialisedPlugin = true;
 
-	LeaveCriticalSection( &g_critical );
+	LeaveConfigLock();
 
 #if SPECS_VERSION == 0x0100
 	FillControls(Controls);
@@ -461,11 +499,14 @@ EXPORT void CALL RomOpen (void)
 		return;
 	}
 	
-	EnterCriticalSection( &g_critical );
+	EnterConfigLock();
+	ZeroMemory( g_ctrlStats, sizeof(g_ctrlStats) );
 	// re-init our paks and shortcuts
 	InitiatePaks( true );
 	// LoadShortcuts( &g_scShortcuts ); WHY are we loading shortcuts again?? Should already be loaded!
-	LeaveCriticalSection( &g_critical );
+	LeaveConfigLock();
+	OpenSITrace();
+	PakStartWriteback();
 	g_bRunning = true;
 	return;
 }
@@ -483,13 +524,22 @@ EXPORT void CALL RomClosed(void)
 	XInputEnable( FALSE );	// disables xinput --tecnicors
 
 	DebugWriteA("CALLED: RomClosed\n");
-	EnterCriticalSection( &g_critical );
+	PakStopWriteback();		// SaveControllerPak below flushes whatever is still dirty
+	EnterConfigLock();
 
 	if (g_sysMouse.didHandle)
 		g_sysMouse.didHandle->SetCooperativeLevel(g_strEmuInfo.hMainWindow, DIB_KEYBOARD); // unlock the mouse, just in case
 
 	for( i = 0; i < ARRAYSIZE(g_pcControllers); ++i )
 	{
+		if( g_pcControllers[i].fPlugged )
+		{
+			DWORD dwMemPakReads = g_ctrlStats[i].dwMemPakCRCHits + g_ctrlStats[i].dwMemPakCRCMisses;
+			DebugWriteA("Controller %d stats: %u bad address CRCs, mempak CRC cache %u/%u hits (%u%%), %u contended locks, %u mempak flushes (%u bytes), %u bank swaps (avg %u us, max %u us)\n", i+1, g_ctrlStats[i].dwAddrCRCErrors,
+				g_ctrlStats[i].dwMemPakCRCHits, dwMemPakReads, dwMemPakReads ? (DWORD)( (ULONGLONG)g_ctrlStats[i].dwMemPakCRCHits * 100 / dwMemPakReads ) : 0,
+				g_ctrlStats[i].dwLockContentions, g_ctrlStats[i].dwWritebackFlushes, g_ctrlStats[i].dwWritebackBytes,
+				g_ctrlStats[i].dwBankSwaps, g_ctrlStats[i].dwBankSwaps ? g_ctrlStats[i].dwBankSwapMicros / g_ctrlStats[i].dwBankSwaps : 0, g_ctrlStats[i].dwMaxBankSwapMicros );
+		}
 		if( g_pcControllers[i].pPakData )
 		{
 			SaveControllerPak( i );
@@ -505,7 +555,8 @@ EXPORT void CALL RomClosed(void)
 	ZeroMemory( g_apdiEffect, sizeof(g_apdiEffect) );
 
 	g_bRunning = false;
-	LeaveCriticalSection( &g_critical );
+	LeaveConfigLock();
+	CloseSITrace();
 	
 	return;
 }
@@ -520,16 +571,16 @@ EXPORT void CALL RomClosed(void)
 *******************************************************************/  	
 EXPORT void CALL GetKeys(int Control, BUTTONS * Keys )
 {
-#ifdef ENABLE_RAWPAK_DEBUG
-	DebugWriteA("CALLED: GetKeys\n");
-#endif
+	LogTraceA( LOG_INPUT, "CALLED: GetKeys\n" );
 	if( g_bConfiguring )
 		Keys->Value = 0;
 	else
 	{
-		EnterCriticalSection( &g_critical );
+		EnterControllerLock( Control );
 		
 		if( g_pcControllers[Control].fPlugged ) {
+			// the device state is shared by all controllers, so our own controller lock isn't enough here
+			EnterCriticalSection( &g_devCritical );
 			if (Control == g_iFirstController )
 			{
 				GetDeviceDatas();
@@ -539,8 +590,10 @@ EXPORT void CALL GetKeys(int Control, BUTTONS * Keys )
 				GetXInputControllerKeys( Control, &Keys->Value );
 			else
 				GetNControllerInput( Control, &Keys->Value );
+			LeaveCriticalSection( &g_devCritical );
 		}
-		LeaveCriticalSection( &g_critical );
+		LeaveControllerLock( Control );
+		RunPendingShortcuts();
 	}
 	return;
 }
@@ -581,18 +634,91 @@ EXPORT void CALL ControllerCommand( int Control, BYTE * Command)
 *******************************************************************/
 EXPORT void CALL ReadController( int Control, BYTE * Command )
 {
-#ifdef ENABLE_RAWPAK_DEBUG
-	DebugWriteA("CALLED: ReadController\n");
-#endif
+	LogTraceA( LOG_INPUT, "CALLED: ReadController\n" );
 	if( Control == -1 )
+	{
+		CommitPakJournals();
+		SITraceNextFrame();
 		return;
+	}
 
-	EnterCriticalSection( &g_critical );
+	EnterControllerLock( Control );
+	const BYTE bRecvLength = Command[1];
+	ProcessControllerCommand( Control, Command );
+	SITraceRecord( Control, Command, bRecvLength );
+	LeaveControllerLock( Control );
+	RunPendingShortcuts();
+	return;
+}
+
+/******************************************************************
+  Function: ProcessPIFBlock
+  Purpose:  Processes every controller command in the pif ram in
+            one pass, instead of one ReadController call per channel.
+  input:    - Pointer to the 64 byte pif ram image. Responses are
+              written in place, exactly as ReadController would.
+  output:   none
+  note:     Not part of the plugin specs; meant for emulators and
+            test harnesses that want to hand over the whole block.
+            Channels past the fourth (cartridge EEPROM) are left
+            untouched.
+*******************************************************************/
+EXPORT void CALL ProcessPIFBlock( BYTE * PIFRam )
+{
+	int iChannel = 0;
+	int i = 0;
+
+	// the last byte is the pif status byte, not part of the command list
+	while( i < 0x3F && iChannel < 4 )
+	{
+		const BYTE bSend = PIFRam[i];
+
+		if( bSend == 0xFE )			// end of commands
+			break;
+		if( bSend == 0x00 )			// skip this channel
+		{
+			iChannel++;
+			i++;
+			continue;
+		}
+		if( bSend == 0xFF )			// padding
+		{
+			i++;
+			continue;
+		}
+		if( bSend & 0xC0 )			// not a valid send length; Project64 stops parsing here too
+			break;
+
+		// read the lengths before processing, errors get or'd into the receive byte
+		if( i + 1 >= 0x3F || PIFRam[i+1] == 0xFE )
+			break;
+		const BYTE bRecv = PIFRam[i+1];
+		const int iNext = i + 2 + bSend + ( bRecv & 0x3F );
+		if( iNext > 0x3F )			// malformed block, don't run off the end
+			break;
+
+		EnterControllerLock( iChannel );
+		ProcessControllerCommand( iChannel, &PIFRam[i] );
+		SITraceRecord( iChannel, &PIFRam[i], bRecv );
+		LeaveControllerLock( iChannel );
+
+		i = iNext;
+		iChannel++;
+	}
+
+	RunPendingShortcuts();
+	CommitPakJournals();
+	SITraceNextFrame();
+	return;
+}
 
+// Handles a single raw controller command; the caller must hold the controller's lock.
+// Command points at the send-length byte of the channel, as in ReadController.
+void ProcessControllerCommand( int Control, BYTE * Command )
+{
 	if( !g_pcControllers[Control].fPlugged )
 	{
 		Command[1] |= RD_ERROR;
-		LeaveCriticalSection( &g_critical );
 		return;
 	}
 
@@ -623,6 +749,11 @@ EXPORT void CALL ReadController( int Control, BYTE * Command )
 			else
 			{
 				Command[5] = ( *(BYTE*)g_pcControllers[Control].pPakData != PAK_NONE ) ? RD_PLUGIN : RD_NOPLUGIN;
+				if( g_pcControllers[Control].fPakSwapped )
+				{	// a freshly swapped mempak bank: report the pak as just inserted so the game drops what it cached
+					Command[5] = Command[5] | RD_NOTINITIALIZED;
+					g_pcControllers[Control].fPakSwapped = 0;
+				}
 				if( g_pcControllers[Control].fPakCRCError )
 				{
 					Command[5] = Command[5] | RD_ADDRCRCERR;
@@ -668,6 +799,8 @@ EXPORT void CALL ReadController( int Control, BYTE * Command )
 			Command[3] = Command[4] = Command[5] = Command[6] = 0;
 		else
 		{
+			// see GetKeys; the device state is shared by all controllers
+			EnterCriticalSection( &g_devCritical );
 			if (Control == g_iFirstController )
 			{
 				GetDeviceDatas();
@@ -677,6 +810,7 @@ EXPORT void CALL ReadController( int Control, BYTE * Command )
 				GetXInputControllerKeys( Control, (LPDWORD)&Command[3] );
 			else
 				GetNControllerInput( Control, (DWORD*)&Command[3] );
+			LeaveCriticalSection( &g_devCritical );
 		}
 		break;
 		
@@ -690,7 +824,7 @@ EXPORT void CALL ReadController( int Control, BYTE * Command )
 			ReadControllerPak( Control, &Command[3] );
 		else
 		{
-			DebugWriteA("Tried to read, but pak wasn't initialized!!\n");
+			LogWarnA( LOG_MEMPAK, "Tried to read, but pak wasn't initialized!!\n" );
 			// InitControllerPak( Control );
 			Command[1] |= RD_ERROR;
 			//ZeroMemory( &Command[5], 32 );
@@ -710,7 +844,7 @@ EXPORT void CALL ReadController( int Control, BYTE * Command )
 			WriteControllerPak( Control, &Command[3] );
 		else
 		{
-			DebugWriteA("Tried to write, but pak wasn't initialized! (paktype was %u)\n", g_pcControllers[Control].PakType);
+			LogWarnA( LOG_MEMPAK, "Tried to write, but pak wasn't initialized! (paktype was %u)\n", g_pcControllers[Control].PakType );
 			// InitControllerPak( Control );
 			Command[1] |= RD_ERROR;
 		}
@@ -740,7 +874,6 @@ EXPORT void CALL ReadController( int Control, BYTE * Command )
 		Command[1] = Command[1] | RD_ERROR;
 	}
 
-	LeaveCriticalSection( &g_critical );
 	return;
 }
 
@@ -789,6 +922,8 @@ EXPORT void CALL CloseDLL (void)
 	// ZeroMemory( g_pcControllers, sizeof(g_pcControllers) ); // why zero the memory if we're just going to close down?
 	
 	FreeDirectInput();
+	WaitGBRomIndexRefresh();	// before the DLL can be unloaded
+	StopDebugLog();	// joins the debug log thread and writes out whatever it hadn't gotten to yet
 
 	return;
 }
@@ -808,6 +943,7 @@ void freePakData( CONTROLLER *pcController )
 	{
 		P_free( pcController->pPakData );
 		pcController->pPakData = NULL;
+		pcController->pPakHandlers = NULL;
 	}
 }
 
@@ -862,6 +998,38 @@ int FindDeviceinList( REFGUID rGUID )
 	return -1;
 }
 
+// Take the lock for a single controller.  If someone else already has it, count that as contention before we wait.
+// The counter is only touched while holding the lock, so it doesn't need to be interlocked.
+void EnterControllerLock( int iControl )
+{
+	if( !TryEnterCriticalSection( &g_ctrlCritical[iControl] ))
+	{
+		EnterCriticalSection( &g_ctrlCritical[iControl] );
+		g_ctrlStats[iControl].dwLockContentions++;
+	}
+}
+
+void LeaveControllerLock( int iControl )
+{
+	LeaveCriticalSection( &g_ctrlCritical[iControl] );
+}
+
+// Configuration swaps (InitiateControllers, DllConfig, RomOpen/RomClosed, the config dialog) need every controller
+// to hold still, so they take g_critical and then all four controller locks in order.
+void EnterConfigLock()
+{
+	EnterCriticalSection( &g_critical );
+	for( int i = 0; i < ARRAYSIZE(g_ctrlCritical); ++i )
+		EnterControllerLock( i );
+}
+
+void LeaveConfigLock()
+{
+	for( int i = ARRAYSIZE(g_ctrlCritical) - 1; i >= 0; --i )
+		LeaveControllerLock( i );
+	LeaveCriticalSection( &g_critical );
+}
+
 // Let's initialize all plugged in controllers' paks.
 // Input: false means run InitControlPak on each plugged controller.  Input true means just clear each pak's CRC error status?
 // When we call this from RomOpen, it's true, otherwise (in DllConfig) it's false.
@@ -933,7 +1101,12 @@ void FillControls(CONTROL Controls[4])
 	}
 }
 
-// called after a poll to execute any shortcuts
+// shortcuts seen by CheckShortcuts, one bit per SC_ index; the mouselock shortcut is bit SC_TOTAL of the first slot
+static LONG g_alPendingShortcuts[4];
+
+// called after a poll to queue any shortcuts
+// The caller holds a controller lock, so nothing that takes other controller locks may run here; the shortcuts
+// are queued and run by RunPendingShortcuts once the caller has let go of its lock.
 void CheckShortcuts()
 {
 	static bool bWasPressed[ sizeof(SHORTCUTSPL)/sizeof(BUTTON) ][4];
@@ -951,7 +1124,7 @@ void CheckShortcuts()
 			bMatching = IsBtnPressed( g_scShortcuts.Player[i].aButtons[j] );
 
 			if( bMatching && !bWasPressed[j][i] )
-				DoShortcut(i, j);
+				InterlockedOr( &g_alPendingShortcuts[i], 1 << j );
 
 			bWasPressed[j][i] = bMatching;
 		}
@@ -960,13 +1133,32 @@ void CheckShortcuts()
 	bMatching = IsBtnPressed( g_scShortcuts.bMouseLock );
 
 	if( bMatching && !bMLWasPressed )
-		DoShortcut(-1, -1); // controller -1 means do mouselock shortcut
+		InterlockedOr( &g_alPendingShortcuts[0], 1 << SC_TOTAL );
 
 	bMLWasPressed = bMatching;
 }
 
+// Runs the shortcuts queued by CheckShortcuts.  Must be called without holding any controller lock.
+void RunPendingShortcuts()
+{
+	for( int i = 0; i < 4; i++ )
+	{
+		if( !g_alPendingShortcuts[i] )
+			continue;
+
+		const LONG lPending = InterlockedExchange( &g_alPendingShortcuts[i], 0 );
+		for( int j = 0; j < SC_TOTAL; j++ )
+			if( lPending & ( 1 << j ))
+				DoShortcut(i, j);
+
+		if( lPending & ( 1 << SC_TOTAL ))
+			DoShortcut(-1, -1); // controller -1 means do mouselock shortcut
+	}
+}
+
 // Executes the shortcut iShortcut on controller iController
 // Special case: if iPlayer is -1, run the mouselock shortcut
+// Must be called without holding any controller lock; it takes the ones it needs itself.
 void DoShortcut( int iControl, int iShortcut )
 {
 	DebugWriteA("Shortcut: %d %d\n", iControl, iShortcut);
@@ -975,7 +1167,9 @@ void DoShortcut( int iControl, int iShortcut )
 
 	if (iControl == -1)
 	{
+		// g_critical keeps configuration swaps away from g_sysMouse, g_devCritical keeps the pollers off it
 		EnterCriticalSection( &g_critical );
+		EnterCriticalSection( &g_devCritical );
 		if( g_sysMouse.didHandle )
 		{
 			g_sysMouse.didHandle->Unacquire();
@@ -996,10 +1190,28 @@ void DoShortcut( int iControl, int iShortcut )
 			g_sysMouse.didHandle->Acquire();
 			g_bExclusiveMouse = !g_bExclusiveMouse;
 		}
+		LeaveCriticalSection( &g_devCritical );
 		LeaveCriticalSection( &g_critical );
 	}
+	else if( iShortcut == SC_CYCLEBANK )
+	{
+		// the pak stays in; only the bank behind it changes
+		if( g_pcControllers[iControl].fPlugged )
+		{
+			EnterControllerLock( iControl );
+			LPMEMPAK mPak = (LPMEMPAK)g_pcControllers[iControl].pPakData;
+			if( mPak && mPak->bPakType == PAK_MEM && SwitchMemPakBank( iControl, mPak->iBank + 1 ))
+			{
+				TCHAR tszBank[DEFAULT_BUFFER / 2];
+				LoadString( g_hResourceDLL, IDS_P_MEMPAKBANK, tszBank, ARRAYSIZE(tszBank) );
+				wsprintf( pszMessage, tszBank, mPak->iBank + 1, mPak->nBanks );
+			}
+			LeaveControllerLock( iControl );
+		}
+	}
 	else if( g_pcControllers[iControl].fPlugged )
 	{
+		EnterControllerLock( iControl );
 		if( g_pcControllers[iControl].pPakData )
 		{
 			SaveControllerPak( iControl );
@@ -1009,21 +1221,17 @@ void DoShortcut( int iControl, int iShortcut )
 		switch (iShortcut)
 		{
 		case SC_NOPAK:
-			EnterCriticalSection( &g_critical );
 			g_pcControllers[iControl].PakType = PAK_NONE;
 			g_pcControllers[iControl].fPakInitialized = 0;
 			LoadString( g_hResourceDLL, IDS_P_NONE, pszMessage, ARRAYSIZE(pszMessage) );
-			LeaveCriticalSection( &g_critical );
 			break;
 
 		case SC_MEMPAK:
 			if (PAK_NONE == g_pcControllers[iControl].PakType)
 			{
-				EnterCriticalSection( &g_critical );
 				g_pcControllers[iControl].PakType = PAK_MEM;
 				g_pcControllers[iControl].fPakInitialized = 0;
 				LoadString( g_hResourceDLL, IDS_P_MEMPAK, pszMessage, ARRAYSIZE(pszMessage) );
-				LeaveCriticalSection( &g_critical );
 			}
 			else
 			{
@@ -1034,7 +1242,6 @@ void DoShortcut( int iControl, int iShortcut )
 		case SC_RUMBPAK:
 			if (PAK_NONE == g_pcControllers[iControl].PakType)
 			{
-				EnterCriticalSection( &g_critical );
 				g_pcControllers[iControl].PakType = PAK_RUMBLE;
 				g_pcControllers[iControl].fPakInitialized = 0;
 
@@ -1049,7 +1256,6 @@ void DoShortcut( int iControl, int iShortcut )
 					}
 
 				LoadString( g_hResourceDLL, IDS_P_RUMBLEPAK, pszMessage, ARRAYSIZE(pszMessage) );
-				LeaveCriticalSection( &g_critical );
 			}
 			else
 			{
@@ -1060,12 +1266,10 @@ void DoShortcut( int iControl, int iShortcut )
 		case SC_TRANSPAK:
 			if (PAK_NONE == g_pcControllers[iControl].PakType)
 			{
-				EnterCriticalSection( &g_critical );
 				g_pcControllers[iControl].PakType = PAK_TRANSFER;
 				g_pcControllers[iControl].fPakInitialized = 0;
 
 				LoadString( g_hResourceDLL, IDS_P_TRANSFERPAK, pszMessage, ARRAYSIZE(pszMessage) );
-				LeaveCriticalSection( &g_critical );
 			}
 			else
 			{
@@ -1076,12 +1280,10 @@ void DoShortcut( int iControl, int iShortcut )
 		case SC_VOICEPAK:
 			if (PAK_NONE == g_pcControllers[iControl].PakType)
 			{
-				EnterCriticalSection( &g_critical );
 				g_pcControllers[iControl].PakType = PAK_VOICE;
 				g_pcControllers[iControl].fPakInitialized = 0;
 
 				LoadString( g_hResourceDLL, IDS_P_VOICEPAK, pszMessage, ARRAYSIZE(pszMessage) );
-				LeaveCriticalSection( &g_critical );
 			}
 			else
 			{
@@ -1092,12 +1294,10 @@ void DoShortcut( int iControl, int iShortcut )
 		case SC_ADAPTPAK:
 			if (PAK_NONE == g_pcControllers[iControl].PakType)
 			{
-				EnterCriticalSection( &g_critical );
 				g_pcControllers[iControl].PakType = PAK_ADAPTOID;
 				g_pcControllers[iControl].fPakInitialized = 0;
 
 				LoadString( g_hResourceDLL, IDS_P_ADAPTOIDPAK, pszMessage, ARRAYSIZE(pszMessage) );
-				LeaveCriticalSection( &g_critical );
 			}
 			else
 			{
@@ -1131,23 +1331,24 @@ void DoShortcut( int iControl, int iShortcut )
 
 		default:
 			DebugWriteA("Invalid iShortcut passed to DoShortcut\n");
-			EnterCriticalSection( &g_critical );
 			g_pcControllers[iControl].fPakInitialized = 0;
-			LeaveCriticalSection( &g_critical );
+			LeaveControllerLock( iControl );
 			return;
 		} // switch (iShortcut)
+
+		if (bEjectFirst)
+		{
+			g_pcControllers[iControl].PakType = PAK_NONE;
+			g_pcControllers[iControl].fPakInitialized = 0;
+			LoadString( g_hResourceDLL, IDS_P_SWITCHING, pszMessage, ARRAYSIZE(pszMessage) );
+		}
+		LeaveControllerLock( iControl );
 	} // else if
 
 	// let the game code re-init the pak.
 
 	if (bEjectFirst)	// we need to eject the current pack first; then set a DoShortcut to try again in 1 second
 	{
-		EnterCriticalSection( &g_critical );
-		g_pcControllers[iControl].PakType = PAK_NONE;
-		g_pcControllers[iControl].fPakInitialized = 0;
-		LoadString( g_hResourceDLL, IDS_P_SWITCHING, pszMessage, ARRAYSIZE(pszMessage) );
-		LeaveCriticalSection( &g_critical );
-
 		LPMSHORTCUT lpmNextShortcut = (LPMSHORTCUT)P_malloc(sizeof(MSHORTCUT));
 		if (!lpmNextShortcut)
 			return;
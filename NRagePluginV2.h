@@ -26,6 +26,7 @@
 
 #include <dinput.h>
 #include "XInputController.h"
+#include "PakIO.h"
 
 /////////////////////////////////////////////////////////////////////////////////
 //General Plugin
@@ -47,16 +48,6 @@
 #define DEFAULT_PAKTYPE			PAK_NONE
 #define DEFAULT_MOUSEMOVE		MM_BUFF
 
-#define PAK_NONE		0
-#define PAK_MEM			1
-#define PAK_RUMBLE		2
-#define PAK_TRANSFER	3
-#define PAK_VOICE		4
-#define PAK_ADAPTOID	7
-
- // just used to display text in GUI
-#define PAK_NONRAW		16
-
 
 
 typedef struct _EMULATOR_INFO
@@ -66,6 +57,9 @@ typedef struct _EMULATOR_INFO
 	HINSTANCE hinst;
 	LANGID Language;
 	bool fDisplayShortPop;	// do we display shortcut message popups?
+	DWORD dwWritebackDelay;		// ms a pak has to go without writes before it's flushed, see PakScheduleWriteback
+	DWORD dwWritebackMaxAge;	// ms a mempak may stay dirty at most, see PakFlushDirty
+	bool fRepairMemPaks;		// repair damaged Memory Paks as they're inserted (off: they're only checked), see RepairMemPakBanks
 
 //	BOOL MemoryBswaped;		// If this is set to TRUE, then the memory has been pre
 							//   bswap on a dword (32 bits) boundry, only effects header. 
@@ -144,6 +138,7 @@ typedef struct _CONTROLLER		// AN N64 CONTROLLER
 
 	unsigned fPakInitialized;	// Has our pak been initialized?  Used to make sure we don't try to write to a mempak that doesn't point to anything.
 	unsigned fPakCRCError;		// The ROM sends CRC data when it tries to write to a mempak.  Is the CRC incorrect?  Usually indicates a bad ROM.
+	unsigned fPakSwapped;		// Set when SwitchMemPakBank or RestorePakSnapshot swaps the mempak; the next status request reports the pak as pulled.
 	unsigned PakType;			// what type of controller pak? mempak? rumble? transfer? etc
 	unsigned fVisualRumble;		// is visual rumble enabled for this controller?
 
@@ -176,10 +171,12 @@ typedef struct _CONTROLLER		// AN N64 CONTROLLER
 
 	void *pPakData;						// Pointer to Pak Data (specific): see PakIO.h
 										// pPakData->bPakType will always be a BYTE indicating what the current pak type is
+	const struct _PAKHANDLERS *pPakHandlers;	// bound by InitControllerPak along with pPakData
 
 	XCONTROLLER xiController;			// To handle an XInput enabled controller	--tecnicors
 } CONTROLLER, *LPCONTROLLER;
 
+
 // This is the Index of WORD PROFILE.Button[X]
   // Buttons:
 #define PF_DPADR	0
@@ -329,10 +326,11 @@ typedef union _MODSPEC_CONFIG
 #define SC_ADAPTPAK		5
 #define SC_SWMEMRUMB	6
 #define SC_SWMEMADAPT	7
+#define SC_CYCLEBANK	8
 
 		// total arraysize of aButtons in SHORTCUTSPL;
 		// make sure you update this if you change the list above
-#define SC_TOTAL		8
+#define SC_TOTAL		9
 
 typedef struct _SHORTCUTSPL
 {
@@ -345,6 +343,7 @@ typedef struct _SHORTCUTSPL
 	//BUTTON AdaptoidPakButton;
 	//BUTTON SwMemRumbleButton;
 	//BUTTON SwMemAdaptoidButton;
+	//BUTTON CycleBankButton;
 } SHORTCUTSPL, *LPSHORTCUTSPL;
 
 typedef struct _SHORTCUTS
@@ -372,10 +371,13 @@ extern int g_nDevices;
 extern DEVICE g_devList[MAX_DEVICES];
 extern DEVICE g_sysMouse;
 extern CONTROLLER g_pcControllers[4];
+extern CONTROLLERSTATS g_ctrlStats[4];
 extern SHORTCUTS g_scShortcuts;
 extern LPDIRECTINPUTDEVICE8 g_apFFDevice[4];
 extern LPDIRECTINPUTEFFECT g_apdiEffect[4];
 extern CRITICAL_SECTION g_critical;
+extern CRITICAL_SECTION g_ctrlCritical[4];
+extern CRITICAL_SECTION g_devCritical;
 
 extern bool g_bRunning;
 extern bool g_bConfiguring;
@@ -383,12 +385,21 @@ extern bool g_bExclusiveMouse;
 
 extern int g_iFirstController;
 
+EXPORT void CALL ProcessPIFBlock( BYTE * PIFRam );
+void ProcessControllerCommand( int Control, BYTE * Command );
+
+void EnterControllerLock( int iControl );
+void LeaveControllerLock( int iControl );
+void EnterConfigLock();
+void LeaveConfigLock();
+
 int WarningMessage( UINT uTextID, UINT uType );
 int FindDeviceinList( const TCHAR *pszProductName, BYTE bProductCounter, bool fFindSimilar );
 int FindDeviceinList( REFGUID rGUID );
 void freePakData( CONTROLLER *pcController );
 void freeModifiers( CONTROLLER *pcController );
 void CheckShortcuts();
+void RunPendingShortcuts();
 bool ErrorMessage( UINT uID, DWORD dwError, bool fUserChoose );
 
 #endif
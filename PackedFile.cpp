@@ -0,0 +1,546 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include <string.h>
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PackedFile.h"
+
+#define GETWORD( p )	((DWORD)(p)[0] | ((DWORD)(p)[1] << 8))
+#define GETDWORD( p )	( GETWORD( p ) | ( GETWORD( (p) + 2 ) << 16 ))
+
+#define INFLATE_FASTBITS	10		// codes up to this long decode with one table lookup
+#define INFLATE_INPUT		0x4000
+
+#define INFLATE_OK			0		// block done
+#define INFLATE_FULL		1		// output buffer full, stop
+#define INFLATE_ERROR		-1
+
+typedef struct _HUFFMAN
+{
+	WORD aFast[1 << INFLATE_FASTBITS];	// by the next INFLATE_FASTBITS input bits: ( symbol << 4 ) | code length, 0 for a longer code
+	short aCount[16];					// number of codes of each length
+	short aSymbol[288];					// symbols in canonical code order
+} HUFFMAN, *LPHUFFMAN;
+
+typedef struct _INFLATESTATE
+{
+	LPPAKFILE pFile;
+	DWORD dwLeft;			// packed bytes not read from the file yet
+	LPCBYTE pIn;
+	LPCBYTE pInEnd;
+	DWORD dwBits;			// bit buffer, next bit lowest
+	int nBits;
+	int nPadded;			// zero bytes fed in past the end of the input; fine to peek at, wrong to use
+	LPBYTE pOut;			// the output is the window as well
+	DWORD dwOut;
+	DWORD dwOutSize;
+	HUFFMAN Lengths;		// literal/length code, and the code length code while reading a dynamic header
+	HUFFMAN Distances;
+	BYTE aIn[INFLATE_INPUT];
+} INFLATESTATE, *LPINFLATESTATE;
+
+static const WORD g_awLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const BYTE g_abLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const WORD g_awDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const BYTE g_abDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const BYTE g_abCodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static bool ReadAt( LPPAKFILE pFile, DWORD dwOffset, LPVOID pBuffer, DWORD dwSize, LPDWORD pdwRead )
+{
+	*pdwRead = 0;
+	if( !PakSeekFile( pFile, dwOffset ))
+		return false;
+	*pdwRead = PakReadFile( pFile, pBuffer, dwSize );
+	return true;
+}
+
+static bool FillInput( LPINFLATESTATE s )
+{
+	DWORD dwRead = 0;
+	if( s->dwLeft )
+		dwRead = PakReadFile( s->pFile, s->aIn, min( s->dwLeft, (DWORD)sizeof(s->aIn) ));
+	if( dwRead == 0 )
+		return false;
+	s->dwLeft -= dwRead;
+	s->pIn = s->aIn;
+	s->pInEnd = s->aIn + dwRead;
+	return true;
+}
+
+static inline void NeedBits( LPINFLATESTATE s, const int nBits )
+{
+	while( s->nBits < nBits )
+	{
+		if( s->pIn == s->pInEnd && !FillInput( s ))
+			s->nPadded++;
+		else
+			s->dwBits |= (DWORD)*s->pIn++ << s->nBits;
+		s->nBits += 8;
+	}
+}
+
+static inline void DropBits( LPINFLATESTATE s, const int nBits )
+{
+	s->dwBits >>= nBits;
+	s->nBits -= nBits;
+}
+
+static inline DWORD GetBits( LPINFLATESTATE s, const int nBits )
+{
+	NeedBits( s, nBits );
+	const DWORD dwValue = s->dwBits & (( 1 << nBits ) - 1 );
+	DropBits( s, nBits );
+	return dwValue;
+}
+
+// whether we've used bits that were never in the input
+static inline bool Overrun( const LPINFLATESTATE s )
+{
+	return s->nPadded * 8 > s->nBits;
+}
+
+// Builds a canonical code from a list of code lengths; false if the lengths over-subscribe it.
+// An incomplete code is accepted, running into one of its missing codes is an error when decoding.
+static bool BuildHuffman( LPHUFFMAN h, LPCBYTE abLengths, const int nSymbols )
+{
+	short aOffsets[16];
+	int iLength, i;
+
+	ZeroMemory( h->aCount, sizeof(h->aCount) );
+	for( i = 0; i < nSymbols; i++ )
+		h->aCount[abLengths[i]]++;
+
+	int iLeft = 1;
+	for( iLength = 1; iLength <= 15; iLength++ )
+	{
+		iLeft = ( iLeft << 1 ) - h->aCount[iLength];
+		if( iLeft < 0 )
+			return false;
+	}
+
+	aOffsets[1] = 0;
+	for( iLength = 1; iLength < 15; iLength++ )
+		aOffsets[iLength + 1] = aOffsets[iLength] + h->aCount[iLength];
+	for( i = 0; i < nSymbols; i++ )
+		if( abLengths[i] )
+			h->aSymbol[aOffsets[abLengths[i]]++] = (short)i;
+
+	// deflate sends codes highest bit first, so the table is indexed by the codes bit reversed
+	ZeroMemory( h->aFast, sizeof(h->aFast) );
+	int iCode = 0, iIndex = 0;
+	for( iLength = 1; iLength <= INFLATE_FASTBITS; iLength++ )
+	{
+		for( int n = 0; n < h->aCount[iLength]; n++, iCode++ )
+		{
+			int iReversed = 0;
+			for( i = 0; i < iLength; i++ )
+				if( iCode & ( 1 << i ))
+					iReversed |= 1 << ( iLength - 1 - i );
+
+			const WORD wEntry = (WORD)(( h->aSymbol[iIndex++] << 4 ) | iLength );
+			for( i = iReversed; i < ( 1 << INFLATE_FASTBITS ); i += 1 << iLength )
+				h->aFast[i] = wEntry;
+		}
+		iCode <<= 1;
+	}
+	return true;
+}
+
+// Returns the next symbol, or -1 for a code that isn't in h.
+static inline int DecodeSymbol( LPINFLATESTATE s, const HUFFMAN *h )
+{
+	NeedBits( s, 15 );
+	const WORD wFast = h->aFast[s->dwBits & (( 1 << INFLATE_FASTBITS ) - 1 )];
+	if( wFast )
+	{
+		DropBits( s, wFast & 0x0F );
+		return wFast >> 4;
+	}
+
+	// a long code, walk it a bit at a time
+	DWORD dwBits = s->dwBits;
+	int iCode = 0, iFirst = 0, iIndex = 0;
+	for( int iLength = 1; iLength <= 15; iLength++ )
+	{
+		iCode |= dwBits & 1;
+		dwBits >>= 1;
+		const int nCount = h->aCount[iLength];
+		if( iCode - nCount < iFirst )
+		{
+			DropBits( s, iLength );
+			return h->aSymbol[iIndex + iCode - iFirst];
+		}
+		iIndex += nCount;
+		iFirst = ( iFirst + nCount ) << 1;
+		iCode <<= 1;
+	}
+	return -1;
+}
+
+static int InflateStored( LPINFLATESTATE s )
+{
+	DropBits( s, s->nBits & 7 );
+	DWORD dwLength = GetBits( s, 16 );
+	if( GetBits( s, 16 ) != ( ~dwLength & 0xFFFF ) || Overrun( s ))
+		return INFLATE_ERROR;
+
+	int iResult = INFLATE_OK;
+	if( dwLength > s->dwOutSize - s->dwOut )
+	{
+		dwLength = s->dwOutSize - s->dwOut;
+		iResult = INFLATE_FULL;
+	}
+
+	// whatever is still in the bit buffer, then straight from the input
+	for( ; dwLength && s->nBits; dwLength-- )
+	{
+		s->pOut[s->dwOut++] = (BYTE)s->dwBits;
+		DropBits( s, 8 );
+	}
+	if( Overrun( s ))
+		return INFLATE_ERROR;
+	while( dwLength )
+	{
+		if( s->pIn == s->pInEnd && !FillInput( s ))
+			return INFLATE_ERROR;
+		const DWORD dwChunk = min( dwLength, (DWORD)( s->pInEnd - s->pIn ));
+		CopyMemory( &s->pOut[s->dwOut], s->pIn, dwChunk );
+		s->pIn += dwChunk;
+		s->dwOut += dwChunk;
+		dwLength -= dwChunk;
+	}
+	return iResult;
+}
+
+static int InflateCodes( LPINFLATESTATE s, const HUFFMAN *pLengths, const HUFFMAN *pDistances )
+{
+	for( ;; )
+	{
+		int iSymbol = DecodeSymbol( s, pLengths );
+		if( iSymbol < 0 || Overrun( s ))
+			return INFLATE_ERROR;
+
+		if( iSymbol < 256 )
+		{
+			if( s->dwOut == s->dwOutSize )
+				return INFLATE_FULL;
+			s->pOut[s->dwOut++] = (BYTE)iSymbol;
+			continue;
+		}
+		if( iSymbol == 256 )
+			return INFLATE_OK;
+
+		iSymbol -= 257;
+		if( iSymbol >= 29 )
+			return INFLATE_ERROR;
+		DWORD dwLength = g_awLengthBase[iSymbol] + GetBits( s, g_abLengthExtra[iSymbol] );
+
+		iSymbol = DecodeSymbol( s, pDistances );
+		if( iSymbol < 0 || iSymbol >= 30 )
+			return INFLATE_ERROR;
+		const DWORD dwDistance = g_awDistanceBase[iSymbol] + GetBits( s, g_abDistanceExtra[iSymbol] );
+		if( dwDistance > s->dwOut || Overrun( s ))
+			return INFLATE_ERROR;
+
+		int iResult = INFLATE_OK;
+		if( dwLength > s->dwOutSize - s->dwOut )
+		{
+			dwLength = s->dwOutSize - s->dwOut;
+			iResult = INFLATE_FULL;
+		}
+		LPBYTE pTo = &s->pOut[s->dwOut];
+		LPCBYTE pFrom = pTo - dwDistance;
+		s->dwOut += dwLength;
+		while( dwLength-- )
+			*pTo++ = *pFrom++;		// byte by byte, the copy may overlap itself
+		if( iResult == INFLATE_FULL )
+			return INFLATE_FULL;
+	}
+}
+
+static int InflateFixed( LPINFLATESTATE s )
+{
+	BYTE abLengths[288 + 30];
+	int i;
+	for( i = 0; i < 144; i++ )
+		abLengths[i] = 8;
+	for( ; i < 256; i++ )
+		abLengths[i] = 9;
+	for( ; i < 280; i++ )
+		abLengths[i] = 7;
+	for( ; i < 288; i++ )
+		abLengths[i] = 8;
+	for( ; i < 288 + 30; i++ )
+		abLengths[i] = 5;
+
+	BuildHuffman( &s->Lengths, abLengths, 288 );
+	BuildHuffman( &s->Distances, &abLengths[288], 30 );
+	return InflateCodes( s, &s->Lengths, &s->Distances );
+}
+
+static int InflateDynamic( LPINFLATESTATE s )
+{
+	BYTE abLengths[286 + 30];
+	const int nLengths = GetBits( s, 5 ) + 257;
+	const int nDistances = GetBits( s, 5 ) + 1;
+	const int nCodes = GetBits( s, 4 ) + 4;
+	int i;
+
+	if( nLengths > 286 || nDistances > 30 )
+		return INFLATE_ERROR;
+
+	ZeroMemory( abLengths, 19 );
+	for( i = 0; i < nCodes; i++ )
+		abLengths[g_abCodeLengthOrder[i]] = (BYTE)GetBits( s, 3 );
+	if( !BuildHuffman( &s->Lengths, abLengths, 19 ))
+		return INFLATE_ERROR;
+
+	for( i = 0; i < nLengths + nDistances; )
+	{
+		const int iSymbol = DecodeSymbol( s, &s->Lengths );
+		if( iSymbol < 0 || Overrun( s ))
+			return INFLATE_ERROR;
+		if( iSymbol < 16 )
+		{
+			abLengths[i++] = (BYTE)iSymbol;
+			continue;
+		}
+
+		BYTE bLength = 0;
+		int nRepeat;
+		if( iSymbol == 16 )
+		{
+			if( i == 0 )
+				return INFLATE_ERROR;
+			bLength = abLengths[i - 1];
+			nRepeat = 3 + GetBits( s, 2 );
+		}
+		else if( iSymbol == 17 )
+			nRepeat = 3 + GetBits( s, 3 );
+		else
+			nRepeat = 11 + GetBits( s, 7 );
+		if( i + nRepeat > nLengths + nDistances )
+			return INFLATE_ERROR;
+		while( nRepeat-- )
+			abLengths[i++] = bLength;
+	}
+
+	if( abLengths[256] == 0		// no end of block code
+		|| !BuildHuffman( &s->Lengths, abLengths, nLengths ) || !BuildHuffman( &s->Distances, &abLengths[nLengths], nDistances ))
+		return INFLATE_ERROR;
+	return InflateCodes( s, &s->Lengths, &s->Distances );
+}
+
+static DWORD Inflate( LPPAKFILE pFile, const DWORD dwPackedSize, LPBYTE pOut, const DWORD dwOutSize )
+{
+	LPINFLATESTATE s = (LPINFLATESTATE)P_malloc( sizeof(INFLATESTATE) );
+	if( s == NULL )
+		return 0;
+	s->pFile = pFile;
+	s->dwLeft = dwPackedSize;
+	s->pIn = s->pInEnd = s->aIn;
+	s->dwBits = 0;
+	s->nBits = 0;
+	s->nPadded = 0;
+	s->pOut = pOut;
+	s->dwOut = 0;
+	s->dwOutSize = dwOutSize;
+
+	int iResult;
+	bool bLast;
+	do
+	{
+		bLast = ( GetBits( s, 1 ) != 0 );
+		switch( GetBits( s, 2 ))
+		{
+		case 0:
+			iResult = InflateStored( s );
+			break;
+		case 1:
+			iResult = InflateFixed( s );
+			break;
+		case 2:
+			iResult = InflateDynamic( s );
+			break;
+		default:
+			iResult = INFLATE_ERROR;
+		}
+	} while( iResult == INFLATE_OK && !bLast );
+
+	const DWORD dwWritten = ( iResult == INFLATE_ERROR ) ? 0 : s->dwOut;
+	P_free( s );
+	return dwWritten;
+}
+
+static bool GetGzipFile( LPPAKFILE pFile, const DWORD dwFileSize, LPCBYTE aHead, const DWORD dwHead, LPPACKEDFILE pPacked )
+{
+	// fixed 10 bytes, then the optional extra field, name, comment and header CRC
+	if( dwHead < 10 || aHead[2] != 8 || ( aHead[3] & 0xE0 ))
+		return false;
+	const BYTE bFlags = aHead[3];
+	DWORD dwPos = 10;
+	if( bFlags & 0x04 )
+		dwPos = ( dwPos + 2 <= dwHead ) ? dwPos + 2 + GETWORD( &aHead[dwPos] ) : dwHead + 1;
+	for( BYTE bString = 0x08; bString <= 0x10; bString <<= 1 )
+	{
+		if( bFlags & bString )
+		{
+			while( dwPos < dwHead && aHead[dwPos] )
+				dwPos++;
+			dwPos++;
+		}
+	}
+	if( bFlags & 0x02 )
+		dwPos += 2;
+
+	BYTE aTrailer[8];
+	DWORD dwRead;
+	if( dwPos > dwHead || dwPos + 8 > dwFileSize || !ReadAt( pFile, dwFileSize - 8, aTrailer, sizeof(aTrailer), &dwRead ) || dwRead != sizeof(aTrailer) )
+		return false;
+
+	pPacked->dwDataOffset = dwPos;
+	pPacked->dwPackedSize = dwFileSize - 8 - dwPos;
+	pPacked->dwCRC = GETDWORD( aTrailer );
+	pPacked->dwSize = GETDWORD( &aTrailer[4] );
+	return true;
+}
+
+static bool IsGBRomName( LPCSTR pszName, const int nLength )
+{
+	for( int i = nLength - 1; i >= 0 && pszName[i] != '/'; i-- )
+		if( pszName[i] == '.' )
+			return ( nLength - i == 3 && !_strnicmp( &pszName[i], ".gb", 3 )) || ( nLength - i == 4 && !_strnicmp( &pszName[i], ".gbc", 4 ));
+	return false;
+}
+
+static bool GetZipFile( LPPAKFILE pFile, const DWORD dwFileSize, LPPACKEDFILE pPacked )
+{
+	DWORD dwRead, nEntries = 0, dwDirSize = 0, dwDirOffset = 0;
+	bool bFound = false;
+
+	// the end of central directory record is somewhere in the last 64K + 22 bytes, before the archive comment
+	const DWORD dwTail = min( dwFileSize, (DWORD)0xFFFF + 22 );
+	LPBYTE aTail = (LPBYTE)P_malloc( dwTail );
+	if( aTail == NULL )
+		return false;
+	if( ReadAt( pFile, dwFileSize - dwTail, aTail, dwTail, &dwRead ) && dwRead == dwTail )
+	{
+		for( int i = (int)dwTail - 22; i >= 0 && !bFound; i-- )
+		{
+			if( GETDWORD( &aTail[i] ) == 0x06054B50 )
+			{
+				nEntries = GETWORD( &aTail[i + 10] );
+				dwDirSize = GETDWORD( &aTail[i + 12] );
+				dwDirOffset = GETDWORD( &aTail[i + 16] );
+				bFound = true;
+			}
+		}
+	}
+	P_free( aTail );
+	if( !bFound || dwDirOffset > dwFileSize || dwDirSize > dwFileSize - dwDirOffset )
+		return false;
+
+	LPBYTE aDirectory = (LPBYTE)P_malloc( dwDirSize );
+	if( aDirectory == NULL )
+		return false;
+	if( !ReadAt( pFile, dwDirOffset, aDirectory, dwDirSize, &dwRead ) || dwRead != dwDirSize )
+		nEntries = 0;
+
+	// the first GB ROM in the archive, or failing that the first file
+	LPCBYTE pEntry = NULL;
+	DWORD dwPos = 0;
+	for( DWORD n = 0; n < nEntries && dwPos + 46 <= dwDirSize && GETDWORD( &aDirectory[dwPos] ) == 0x02014B50; n++ )
+	{
+		LPCBYTE pThis = &aDirectory[dwPos];
+		const int nName = GETWORD( &pThis[28] );
+		if( dwPos + 46 + nName > dwDirSize )
+			break;
+		if( nName && pThis[46 + nName - 1] != '/' )
+		{
+			if( IsGBRomName( (LPCSTR)&pThis[46], nName ))
+			{
+				pEntry = pThis;
+				break;
+			}
+			if( pEntry == NULL )
+				pEntry = pThis;
+		}
+		dwPos += 46 + nName + GETWORD( &pThis[30] ) + GETWORD( &pThis[32] );
+	}
+
+	bool bReturn = false;
+	if( pEntry != NULL && !( GETWORD( &pEntry[8] ) & 0x0001 ) && ( GETWORD( &pEntry[10] ) == 0 || GETWORD( &pEntry[10] ) == 8 ))
+	{
+		pPacked->bStored = ( GETWORD( &pEntry[10] ) == 0 );
+		pPacked->dwCRC = GETDWORD( &pEntry[16] );
+		pPacked->dwPackedSize = GETDWORD( &pEntry[20] );
+		pPacked->dwSize = GETDWORD( &pEntry[24] );
+		const DWORD dwLocal = GETDWORD( &pEntry[42] );
+
+		// the data follows the local header, whose name and extra field needn't match the central directory's
+		BYTE aLocal[30];
+		if( ReadAt( pFile, dwLocal, aLocal, sizeof(aLocal), &dwRead ) && dwRead == sizeof(aLocal) && GETDWORD( aLocal ) == 0x04034B50 )
+		{
+			pPacked->dwDataOffset = dwLocal + 30 + GETWORD( &aLocal[26] ) + GETWORD( &aLocal[28] );
+			bReturn = pPacked->dwDataOffset <= dwFileSize && pPacked->dwPackedSize <= dwFileSize - pPacked->dwDataOffset
+						&& ( !pPacked->bStored || pPacked->dwPackedSize == pPacked->dwSize );
+		}
+	}
+	P_free( aDirectory );
+	return bReturn;
+}
+
+bool GetPackedFile( LPPAKFILE pFile, LPPACKEDFILE pPacked )
+{
+	BYTE aHead[0x400];	// room for the gzip header with a long file name in it
+	DWORD dwRead;
+
+	ZeroMemory( pPacked, sizeof(PACKEDFILE) );
+	const DWORD dwFileSize = PakGetFileSize( pFile );
+	if( dwFileSize == 0xFFFFFFFF || !ReadAt( pFile, 0, aHead, sizeof(aHead), &dwRead ))
+		return false;
+
+	if( dwRead >= 2 && aHead[0] == 0x1F && aHead[1] == 0x8B )
+	{
+		pPacked->iFormat = PACKED_GZIP;
+		return GetGzipFile( pFile, dwFileSize, aHead, dwRead, pPacked );
+	}
+	if( dwRead >= 4 && GETDWORD( aHead ) == 0x04034B50 )
+	{
+		pPacked->iFormat = PACKED_ZIP;
+		return GetZipFile( pFile, dwFileSize, pPacked );
+	}
+	pPacked->iFormat = PACKED_NONE;
+	return true;
+}
+
+DWORD UnpackFile( LPPAKFILE pFile, const PACKEDFILE *pPacked, LPBYTE pOut, DWORD dwOutSize )
+{
+	if( !PakSeekFile( pFile, pPacked->dwDataOffset ))
+		return 0;
+	if( pPacked->bStored )
+		return PakReadFile( pFile, pOut, min( dwOutSize, pPacked->dwPackedSize ));
+	return Inflate( pFile, pPacked->dwPackedSize, pOut, dwOutSize );
+}
@@ -0,0 +1,57 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PACKEDFILE_H_
+#define _PACKEDFILE_H_
+
+// gzip and zip files, for GB ROMs kept compressed.
+//
+// Only what ROM packs use: a single gzip member, or one file out of a zip archive (the first .gb/.gbc in
+// it, else the first file), stored or deflated.  No zip64 and no encryption.
+// Unpacking streams the file through a small buffer straight into the caller's memory, which doubles as
+// the deflate window, so nothing the size of the ROM is allocated besides the output.
+
+#define PACKED_NONE		0
+#define PACKED_GZIP		1
+#define PACKED_ZIP		2
+
+typedef struct _PACKEDFILE
+{
+	int iFormat;			// PACKED_ constant
+	bool bStored;			// zip member kept without compression
+	DWORD dwDataOffset;		// where the packed data starts in the file
+	DWORD dwPackedSize;
+	DWORD dwSize;			// once unpacked
+	DWORD dwCRC;			// CRC32 of the unpacked data
+} PACKEDFILE, *LPPACKEDFILE;
+
+// Looks for a gzip or zip signature at the start of pFile and fills pPacked from its headers.
+// iFormat is PACKED_NONE for anything else.  Returns false if the file is packed but damaged or unsupported.
+bool GetPackedFile( struct _PAKFILE *pFile, LPPACKEDFILE pPacked );
+
+// Unpacks the first dwOutSize bytes (at most) of the file described by pPacked into pOut.
+// Returns the number of bytes written, 0 if the data is damaged.  Doesn't check the CRC, a caller
+// wanting all of it compares the result against pPacked->dwSize and pPacked->dwCRC.
+DWORD UnpackFile( struct _PAKFILE *pFile, const PACKEDFILE *pPacked, LPBYTE pOut, DWORD dwOutSize );
+
+#endif // #ifndef _PACKEDFILE_H_
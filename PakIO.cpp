@@ -22,774 +22,879 @@
 */
 
 #include "commonIncludes.h"
+#ifdef _WIN32
 #include <windows.h>
-#include <Commctrl.h>
-#include <tchar.h>
+#endif
 #include <stdio.h>
-#include "NRagePluginV2.h"
-#include "DirectInput.h"
-#include "Interface.h"
-#include "FileAccess.h"
 #include "PakIO.h"
+#include "PakJournal.h"
+#include "PakStore.h"
+#include "MemPakFormat.h"
 #include "GBCart.h"
+#include "PakPlatform.h"
+
+// DataCRC lookup tables, filled by InitPakCRCTables.
+// g_aDataCRCTable[0] is the regular byte-at-a-time table for the 0x85 polynomial;
+// g_aDataCRCTable[n] additionally pushes the result through n zero bytes, which lets DataCRC
+// fold 8 data bytes per step ("slicing-by-8").  2 KB total, so it stays in L1.
+static BYTE g_aDataCRCTable[8][256];
+// Address CRC for every 11 bit pak address, filled by InitPakCRCTables.
+static BYTE g_aAddressCRCTable[2048];
+// standard CRC-32 (reflected, polynomial 0x04C11DB7) for our own file formats
+static DWORD g_aCRC32Table[256];
+// "00".."FF" for every byte value, ready to store as one WORD, and the value of every hex digit
+// (0 for any other character).  Both filled by InitPakCRCTables.
+static WORD g_aHexPairs[256];
+static BYTE g_aHexValue[256];
+
+// Checks the 5 bit CRC the N64 sends along with every pak address (Command[0..1]).
+// A bad CRC doesn't stop the transfer; the controller code flags it for the next status request.
+bool IsAddressCRCValid( LPCBYTE Command )
+{
+	return g_aAddressCRCTable[( Command[0] << 3 ) | ( Command[1] >> 5 )] == ( Command[1] & 0x1F );
+}
 
-// ProtoTypes
-BYTE AddressCRC( LPCBYTE Address );
-BYTE DataCRC( LPCBYTE Data, const int iLength );
-VOID CALLBACK WritebackProc( HWND hWnd, UINT msg, UINT_PTR idEvent, DWORD dwTime );
+// PAK_MEM (Memory Pak)
 
-bool InitControllerPak( const int iControl )
-// Prepares the Pak
+// checks every bank of a freshly opened pak and parses them, so a bank swap has nothing left to do.
+// Nothing is written: damage is only logged, repairs are up to RepairMemPakBanks.
+static void MemPakMounted( LPMEMPAK mPak )
 {
-	if( !g_pcControllers[iControl].fPlugged )
-		return false;
-	bool bReturn = false;
-	if( g_pcControllers[iControl].pPakData )
+	for( int iBank = 0; iBank < mPak->nBanks; iBank++ )
 	{
-		SaveControllerPak( iControl );
-		CloseControllerPak( iControl );
+		MEMPAKCHECK Check;
+		LPCBYTE aBank = mPak->aMemPakBanks + iBank * PAK_MEM_SIZE;
+		const DWORD dwErrors = ValidateMemPak( aBank, &Check );
+		if( dwErrors & MPERR_DAMAGED )
+			LogWarnA( LOG_MEMPAK, "Memory Pak bank %d is damaged (%02X, note %d block %d), left as it is\n",
+						iBank, dwErrors, Check.iBadNote, Check.bBadBlock );
+		BuildMemPakModel( &mPak->aModels[iBank], aBank );
 	}
+	mPak->pModel = &mPak->aModels[mPak->iBank];
+}
 
-	switch( g_pcControllers[iControl].PakType )
+int RepairMemPakBanks( LPMEMPAK mPak )
+{
+	int nRepaired = 0;
+	for( int iBank = 0; mPak->aMemPakBanks && iBank < mPak->nBanks; iBank++ )
 	{
-	case PAK_MEM:
-		{
-			g_pcControllers[iControl].pPakData = P_malloc( sizeof(MEMPAK));
-			MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
-			mPak->bPakType = PAK_MEM;
-			mPak->fReadonly = false;
-			mPak->fDexSave = false;
-			mPak->hMemPakHandle = NULL;
-
-			DWORD dwFilesize = PAK_MEM_SIZE;	// expected file size
-			TCHAR szBuffer[MAX_PATH+1],
-				  szFullPath[MAX_PATH+1],
-				  *pcFile;
-
-			GetAbsoluteFileName( szBuffer, g_pcControllers[iControl].szMempakFile, DIRECTORY_MEMPAK );
-			GetFullPathName( szBuffer, sizeof(szFullPath) / sizeof(TCHAR), szFullPath, &pcFile );
-
-			bool isNewfile = !CheckFileExists( szBuffer );
-
-			if( pcFile == NULL )
-			{ // no Filename specified
-				WarningMessage( IDS_ERR_MEM_NOSPEC, MB_OK | MB_ICONWARNING );
-				g_pcControllers[iControl].PakType = PAK_NONE;
-				break; // memory is freed at the end of this function
-			}
-
-			TCHAR *pcPoint = _tcsrchr( pcFile, '.' );
-			if( !lstrcmpi( pcPoint, _T(".n64") ) )
-			{
-				mPak->fDexSave = true;
-				dwFilesize += PAK_MEM_DEXOFFSET;
-			}
-			else
+		MEMPAKCHECK Check;
+		const DWORD dwBankOffset = iBank * PAK_MEM_SIZE;
+		LPBYTE aBank = mPak->aMemPakBanks + dwBankOffset;
+		const DWORD dwErrors = ValidateMemPak( aBank, &Check );
+		if( !( dwErrors & MPERR_DAMAGED ))
+			continue;
+
+		// repair a copy, and only take it if it leaves a usable pak; otherwise it's the player's call to format
+		BYTE aHeader[0x500];
+		CopyMemory( aHeader, aBank, sizeof(aHeader) );
+		const DWORD dwLeft = RepairMemPak( aHeader, &Check );
+		LogWarnA( LOG_MEMPAK, "Memory Pak bank %d: %02X damaged, %02X left after repair\n", iBank, dwErrors, dwLeft );
+		if( dwLeft & MPERR_DAMAGED )
+			continue;
+
+		for( int i = 0; i < 0x300; i += 32 )
+			if( memcmp( &aHeader[i], &aBank[i], 32 ))
 			{
-				mPak->fDexSave = false;
-			}
-
-			HANDLE hFileHandle = CreateFile( szFullPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL );
-			if( hFileHandle == INVALID_HANDLE_VALUE )
-			{// test if Read-only access is possible
-				hFileHandle = CreateFile( szFullPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL );
-				if( hFileHandle != INVALID_HANDLE_VALUE )
-				{
-					TCHAR tszTitle[DEFAULT_BUFFER], tszText[DEFAULT_BUFFER];
-
-					LoadString( g_hResourceDLL, IDS_DLG_MEM_READONLY, tszText, DEFAULT_BUFFER );
-					LoadString( g_hResourceDLL, IDS_DLG_WARN_TITLE, tszTitle, DEFAULT_BUFFER );
-					wsprintf( szBuffer, tszText, pcFile );
-					MessageBox( g_strEmuInfo.hMainWindow, szBuffer, tszTitle, MB_OK | MB_ICONWARNING );
-					mPak->fReadonly = true;
-					DebugWriteA("Ramfile opened in READ ONLY mode.\n");
-				}
-				else
+				PakJournalWrite( mPak->pJournal, mPak->aMemPakBanks, dwBankOffset + i, &aHeader[i] );
+				MarkSnapshotPage( mPak->aSnapWritten, dwBankOffset + i );
+				const int iBlock = ( dwBankOffset + i ) >> 5;
+				mPak->aBlockCRCValid[iBlock >> 5] &= ~( 1u << ( iBlock & 31 ));
+				if( !mPak->fReadonly )
 				{
-					TCHAR tszTitle[DEFAULT_BUFFER], tszText[DEFAULT_BUFFER];
-
-					LoadString( g_hResourceDLL, IDS_ERR_MEMOPEN, tszText, DEFAULT_BUFFER );
-					LoadString( g_hResourceDLL, IDS_DLG_WARN_TITLE, tszTitle, DEFAULT_BUFFER );
-					wsprintf( szBuffer, tszText, pcFile );
-					MessageBox( g_strEmuInfo.hMainWindow, szBuffer, tszTitle, MB_OK | MB_ICONWARNING );
-					g_pcControllers[iControl].PakType = PAK_NONE;	// set so that CloseControllerPak doesn't try to close a file that isn't open
-					DebugWrite(_T("Unable to read or create MemPak file %s.\n"), pcFile);
-					break; // memory is freed at the end of this function
+					if( mPak->dwDirtyPages == 0 )
+						mPak->dwFirstDirtyTick = PakTickCount();
+					mPak->dwLastWriteTick = PakTickCount();
+					mPak->dwDirtyPages |= 1u << ( dwBankOffset / PAK_MEM_PAGE_SIZE );
 				}
 			}
+		BuildMemPakModel( &mPak->aModels[iBank], aBank );
+		++nRepaired;
+	}
+	PakJournalCommit( mPak->pJournal );
+	return nRepaired;
+}
 
-			DWORD dwCurrentSize = GetFileSize( hFileHandle, NULL );
-			if ( mPak->fReadonly )
-			{
-				DWORD dwBytesRead = 0;
-
-				if( mPak->fDexSave )
-				{
-					SetFilePointer( hFileHandle, PAK_MEM_DEXOFFSET, NULL, FILE_BEGIN );
-				}
-				else
-				{
-					SetFilePointer( hFileHandle, 0L, NULL, FILE_BEGIN );
-				}
-
-				dwFilesize = min( dwFilesize, GetFileSize( hFileHandle, NULL ));
-				if( !isNewfile )
-				{
-					mPak->aMemPakData = (LPBYTE)P_malloc( sizeof(BYTE) * PAK_MEM_SIZE );
-					if( ReadFile( hFileHandle, mPak->aMemPakData, PAK_MEM_SIZE, &dwBytesRead, NULL ))
-					{
-						if( dwBytesRead < dwFilesize )
-							FillMemory( (LPBYTE)mPak->aMemPakData + dwBytesRead, PAK_MEM_SIZE - dwBytesRead, 0xFF );
-
-						bReturn = true;
-					}
-					else
-						P_free( mPak->aMemPakData );
-				}
-				else
-				{
-					FormatMemPak( mPak->aMemPakData );
-					bReturn = true;
-				}
-				CloseHandle( hFileHandle );
-			}
-			else
-			{
-				// use mapped file
-				mPak->hMemPakHandle = CreateFileMapping( hFileHandle, NULL, mPak->fReadonly ? PAGE_READONLY : PAGE_READWRITE, 0, dwFilesize, NULL);
-				// test for invalid handle
-				if (mPak->hMemPakHandle == NULL)
-				{
-					// note: please don't move the CloseHandle call before GetLastError
-					DebugWriteA("Couldn't CreateFileMapping for MemPak file : %08x\n", GetLastError());
-					CloseHandle(hFileHandle);
-					break; // memory is freed at the end of the function
-				}
-				CloseHandle(hFileHandle); // we can close the file handle now with no problems
-
-				mPak->aMemPakData = (LPBYTE)MapViewOfFile( mPak->hMemPakHandle, FILE_MAP_ALL_ACCESS, 0, 0,  mPak->fDexSave ? PAK_MEM_SIZE + PAK_MEM_DEXOFFSET : PAK_MEM_SIZE );
-
-				// this is a bit tricky:
-				// if it's a dexsave, move the pakdata pointer forward so it points to where the actual mempak data starts
-				// we need to make sure to move it back when we UnmapViewOfFile
-				if (mPak->aMemPakData == NULL)
-					ErrorMessage(IDS_ERR_MAPVIEW, GetLastError(), false);
-
-				if ( mPak->fDexSave )
-					mPak->aMemPakData += PAK_MEM_DEXOFFSET;
-
-                if( dwCurrentSize < dwFilesize )
-					FillMemory( (LPBYTE)mPak->aMemPakData + (mPak->fDexSave ? dwCurrentSize - PAK_MEM_DEXOFFSET : dwCurrentSize), dwFilesize - dwCurrentSize, 0xFF );
-
-				if( isNewfile )
-				{
-					if (mPak->fDexSave )
-					{
-						PVOID pHeader = MapViewOfFile( mPak->hMemPakHandle, FILE_MAP_ALL_ACCESS, 0, 0, PAK_MEM_DEXOFFSET );
-						const char szHeader[] = "123-456-STD";	// "OMG-WTF-BBQ"? --rabid
-						ZeroMemory( pHeader, PAK_MEM_DEXOFFSET );
-						CopyMemory( pHeader, szHeader, sizeof(szHeader) );
-						FlushViewOfFile( pHeader, PAK_MEM_DEXOFFSET );
-						UnmapViewOfFile( pHeader );
-					}
-					FormatMemPak( mPak->aMemPakData );
-				}
+bool OpenMemPak( LPMEMPAK mPak, const TCHAR *pszFullPath, const TCHAR *pszFileName )
+{
+	bool bReturn = false;
 
-				bReturn = true;
-			}			
+	mPak->bPakType = PAK_MEM;
+	mPak->fReadonly = false;
+	mPak->fDexSave = false;
+	mPak->pMapping = NULL;
+	mPak->aMemPakData = NULL;
+	mPak->aMemPakBanks = NULL;
+	mPak->nBanks = 1;
+	mPak->iBank = 0;
+	ZeroMemory( mPak->aBlockCRCValid, sizeof(mPak->aBlockCRCValid) );
+	mPak->dwDirtyPages = 0;
+	mPak->dwRetryPages = 0;
+	ZeroMemory( mPak->aSnapWritten, sizeof(mPak->aSnapWritten) );
+	mPak->pJournal = NULL;
+	mPak->pStore = NULL;
+	for( int i = 0; i < PAK_MEM_BANKS_MAX; i++ )
+		mPak->aModels[i].aMemPak = NULL;
+	mPak->pModel = &mPak->aModels[0];
+
+	bool isNewfile = !PakFileExists( pszFullPath );
+
+	if( IsPakManifest( pszFileName ))
+	{
+		// content-addressed backend: the pak lives on the heap and the writeback thread stores its changed pages
+		mPak->aMemPakData = (LPBYTE)P_malloc( sizeof(BYTE) * PAK_MEM_SIZE );
+		if( mPak->aMemPakData )
+			mPak->pStore = OpenPakStore( pszFullPath, mPak->aMemPakData, true );
+		if( !mPak->pStore )
+		{
+			PakNotify( IDS_ERR_MEMOPEN, pszFileName );
+			if( mPak->aMemPakData )
+				P_free( mPak->aMemPakData );
+			mPak->aMemPakData = NULL;
+			return false;
 		}
-		break;
+		mPak->aMemPakBanks = mPak->aMemPakData;
+		MemPakMounted( mPak );
+		return true;
+	}
 
-	case PAK_RUMBLE:
+	LPPAKFILE pFile = PakOpenFile( pszFullPath, PAK_FILE_WRITE );
+	if( pFile == NULL )
+	{// test if Read-only access is possible
+		pFile = PakOpenFile( pszFullPath, PAK_FILE_READ );
+		if( pFile != NULL )
 		{
-			g_pcControllers[iControl].pPakData = P_malloc( sizeof(RUMBLEPAK));
-			RUMBLEPAK *rPak = (RUMBLEPAK*)g_pcControllers[iControl].pPakData;
-			rPak->bPakType = PAK_RUMBLE;
-
-			rPak->fLastData = true;		// statistically, if uninitted it would return true --rabid
-//			rPak->bRumbleTyp = g_pcControllers[iControl].bRumbleTyp;
-//			rPak->bRumbleStrength = g_pcControllers[iControl].bRumbleStrength;
-//			rPak->fVisualRumble = g_pcControllers[iControl].fVisualRumble;
-			if( !g_pcControllers[iControl].xiController.bConnected )	//used to make sure only xinput cotroller rumbles --tecnicors
-				CreateEffectHandle( iControl, g_pcControllers[iControl].bRumbleTyp, g_pcControllers[iControl].bRumbleStrength );
-			bReturn = true;
+			PakNotify( IDS_DLG_MEM_READONLY, pszFileName );
+			mPak->fReadonly = true;
+			DebugWriteA("Ramfile opened in READ ONLY mode.\n");
 		}
-		break;
-	case PAK_TRANSFER:
+		else
 		{
-			g_pcControllers[iControl].pPakData = P_malloc( sizeof(TRANSFERPAK));
-			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
-			tPak->bPakType = PAK_TRANSFER;
-
-			tPak->gbCart.hRomFile = NULL;
-			tPak->gbCart.hRamFile = NULL;
-			tPak->gbCart.sGoombaRamPath = NULL;
-			tPak->gbCart.RomData = NULL;
-			tPak->gbCart.RamData = NULL;
-
-			/*
-			 * Once the Interface is implemented g_pcControllers[iControl].szTransferRom will hold filename of the GB-Rom
-			 * and g_pcControllers[iControl].szTransferSave holds Filename of the SRAM Save
-			 * 
-			 * Here, both files should be opened and the handles stored in tPak ( modify the struct for Your own purposes, only bPakType must stay at first )
-			 */
-
-
-			//CreateFile( g_pcControllers[iControl].szTransferSave, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL );
-			tPak->iCurrentAccessMode = 0;
-			tPak->iCurrentBankNo = 0;
-			tPak->iEnableState = false;
-			tPak->iAccessModeChanged = 0x44;
-
-			tPak->bPakInserted = LoadCart( &tPak->gbCart, g_pcControllers[iControl].szTransferRom, g_pcControllers[iControl].szTransferSave, _T("") );
-
-			if (tPak->bPakInserted) {
-				DebugWriteA( "*** Init Transfer Pak - Success***\n" );
-			} else {
-				DebugWriteA( "*** Init Transfer Pak - FAILURE***\n" );
-			}
-
-			bReturn = true;
+			PakNotify( IDS_ERR_MEMOPEN, pszFileName );
+			DebugWrite(_T("Unable to read or create MemPak file %s.\n"), pszFileName);
+			return false;
 		}
-		break;
+	}
 
-	/*case PAK_VOICE:
+	DWORD dwCurrentSize = PakGetFileSize( pFile );
+	// what's in an existing file counts for more than its name
+	const int iFormat = DetectMemPakFileFormat( pFile, pszFileName );
+	if( iFormat == MPF_NOTE )
+	{
+		PakCloseFile( pFile );
+		PakNotify( IDS_ERR_MEMOPEN, pszFileName );
+		DebugWrite(_T("%s is a note file, not a MemPak.\n"), pszFileName);
+		return false;
+	}
+	mPak->fDexSave = ( iFormat == MPF_DEXDRIVE );
+	mPak->nBanks = MemPakFormatBanks( iFormat, dwCurrentSize );		// a new bank file gets the default
+	if( iFormat == MPF_BANKS )
+		DebugWriteA("Mempak bank file with %d banks.\n", mPak->nBanks);
+	const DWORD dwImageOffset = MemPakFormatOffset( iFormat );
+	const DWORD dwBanksSize = mPak->nBanks * PAK_MEM_SIZE;
+	DWORD dwFilesize = MemPakFormatSize( iFormat, mPak->nBanks );	// expected file size
+
+	if ( mPak->fReadonly )
+	{
+		mPak->aMemPakData = (LPBYTE)P_malloc( sizeof(BYTE) * dwBanksSize );
+		if( mPak->aMemPakData && !isNewfile )
 		{
-			g_pcControllers[iControl].pPakData = P_malloc( sizeof(VOICEPAK));
-			VOICEPAK *vPak = (VOICEPAK*)g_pcControllers[iControl].pPakData;
-			vPak->bPakType = PAK_VOICE;
+			// whatever the file is short of reads as erased
+			DWORD dwBytesRead = PakSeekFile( pFile, dwImageOffset ) ? PakReadFile( pFile, mPak->aMemPakData, dwBanksSize ) : 0;
+			if( dwBytesRead < dwBanksSize )
+				FillMemory( (LPBYTE)mPak->aMemPakData + dwBytesRead, dwBanksSize - dwBytesRead, 0xFF );
 
 			bReturn = true;
 		}
-		break;*/
-	
-	case PAK_ADAPTOID:
-		if( !g_pcControllers[iControl].fIsAdaptoid )
-			g_pcControllers[iControl].PakType = PAK_NONE;
-		else
+		else if( mPak->aMemPakData )
 		{
-			g_pcControllers[iControl].pPakData = P_malloc( sizeof(ADAPTOIDPAK));
-			ADAPTOIDPAK *aPak = (ADAPTOIDPAK*)g_pcControllers[iControl].pPakData;
-			aPak->bPakType = PAK_ADAPTOID;
-
-			aPak->bIdentifier = 0x80;
-#ifdef ADAPTOIDPAK_RUMBLEFIX
-			aPak->fRumblePak = true;
-#pragma message( "Driver-fix for Rumble with Adaptoid enabled" )
-#else
-			aPak->fRumblePak = false;
-#endif
+			for( int i = 0; i < mPak->nBanks; i++ )
+				FormatMemPak( mPak->aMemPakData + i * PAK_MEM_SIZE );
 			bReturn = true;
 		}
-		break;
-
-	
-	/*case PAK_NONE:
-		break;*/
+		PakCloseFile( pFile );
 	}
+	else
+	{
+		// use mapped file
+		mPak->aMemPakData = PakMapFile( pFile, dwFilesize, false, &mPak->pMapping );
+		PakCloseFile( pFile ); // we can close the file now with no problems
+		if (mPak->aMemPakData == NULL)
+		{
+			PakNotifyError( IDS_ERR_MAPVIEW, 0 );
+			return false;
+		}
+
+		// this is a bit tricky:
+		// if it's a dexsave, move the pakdata pointer forward so it points to where the actual mempak data starts
+		// we need to make sure to move it back when we unmap it
+		LPBYTE pHeader = mPak->aMemPakData;
+		mPak->aMemPakData += dwImageOffset;
+
+        if( dwCurrentSize < dwFilesize )
+			FillMemory( pHeader + dwCurrentSize, dwFilesize - dwCurrentSize, 0xFF );
 
-	// if there were any unrecoverable errors and we have allocated pPakData, free it and set paktype to NONE
-	if( !bReturn && g_pcControllers[iControl].pPakData )
-		CloseControllerPak( iControl );
+		if( isNewfile )
+		{
+			if( dwImageOffset )
+			{	// the header sits right in front of the mempak data in the same view
+				WriteMemPakFormatHeader( iFormat, pHeader );
+				PakFlushFile( pHeader, dwImageOffset );
+			}
+			for( int i = 0; i < mPak->nBanks; i++ )
+				FormatMemPak( mPak->aMemPakData + i * PAK_MEM_SIZE );
+		}
+
+		// replays whatever a crash left in the journal
+		mPak->pJournal = OpenPakJournal( pszFullPath, mPak->aMemPakData, dwBanksSize, isNewfile );
+
+		bReturn = true;
+	}			
+
+	mPak->aMemPakBanks = mPak->aMemPakData;
+	if( mPak->aMemPakData )
+		MemPakMounted( mPak );
 
 	return bReturn;
 }
 
+BYTE ReadMemPak( LPMEMPAK mPak, const WORD dwAddress, LPBYTE Data, LPCONTROLLERSTATS pStats )
+{
+	if( dwAddress < 0x8000 )
+	{
+		CopyMemory( Data, &mPak->aMemPakData[dwAddress], 32 );
+
+		// the block only changes through WriteMemPak, which keeps the cache current
+		const int iBlock = ( mPak->iBank * PAK_MEM_SIZE + dwAddress ) >> 5;
+		const DWORD dwMask = 1 << ( iBlock & 31 );
+		if( mPak->aBlockCRCValid[iBlock >> 5] & dwMask )
+		{
+			Data[32] = mPak->aBlockCRC[iBlock];
+			if( pStats )
+				pStats->dwMemPakCRCHits++;
+		}
+		else
+		{
+			Data[32] = mPak->aBlockCRC[iBlock] = DataCRC( Data, 32 );
+			mPak->aBlockCRCValid[iBlock >> 5] |= dwMask;
+			if( pStats )
+				pStats->dwMemPakCRCMisses++;
+		}
+	}
+	else
+	{
+		CopyMemory( Data, &mPak->aMemPakTemp[(dwAddress%0x100)], 32 );
+		Data[32] = DataCRC( Data, 32 );
+	}
+	return RD_OK;
+}
+
+BYTE WriteMemPak( LPMEMPAK mPak, const WORD dwAddress, LPBYTE Data )
+{
+	// Switched to memory-mapped file
+	// That way, if the computer dies due to power loss or something mid-play, the savegame is still there.
+	Data[32] = DataCRC( Data, 32 );
+	if( dwAddress < 0x8000 )
+	{
+		const DWORD dwOffset = mPak->iBank * PAK_MEM_SIZE + dwAddress;	// in aMemPakBanks
+		PakJournalWrite( mPak->pJournal, mPak->aMemPakBanks, dwOffset, Data );
+		MarkSnapshotPage( mPak->aSnapWritten, dwOffset );
+		UpdateMemPakModel( mPak->pModel, dwAddress );
+		// the block now holds exactly Data, so its CRC is already known; refresh the cache entry instead of dropping it
+		const int iBlock = dwOffset >> 5;
+		mPak->aBlockCRC[iBlock] = Data[32];
+		mPak->aBlockCRCValid[iBlock >> 5] |= 1 << ( iBlock & 31 );
+		if (!mPak->fReadonly )
+		{
+			// the writeback thread picks this up; nothing is written from here
+			const DWORD dwNow = PakTickCount();
+			if( mPak->dwDirtyPages == 0 )
+				mPak->dwFirstDirtyTick = dwNow;
+			mPak->dwLastWriteTick = dwNow;
+			mPak->dwDirtyPages |= 1u << ( dwOffset / PAK_MEM_PAGE_SIZE );
+		}
+	}
+	else
+		CopyMemory( &mPak->aMemPakTemp[(dwAddress%0x100)], Data, 32 );
+	return RD_OK;
+}
 
-BYTE ReadControllerPak( const int iControl, LPBYTE Command )
+void SaveMemPak( LPMEMPAK mPak )
 {
-	BYTE bReturn = RD_ERROR;
-	LPBYTE Data = &Command[2];
+	if( mPak->pStore )
+	{
+		WritePakStore( mPak->pStore, mPak->aMemPakData, mPak->dwDirtyPages | mPak->dwRetryPages, &mPak->dwRetryPages );
+		mPak->dwDirtyPages = 0;
+	}
+	else if( !mPak->fReadonly && mPak->aMemPakBanks )
+	{
+		PakFlushFile( mPak->aMemPakBanks, mPak->nBanks * PAK_MEM_SIZE );	// we've already written the stuff, just flush the cache
+		mPak->dwDirtyPages = 0;
+		PakJournalCheckpoint( mPak->pJournal, PakJournalMark( mPak->pJournal ));
+	}
+}
 
-#ifdef MAKEADRESSCRCCHECK
-#pragma message( "Addresscheck for Pak-Reads active" )
-	if( AddressCRC( Command ) != (Command[1] & 0x1F) )
+void CloseMemPak( LPMEMPAK mPak )
+{
+	if( mPak->pStore )
 	{
-		g_pcControllers[iControl].fPakCRCError = true;
-		if( WarningMessage( IDS_DLG_MEM_BADADDRESSCRC, MB_OKCANCEL | MB_ICONQUESTION ) == IDCANCEL )
-			return RD_ERROR;
+		DWORD dwFailedPages = 0;
+		WritePakStore( mPak->pStore, mPak->aMemPakData, mPak->dwDirtyPages | mPak->dwRetryPages, &dwFailedPages );
+		if( dwFailedPages )
+			LogWarnA( LOG_MEMPAK, "CloseMemPak: pages %08X couldn't be stored and are lost\n", dwFailedPages );
+		ClosePakStore( mPak->pStore );
+		mPak->pStore = NULL;
+		P_free( mPak->aMemPakData );
+		mPak->aMemPakData = mPak->aMemPakBanks = NULL;
 	}
-#endif
+	else if( mPak->fReadonly )
+	{
+		if( mPak->aMemPakBanks )
+			P_free( mPak->aMemPakBanks );
+		mPak->aMemPakData = mPak->aMemPakBanks = NULL;
+	}
+	else if( mPak->aMemPakBanks )
+	{
+		PakFlushFile( mPak->aMemPakBanks, mPak->nBanks * PAK_MEM_SIZE );
+		ClosePakJournal( mPak->pJournal );
+		mPak->pJournal = NULL;
+		// if it's a dexsave, our original mapped view is not aMemPakBanks
+		PakUnmapFile( mPak->fDexSave ? mPak->aMemPakBanks - PAK_MEM_DEXOFFSET : mPak->aMemPakBanks, mPak->pMapping );
+		mPak->pMapping = NULL;
+		mPak->aMemPakData = mPak->aMemPakBanks = NULL;
+	}
+}
+
+// The other banks are already mapped, checked and parsed, and the CRC cache covers all of them, so it's just pointers.
+bool SelectMemPakBank( LPMEMPAK mPak, const int iBank )
+{
+	if( !mPak->aMemPakBanks || mPak->nBanks < 2 )
+		return false;
 
-	if( !g_pcControllers[iControl].pPakData )
-		return RD_ERROR;
+	mPak->iBank = iBank % mPak->nBanks;
+	mPak->aMemPakData = mPak->aMemPakBanks + mPak->iBank * PAK_MEM_SIZE;
+	mPak->pModel = &mPak->aModels[mPak->iBank];
+	return true;
+}
+
+void MemPakRestored( LPMEMPAK mPak, const DWORD dwOffset, const DWORD dwBytes )
+{
+	for( DWORD dwBlock = dwOffset >> 5; dwBlock < ( dwOffset + dwBytes + 31 ) >> 5; dwBlock++ )
+		mPak->aBlockCRCValid[dwBlock >> 5] &= ~( 1u << ( dwBlock & 31 ));
 
-	WORD dwAddress = (Command[0] << 8) + (Command[1] & 0xE0);
+	// only 0x000-0x4FF of a bank goes into its model
+	for( int iBank = dwOffset / PAK_MEM_SIZE; iBank < mPak->nBanks && (DWORD)iBank * PAK_MEM_SIZE < dwOffset + dwBytes; iBank++ )
+		if( dwOffset < iBank * PAK_MEM_SIZE + 0x500 )
+			BuildMemPakModel( &mPak->aModels[iBank], mPak->aMemPakBanks + iBank * PAK_MEM_SIZE );
+}
 
-	switch( *(BYTE*)g_pcControllers[iControl].pPakData )
+void FlushMemPakPages( LPCBYTE aMemPakBanks, DWORD dwPages, LPCONTROLLERSTATS pStats )
+{
+	int iPage = 0;
+	while( dwPages )
 	{
-	case PAK_MEM:
+		if( !( dwPages & ( 1u << iPage )))
 		{
-			MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
-			
-			if( dwAddress < 0x8000 )
-				CopyMemory( Data, &mPak->aMemPakData[dwAddress], 32 );
-			else
-				CopyMemory( Data, &mPak->aMemPakTemp[(dwAddress%0x100)], 32 );
-			Data[32] = DataCRC( Data, 32 );
-			bReturn = RD_OK;
+			++iPage;
+			continue;
 		}
-		break;
-	case PAK_RUMBLE:
-		if(( dwAddress >= 0x8000 ) && ( dwAddress < 0x9000 ) )
+		int iEnd = iPage;
+		while( iEnd < 32 && ( dwPages & ( 1u << iEnd )))	// with 4 banks the last page is bit 31
 		{
-			RUMBLEPAK *rPak = (RUMBLEPAK*)g_pcControllers[iControl].pPakData;
+			dwPages &= ~( 1u << iEnd );
+			++iEnd;
+		}
 
-			if (rPak->fLastData)
-				FillMemory( Data, 32, 0x80 );
-			else
-				ZeroMemory( Data, 32 );
-			
-			if( g_pcControllers[iControl].xiController.bConnected && g_pcControllers[iControl].fXInput )	// xinput controller rumble --tecnicors
-				VibrateXInputController( g_pcControllers[iControl].xiController.nControl, 0, 0);
-			else if (g_apFFDevice[iControl])
-				g_apFFDevice[iControl]->Acquire();
+		const DWORD dwBytes = ( iEnd - iPage ) * PAK_MEM_PAGE_SIZE;
+		PakFlushFile( &aMemPakBanks[iPage * PAK_MEM_PAGE_SIZE], dwBytes );
+		if( pStats )
+		{
+			pStats->dwWritebackFlushes++;
+			pStats->dwWritebackBytes += dwBytes;
 		}
-		else
-			ZeroMemory( Data, 32 );
+		LogDebugA( LOG_MEMPAK, "Mempak: flushed %u bytes at %04X\n", dwBytes, iPage * PAK_MEM_PAGE_SIZE );
+		iPage = iEnd;
+	}
+}
 
-		Data[32] = DataCRC( Data, 32 );
-		bReturn = RD_OK;
-		break;
+// PAK_TRANSFER (Transfer Pak)
 
-	case PAK_TRANSFER:
-		{
-			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;	// TODO: null pointer check on tPak
-			// set bReturn = RD_OK when implementing Transferpak
-			bReturn = RD_OK;
-			DebugWriteA( "TPak Read:\n" );
-			DebugWriteA( "  Address: %04X\n", dwAddress );
+static void TPakSetEnableState( LPTRANSFERPAK tPak, const bool fEnable );
 
-			switch (dwAddress >> 12)
-			{
-			case 0x8: //	if ((dwAddress >= 0x8000) && (dwAddress <= 0x8FFF))
-				DebugWriteA( "Query Enable State: %u\n", tPak->iEnableState );
-				if (tPak->iEnableState == false)
-					ZeroMemory(Data, 32);
-				else
-					FillMemory(Data, 32, 0x84);
-				break;
-			case 0xB: //	if ((dwAddress >= 0xB000) && (dwAddress <= 0xBFFF))
-				if (tPak->iEnableState == true) {
-					DebugWriteA( "Query Cart. State:" );
-					if (tPak->bPakInserted) {
-						if (tPak->iCurrentAccessMode == 1) {
-							FillMemory(Data, 32, 0x89);
-							DebugWriteA( " Inserted, Access Mode 1\n" );
-						} else {
-							FillMemory(Data, 32, 0x80);
-							DebugWriteA( " Inserted, Access Mode 0\n" );
-						}
-						Data[0] = Data[0] | (BYTE)tPak->iAccessModeChanged;
-					} else {
-						FillMemory(Data, 32, 0x40); // Cart not inserted.
-						DebugWriteA( " Not Inserted\n" );
-					}
-					tPak->iAccessModeChanged = 0;
-				}
-				break;
-			case 0xC:
-			case 0xD:
-			case 0xE:
-			case 0xF: //	if ((dwAddress >= 0xC000))
-				if (tPak->iEnableState == true) {
-					DebugWriteA( "Cart Read: Bank:%i\n", tPak->iCurrentBankNo );
-					DebugWriteA( "    Address:%04X\n", ((dwAddress & 0xFFE0) - 0xC000) + ((tPak->iCurrentBankNo & 3) * 0x4000) );
-
-					tPak->gbCart.ptrfnReadCart(&tPak->gbCart, ((dwAddress & 0xFFE0) - 0xC000) + ((tPak->iCurrentBankNo & 3) * 0x4000), Data);
-				}
-				break;
-			default:
-				DebugWriteA("WARNING: Unusual Pak Read\n" );
-				DebugWriteA("  Address: %04X\n", dwAddress);
-			} // end switch (dwAddress >> 12)
+void InitTransferPak( LPTRANSFERPAK tPak, LPCTSTR pszRomFile, LPCTSTR pszSaveFile )
+{
+	tPak->bPakType = PAK_TRANSFER;
+
+	tPak->gbCart.pRamMapping = NULL;
+	tPak->gbCart.sGoombaRamPath = NULL;
+	tPak->gbCart.RomData = NULL;
+	tPak->gbCart.RamData = NULL;
+	tPak->gbCart.pJournal = NULL;
+	tPak->gbCart.ptrfnReadCart = NULL;
+	tPak->gbCart.ptrfnWriteCart = NULL;
+
+	tPak->iCurrentAccessMode = 0;
+	tPak->iCurrentBankNo = 0;
+	tPak->iGBBaseOffset = -0xC000;	// bank 0
+	TPakSetEnableState( tPak, false );
+	tPak->iAccessModeChanged = 0x44;
+
+	tPak->bPakInserted = LoadCart( &tPak->gbCart, pszRomFile, pszSaveFile, _T("") );
+
+	if (tPak->bPakInserted) {
+		DebugWriteA( "*** Init Transfer Pak - Success***\n" );
+	} else {
+		DebugWriteA( "*** Init Transfer Pak - FAILURE***\n" );
+	}
+}
 
-#ifdef ENABLE_RAWPAK_DEBUG
-			DebugWriteA( "TPak Data: " );
+// Transfer Pak register space, one handler per 4 KB region (dwAddress >> 12).
+// The enabled/disabled tables are swapped by TPakSetEnableState, so the handlers never test iEnableState themselves.
 
-			for (int i = 0; i < 32; i ++) {
-				if ((i < 31) && ((i & 7) == 0)) DebugWriteA( "\n  " );
-				DebugWriteByteA(Data[i]);
-				if (i < 31) {
-					DebugWriteA( ", ");
-				}
-			}
-			DebugWriteA( "\n" );
-#endif
+static void TPakReadUnusual( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )
+{
+	LogWarnA( LOG_TPAK, "WARNING: Unusual Pak Read\n  Address: %04X\n", dwAddress );
+}
 
-			Data[32] = DataCRC( Data, 32 );
+static void TPakReadIgnore( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )
+{
+	// cart is disabled, Data is left as it is
+}
 
-			bReturn = RD_OK;
-		}
-		break;
+static void TPakReadEnable( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )	// 0x8000 - 0x8FFF
+{
+	LogTraceA( LOG_TPAK, "Query Enable State: %u\n", tPak->iEnableState );
+	if (tPak->iEnableState == false)
+		ZeroMemory(Data, 32);
+	else
+		FillMemory(Data, 32, 0x84);
+}
 
-	/*case PAK_VOICE:
-		break;*/
-	
-	case PAK_ADAPTOID:
-		if( ReadAdaptoidPak( iControl, dwAddress, Data ) == DI_OK )
-		{
-			Data[32] = DataCRC( Data, 32 );
-			bReturn = RD_OK;
-			
-			if( ((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->fRumblePak )
-			{
-				BYTE bId = ((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->bIdentifier;
-				if(	(( dwAddress == 0x8000 ) && ( bId == 0x80 ) && ( Data[0] != 0x80 ))
-					|| (( dwAddress == 0x8000 ) && ( bId != 0x80 ) && ( Data[0] != 0x00 ))
-					|| (( dwAddress < 0x8000 ) && ( Data[0] != 0x00 )))
-				{
-					((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->fRumblePak = false;
-					DebugWriteA( "\nAssuming the inserted Pak AINT a RumblePak\nDisabling Rumblefix\n" );
-				}	
-			}
+static void TPakReadStatus( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )	// 0xB000 - 0xBFFF
+{
+	LogTraceA( LOG_TPAK, "Query Cart. State:" );
+	if (tPak->bPakInserted) {
+		if (tPak->iCurrentAccessMode == 1) {
+			FillMemory(Data, 32, 0x89);
+			LogTraceA( LOG_TPAK, " Inserted, Access Mode 1\n" );
+		} else {
+			FillMemory(Data, 32, 0x80);
+			LogTraceA( LOG_TPAK, " Inserted, Access Mode 0\n" );
 		}
-		break;
-	
-	/*case PAK_NONE:
-		break;*/
+		Data[0] = Data[0] | (BYTE)tPak->iAccessModeChanged;
+	} else {
+		FillMemory(Data, 32, 0x40); // Cart not inserted.
+		LogTraceA( LOG_TPAK, " Not Inserted\n" );
 	}
+	tPak->iAccessModeChanged = 0;
+}
 
-	return bReturn;
+static void TPakReadCart( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )		// 0xC000 - 0xFFFF
+{
+	const WORD wGBAddress = (WORD)( dwAddress + tPak->iGBBaseOffset );
+	LogTraceA( LOG_TPAK, "Cart Read: Bank:%i\n    Address:%04X\n", tPak->iCurrentBankNo, wGBAddress );
+
+	ReadCart(&tPak->gbCart, wGBAddress, Data);
+}
+
+static void TPakWriteUnusual( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )
+{
+	LogWarnA( LOG_TPAK, "WARNING: Unusual Pak Write\n  Address: %04X\n", dwAddress );
 }
 
-// Called when the N64 tries to write to the controller pak, e.g. a mempak
-BYTE WriteControllerPak( const int iControl, LPBYTE Command )
+static void TPakWriteIgnore( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )
 {
-	BYTE bReturn = RD_ERROR;
-	BYTE *Data = &Command[2];
+	// cart is disabled, bank and mode writes are dropped
+}
 
-#ifdef MAKEADRESSCRCCHECK
-#pragma message( "Addresscheck for Pak-Writes active" )
-	if( AddressCRC( Command ) != (Command[1] & 0x1F) )
-	{
-		g_pcControllers[iControl].fPakCRCError = true;
-		if( WarningMessage( IDS_DLG_MEM_BADADDRESSCRC, MB_OKCANCEL | MB_ICONQUESTION ) == IDCANCEL )
-			return RD_ERROR;
+static void TPakWriteEnable( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )	// 0x8000 - 0x8FFF
+{
+	if (Data[0] == 0xFE) {
+		LogDebugA( LOG_TPAK, "Cart Disable\n" );
+		TPakSetEnableState( tPak, false );
 	}
-#endif
+	else if (Data[0] == 0x84) {
+		LogDebugA( LOG_TPAK, "Cart Enable\n" );
+		TPakSetEnableState( tPak, true );
+	}
+	else {
+		LogWarnA( LOG_TPAK, "WARNING: Unusual Cart Enable/Disable\n  Address: %04X\n  Data: %02X\n", dwAddress, Data[0] );
+	}
+}
 
-	if( !g_pcControllers[iControl].pPakData )
-		return RD_ERROR;
+static void TPakWriteBank( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )		// 0xA000 - 0xAFFF
+{
+	tPak->iCurrentBankNo = Data[0];
+	// the only place the window into GB address space moves
+	tPak->iGBBaseOffset = ( tPak->iCurrentBankNo & 3 ) * 0x4000 - 0xC000;
+	LogDebugA( LOG_TPAK, "Set TPak Bank No:%02X\n", Data[0] );
+}
 
-	WORD dwAddress = (Command[0] << 8) + (Command[1] & 0xE0);
+static void TPakWriteMode( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )		// 0xB000 - 0xBFFF
+{
+	tPak->iCurrentAccessMode = Data[0] & 1;
+	tPak->iAccessModeChanged = 4;
+	LogDebugA( LOG_TPAK, "Set TPak Access Mode: %04X\n", tPak->iCurrentAccessMode );
+	if ((Data[0] != 1) && (Data[0] != 0)) {
+		LogWarnA( LOG_TPAK, "WARNING: Unusual Access Mode Change\n  Address: %04X\n  Data: %02X\n", dwAddress, Data[0] );
+	}
+}
 
-	switch( *(BYTE*)g_pcControllers[iControl].pPakData )
-	{
-	case PAK_MEM:
-		{
-			// Switched to memory-mapped file
-			// That way, if the computer dies due to power loss or something mid-play, the savegame is still there.
-			MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
-			
-			if( dwAddress < 0x8000 )
-			{
-				CopyMemory( &mPak->aMemPakData[dwAddress], Data, 32 );
-				if (!mPak->fReadonly )
-					SetTimer( g_strEmuInfo.hMainWindow, PAK_MEM, 2000, (TIMERPROC) WritebackProc ); // if we go 2 seconds without a write, call the Writeback proc (which will flush the cache)
-			}
-			else
-				CopyMemory( &mPak->aMemPakTemp[(dwAddress%0x100)], Data, 32 );
-			Data[32] = DataCRC( Data, 32 );
-			bReturn = RD_OK;
-		}
-		break;
-	case PAK_RUMBLE:
-		if( dwAddress == PAK_IO_RUMBLE )
-		{
-			if( g_pcControllers[iControl].xiController.bConnected  && g_pcControllers[iControl].fXInput )	// xinput controller rumble --tecnicors
-			{
-				if( *Data )
-					VibrateXInputController( g_pcControllers[iControl].xiController.nControl );
-				else
-					VibrateXInputController( g_pcControllers[iControl].xiController.nControl, 0, 0 );
-				goto end_rumble;
-			}
+static void TPakWriteCart( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )		// 0xC000 - 0xFFFF, enabled or not
+{
+	WriteCart(&tPak->gbCart, (WORD)( dwAddress + tPak->iGBBaseOffset ), Data);
+}
 
-			if( g_pcControllers[iControl].fVisualRumble )
-				FlashWindow( g_strEmuInfo.hMainWindow, ( *Data != 0 ) ? TRUE : FALSE );
-			if( g_pcControllers[iControl].bRumbleTyp == RUMBLE_DIRECT )
-			{  // Adaptoid Direct Rumble
-				if( g_pcControllers[iControl].fIsAdaptoid )
-					DirectRumbleCommand( iControl, *Data );
-			}
-			else
-			{  // FF-FeedBack Rumble
-				if( g_apdiEffect[iControl] )
-				{
-					g_apFFDevice[iControl]->Acquire();
-					if( *Data )
-					{
-						// g_apdiEffect[iControl]->Start( 1, DIES_SOLO );
-						HRESULT hr; 
-						hr = g_apdiEffect[iControl]->Start( 1, DIES_NODOWNLOAD );
-						if( hr != DI_OK )// just download if needed( seems to work smoother)
-						{
-							hr = g_apdiEffect[iControl]->Start( 1, 0 );
-							if (hr != DI_OK)
-							{
-								DebugWriteA("Rumble: Can't rumble %d: %lX\n", iControl, hr);
-							}
-							else
-								DebugWriteA("Rumble: DIES_NODOWNLOAD failed, regular OK on control %d\n", iControl);
-						}
-						else
-							DebugWriteA("Rumble: DIES_NODOWNLOAD OK on control %d\n", iControl);
-					}
-					else
-					{
-						g_apdiEffect[iControl]->Stop();
-					}
-				}
-			}
-		}
-		else if (dwAddress >= 0x8000 && dwAddress < 0x9000)
-		{
-			RUMBLEPAK *rPak = (RUMBLEPAK*)g_pcControllers[iControl].pPakData;
-			rPak->fLastData = (*Data) ? true : false;
+static const TPAKHANDLER g_aTPakReadDisabled[16] =
+{
+	TPakReadUnusual, TPakReadUnusual, TPakReadUnusual, TPakReadUnusual,	// 0x0000 - 0x3FFF
+	TPakReadUnusual, TPakReadUnusual, TPakReadUnusual, TPakReadUnusual,	// 0x4000 - 0x7FFF
+	TPakReadEnable, TPakReadUnusual, TPakReadUnusual, TPakReadIgnore,	// 0x8000 - 0xBFFF
+	TPakReadIgnore, TPakReadIgnore, TPakReadIgnore, TPakReadIgnore		// 0xC000 - 0xFFFF
+};
+
+static const TPAKHANDLER g_aTPakReadEnabled[16] =
+{
+	TPakReadUnusual, TPakReadUnusual, TPakReadUnusual, TPakReadUnusual,
+	TPakReadUnusual, TPakReadUnusual, TPakReadUnusual, TPakReadUnusual,
+	TPakReadEnable, TPakReadUnusual, TPakReadUnusual, TPakReadStatus,
+	TPakReadCart, TPakReadCart, TPakReadCart, TPakReadCart
+};
+
+static const TPAKHANDLER g_aTPakWriteDisabled[16] =
+{
+	TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual,
+	TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual,
+	TPakWriteEnable, TPakWriteUnusual, TPakWriteIgnore, TPakWriteIgnore,
+	TPakWriteCart, TPakWriteCart, TPakWriteCart, TPakWriteCart
+};
+
+static const TPAKHANDLER g_aTPakWriteEnabled[16] =
+{
+	TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual,
+	TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual, TPakWriteUnusual,
+	TPakWriteEnable, TPakWriteUnusual, TPakWriteBank, TPakWriteMode,
+	TPakWriteCart, TPakWriteCart, TPakWriteCart, TPakWriteCart
+};
+
+static void TPakSetEnableState( LPTRANSFERPAK tPak, const bool fEnable )
+{
+	tPak->iEnableState = fEnable;
+	tPak->ptrfnReadTable = fEnable ? g_aTPakReadEnabled : g_aTPakReadDisabled;
+	tPak->ptrfnWriteTable = fEnable ? g_aTPakWriteEnabled : g_aTPakWriteDisabled;
+}
+
+BYTE ReadTransferPak( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )
+{
+	LogTraceA( LOG_TPAK, "TPak Read:\n  Address: %04X\n", dwAddress );
+
+	tPak->ptrfnReadTable[dwAddress >> 12]( tPak, dwAddress, Data );
+
+#ifdef ENABLE_RAWPAK_DEBUG
+	DebugWriteA( "TPak Data: " );
+
+	for (int i = 0; i < 32; i ++) {
+		if ((i < 31) && ((i & 7) == 0)) DebugWriteA( "\n  " );
+		DebugWriteByteA(Data[i]);
+		if (i < 31) {
+			DebugWriteA( ", ");
 		}
+	}
+	DebugWriteA( "\n" );
+#endif
 
-end_rumble:		// added so after xinput controller rumbles, gets here --tecnicors
-		Data[32] = DataCRC( Data, 32 );
-		bReturn = RD_OK;
-		break;
+	Data[32] = DataCRC( Data, 32 );
+	return RD_OK;
+}
 
-	case PAK_TRANSFER:
-		{
-			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
-			// set bReturn = RD_OK when implementing Transferpak
-			DebugWriteA( "TPak Write:\n" );
-			DebugWriteA( "  Address: %04X\n", dwAddress );
+BYTE WriteTransferPak( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data )
+{
+	LogTraceA( LOG_TPAK, "TPak Write:\n  Address: %04X\n", dwAddress );
 
 #ifdef ENABLE_RAWPAK_DEBUG
-			DebugWriteA( "  Data: ");
+	DebugWriteA( "  Data: ");
 
-			for (int i = 0; i < 32; i++) {
-				if ((i < 31) && ((i & 7) == 0)) DebugWriteA( "\n    " );
-				DebugWriteByteA( Data[i]);
-				if (i < 31) {
-					DebugWriteA( ", " );
-				}
-			}
+	for (int i = 0; i < 32; i++) {
+		if ((i < 31) && ((i & 7) == 0)) DebugWriteA( "\n    " );
+		DebugWriteByteA( Data[i]);
+		if (i < 31) {
+			DebugWriteA( ", " );
+		}
+	}
 
-			DebugWriteA( "\n" );
+	DebugWriteA( "\n" );
 #endif // #ifdef ENABLE_RAWPAK_DEBUG
 
-			switch (dwAddress >> 12)
-			{
-			case 0x8: //	if ((dwAddress >= 0x8000) && (dwAddress <= 0x8FFF))
-				if (Data[0] == 0xFE) {
-					DebugWriteA("Cart Disable\n" );
-					tPak->iEnableState = false;
-				}
-				else if (Data[0] == 0x84) {
-					DebugWriteA("Cart Enable\n" );
-					tPak->iEnableState = true;
-				}
-				else {
-					DebugWriteA("WARNING: Unusual Cart Enable/Disable\n" );
-					DebugWriteA("  Address: " );
-					DebugWriteWordA(dwAddress);
-					DebugWriteA("\n" );
-					DebugWriteA("  Data: " );
-					DebugWriteByteA(Data[0]);
-					DebugWriteA("\n" );
-				}
-				break;
-			case 0xA: //	if ((dwAddress >= 0xA000) && (dwAddress <= 0xAFFF))
-				if (tPak->iEnableState == true) {
-					tPak->iCurrentBankNo = Data[0];
-					DebugWriteA("Set TPak Bank No:%02X\n", Data[0] );
-				}
-				break;
-			case 0xB: //	if ((dwAddress >= 0xB000) && (dwAddress <= 0xBFFF))
-				if (tPak->iEnableState == true) {
-					tPak->iCurrentAccessMode = Data[0] & 1;
-					tPak->iAccessModeChanged = 4;
-					DebugWriteA("Set TPak Access Mode: %04X\n", tPak->iCurrentAccessMode);
-					if ((Data[0] != 1) && (Data[0] != 0)) {
-						DebugWriteA("WARNING: Unusual Access Mode Change\n" );
-						DebugWriteA("  Address: " );
-						DebugWriteWordA(dwAddress);
-						DebugWriteA("\n" );
-						DebugWriteA("  Data: " );
-						DebugWriteByteA(Data[0]);
-						DebugWriteA("\n" );
-					}
-				}
-				break;
-			case 0xC:
-			case 0xD:
-			case 0xE:
-			case 0xF: //	if (dwAddress >= 0xC000)
-				tPak->gbCart.ptrfnWriteCart(&tPak->gbCart, ((dwAddress & 0xFFE0) - 0xC000) + ((tPak->iCurrentBankNo & 3) * 0x4000), Data);
-				if (tPak->gbCart.hRamFile != NULL )
-					SetTimer( g_strEmuInfo.hMainWindow, PAK_TRANSFER, 2000, (TIMERPROC) WritebackProc ); // if we go 2 seconds without a write, call the Writeback proc (which will flush the cache)
-				break;
-			default:
-				DebugWriteA("WARNING: Unusual Pak Write\n" );
-				DebugWriteA("  Address: %04X\n", dwAddress);
-			} // end switch (dwAddress >> 12)
+	tPak->ptrfnWriteTable[dwAddress >> 12]( tPak, dwAddress, Data );
 
-			Data[32] = DataCRC( Data, 32 );
-			bReturn = RD_OK; 
-		}
-		break;
+	Data[32] = DataCRC( Data, 32 );
+	return RD_OK;
+}
 
-	/*case PAK_VOICE:
-		break;*/
-	
-	case PAK_ADAPTOID:
-		if(( dwAddress == PAK_IO_RUMBLE ) && ((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->fRumblePak )
-		{
-			if( DirectRumbleCommand( iControl, *Data ) == DI_OK )
-			{
-				Data[32] = DataCRC( Data, 32 );
-				bReturn = RD_OK;
-			}
-		}
-		else
-		{
-			if( WriteAdaptoidPak( iControl, dwAddress, Data ) == DI_OK )
-			{
-				Data[32] = DataCRC( Data, 32 );
-				if( dwAddress == 0x8000 )
-					((ADAPTOIDPAK*)g_pcControllers[iControl].pPakData)->bIdentifier = Data[0];
+// refreshes one 32 byte chunk of the index page: its share of the checksum and the free bits of its 16 entries
+static void RecalcIndexChunk( LPMEMPAKMODEL pModel, const int iChunk )
+{
+	LPCBYTE aChunk = &pModel->aMemPak[0x100 + iChunk * 32];
+	WORD wSum = 0;
+
+	for( int i = ( iChunk ? 0 : 0x0A ); i < 32; i++ )
+		wSum += aChunk[i];
+	pModel->aIndexSum[iChunk] = wSum;
+
+	// entry n lives at 0x101 + n*2, so this chunk holds entries iChunk*16 .. iChunk*16+15
+	WORD wFree = 0;
+	for( int n = 0; n < 16; n++ )
+		if( aChunk[1 + n*2] == 0x03 )
+			wFree |= 1 << n;
+	if( iChunk == 0 )
+		wFree &= ~0x1F;		// blocks 0-4 hold the header, index and notes, never data
+
+	DWORD &dwFree = pModel->aFreeBlocks[iChunk >> 1];
+	if( iChunk & 1 )
+		dwFree = ( dwFree & 0x0000FFFF ) | ((DWORD)wFree << 16 );
+	else
+		dwFree = ( dwFree & 0xFFFF0000 ) | wFree;
+}
 
-				bReturn = RD_OK;
-			}
+// walks every note's block chain; each walk is bounded by the blocks still unaccounted for
+static void UpdateNoteChains( LPMEMPAKMODEL pModel )
+{
+	LPCBYTE aMemPak = pModel->aMemPak;
+	WORD wRemainingBlocks = 123;
+	BYTE bNextIndex;
+	int i = 0;
+
+	ZeroMemory( pModel->aNoteBlocks, sizeof(pModel->aNoteBlocks) );
+	while( i < 16 && wRemainingBlocks <= 123 )
+	{
+		BYTE &bBlocks = pModel->aNoteBlocks[i];
+		bNextIndex = aMemPak[0x307 + (i*0x20)];
+		while(( bNextIndex >= 5 ) && ( bBlocks < wRemainingBlocks ))
+		{
+			bBlocks++;
+			bNextIndex = aMemPak[0x101 + (bNextIndex*2)];
 		}
-		break;
 
-	/*case PAK_NONE:
-		break;*/
+		if( bBlocks > wRemainingBlocks )
+			wRemainingBlocks = 0xFF;
+		else
+			wRemainingBlocks -= bBlocks;
+	
+		i++;
 	}
+	pModel->wRemainingBlocks = wRemainingBlocks;
+	pModel->fChainsCurrent = true;
+}
 
-	return bReturn;
+// copies note iNote's header out of the note table
+static void ParseMemPakNote( LPMEMPAKMODEL pModel, const int iNote )
+{
+	LPCBYTE aEntry = &pModel->aMemPak[0x300 + iNote * 32];
+	LPMEMPAKNOTE pNote = &pModel->aNotes[iNote];
+
+	pNote->fUsed = ( aEntry[0x00] || aEntry[0x01] || aEntry[0x02] );
+	CopyMemory( pNote->aGameCode, &aEntry[0x00], sizeof(pNote->aGameCode) );
+	CopyMemory( pNote->aPublisher, &aEntry[0x04], sizeof(pNote->aPublisher) );
+	pNote->bFirstBlock = aEntry[0x07];
+	CopyMemory( pNote->aExtension, &aEntry[0x0C], sizeof(pNote->aExtension) );
+	CopyMemory( pNote->aName, &aEntry[0x10], sizeof(pNote->aName) );
+}
+
+// parses the index and note table of aMemPak; the model keeps pointing at aMemPak
+void BuildMemPakModel( LPMEMPAKMODEL pModel, LPCBYTE aMemPak )
+{
+	pModel->aMemPak = aMemPak;
+	for( int i = 0; i < 8; i++ )
+		RecalcIndexChunk( pModel, i );
+	for( int i = 0; i < 16; i++ )
+		ParseMemPakNote( pModel, i );
+	pModel->fChainsCurrent = false;		// rebuilt on the first query
 }
 
-void SaveControllerPak( const int iControl )
+// call after 32 bytes at dwAddress were written to the image; writes outside the index and note table are free
+void UpdateMemPakModel( LPMEMPAKMODEL pModel, const WORD dwAddress )
 {
-	if( !g_pcControllers[iControl].pPakData )
+	if( !pModel->aMemPak )
 		return;
 
-	switch( *(BYTE*)g_pcControllers[iControl].pPakData )
+	if( dwAddress >= 0x100 && dwAddress < 0x200 )
 	{
-	case PAK_MEM:
-		{
-			MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
+		RecalcIndexChunk( pModel, ( dwAddress - 0x100 ) >> 5 );
+		pModel->fChainsCurrent = false;
+	}
+	else if( dwAddress >= 0x300 && dwAddress < 0x500 )
+	{
+		// a 32 byte write covers exactly one note
+		ParseMemPakNote( pModel, ( dwAddress - 0x300 ) >> 5 );
+		pModel->fChainsCurrent = false;
+	}
+}
 
-			if( !mPak->fReadonly )
-				FlushViewOfFile( mPak->aMemPakData, PAK_MEM_SIZE );	// we've already written the stuff, just flush the cache
-		}
-		break;
-	case PAK_RUMBLE:
-		break;
-	case PAK_TRANSFER:
-		{
-			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
-			// here the changes( if any ) in the SRAM should be saved
+// the sum of 0x10A-0x1FF must match the checksum byte at 0x101
+bool IsMemPakIndexValid( const MEMPAKMODEL *pModel )
+{
+	int iSum = 0;
+	for( int i = 0; i < 8; i++ )
+		iSum += pModel->aIndexSum[i];
+	return ( iSum % 256 ) == pModel->aMemPak[0x101];
+}
+
+// returns the number of remaining blocks in a mempak, more than 123 if the chains don't fit
+WORD MemPakRemainingBlocks( LPMEMPAKMODEL pModel )
+{
+	if( !pModel->fChainsCurrent )
+		UpdateNoteChains( pModel );
+	return pModel->wRemainingBlocks;
+}
 
-			if (tPak->gbCart.hRamFile != NULL || tPak->gbCart.sGoombaRamPath != NULL)
+// returns the first free data block at or after iFirst, or -1 if there is none
+int FindFreeMemPakBlock( const MEMPAKMODEL *pModel, const int iFirst )
+{
+	for( int i = iFirst >> 5; i < 4; i++ )
+	{
+		DWORD dwFree = pModel->aFreeBlocks[i];
+		if( i == ( iFirst >> 5 ))
+			dwFree &= 0xFFFFFFFF << ( iFirst & 31 );
+		if( dwFree )
+		{
+			int iBlock = i << 5;
+			while( !( dwFree & 1 ))
 			{
-				SaveCart(&tPak->gbCart, g_pcControllers[iControl].szTransferSave, _T(""));
-				DebugWriteA( "*** Save Transfer Pak ***\n" );
+				dwFree >>= 1;
+				iBlock++;
 			}
+			return iBlock;
 		}
-		break;
-	case PAK_VOICE:
-		break;
-	case PAK_ADAPTOID:
-		break;
-
-	/*case PAK_NONE:
-		break;*/
 	}
+	return -1;
+}
+
+
+// a copy of the ID block is good if the big endian word sum over its first 0x1C bytes
+// matches the word at 0x1C, and the word at 0x1E is 0xFFF2 minus that sum
+static bool IsIDBlockValid( LPCBYTE aID )
+{
+	WORD wSum = 0;
+	for( int i = 0; i < 0x1C; i += 2 )
+		wSum += MAKEWORD( aID[i+1], aID[i] );
+	return ( MAKEWORD( aID[0x1D], aID[0x1C] ) == wSum ) && ( MAKEWORD( aID[0x1F], aID[0x1E] ) == (WORD)( 0xFFF2 - wSum ));
 }
 
-// if there is pPakData for the controller, does any closing of handles before freeing the pPakData struct and setting it to NULL
-// also sets fPakInitialized to false
-void CloseControllerPak( const int iControl )
+static const int g_aIDBlockBackups[] = { 0x60, 0x80, 0xC0 };
+
+// checks the index page at iIndex (0x100, or its backup at 0x200) against the note table at 0x300
+static DWORD CheckMemPakIndex( LPCBYTE aMemPak, const int iIndex, LPMEMPAKCHECK pCheck )
 {
-	if( !g_pcControllers[iControl].pPakData )
-		return;
+	DWORD dwErrors = 0;
+	BYTE aOwner[128];		// 1 + the note that claimed each block, 0 if none did
+	int i, iSum = 0;
+
+	for( i = iIndex + 0x0A; i < iIndex + 0x100; i++ )
+		iSum += aMemPak[i];
+	if(( iSum % 256 ) != aMemPak[iIndex + 1] )
+		dwErrors |= MPERR_CHECKSUM;
 
-	g_pcControllers[iControl].fPakInitialized = 0;
+	ZeroMemory( aOwner, sizeof(aOwner) );
+	pCheck->nNotes = 0;
+	pCheck->wUsedBlocks = 0;
+	pCheck->iBadNote = -1;
+	pCheck->bBadBlock = 0;
 
-	switch( *(BYTE*)g_pcControllers[iControl].pPakData )
+	for( int iNote = 0; iNote < 16; iNote++ )
 	{
-	case PAK_MEM:
+		LPCBYTE pNote = &aMemPak[0x300 + iNote*32];
+		if( !( pNote[0] || pNote[1] || pNote[2] ))	// same test the Memory Pak dialog lists notes by
+			continue;
+		pCheck->nNotes++;
+
+		// every block can be claimed once, so the walk ends within 128 steps even on a looped chain
+		DWORD dwNoteError = 0;
+		BYTE bBlock = pNote[7];
+		while( !dwNoteError )
 		{
-			MEMPAK *mPak = (MEMPAK*)g_pcControllers[iControl].pPakData;
-			
-			if( mPak->fReadonly )
-			{
-				P_free( mPak->aMemPakData );
-				mPak->aMemPakData = NULL;
-			}
+			if(( bBlock < 5 ) || ( bBlock > 127 ))
+				dwNoteError = MPERR_CHAIN;
+			else if( aOwner[bBlock] )
+				dwNoteError = ( aOwner[bBlock] == iNote + 1 ) ? MPERR_LOOP : MPERR_CROSSLINK;
 			else
 			{
-				FlushViewOfFile( mPak->aMemPakData, PAK_MEM_SIZE );
-				// if it's a dexsave, our original mapped view is not aMemPakData 
-				UnmapViewOfFile( mPak->fDexSave ? mPak->aMemPakData - PAK_MEM_DEXOFFSET : mPak->aMemPakData );
-				if ( mPak->hMemPakHandle != NULL )
-					CloseHandle( mPak->hMemPakHandle );
+				aOwner[bBlock] = iNote + 1;
+				pCheck->wUsedBlocks++;
+				bBlock = aMemPak[iIndex + 1 + bBlock*2];
+				if( bBlock == 0x01 )
+					break;
 			}
 		}
-		break;
-	case PAK_RUMBLE:
-		ReleaseEffect( g_apdiEffect[iControl] );
-		g_apdiEffect[iControl] = NULL;
-		break;
-	case PAK_TRANSFER:
+
+		if( dwNoteError )
 		{
-			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[iControl].pPakData;
-			UnloadCart(&tPak->gbCart);
-			DebugWriteA( "*** Close Transfer Pak ***\n" );
-			// close files and free any additionally ressources
+			dwErrors |= dwNoteError;
+			if( pCheck->iBadNote < 0 )
+			{
+				pCheck->iBadNote = iNote;
+				pCheck->bBadBlock = bBlock;
+			}
 		}
-		break;
-	case PAK_VOICE:
-		break;
-	
-	case PAK_ADAPTOID:
-		break;
+	}
 
-	/*case PAK_NONE:
-		break;*/
+	for( i = 5; i < 128; i++ )
+		if( !aOwner[i] && aMemPak[iIndex + 1 + i*2] != 0x03 )
+			dwErrors |= MPERR_LOSTBLOCK;
+
+	return dwErrors;
+}
+
+// checks the ID block, the index checksum and every note's block chain; needs no window or file,
+// only the first 0x500 bytes of aMemPak.  returns the MPERR_ bits, also left in pCheck->dwErrors
+DWORD ValidateMemPak( LPCBYTE aMemPak, LPMEMPAKCHECK pCheck )
+{
+	DWORD dwErrors = 0;
+
+	if( !IsIDBlockValid( &aMemPak[0x20] ))
+	{
+		dwErrors |= MPERR_IDBLOCK | MPERR_NOIDBLOCK;
+		for( int i = 0; i < ARRAYSIZE(g_aIDBlockBackups); i++ )
+			if( IsIDBlockValid( &aMemPak[g_aIDBlockBackups[i]] ))
+				dwErrors &= ~MPERR_NOIDBLOCK;
 	}
 
-	freePakData( &g_pcControllers[iControl] );
-	return;
+	dwErrors |= CheckMemPakIndex( aMemPak, 0x100, pCheck );
+	pCheck->dwErrors = dwErrors;
+	return dwErrors;
 }
 
-// returns the number of remaining blocks in a mempak
-// aNoteSizes should be an array of 16 bytes, which will be overwritten with the size in blocks of each note
-inline WORD CountBlocks( LPCBYTE bMemPakBinary, LPBYTE aNoteSizes )
+// repairs what ValidateMemPak found in pCheck: the ID block from a good backup, and the index from the
+// backup page at 0x200 if that one is sound (or just the checksum, if the chains themselves are fine).
+// only 0x000-0x2FF are written.  returns the MPERR_ bits still set afterwards
+DWORD RepairMemPak( LPBYTE aMemPak, LPMEMPAKCHECK pCheck )
 {
-	WORD wRemainingBlocks = 123;
-	BYTE bNextIndex;
-	int i = 0;
-	while( i < 16 && wRemainingBlocks <= 123 )
+	if(( pCheck->dwErrors & ( MPERR_IDBLOCK | MPERR_NOIDBLOCK )) == MPERR_IDBLOCK )
+	{
+		for( int i = 0; i < ARRAYSIZE(g_aIDBlockBackups); i++ )
+			if( IsIDBlockValid( &aMemPak[g_aIDBlockBackups[i]] ))
+			{
+				CopyMemory( &aMemPak[0x20], &aMemPak[g_aIDBlockBackups[i]], 0x20 );
+				break;
+			}
+	}
+
+	if( pCheck->dwErrors & ( MPERR_CHECKSUM | MPERR_CHAIN | MPERR_LOOP | MPERR_CROSSLINK ))
 	{
-		aNoteSizes[i] = 0;
-		bNextIndex = bMemPakBinary[0x307 + (i*0x20)];
-		while(( bNextIndex >= 5 ) && ( aNoteSizes[i] < wRemainingBlocks))
+		MEMPAKCHECK Backup;
+		if( !( CheckMemPakIndex( aMemPak, 0x200, &Backup ) & ( MPERR_CHECKSUM | MPERR_CHAIN | MPERR_LOOP | MPERR_CROSSLINK )))
+			CopyMemory( &aMemPak[0x100], &aMemPak[0x200], 0x100 );
+		else if( !( pCheck->dwErrors & ( MPERR_CHAIN | MPERR_LOOP | MPERR_CROSSLINK )))
 		{
-			aNoteSizes[i]++;
-			bNextIndex = bMemPakBinary[0x101 + (bNextIndex*2)];
+			int iSum = 0;
+			for( int i = 0x10A; i < 0x200; i++ )
+				iSum += aMemPak[i];
+			aMemPak[0x101] = iSum % 256;
+			CopyMemory( &aMemPak[0x200], &aMemPak[0x100], 0x100 );
 		}
-
-		if( aNoteSizes[i] > wRemainingBlocks )
-			wRemainingBlocks = 0xFF;
-		else
-			wRemainingBlocks -= aNoteSizes[i];
-	
-		i++;
 	}
-	return wRemainingBlocks;
-}
 
+	return ValidateMemPak( aMemPak, pCheck );
+}
 
 
 void FormatMemPak( LPBYTE aMemPak )
@@ -802,7 +907,7 @@ void FormatMemPak( LPBYTE aMemPak )
 	BYTE aValidCodes[] = {	0x12, 0xC5, 0x8F, 0x6F, 0xA4, 0x28, 0x5B, 0xCA };
 	BYTE aCode[8];
 
-	int iRand = (( (ULONG)aMemPak / 4 + (ULONG)g_strEmuInfo.hMainWindow / 4 ) % (sizeof(aValidCodes)/8) );
+	int iRand = (int)(( (ULONG_PTR)aMemPak / 4 ) % (sizeof(aValidCodes)/8) );
 	for( int n = 0; n <8; n++ )
 		aCode[n] = aValidCodes[n+iRand];
 
@@ -948,7 +1053,7 @@ int ReverseNotesA( LPCSTR Text, LPBYTE Note )
 			{
 				if( c == aSpecial[i] )
 				{
-					*Note = (byte)i + 0x34;
+					*Note = (BYTE)i + 0x34;
 					break;
 				}
 			}
@@ -959,437 +1064,328 @@ int ReverseNotesA( LPCSTR Text, LPBYTE Note )
 	return TextPos - Text;
 }
 
-WORD ShowMemPakContent( LPCBYTE bMemPakBinary, HWND hListWindow )
+// two hex digits per byte, one store each
+void HextoTextA( LPCBYTE Data, LPSTR szText, const int nBytes )
+{
+	for( int i = 0; i < nBytes; i++ )
+		*(WORD UNALIGNED *)&szText[i*2] = g_aHexPairs[Data[i]];
+	szText[nBytes*2] = '\0';
+}
+
+// used when reading in a Note file, to convert text to binary (unserialize)
+// anything that isn't a hex digit reads as 0
+void TexttoHexA( LPCSTR szText, LPBYTE Data, const int nBytes )
 {
-	BYTE bMemPakValid = MPAK_OK;
-	TCHAR szBuffer[40];
-	BYTE aNoteSizes[16];
-	bool bFirstChar;
+	for( int i = 0; i < nBytes; i++ )
+		Data[i] = ( g_aHexValue[(BYTE)szText[i*2]] << 4 ) | g_aHexValue[(BYTE)szText[i*2+1]];
+}
 
+// .a64 note files:
+//   a64-notes / <description> / a64-data
+//   header line (see InsertNoteFile)
+//   8 lines of 64 hex digits per block
+//   a64-crc / <CRC-32 of the block data, 8 hex digits> / a64-end
+bool SaveNoteFileA( LPCBYTE aMemPak, const int iNote, LPCTSTR pszFileName )
+{
+	MEMPAKMODEL Model;
+	bool bReturn = false;
+	BuildMemPakModel( &Model, aMemPak );
+	if( MemPakRemainingBlocks( &Model ) > 123 )
+		return false;
 
-	LVITEM lvItem;
-	lvItem.mask = LVIF_TEXT | LVIF_PARAM;
-	lvItem.iItem = 0;
-	lvItem.iSubItem = 0;
-	lvItem.pszText = szBuffer;
+	const int nBlocks = Model.aNoteBlocks[iNote];
+	LPCBYTE aNote = &aMemPak[0x300 + iNote * 32];
 
-	int i = 0,
-		nNotes = 0,
-		iSum = 0,
-		iRemainingBlocks = 0;
+	// the file is built up here and goes out in a single write: 66 chars per line of data, plus room for the rest
+	LPSTR pszFile = (LPSTR)P_malloc( nBlocks * 8 * 66 + 256 );
+	if( !pszFile )
+		return false;
 
-	for( i = 0x10A; i < 0x200; i++ )
-		iSum += bMemPakBinary[i];
+	lstrcpyA( pszFile, "a64-notes\r\ndescription of game save goes here...\r\na64-data\r\n" );
+	LPSTR pszPos = pszFile + lstrlenA( pszFile );
+
+	char szLine[70];
+	CopyMemory( szLine, aNote, 4 );
+	szLine[4] = ' ';
+	szLine[5] = aNote[4];
+	szLine[6] = aNote[5];
+	szLine[7] = ' ';
+	HextoTextA( &aNote[8], &szLine[8], 2 );
+
+	int pos = 12;
+	szLine[pos++] = ' ';
+	szLine[pos++] = aNote[0x0A] + '0';
+	szLine[pos++] = ' ';
+	szLine[pos++] = '{';
+	
+	pos += TranslateNotesA( &aNote[0x0C], &szLine[pos], 1 );
 
+	szLine[pos++] = '}';
+	szLine[pos++] = ' ';
+	szLine[pos++] = '{';
 
-	if((( iSum % 256 ) == bMemPakBinary[0x101] ))
-	{
-		iRemainingBlocks = CountBlocks( bMemPakBinary, aNoteSizes );
+	pos += TranslateNotesA( &aNote[0x10], &szLine[pos], 16 );
 
-		if( iRemainingBlocks <= 123 )
+	lstrcatA( szLine, "}\r\n" );
+	lstrcpyA( pszPos, szLine );
+	pszPos += lstrlenA( szLine );
+
+	DWORD dwCRC = 0;
+	BYTE bNextIndex = aNote[0x7];
+	for( int iBlock = 0; iBlock < nBlocks; iBlock++ )
+	{
+		LPCBYTE pBlock = &aMemPak[bNextIndex * 0x100];
+		dwCRC = CRC32( dwCRC, pBlock, 0x100 );
+		for( int i = 0; i < 0x100; i += 32 )
 		{
-			for( lvItem.lParam = 0; lvItem.lParam < 16; lvItem.lParam++ )
-			{
-				
-				if( bMemPakBinary[0x300 + (lvItem.lParam*32)] ||
-					bMemPakBinary[0x301 + (lvItem.lParam*32)] ||
-					bMemPakBinary[0x302 + (lvItem.lParam*32)] )
-				{
-					int iChars = TranslateNotes( &bMemPakBinary[0x300 + (lvItem.lParam*32) + 0x10], szBuffer, 16 );
-
-					if( TranslateNotes( &bMemPakBinary[0x300 + (lvItem.lParam*32) + 0x0C], &szBuffer[iChars + 1], 1 ) )
-						szBuffer[iChars] = _T('_');
-
-					bFirstChar = true;
-					for( i = 0; i < (int)lstrlen(szBuffer); i++ )
-					{
-						if( szBuffer[i] == ' ' )
-							bFirstChar = true;
-						else
-						{
-							if( bFirstChar && ( szBuffer[i] >= 'a') && ( szBuffer[i] <= 'z'))
-							{
-								bFirstChar = false;
-								szBuffer[i] -= 0x20;
-							}
-						}
-
-					}
-	
-					i = ListView_InsertItem( hListWindow, &lvItem );
-
-					switch( bMemPakBinary[0x303 + (lvItem.lParam*32)] )
-					{
-					case 0x00:
-						LoadString( g_hResourceDLL, IDS_P_MEM_NOREGION, szBuffer, 40 );
-						break;
-					case 0x37:
-						LoadString( g_hResourceDLL, IDS_P_MEM_BETA, szBuffer, 40 );
-						break;
-					case 0x41:
-						LoadString( g_hResourceDLL, IDS_P_MEM_NTSC, szBuffer, 40 );
-						break;
-					case 0x44:
-						LoadString( g_hResourceDLL, IDS_P_MEM_GERMANY, szBuffer, 40 );
-						break;
-					case 0x45:
-						LoadString( g_hResourceDLL, IDS_P_MEM_USA, szBuffer, 40 );
-						break;
-					case 0x46:
-						LoadString( g_hResourceDLL, IDS_P_MEM_FRANCE, szBuffer, 40 );
-						break;
-					case 0x49:
-						LoadString( g_hResourceDLL, IDS_P_MEM_ITALY, szBuffer, 40 );
-						break;
-					case 0x4A:
-						LoadString( g_hResourceDLL, IDS_P_MEM_JAPAN, szBuffer, 40 );
-						break;
-					case 0x50:
-						LoadString( g_hResourceDLL, IDS_P_MEM_EUROPE, szBuffer, 40 );
-						break;
-					case 0x53:
-						LoadString( g_hResourceDLL, IDS_P_MEM_SPAIN, szBuffer, 40 );
-						break;
-					case 0x55:
-						LoadString( g_hResourceDLL, IDS_P_MEM_AUSTRALIA, szBuffer, 40 );
-						break;
-					case 0x58:
-					case 0x59:
-						LoadString( g_hResourceDLL, IDS_P_MEM_PAL, szBuffer, 40 );
-						break;
-					default:
-						{
-							TCHAR szTemp[40];
-							LoadString( g_hResourceDLL, IDS_P_MEM_UNKNOWNREGION, szTemp, 40 );
-							wsprintf( szBuffer, szTemp, bMemPakBinary[0x303 + (lvItem.lParam*32)] );
-						}
-					}
-
-					ListView_SetItemText( hListWindow, i, 1, szBuffer );
-
-					wsprintf( szBuffer, _T("%i"), aNoteSizes[lvItem.lParam] );
-					ListView_SetItemText( hListWindow, i, 2, szBuffer );
-					nNotes++;
-				}
-			}
-			
+			HextoTextA( &pBlock[i], pszPos, 32 );
+			pszPos[64] = '\r';
+			pszPos[65] = '\n';
+			pszPos += 66;
 		}
+		bNextIndex = aMemPak[0x101 + (bNextIndex*2)];
+	}
+	pszPos += wsprintfA( pszPos, "a64-crc\r\n%08X\r\na64-end\r\n", dwCRC );
+
+	LPPAKFILE pFile = PakOpenFile( pszFileName, PAK_FILE_CREATE );
+	if( pFile != NULL )
+	{	
+		if( PakWriteFile( pFile, pszFile, (DWORD)( pszPos - pszFile )))
+			bReturn = true;
 		else
-			bMemPakValid = MPAK_DAMAGED;
+			PakNotifyError( IDS_ERR_NOTEWRITE, PakLastError() );
 
+		PakCloseFile( pFile );
 	}
 	else
-		bMemPakValid = MPAK_DAMAGED;
+		PakNotifyError( IDS_ERR_NOTEREAD, PakLastError() );
 
-	return MAKEWORD( (BYTE)iRemainingBlocks, bMemPakValid );
+	P_free( pszFile );
+	return bReturn;
 }
 
-void HextoTextA( LPCBYTE Data, LPSTR szText, const int nBytes )
+// splits the next line off a file held in memory and strips its line break; NULL once pszEnd is reached
+// (the buffer needs one spare byte past pszEnd for the terminator)
+static LPSTR NextLineA( LPSTR &pszPos, LPCSTR pszEnd )
 {
-	const char acValues[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
-							  'A', 'B', 'C', 'D', 'E', 'F' };
-
-	for( int i = 0; i < nBytes; i++ )
-	{
-		BYTE byte = *Data;
-		szText[0] = acValues[(byte>>4) & 0x0F];
-		szText[1] = acValues[byte & 0x0F];
-
-		++Data;
-		szText+=2;
-	}
-	*szText = '\0';
+	if( pszPos >= pszEnd )
+		return NULL;
+
+	LPSTR pszLine = pszPos;
+	while(( pszPos < pszEnd ) && ( *pszPos != '\r' ) && ( *pszPos != '\n' ))
+		pszPos++;
+
+	LPSTR pszBreak = pszPos;
+	if(( pszPos < pszEnd ) && ( *pszPos == '\r' ))
+		pszPos++;
+	if(( pszPos < pszEnd ) && ( *pszPos == '\n' ))
+		pszPos++;
+	*pszBreak = '\0';
+	return pszLine;
 }
 
-// used when reading in a Note file, to convert text to binary (unserialize)
-void TexttoHexA( LPCSTR szText, LPBYTE Data, const int nBytes )
+// one pass over an .a64 file held in memory: the header line is left in *ppszHeader and the data lines are
+// decoded straight into aData, which has room for 123 blocks.  returns the number of whole blocks,
+// or 0 with *puError set to the message to show
+static int ParseNoteFileA( LPSTR pszFile, LPCSTR pszEnd, LPSTR *ppszHeader, LPBYTE aData, UINT *puError )
 {
-	bool fLowByte = false;
-	LPCSTR endText = szText + nBytes * 2;
+	LPSTR pszPos = pszFile,
+		  pszLine;
 
-	for( ; szText < endText; ++szText )
+	while(( pszLine = NextLineA( pszPos, pszEnd )) && strncmp( "a64-data", pszLine, 8 ))
+		;
+	if( !pszLine )
 	{
-		BYTE bByte = 0;
+		*puError = IDS_ERR_NOTEREAD;
+		return 0;
+	}
 
-		if(( '0' <= *szText ) && ( *szText <= '9' ))
-			bByte = *szText - '0';
-		else
+	if( !( *ppszHeader = NextLineA( pszPos, pszEnd )))
+	{
+		*puError = IDS_ERR_NOTEEOF;
+		return 0;
+	}
+
+	int nLines = 0;
+	while(( pszLine = NextLineA( pszPos, pszEnd )) && strncmp( "a64-crc", pszLine, 7 ))
+	{
+		if( nLines == 123 * 8 )
 		{
-			if(( 'A' <= *szText ) && ( *szText <= 'F' ))
-				bByte = szText[0] - 'A' + 10;
-			else if(( 'a' <= *szText ) && ( *szText <= 'f' ))
-				bByte = szText[0] - 'a' + 10;
+			*puError = IDS_ERR_MEMPAK_SPACE;
+			return 0;
 		}
-
-		if( !fLowByte )
-			*Data = bByte << 4;
-		else
+		if( lstrlenA( pszLine ) < 64 )
 		{
-			*Data |= bByte;
-			++Data;
+			*puError = IDS_ERR_NOTEEOF;
+			return 0;
 		}
-
-		fLowByte = !fLowByte;
+		TexttoHexA( pszLine, &aData[nLines * 32], 32 );
+		nLines++;
 	}
-}
 
-bool SaveNoteFileA( LPCBYTE aMemPak, const int iNote, LPCTSTR pszFileName )
-{
-	BYTE aNoteSizes[16];
-	LPBYTE aNote;
-	bool bReturn = false;
-	if( CountBlocks( aMemPak, aNoteSizes ) > 123 )
-		return false;
-
-	aNote = (LPBYTE)P_malloc( aNoteSizes[iNote] * 0x100 + 32 );
-	if( !aNote )
-		return false;
-
-	CopyMemory( aNote, &aMemPak[0x300 + iNote * 32], 32 );
-	BYTE bNextIndex = aNote[0x7];
-	int iBlock = 0;
-	while( iBlock < aNoteSizes[iNote] )
+	const int nBlocks = nLines / 8;
+	if( !nBlocks )
 	{
-		CopyMemory( &aNote[32 + iBlock * 0x100], &aMemPak[bNextIndex * 0x100], 0x100);
-		bNextIndex = aMemPak[0x101 + (bNextIndex*2)];
-		
-		iBlock++;
+		*puError = IDS_ERR_NOTEREAD;
+		return 0;
+	}
+	// without the a64-crc line (older exports have it too) or with a partial block, the file was cut short
+	if( !pszLine || ( nLines % 8 ))
+	{
+		*puError = IDS_ERR_NOTEEOF;
+		return 0;
 	}
 
-	HANDLE hFile = CreateFile( pszFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
-	if ( hFile != INVALID_HANDLE_VALUE )
-	{	
-		SetFilePointer( hFile, 0L, NULL, FILE_BEGIN );
-		char szLine[70];
-		
-		
-		DWORD dwBytesWritten = 0;
-		lstrcpyA( szLine, "a64-notes\r\ndescription of game save goes here...\r\na64-data\r\n" );
-		WriteFile( hFile, szLine, lstrlenA(szLine), &dwBytesWritten, NULL );
-
-		CopyMemory( szLine, aNote, 4 );
-		szLine[4] = ' ';
-		szLine[5] = aNote[4];
-		szLine[6] = aNote[5];
-		szLine[7] = ' ';
-		HextoTextA( &aNote[8], &szLine[8], 2 );
-
-		int pos = 12;
-		szLine[pos++] = ' ';
-		szLine[pos++] = aNote[0x0A] + '0';
-		szLine[pos++] = ' ';
-		szLine[pos++] = '{';
-		
-		pos += TranslateNotesA( &aNote[0x0C], &szLine[pos], 1 );
-
-		szLine[pos++] = '}';
-		szLine[pos++] = ' ';
-		szLine[pos++] = '{';
-
-		pos += TranslateNotesA( &aNote[0x10], &szLine[pos], 16 );
-
-		lstrcatA( szLine, "}\r\n" );
-		WriteFile( hFile, szLine, lstrlenA(szLine), &dwBytesWritten, NULL );
-
-		for( int i = 32; i < aNoteSizes[iNote] * 0x100 + 32; i += 32 )
-		{
-			HextoTextA( &aNote[i], szLine, 32 );
-			WriteFile( hFile, szLine, lstrlenA(szLine), &dwBytesWritten, NULL );
-			WriteFile( hFile, "\r\n", 2, &dwBytesWritten, NULL );
-		}
-		WriteFile( hFile, "a64-crc\r\n", 9, &dwBytesWritten, NULL );
-
-		// TODO: insert crc here
-		lstrcpynA( szLine, "00000000\r\n", 70 );
-		WriteFile( hFile, szLine, lstrlenA(szLine), &dwBytesWritten, NULL );
-		//
-		WriteFile( hFile, "a64-end\r\n", 9, &dwBytesWritten, NULL );
-
-		SetEndOfFile( hFile );
-		bReturn = true;
-		CloseHandle( hFile );
+	// notes exported before the crc was filled in carry 00000000; those are taken as they are
+	if(( pszLine = NextLineA( pszPos, pszEnd )) && lstrcmpA( pszLine, "00000000" ))
+	{
+		char szCRC[9];
+		wsprintfA( szCRC, "%08X", CRC32( 0, aData, nBlocks * 0x100 ));
+		if( lstrcmpiA( szCRC, pszLine ))
+			LogWarnA( LOG_MEMPAK, "Note file crc %s doesn't match its data (%s)\n", pszLine, szCRC );
 	}
-	else
-		ErrorMessage( IDS_ERR_NOTEREAD, GetLastError(), false );
 
-	P_free( aNote );
-	return bReturn;
+	return nBlocks;
 }
 
 // read a Note from a file pszFileName (.a64 format), and insert it into the given MemPak
 // returns true on success, false otherwise
 bool InsertNoteFile( LPBYTE aMemPak, LPCTSTR pszFileName )
 {
-//	bool bReturn = false;
-
-	FILE* nFile = NULL;
-
-	if( (nFile = _tfopen(pszFileName, _T("r") ) ) != NULL )
+	LPPAKFILE pFile = PakOpenFile( pszFileName, PAK_FILE_READ );
+	if( pFile == NULL )
 	{
-		char szLine[128];
-		fpos_t pDataStart;
-
-		while( fgets(szLine, sizeof(szLine) - 1, nFile) )
-		{
-			if( !strncmp( "a64-data", szLine, 8 ))
-			{
-				return fgetpos(nFile, &pDataStart);
-				break;
-			}
-		}
-
-		// assumes the file keeps going...
-		// discard the next line
-		fgets(szLine, sizeof(szLine) - 1, nFile); // not really necessary to check for EOF, as it will fail gracefully when dwNoteSize is zero.
+		PakNotifyError( IDS_ERR_NOTEREAD, 0 );
+		return false;
+	}
 
-		DWORD dwNoteSize = 0;
-		while( fgets(szLine, sizeof(szLine) - 1, nFile) && strncmp( "a64-crc", szLine, 7 ))
-		{
-			dwNoteSize++;
-		}
-		dwNoteSize /= 8;
+	// a full 123 block note is about 65 KB of text, so the whole file is read in one go
+	DWORD dwFileSize = PakGetFileSize( pFile ),
+		  dwBytesRead = 0;
+	LPSTR pszFile = NULL;
+	LPBYTE aData = NULL;
+	if( dwFileSize < 0x40000 )
+	{
+		pszFile = (LPSTR)P_malloc( dwFileSize + 1 );
+		aData = (LPBYTE)P_malloc( 123 * 0x100 );
+	}
 
-		BYTE aNoteSizes[16];
-		WORD wRemainingBlocks;
-		int i,
-			ifreeNote = -1;
+	UINT uError = IDS_ERR_NOTEREAD;
+	LPSTR szLine = NULL;
+	int nBlocks = 0;
+	if( pszFile && aData && ( dwBytesRead = PakReadFile( pFile, pszFile, dwFileSize )) == dwFileSize )
+		nBlocks = ParseNoteFileA( pszFile, pszFile + dwBytesRead, &szLine, aData, &uError );
+	PakCloseFile( pFile );
 
-		wRemainingBlocks = CountBlocks( aMemPak, aNoteSizes );
+	MEMPAKMODEL Model;
+	int i,
+		ifreeNote = -1;
 
-		if( dwNoteSize <= 0 )
-		{
-			ErrorMessage( IDS_ERR_NOTEREAD, 0, false );
-			fclose(nFile);
-			return false;
-		}
+	if( nBlocks )
+	{
+		// the index has to have that many free entries as well, or the chain can't be laid down
+		BuildMemPakModel( &Model, aMemPak );
+		int iFree = 4;
+		for( i = 0; ( i < nBlocks ) && ( iFree >= 0 ); i++ )
+			iFree = FindFreeMemPakBlock( &Model, iFree + 1 );
+
+		if(( MemPakRemainingBlocks( &Model ) < nBlocks ) || ( iFree < 0 ))
+			uError = IDS_ERR_MEMPAK_SPACE;
 		else
 		{
-			if( wRemainingBlocks < dwNoteSize )
-			{
-				ErrorMessage( IDS_ERR_MEMPAK_SPACE, 0, false );
-				fclose(nFile);
-				return false;
-			}
-			else
+			i = 0;
+			while(( i < 16 ) && ( ifreeNote == -1 ))
 			{
-				i = 0;
-				while(( i < 16 ) && ( ifreeNote == -1 ))
-				{
-					if( aNoteSizes[i] == 0 )
-						ifreeNote = i;
-					i++;
-				}
-				if( ifreeNote == -1 )
-				{
-                    ErrorMessage( IDS_ERR_MEMPAK_NONOTES, 0, false );
-					fclose(nFile);
-					return false;
-				}
+				if( Model.aNoteBlocks[i] == 0 )
+					ifreeNote = i;
+				i++;
 			}
+			if( ifreeNote == -1 )
+				uError = IDS_ERR_MEMPAK_NONOTES;
 		}
+	}
 
-		// HEADER START
+	if( ifreeNote == -1 )
+	{
+		PakNotifyError( uError, 0 );
+		if( pszFile )
+			P_free( pszFile );
+		if( aData )
+			P_free( aData );
+		return false;
+	}
 
-		// .a64 header should look something like this:
-		// NBCE 01 0203 0 {} {BLASTCORPS GAME}
-		// first 4 chars are the first 4 bytes
-		// next 2 chars are the next 2 bytes
-		// next 4 chars are bytes 8 and 9, in hex (huh?)
-		// next character is byte 10, in hex (but only one character this time)
-		// now we've got two sets of braces... the first one contains byte 12 in encoded form (use ReverseNotesA)
-		// the second one should contain bytes 16 through 31 (ReverseNotesA)
+	// HEADER START
 
-		BYTE *pBlock;
-		fsetpos(nFile, &pDataStart);
-		if (! fgets(szLine, sizeof(szLine) - 1, nFile) )
-		{
-			ErrorMessage( IDS_ERR_NOTEEOF, 0, false );
-			fclose(nFile);
-			return false;
-		}
+	// .a64 header should look something like this:
+	// NBCE 01 0203 0 {} {BLASTCORPS GAME}
+	// first 4 chars are the first 4 bytes
+	// next 2 chars are the next 2 bytes
+	// next 4 chars are bytes 8 and 9, in hex (huh?)
+	// next character is byte 10, in hex (but only one character this time)
+	// now we've got two sets of braces... the first one contains byte 12 in encoded form (use ReverseNotesA)
+	// the second one should contain bytes 16 through 31 (ReverseNotesA)
 
-		szLine[strlen(szLine) - 1] = '\0'; // remove newline
-		
-		pBlock = &aMemPak[0x300 + ifreeNote*32];
-		CopyMemory( pBlock, szLine, 4 );
-		pBlock[4] = szLine[5];
-		pBlock[5] = szLine[6];
-		TexttoHexA( &szLine[8], &pBlock[8], 2 );
-		pBlock[10] = szLine[13] - '0';
+	BYTE *pBlock = &aMemPak[0x300 + ifreeNote*32];
+	CopyMemory( pBlock, szLine, 4 );
+	pBlock[4] = szLine[5];
+	pBlock[5] = szLine[6];
+	TexttoHexA( &szLine[8], &pBlock[8], 2 );
+	pBlock[10] = szLine[13] - '0';
 
-		int len = lstrlenA( szLine );
+	int len = lstrlenA( szLine );
 
-		i = 16;
-		while(( szLine[i] != '}' ) && (i < len))
-			i++;
+	i = 16;
+	while(( szLine[i] != '}' ) && (i < len))
+		i++;
 
-		szLine[i] = '\0';
-		i += ReverseNotesA( &szLine[16], &pBlock[12] );
+	szLine[i] = '\0';
+	i += ReverseNotesA( &szLine[16], &pBlock[12] );
 
-		while(( szLine[i] != '{' ) && (i < len))
-			i++;
+	while(( szLine[i] != '{' ) && (i < len))
+		i++;
 
+	if(i < len)
+	{
+		int start = i+1;
+		while(( szLine[i] != '}' ) && (i < len))
+			i++;
 		if(i < len)
 		{
-			int start = i+1;
-			while(( szLine[i] != '}' ) && (i < len))
-				i++;
-			if(i < len)
-			{
-				szLine[i] = '\0';
-				ReverseNotesA( &szLine[start], &pBlock[16] );
-			}
+			szLine[i] = '\0';
+			ReverseNotesA( &szLine[start], &pBlock[16] );
 		}
+	}
 
-		while(( szLine[i] != '}' ) && (i < len))
-			i++;
-		szLine[i] = '\0';
-
-		// HEADER END
-
-		BYTE bDataBlock = 5;
-		pBlock = &pBlock[7];
-		BYTE *pDataBlock;
+	// HEADER END
 
-		while( dwNoteSize > 0 )
-		{
-			while( aMemPak[0x101 + bDataBlock*2] != 0x03 )
-				bDataBlock++;
-			*pBlock = bDataBlock;
-			pBlock = &aMemPak[0x101 + bDataBlock*2];
-			pDataBlock = &aMemPak[bDataBlock * 0x100];
-			for( i = 0; i < 0x100; i+=32 )
-			{
-				if (! fgets(szLine, sizeof(szLine) - 1, nFile) )
-				{
-					ErrorMessage( IDS_ERR_NOTEEOF, 0, false );
-					fclose(nFile);
-					return false;
-				}
+	// blocks we've taken lie behind iDataBlock, so the bitmap from before the insert is still good;
+	// the space check above made sure there are enough of them
+	int iDataBlock = 5;
+	pBlock = &pBlock[7];
 
-				szLine[strlen(szLine) - 1] = '\0'; // remove newline
-				TexttoHexA( szLine, &pDataBlock[i], 32 );
-			}
-			bDataBlock++;
-			dwNoteSize--;
-		}
-		*pBlock = 0x01;
+	for( int iBlock = 0; iBlock < nBlocks; iBlock++ )
+	{
+		iDataBlock = FindFreeMemPakBlock( &Model, iDataBlock );
+		*pBlock = (BYTE)iDataBlock;
+		pBlock = &aMemPak[0x101 + iDataBlock*2];
+		CopyMemory( &aMemPak[iDataBlock * 0x100], &aData[iBlock * 0x100], 0x100 );
+		iDataBlock++;
+	}
+	*pBlock = 0x01;
 
-		int iSum = 0;
+	int iSum = 0;
 
-		for( i = 0x10A; i < 0x200; i++ )
-			iSum += aMemPak[i];
+	for( i = 0x10A; i < 0x200; i++ )
+		iSum += aMemPak[i];
 
-		aMemPak[0x101] = iSum % 256;
+	aMemPak[0x101] = iSum % 256;
 
-		CopyMemory( &aMemPak[0x200], &aMemPak[0x100], 0x100 );
+	CopyMemory( &aMemPak[0x200], &aMemPak[0x100], 0x100 );
 
-		fclose(nFile);
-		return true;
-	}
-	else
-		ErrorMessage( IDS_ERR_NOTEREAD, 0, false );
-	return false;
+	P_free( pszFile );
+	P_free( aData );
+	return true;
 }
 
 // Remove a mempak "Note"
@@ -1420,6 +1416,7 @@ bool RemoveNote( LPBYTE aMemPak, const int iNote )
 
 
 
+// Bit-serial address CRC, only used to build g_aAddressCRCTable.
 BYTE AddressCRC( LPCBYTE Address )
 {
 	bool HighBit;
@@ -1443,7 +1440,95 @@ BYTE AddressCRC( LPCBYTE Address )
 	return Remainder;
 }
 
+// Builds the CRC and hex lookup tables.  Must be called once before any pak I/O (done in DllMain).
+void InitPakCRCTables()
+{
+	for( int i = 0; i < 256; i++ )
+	{
+		BYTE Remainder = (BYTE)i;
+		for( int bBit = 0; bBit < 8; bBit++ )
+			Remainder = ( Remainder & 0x80 ) ? (BYTE)(( Remainder << 1 ) ^ 0x85 ) : (BYTE)( Remainder << 1 );
+		g_aDataCRCTable[0][i] = Remainder;
+	}
+
+	for( int n = 1; n < 8; n++ )
+		for( int i = 0; i < 256; i++ )
+			g_aDataCRCTable[n][i] = g_aDataCRCTable[0][g_aDataCRCTable[n-1][i]];
+
+	for( int i = 0; i < ARRAYSIZE(g_aAddressCRCTable); i++ )
+	{
+		BYTE aAddress[2] = { (BYTE)( i >> 3 ), (BYTE)( i << 5 ) };
+		g_aAddressCRCTable[i] = AddressCRC( aAddress );
+	}
+
+	for( int i = 0; i < 256; i++ )
+	{
+		DWORD dwRemainder = i;
+		for( int bBit = 0; bBit < 8; bBit++ )
+			dwRemainder = ( dwRemainder & 1 ) ? ( dwRemainder >> 1 ) ^ 0xEDB88320 : dwRemainder >> 1;
+		g_aCRC32Table[i] = dwRemainder;
+	}
+
+	const char acValues[] = "0123456789ABCDEF";
+	ZeroMemory( g_aHexValue, sizeof(g_aHexValue) );
+	for( int i = 0; i < 256; i++ )
+		g_aHexPairs[i] = MAKEWORD( acValues[i >> 4], acValues[i & 0x0F] );
+	for( int i = 0; i < 16; i++ )
+	{
+		g_aHexValue[(BYTE)acValues[i]] = (BYTE)i;
+		g_aHexValue[(BYTE)( acValues[i] | 0x20 )] = (BYTE)i;	// lower case; harmless for the digits
+	}
+}
+
+// Continues a CRC-32 over more data; start with dwCRC = 0.
+DWORD CRC32( DWORD dwCRC, LPCBYTE Data, const int iLength )
+{
+	dwCRC = ~dwCRC;
+	for( int i = 0; i < iLength; i++ )
+		dwCRC = g_aCRC32Table[( dwCRC ^ Data[i] ) & 0xFF] ^ ( dwCRC >> 8 );
+	return ~dwCRC;
+}
+
+// Table driven CRC of a pak data block, 8 bytes per step.
+// Gives the same result as DataCRCSerial, which is about 40x slower on a 32 byte block.
 BYTE DataCRC( LPCBYTE Data, const int iLength )
+{
+	register BYTE Remainder = 0;
+	int i = 0;
+
+	for( ; i + 8 <= iLength; i += 8 )
+	{
+		Remainder = g_aDataCRCTable[7][Remainder ^ Data[i]]	^ g_aDataCRCTable[6][Data[i+1]]
+				  ^ g_aDataCRCTable[5][Data[i+2]]			^ g_aDataCRCTable[4][Data[i+3]]
+				  ^ g_aDataCRCTable[3][Data[i+4]]			^ g_aDataCRCTable[2][Data[i+5]]
+				  ^ g_aDataCRCTable[1][Data[i+6]]			^ g_aDataCRCTable[0][Data[i+7]];
+	}
+	for( ; i < iLength; i++ )
+		Remainder = g_aDataCRCTable[0][Remainder ^ Data[i]];
+
+#ifdef _DEBUG
+	if( Remainder != DataCRCSerial( Data, iLength ))
+		DebugWriteA( "DataCRC: table result %02X doesn't match reference %02X!\n", Remainder, DataCRCSerial( Data, iLength ));
+#endif
+
+	return Remainder;
+}
+
+// Table driven CRC of a pak data block, one byte per step; the classic table version.
+// DataCRC does 8 bytes per lookup round instead; this one is kept to measure that against.
+BYTE DataCRCBytewise( LPCBYTE Data, const int iLength )
+{
+	register BYTE Remainder = 0;
+
+	for( int i = 0; i < iLength; i++ )
+		Remainder = g_aDataCRCTable[0][Remainder ^ Data[i]];
+
+	return Remainder;
+}
+
+// Bit-serial reference implementation of DataCRC, one loop iteration per bit.
+// Not used on the hot path anymore; kept as the oracle the table version is checked against in debug builds.
+BYTE DataCRCSerial( LPCBYTE Data, const int iLength )
 {
 	register BYTE Remainder = Data[0];
 
@@ -1466,32 +1551,3 @@ BYTE DataCRC( LPCBYTE Data, const int iLength )
 
 	return Remainder;
 }
-
-VOID CALLBACK WritebackProc( HWND hWnd, UINT msg, UINT_PTR idEvent, DWORD dwTime )
-{
-	KillTimer(hWnd, idEvent); // timer suicide
-
-	switch (idEvent)
-	{
-	case PAK_MEM:
-		DebugWriteA("Mempak: WritebackProc flushed file writes\n");
-		for( int i = 0; i < 4; i++ )
-		{
-			MEMPAK *mPak = (MEMPAK*)g_pcControllers[i].pPakData;
-
-			if ( mPak && mPak->bPakType == PAK_MEM && !mPak->fReadonly && mPak->hMemPakHandle != NULL )
-				FlushViewOfFile( mPak->aMemPakData, PAK_MEM_SIZE );
-		}
-		return;
-	case PAK_TRANSFER:
-		DebugWriteA("TPak: WritebackProc flushed file writes\n");
-		for( int i = 0; i < 4; i++ )
-		{
-			LPTRANSFERPAK tPak = (LPTRANSFERPAK)g_pcControllers[i].pPakData;
-
-			if (tPak && tPak->bPakType == PAK_TRANSFER && tPak->bPakInserted && tPak->gbCart.hRamFile != NULL )
-				FlushViewOfFile( tPak->gbCart.RamData, (tPak->gbCart.RomData[0x149] == 1 ) ? 0x0800 : tPak->gbCart.iNumRamBanks * 0x2000);
-		}
-		return;
-	}
-}
@@ -24,12 +24,44 @@
 #ifndef _PAKIO_H_
 #define _PAKIO_H_
 
-bool InitControllerPak( const int iControl );
-void SaveControllerPak( const int iControl );
-BYTE ReadControllerPak( const int iControl, LPBYTE Command );
-BYTE WriteControllerPak( const int iControl, LPBYTE Command );
-void CloseControllerPak( const int iControl );
-WORD ShowMemPakContent( LPCBYTE bMemPakBinary, HWND hListWindow );
+#include "PakSnapshot.h"
+
+// The pak core: Memory Pak and Transfer Pak emulation on the pak's own structure, with no controller,
+// window or DirectInput behind it.  ControllerPak.cpp binds it to the plugin's controllers; the core
+// itself builds without windows.h (see PakPlatform.h).
+
+#define PAK_NONE		0
+#define PAK_MEM			1
+#define PAK_RUMBLE		2
+#define PAK_TRANSFER	3
+#define PAK_VOICE		4
+#define PAK_ADAPTOID	7
+
+ // just used to display text in GUI
+#define PAK_NONRAW		16
+
+// Runtime counters for each N64 controller.
+// Kept out of CONTROLLER because that gets copied to and from the config dialog wholesale.
+typedef struct _CONTROLLERSTATS
+{
+	DWORD dwAddrCRCErrors;		// pak reads/writes sent with a bad address CRC
+	DWORD dwMemPakCRCHits;		// mempak reads answered from the per-block CRC cache
+	DWORD dwMemPakCRCMisses;	// mempak reads that had to run DataCRC
+	DWORD dwLockContentions;	// times this controller's lock was already held when we went for it
+	DWORD dwWritebackFlushes;	// mempak ranges flushed to disk by the background writeback
+	DWORD dwWritebackBytes;		// bytes in those ranges
+	DWORD dwBankSwaps;			// SwitchMemPakBank calls that swapped the mempak
+	DWORD dwBankSwapMicros;		// total time spent in them
+	DWORD dwMaxBankSwapMicros;	// longest of them
+} CONTROLLERSTATS, *LPCONTROLLERSTATS;
+
+void InitPakCRCTables();
+DWORD CRC32( DWORD dwCRC, LPCBYTE Data, const int iLength );
+BYTE DataCRC( LPCBYTE Data, const int iLength );
+BYTE DataCRCBytewise( LPCBYTE Data, const int iLength );
+BYTE DataCRCSerial( LPCBYTE Data, const int iLength );
+BYTE AddressCRC( LPCBYTE Address );
+bool IsAddressCRCValid( LPCBYTE Command );
 int TranslateNotesA( LPCBYTE bNote, LPSTR Text, const int iChars );
 int TranslateNotesW( LPCBYTE bNote, LPWSTR Text, const int iChars );
 void FormatMemPak( LPBYTE aMemPak );
@@ -113,26 +145,121 @@ void HextoTextA( LPCBYTE Data, LPSTR szText, const int nBytes );
 	// 32 KB mempak
 #define PAK_MEM_SIZE		32*1024
 #define PAK_MEM_DEXOFFSET	0x1040
+	// number of 32 byte blocks (one pak transfer each) in a mempak
+#define PAK_MEM_BLOCKS		(PAK_MEM_SIZE / 32)
+	// mempak writeback granularity: 8 pages of 4 KB per bank, one bit each in MEMPAK::dwDirtyPages
+#define PAK_MEM_PAGE_SIZE	0x1000
+	// banks in a bank file (.mpb): several paks in one mapping, swapped with SwitchMemPakBank.
+	// dwDirtyPages has room for the pages of 4.
+#define PAK_MEM_BANKS_DEFAULT	4
+#define PAK_MEM_BANKS_MAX		4
 
 // Pak Specific Data //
 // First BYTE always determines current Paktype
 // this can be different to the paktype in the Controller-structure.
-// that makes sure to corectly handle/close the pak.
+// that makes sure to corectly handle/close the pak (pPakHandlers is bound to the same type).
 
 //PAK_NONE
 //pPakData = NULL;
 
 //PAK_MEM
+// One entry of the note table (0x300 + n*32) as it is stored, in the pak's own character set.
+typedef struct _MEMPAKNOTE
+{
+	bool fUsed;					// the game code has something in its first 3 bytes
+	BYTE aGameCode[4];			// 0x00; the last byte is the region (0x45 USA, 0x4A Japan, ...)
+	BYTE aPublisher[2];			// 0x04
+	BYTE bFirstBlock;			// 0x07; start of the note's chain in the index
+	BYTE aExtension[4];			// 0x0C; only the first character is shown
+	BYTE aName[16];				// 0x10
+} MEMPAKNOTE, *LPMEMPAKNOTE;
+
+// Parsed view of a Memory Pak's index (0x100) and note table (0x300), so listings and free space
+// queries don't have to rescan the image.  UpdateMemPakModel keeps it current as 32 byte writes land.
+typedef struct _MEMPAKMODEL
+{
+	LPCBYTE aMemPak;			// image the model describes; only 0x000-0x4FF is ever read
+	WORD aIndexSum[8];			// byte sum of each 32 byte chunk of the index page, counting 0x10A-0x1FF only
+	DWORD aFreeBlocks[4];		// one bit per data block whose index entry is 0x03 (free)
+	bool fChainsCurrent;		// aNoteBlocks and wRemainingBlocks are up to date
+	BYTE aNoteBlocks[16];		// length in blocks of each note's chain
+	WORD wRemainingBlocks;		// blocks left for new notes, > 123 if the chains are damaged
+	MEMPAKNOTE aNotes[16];		// the note table, refreshed entry by entry
+} MEMPAKMODEL, *LPMEMPAKMODEL;
+
+void BuildMemPakModel( LPMEMPAKMODEL pModel, LPCBYTE aMemPak );
+void UpdateMemPakModel( LPMEMPAKMODEL pModel, const WORD dwAddress );
+bool IsMemPakIndexValid( const MEMPAKMODEL *pModel );
+WORD MemPakRemainingBlocks( LPMEMPAKMODEL pModel );
+int FindFreeMemPakBlock( const MEMPAKMODEL *pModel, const int iFirst );
+
+// ValidateMemPak error bits
+#define MPERR_IDBLOCK		0x01	// primary ID block (0x20) fails its checksum
+#define MPERR_NOIDBLOCK		0x02	// ...and so do all its backups (0x60, 0x80, 0xC0)
+#define MPERR_CHECKSUM		0x04	// index checksum at 0x101 doesn't match 0x10A-0x1FF
+#define MPERR_CHAIN			0x08	// a note's chain runs into a free or reserved index entry
+#define MPERR_LOOP			0x10	// a note's chain runs back into itself
+#define MPERR_CROSSLINK		0x20	// two notes' chains share a block
+#define MPERR_LOSTBLOCK		0x40	// a block is allocated but no note owns it (harmless)
+#define MPERR_DAMAGED		( MPERR_IDBLOCK | MPERR_CHECKSUM | MPERR_CHAIN | MPERR_LOOP | MPERR_CROSSLINK )
+
+typedef struct _MEMPAKCHECK
+{
+	DWORD dwErrors;			// MPERR_ bits
+	int nNotes;				// notes with a header
+	WORD wUsedBlocks;		// blocks reachable from the notes' chains
+	int iBadNote;			// first note whose chain is broken, -1 if none
+	BYTE bBadBlock;			// index entry where that chain broke
+} MEMPAKCHECK, *LPMEMPAKCHECK;
+
+DWORD ValidateMemPak( LPCBYTE aMemPak, LPMEMPAKCHECK pCheck );
+DWORD RepairMemPak( LPBYTE aMemPak, LPMEMPAKCHECK pCheck );
+
 typedef struct _MEMPAK
 {
 	BYTE bPakType;				// set to PAK_MEM
-	HANDLE hMemPakHandle;		// a file mapping handle
+	struct _PAKMAPPING *pMapping;	// mapping of the file, NULL if readonly or a manifest
 	bool fDexSave;				// true if .n64 file, false if .mpk file
 	bool fReadonly;				// set if we can't open mempak file in "write" mode
-	LPBYTE aMemPakData;			//[PAK_MEM_SIZE];
+	LPBYTE aMemPakData;			//[PAK_MEM_SIZE]; the current bank
+	LPBYTE aMemPakBanks;		//[nBanks * PAK_MEM_SIZE]; what was mapped or allocated, aMemPakData points into it
+	int nBanks;					// paks in the file, 1 unless it's a bank file (.mpb)
+	int iBank;					// the one the game sees
 	BYTE aMemPakTemp[0x100];	// some extra on the top for "test" (temporary) data
+	BYTE aBlockCRC[PAK_MEM_BANKS_MAX * PAK_MEM_BLOCKS];		// cached DataCRC of each 32 byte block of aMemPakBanks
+	DWORD aBlockCRCValid[PAK_MEM_BANKS_MAX * PAK_MEM_BLOCKS / 32];	// one bit per block, set if its aBlockCRC entry is current
+	DWORD dwDirtyPages;			// PAK_MEM_PAGE_SIZE pages of aMemPakBanks written since the last flush, one bit each
+	DWORD dwFirstDirtyTick;		// PakTickCount() when dwDirtyPages last went from 0 to non-0
+	DWORD dwLastWriteTick;		// PakTickCount() of the latest write
+	DWORD dwRetryPages;			// dirty pages the store couldn't take last time; only touched with the writeback held
+	DWORD aSnapWritten[PAK_SNAP_PAGES / 32];	// PAK_SNAP_PAGE_SIZE pages of aMemPakBanks written since the last TakePakSnapshot
+	struct _PAKJOURNAL *pJournal;	// write-ahead journal of the mapped file (all banks), NULL if readonly
+	struct _PAKSTORE *pStore;	// content-addressed store behind aMemPakData if the file is a manifest (.mpm), else NULL
+	MEMPAKMODEL aModels[PAK_MEM_BANKS_MAX];	// parsed index and note table of each bank, all built when the pak is opened
+	LPMEMPAKMODEL pModel;		// the one of aMemPakData
 } MEMPAK, *LPMEMPAK;
 
+// Opens pszFullPath (pszFileName is its file name part, for messages) into a zeroed MEMPAK: maps it,
+// or reads it if it's readonly, or loads it from its store if it's a manifest.  The player is told what
+// went wrong; on failure whatever was opened is released again.  Every bank is checked, but a damaged
+// one is left alone.
+bool OpenMemPak( LPMEMPAK mPak, const TCHAR *pszFullPath, const TCHAR *pszFileName );
+// Repairs the damaged banks of an open pak through its journal, where RepairMemPak leaves them usable.
+// Only called if the player asked for it (RepairMemPaks in NRage.ini).  Returns the number of banks repaired.
+int RepairMemPakBanks( LPMEMPAK mPak );
+// 32 byte pak transfers at dwAddress; both fill in Data[32] with the data CRC.  pStats may be NULL.
+BYTE ReadMemPak( LPMEMPAK mPak, const WORD dwAddress, LPBYTE Data, LPCONTROLLERSTATS pStats );
+BYTE WriteMemPak( LPMEMPAK mPak, const WORD dwAddress, LPBYTE Data );
+// Both must not run alongside FlushMemPakPages or WritePakStore on the same pak.
+void SaveMemPak( LPMEMPAK mPak );
+void CloseMemPak( LPMEMPAK mPak );
+// Makes bank iBank of a bank file the current one.  Returns false if there's no bank to switch to.
+bool SelectMemPakBank( LPMEMPAK mPak, const int iBank );
+// Brings the caches up to date after dwBytes at dwOffset in aMemPakBanks were changed behind WriteMemPak's back.
+void MemPakRestored( LPMEMPAK mPak, const DWORD dwOffset, const DWORD dwBytes );
+// Flushes the PAK_MEM_PAGE_SIZE pages set in dwPages, one PakFlushFile per run of them.
+void FlushMemPakPages( LPCBYTE aMemPakBanks, DWORD dwPages, LPCONTROLLERSTATS pStats );
+
 //PAK_RUMBLE
 typedef struct _RUMBLEPAK
 {
@@ -145,6 +272,9 @@ typedef struct _RUMBLEPAK
 
 #include "GBCart.h"
 //PAK_TRANSFER
+// handler for one 4 KB region of the Transfer Pak's address space
+typedef void (*TPAKHANDLER)(struct _TRANSFERPAK *tPak, const WORD dwAddress, LPBYTE Data);
+
 typedef struct _TRANSFERPAK
 {
 	BYTE bPakType;
@@ -153,9 +283,17 @@ typedef struct _TRANSFERPAK
 	int iAccessModeChanged;
 	bool iEnableState;
 	bool bPakInserted;
+	int iGBBaseOffset;					// added to a 0xC000-0xFFFF pak address to get the GB address; follows iCurrentBankNo
+	const TPAKHANDLER *ptrfnReadTable;	// 16 entries indexed by dwAddress >> 12, swapped with iEnableState
+	const TPAKHANDLER *ptrfnWriteTable;
 	GBCART gbCart;
 } TRANSFERPAK, *LPTRANSFERPAK;
 
+// Resets the registers and loads the cart; bPakInserted says whether that worked.
+void InitTransferPak( LPTRANSFERPAK tPak, LPCTSTR pszRomFile, LPCTSTR pszSaveFile );
+BYTE ReadTransferPak( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data );
+BYTE WriteTransferPak( LPTRANSFERPAK tPak, const WORD dwAddress, LPBYTE Data );
+
 //PAK_VOICE
 typedef struct _VOICEPAK //not supported
 {
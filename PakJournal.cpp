@@ -0,0 +1,347 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PakJournal.h"
+
+#define JOURNAL_MAGIC		0x4C4A524E		// "NRJL"
+#define JOURNAL_VERSION		2
+#define JOURNAL_COMMIT		0xFFFFFFFF		// dwOffset of a commit record
+
+typedef struct _JOURNALHEADER
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD dwDataSize;
+	volatile LONG lCheckpoint;	// records before this sequence number are in the data file
+	DWORD dwRecords;			// ring size
+} JOURNALHEADER;
+
+typedef struct _JOURNALRECORD
+{
+	DWORD dwSequence;			// slot holds a live record only if this matches the sequence number we expect there
+	DWORD dwOffset;				// in the data, or JOURNAL_COMMIT
+	BYTE aOld[32];
+	BYTE aNew[32];
+	DWORD dwCRC;				// CRC32 over everything above
+} JOURNALRECORD;
+
+#define JOURNAL_HEADER_SIZE	64
+
+inline DWORD JournalFileSize( const DWORD dwRecords )
+{
+	return JOURNAL_HEADER_SIZE + dwRecords * sizeof(JOURNALRECORD);
+}
+
+// room for two groups that write every 32 byte block
+static DWORD InitialJournalRecords( const DWORD dwDataSize )
+{
+	DWORD dwRecords = PAK_JOURNAL_RECORDS;
+	while( dwRecords < dwDataSize / 32 * 2 )
+		dwRecords <<= 1;
+	return dwRecords;
+}
+
+// the header is read through the first view, which never moves
+inline JOURNALHEADER *JournalHeader( LPPAKJOURNAL pJournal )
+{
+	return (JOURNALHEADER*)pJournal->apViews[0];
+}
+
+inline JOURNALRECORD *JournalSlot( LPBYTE pView, const DWORD dwRecords, const DWORD dwSequence )
+{
+	return (JOURNALRECORD*)( pView + JOURNAL_HEADER_SIZE ) + ( dwSequence & ( dwRecords - 1 ));
+}
+
+inline JOURNALRECORD *JournalSlot( LPPAKJOURNAL pJournal, const DWORD dwSequence )
+{
+	return JournalSlot( pJournal->pRing, pJournal->dwRecords, dwSequence );
+}
+
+static bool IsValidRecord( LPPAKJOURNAL pJournal, const JOURNALRECORD *pRecord, const DWORD dwSequence )
+{
+	return pRecord->dwSequence == dwSequence
+		&& pRecord->dwCRC == CRC32( 0, (LPCBYTE)pRecord, FIELD_OFFSET( JOURNALRECORD, dwCRC ))
+		&& ( pRecord->dwOffset == JOURNAL_COMMIT || pRecord->dwOffset <= pJournal->dwDataSize - 32 );
+}
+
+// Redoes the committed groups of a journal left behind by a crash and rolls back its uncommitted tail, then flushes the data.
+static void RecoverPakJournal( LPPAKJOURNAL pJournal, LPBYTE pView, const DWORD dwRecords )
+{
+	const DWORD dwStart = (DWORD)((JOURNALHEADER*)pView)->lCheckpoint;
+	DWORD dwEnd = dwStart, dwCommitted = dwStart;
+
+	while( dwEnd - dwStart < dwRecords && IsValidRecord( pJournal, JournalSlot( pView, dwRecords, dwEnd ), dwEnd ))
+	{
+		if( JournalSlot( pView, dwRecords, dwEnd )->dwOffset == JOURNAL_COMMIT )
+			dwCommitted = dwEnd + 1;
+		++dwEnd;
+	}
+
+	if( dwEnd != dwStart )
+	{
+		for( DWORD dwSeq = dwStart; dwSeq != dwCommitted; ++dwSeq )
+		{
+			const JOURNALRECORD *pRecord = JournalSlot( pView, dwRecords, dwSeq );
+			if( pRecord->dwOffset != JOURNAL_COMMIT )
+				CopyMemory( &pJournal->pData[pRecord->dwOffset], pRecord->aNew, 32 );
+		}
+		for( DWORD dwSeq = dwEnd; dwSeq != dwCommitted; --dwSeq )
+		{
+			const JOURNALRECORD *pRecord = JournalSlot( pView, dwRecords, dwSeq - 1 );
+			CopyMemory( &pJournal->pData[pRecord->dwOffset], pRecord->aOld, 32 );
+		}
+		PakFlushFile( pJournal->pData, pJournal->dwDataSize );
+		DebugWrite( _T("PakJournal: recovered %s, %u records redone, %u rolled back\n"), pJournal->szFile, dwCommitted - dwStart, dwEnd - dwCommitted );
+	}
+}
+
+// Maps a journal left behind by a crash, at whatever size its ring had grown to, and recovers it.
+static void RecoverPakJournalFile( LPPAKJOURNAL pJournal, LPPAKFILE pFile )
+{
+	JOURNALHEADER header;
+	if( PakReadFile( pFile, &header, sizeof(header) ) != sizeof(header) || header.dwMagic != JOURNAL_MAGIC
+		|| header.dwVersion != JOURNAL_VERSION || header.dwDataSize != pJournal->dwDataSize )
+		return;		// new (or unusable) journal
+	if( header.dwRecords < PAK_JOURNAL_RECORDS || ( header.dwRecords & ( header.dwRecords - 1 ))
+		|| header.dwRecords > ( InitialJournalRecords( pJournal->dwDataSize ) << PAK_JOURNAL_GROWTHS )
+		|| PakGetFileSize( pFile ) < JournalFileSize( header.dwRecords ))
+	{
+		DebugWrite( _T("PakJournal: %s has a bad ring size, ignored\n"), pJournal->szFile );
+		return;
+	}
+
+	LPPAKMAPPING pMapping;
+	LPBYTE pView = PakMapFile( pFile, JournalFileSize( header.dwRecords ), false, &pMapping );
+	if( pView == NULL )
+		return;
+	RecoverPakJournal( pJournal, pView, header.dwRecords );
+	PakUnmapFile( pView, pMapping );
+}
+
+LPPAKJOURNAL OpenPakJournal( LPCTSTR pszDataFile, LPBYTE pData, const DWORD dwDataSize, const bool fDiscard )
+{
+	LPPAKJOURNAL pJournal = (LPPAKJOURNAL)P_malloc( sizeof(PAKJOURNAL) );
+	if( pJournal == NULL )
+		return NULL;
+	ZeroMemory( pJournal, sizeof(PAKJOURNAL) );
+
+	lstrcpyn( pJournal->szFile, pszDataFile, MAX_PATH - 4 );
+	lstrcat( pJournal->szFile, _T(".jnl") );
+	pJournal->pData = pData;
+	pJournal->dwDataSize = dwDataSize;
+
+	LPPAKFILE pFile = PakOpenFile( pJournal->szFile, PAK_FILE_WRITE );
+	if( pFile == NULL )
+	{
+		DebugWrite( _T("PakJournal: can't open %s, writes won't be journaled\n"), pJournal->szFile );
+		P_free( pJournal );
+		return NULL;
+	}
+	if( !fDiscard )
+		RecoverPakJournalFile( pJournal, pFile );
+
+	// everything is in the data now; start over with an empty ring at its initial size
+	pJournal->dwRecords = InitialJournalRecords( dwDataSize );
+	const DWORD dwFileSize = JournalFileSize( pJournal->dwRecords );
+	if( PakSetFileSize( pFile, dwFileSize ))
+		pJournal->apViews[0] = PakMapFile( pFile, dwFileSize, false, &pJournal->apMappings[0] );
+	PakCloseFile( pFile );
+	if( pJournal->apViews[0] == NULL )
+	{
+		P_free( pJournal );
+		return NULL;
+	}
+	pJournal->nViews = 1;
+	pJournal->pRing = pJournal->apViews[0];
+
+	// sequence numbers start at 1 so zeroed slots never look valid
+	ZeroMemory( pJournal->pRing, dwFileSize );
+	JOURNALHEADER *pHeader = JournalHeader( pJournal );
+	pHeader->dwMagic = JOURNAL_MAGIC;
+	pHeader->dwVersion = JOURNAL_VERSION;
+	pHeader->dwDataSize = dwDataSize;
+	pHeader->dwRecords = pJournal->dwRecords;
+	pHeader->lCheckpoint = 1;
+	PakFlushFile( pJournal->pRing, dwFileSize );
+	pJournal->dwHead = pJournal->dwCommitted = 1;
+	return pJournal;
+}
+
+void ClosePakJournal( LPPAKJOURNAL pJournal )
+{
+	if( pJournal == NULL )
+		return;
+
+	for( int i = pJournal->nViews - 1; i >= 0; --i )
+		PakUnmapFile( pJournal->apViews[i], pJournal->apMappings[i] );
+	PakDeleteFile( pJournal->szFile );		// a clean close leaves nothing to recover
+	P_free( pJournal );
+}
+
+// Doubles the ring.  The writeback thread may be checkpointing through the older views meanwhile, which is
+// why they stay mapped; all of them map the same file.  A crash halfway leaves the old ring intact, since
+// the header only gets the new size once every record has been copied to the slot it has in the new ring.
+static bool GrowPakJournal( LPPAKJOURNAL pJournal )
+{
+	if( pJournal->nViews > PAK_JOURNAL_GROWTHS )
+		return false;
+
+	const DWORD dwRecords = pJournal->dwRecords;
+	LPPAKFILE pFile = PakOpenFile( pJournal->szFile, PAK_FILE_EXISTING );
+	if( pFile == NULL )
+		return false;
+	LPPAKMAPPING pMapping;
+	LPBYTE pView = PakMapFile( pFile, JournalFileSize( dwRecords * 2 ), false, &pMapping );
+	PakCloseFile( pFile );
+	if( pView == NULL )
+		return false;
+
+	// a record keeps its slot unless its sequence number has the new bit set, in which case it moves up into
+	// the half the file just grew by
+	for( DWORD dwSeq = (DWORD)JournalHeader( pJournal )->lCheckpoint; dwSeq != pJournal->dwHead; ++dwSeq )
+	{
+		if( dwSeq & dwRecords )
+			CopyMemory( JournalSlot( pView, dwRecords * 2, dwSeq ), JournalSlot( pView, dwRecords, dwSeq ), sizeof(JOURNALRECORD) );
+	}
+	((JOURNALHEADER*)pView)->dwRecords = dwRecords * 2;
+
+	pJournal->apViews[pJournal->nViews] = pView;
+	pJournal->apMappings[pJournal->nViews] = pMapping;
+	++pJournal->nViews;
+	pJournal->pRing = pView;
+	pJournal->dwRecords = dwRecords * 2;
+	DebugWrite( _T("PakJournal: %s grew to %u records\n"), pJournal->szFile, pJournal->dwRecords );
+	return true;
+}
+
+// Returns false if the record doesn't fit in the ring even after growing it.
+static bool AppendRecord( LPPAKJOURNAL pJournal, const DWORD dwOffset, LPCBYTE Data )
+{
+	// the writeback thread may move the checkpoint forward while we look; that only frees more room
+	if( pJournal->dwHead - (DWORD)JournalHeader( pJournal )->lCheckpoint >= pJournal->dwRecords && !GrowPakJournal( pJournal ))
+		return false;
+
+	JOURNALRECORD *pRecord = JournalSlot( pJournal, pJournal->dwHead );
+	pRecord->dwSequence = pJournal->dwHead;
+	pRecord->dwOffset = dwOffset;
+	if( Data )
+	{
+		CopyMemory( pRecord->aOld, &pJournal->pData[dwOffset], 32 );
+		CopyMemory( pRecord->aNew, Data, 32 );
+	}
+	else
+	{
+		ZeroMemory( pRecord->aOld, 32 );
+		ZeroMemory( pRecord->aNew, 32 );
+	}
+	pRecord->dwCRC = CRC32( 0, (LPCBYTE)pRecord, FIELD_OFFSET( JOURNALRECORD, dwCRC ));
+	++pJournal->dwHead;
+	return true;
+}
+
+// Takes the records of the current group back out of the ring and lets its writes go through unjournaled,
+// like they would without a journal, rather than leave recovery a group that's only partly there.  The
+// earlier groups go too: redoing them on top of the unjournaled writes would roll those back.  Only the
+// journal header gets written here, the data stays with the writeback thread.
+static void DropPakJournalGroup( LPPAKJOURNAL pJournal )
+{
+	for( DWORD dwSeq = pJournal->dwCommitted; dwSeq != pJournal->dwHead; ++dwSeq )
+		JournalSlot( pJournal, dwSeq )->dwSequence = ~dwSeq;
+	pJournal->dwHead = pJournal->dwCommitted;
+	PakJournalCheckpoint( pJournal, pJournal->dwCommitted );
+	pJournal->fDropped = true;
+	LogWarnA( LOG_MEMPAK | LOG_TPAK, "PakJournal: a group didn't fit in %u records, writing it unjournaled\n", pJournal->dwRecords );
+}
+
+void PakJournalWrite( LPPAKJOURNAL pJournal, LPBYTE pData, const DWORD dwOffset, LPCBYTE Data )
+{
+	if( pJournal && !pJournal->fDropped && dwOffset <= pJournal->dwDataSize - 32 )	// RTC bytes past the journaled range go straight through
+	{
+		if( AppendRecord( pJournal, dwOffset, Data ))
+			pJournal->fPending = true;
+		else
+			DropPakJournalGroup( pJournal );
+	}
+	CopyMemory( &pData[dwOffset], Data, 32 );
+}
+
+void PakJournalCommit( LPPAKJOURNAL pJournal )
+{
+	if( pJournal == NULL )
+		return;
+
+	if( pJournal->fDropped )
+	{
+		pJournal->fDropped = false;
+		pJournal->fPending = false;
+	}
+	else if( pJournal->fPending )
+	{
+		if( AppendRecord( pJournal, JOURNAL_COMMIT, NULL ))
+		{
+			pJournal->dwCommitted = pJournal->dwHead;
+			pJournal->fPending = false;
+		}
+		else
+		{
+			DropPakJournalGroup( pJournal );
+			pJournal->fDropped = false;
+			pJournal->fPending = false;
+		}
+	}
+
+	if( pJournal->dwHead - (DWORD)JournalHeader( pJournal )->lCheckpoint > pJournal->dwRecords / 2 )
+		pJournal->fWantCheckpoint = true;
+}
+
+DWORD PakJournalMark( LPPAKJOURNAL pJournal )
+{
+	return pJournal ? pJournal->dwCommitted : 0;
+}
+
+// May run on the writeback thread while the owner keeps journaling; the checkpoint only ever moves forward.
+void PakJournalCheckpoint( LPPAKJOURNAL pJournal, const DWORD dwMark )
+{
+	if( pJournal == NULL )
+		return;
+
+	JOURNALHEADER *pHeader = JournalHeader( pJournal );
+	LONG lCheckpoint = pHeader->lCheckpoint;
+	while( (LONG)( dwMark - (DWORD)lCheckpoint ) > 0 )
+	{
+		const LONG lSeen = PakAtomicCompareExchange( &pHeader->lCheckpoint, (LONG)dwMark, lCheckpoint );
+		if( lSeen == lCheckpoint )
+		{
+			PakFlushFile( pHeader, JOURNAL_HEADER_SIZE );
+			pJournal->fWantCheckpoint = false;	// the next commit asks again if the ring is still too full
+			break;
+		}
+		lCheckpoint = lSeen;
+	}
+}
@@ -0,0 +1,81 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PAKJOURNAL_H_
+#define _PAKJOURNAL_H_
+
+// Write-ahead journal for pak data that lives in a mapped file (mempaks, Transfer Pak SRAM).
+//
+// Every 32 byte block write is recorded, old and new contents, in "<datafile>.jnl" before it touches the data.
+// The journal is itself a mapped file, so records cost a memcpy and survive the emulator crashing.
+// (Nothing forces the journal to disk ahead of the data, so an OS crash or power loss is still best effort.)
+// PakJournalCommit closes a group of writes (one emulated frame); PakJournalCheckpoint drops everything
+// up to the last commit once the data file has been flushed.  If the journal is still there when the pak is
+// opened again, committed groups are redone and the uncommitted tail is rolled back, so a note write
+// interrupted halfway never leaves a torn index table behind.
+//
+// The ring starts out with room for two groups that write every block of the data (snapshot restores), and
+// the writer never flushes anything itself: once the ring is half full, PakJournalWantsCheckpoint asks the
+// writeback thread to flush and checkpoint, and if the ring fills up before that happens, it doubles.  A group
+// that doesn't fit even then is dropped from the journal as a whole, so recovery never sees part of a group.
+
+#define PAK_JOURNAL_RECORDS		1024	// smallest ring
+#define PAK_JOURNAL_GROWTHS		4		// times the ring may double
+
+typedef struct _PAKJOURNAL
+{
+	struct _PAKMAPPING *apMappings[PAK_JOURNAL_GROWTHS+1];	// the first view and every bigger one the ring grew into;
+	LPBYTE apViews[PAK_JOURNAL_GROWTHS+1];					// all of them stay mapped until the close
+	int nViews;
+	LPBYTE pRing;				// the latest view, used by the owner only; PakJournalCheckpoint sticks to apViews[0]
+	DWORD dwRecords;			// ring size, a power of 2
+	LPBYTE pData;				// the journaled data, and its size
+	DWORD dwDataSize;
+	DWORD dwHead;				// sequence number of the next record
+	DWORD dwCommitted;			// sequence number after the latest commit record
+	bool fPending;				// block records since the latest commit
+	bool fDropped;				// the current group didn't fit and goes unjournaled
+	volatile bool fWantCheckpoint;	// the ring is more than half full
+	TCHAR szFile[MAX_PATH+1];
+} PAKJOURNAL, *LPPAKJOURNAL;
+
+// Opens or creates the journal for pszDataFile and recovers pData from it; fDiscard throws away a leftover journal
+// instead (the data file was just created).  Returns NULL if no journal could be created, in which case writes
+// simply go unjournaled.
+LPPAKJOURNAL OpenPakJournal( LPCTSTR pszDataFile, LPBYTE pData, const DWORD dwDataSize, const bool fDiscard );
+// The data must be flushed already.  Deletes the journal file.
+void ClosePakJournal( LPPAKJOURNAL pJournal );
+
+// Journals a 32 byte block write at dwOffset of pData, then performs it.  pJournal may be NULL.
+void PakJournalWrite( LPPAKJOURNAL pJournal, LPBYTE pData, const DWORD dwOffset, LPCBYTE Data );
+void PakJournalCommit( LPPAKJOURNAL pJournal );
+// Everything committed before the returned mark is in the data; once that is flushed, pass the mark to PakJournalCheckpoint.
+DWORD PakJournalMark( LPPAKJOURNAL pJournal );
+void PakJournalCheckpoint( LPPAKJOURNAL pJournal, const DWORD dwMark );
+// true if the owner of the data should flush it and checkpoint soon; pJournal may be NULL
+inline bool PakJournalWantsCheckpoint( LPPAKJOURNAL pJournal )
+{
+	return pJournal && pJournal->fWantCheckpoint;
+}
+
+#endif // #ifndef _PAKJOURNAL_H_
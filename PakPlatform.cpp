@@ -0,0 +1,416 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include <windows.h>
+#include "NRagePluginV2.h"
+#include "PakPlatform.h"
+
+// Files //
+
+// a PAKFILE is the file handle itself, a PAKMAPPING the file mapping handle
+LPPAKFILE PakOpenFile( const TCHAR *pszFile, const int iMode )
+{
+	static const DWORD aAccess[] = { GENERIC_READ, GENERIC_READ | GENERIC_WRITE, GENERIC_READ | GENERIC_WRITE, GENERIC_WRITE };
+	static const DWORD aDisposition[] = { OPEN_EXISTING, OPEN_ALWAYS, OPEN_EXISTING, CREATE_ALWAYS };
+
+	HANDLE hFile = CreateFile( pszFile, aAccess[iMode], ( iMode == PAK_FILE_CREATE ) ? 0 : FILE_SHARE_READ, NULL, aDisposition[iMode], 0, NULL );
+	return ( hFile == INVALID_HANDLE_VALUE ) ? NULL : (LPPAKFILE)hFile;
+}
+
+void PakCloseFile( LPPAKFILE pFile )
+{
+	if( pFile != NULL )
+		CloseHandle( (HANDLE)pFile );
+}
+
+DWORD PakReadFile( LPPAKFILE pFile, void *pBuffer, const DWORD dwSize )
+{
+	DWORD dwRead = 0;
+	if( !ReadFile( (HANDLE)pFile, pBuffer, dwSize, &dwRead, NULL ))
+		return 0;
+	return dwRead;
+}
+
+bool PakWriteFile( LPPAKFILE pFile, const void *pBuffer, const DWORD dwSize )
+{
+	DWORD dwWritten = 0;
+	return WriteFile( (HANDLE)pFile, pBuffer, dwSize, &dwWritten, NULL ) && dwWritten == dwSize;
+}
+
+bool PakSeekFile( LPPAKFILE pFile, const DWORD dwOffset )
+{
+	return SetFilePointer( (HANDLE)pFile, dwOffset, NULL, FILE_BEGIN ) != INVALID_SET_FILE_POINTER;
+}
+
+DWORD PakGetFileSize( LPPAKFILE pFile )
+{
+	return GetFileSize( (HANDLE)pFile, NULL );
+}
+
+bool PakSetFileSize( LPPAKFILE pFile, const DWORD dwSize )
+{
+	return SetFilePointer( (HANDLE)pFile, dwSize, NULL, FILE_BEGIN ) != INVALID_SET_FILE_POINTER && SetEndOfFile( (HANDLE)pFile );
+}
+
+bool PakSyncFile( LPPAKFILE pFile )
+{
+	return FlushFileBuffers( (HANDLE)pFile ) != 0;
+}
+
+static ULONGLONG FileTimeValue( const FILETIME *pTime )
+{
+	return ((ULONGLONG)pTime->dwHighDateTime << 32 ) | pTime->dwLowDateTime;
+}
+
+bool PakGetFileInfo( LPPAKFILE pFile, LPPAKFILEINFO pInfo )
+{
+	BY_HANDLE_FILE_INFORMATION FileInfo;
+	if( !GetFileInformationByHandle( (HANDLE)pFile, &FileInfo ))
+		return false;
+
+	pInfo->qwVolume = FileInfo.dwVolumeSerialNumber;
+	pInfo->qwFileID = ((ULONGLONG)FileInfo.nFileIndexHigh << 32 ) | FileInfo.nFileIndexLow;
+	pInfo->qwSize = ((ULONGLONG)FileInfo.nFileSizeHigh << 32 ) | FileInfo.nFileSizeLow;
+	pInfo->qwLastWrite = FileTimeValue( &FileInfo.ftLastWriteTime );
+	pInfo->fDirectory = ( FileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) != 0;
+	return true;
+}
+
+bool PakGetPathInfo( const TCHAR *pszPath, LPPAKFILEINFO pInfo )
+{
+	WIN32_FILE_ATTRIBUTE_DATA FileData;
+	if( !GetFileAttributesEx( pszPath, GetFileExInfoStandard, &FileData ))
+		return false;
+
+	pInfo->qwVolume = 0;
+	pInfo->qwFileID = 0;
+	pInfo->qwSize = ((ULONGLONG)FileData.nFileSizeHigh << 32 ) | FileData.nFileSizeLow;
+	pInfo->qwLastWrite = FileTimeValue( &FileData.ftLastWriteTime );
+	pInfo->fDirectory = ( FileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) != 0;
+	return true;
+}
+
+// Paths //
+
+bool PakFileExists( const TCHAR *pszPath )
+{
+	return GetFileAttributes( pszPath ) != INVALID_FILE_ATTRIBUTES;
+}
+
+bool PakDeleteFile( const TCHAR *pszPath )
+{
+	return DeleteFile( pszPath ) != 0;
+}
+
+bool PakRenameFile( const TCHAR *pszFrom, const TCHAR *pszTo, const bool fReplace )
+{
+	return MoveFileEx( pszFrom, pszTo, MOVEFILE_WRITE_THROUGH | ( fReplace ? MOVEFILE_REPLACE_EXISTING : 0 )) != 0;
+}
+
+bool PakCreateDirectory( const TCHAR *pszPath )
+{
+	return CreateDirectory( pszPath, NULL ) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+TCHAR *PakFullPathName( const TCHAR *pszPath, TCHAR *pszFull )
+{
+	TCHAR *pszFilePart = NULL;
+	const DWORD dwLength = GetFullPathName( pszPath, MAX_PATH + 1, pszFull, &pszFilePart );
+	if( dwLength == 0 || dwLength > MAX_PATH )
+		return NULL;
+	return pszFilePart;
+}
+
+void PakFindFiles( const TCHAR *pszDirectory, const TCHAR *pszSuffix, PAKFINDPROC pfnFile, void *pParam )
+{
+	TCHAR szPattern[MAX_PATH+1];
+	const int nDirectory = lstrlen( pszDirectory );
+	if( nDirectory + ( pszSuffix ? lstrlen( pszSuffix ) : 3 ) + 2 > MAX_PATH )
+		return;
+	lstrcpy( szPattern, pszDirectory );
+	if( nDirectory && szPattern[nDirectory - 1] != _T('\\') )
+		lstrcat( szPattern, _T("\\") );
+	lstrcat( szPattern, _T("*") );
+	lstrcat( szPattern, pszSuffix ? pszSuffix : _T(".*") );
+
+	WIN32_FIND_DATA FindFile;
+	HANDLE hFindFile = FindFirstFile( szPattern, &FindFile );
+	if( hFindFile == INVALID_HANDLE_VALUE )
+		return;
+	do
+	{
+		if( !( FindFile.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) && !pfnFile( FindFile.cFileName, pParam ))
+			break;
+	} while( FindNextFile( hFindFile, &FindFile ));
+	FindClose( hFindFile );
+}
+
+void PakFindDirectories( const TCHAR *pszDirectory, PAKFINDPROC pfnDirectory, void *pParam )
+{
+	TCHAR szPattern[MAX_PATH+1];
+	const int nDirectory = lstrlen( pszDirectory );
+	if( nDirectory + 3 > MAX_PATH )
+		return;
+	lstrcpy( szPattern, pszDirectory );
+	if( nDirectory && szPattern[nDirectory - 1] != _T('\\') )
+		lstrcat( szPattern, _T("\\") );
+	lstrcat( szPattern, _T("*") );
+
+	WIN32_FIND_DATA FindFile;
+	HANDLE hFindFile = FindFirstFile( szPattern, &FindFile );
+	if( hFindFile == INVALID_HANDLE_VALUE )
+		return;
+	do
+	{
+		// junctions aren't followed, so one pointing back up the tree can't send a walk in circles
+		if(( FindFile.dwFileAttributes & ( FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_REPARSE_POINT )) != FILE_ATTRIBUTE_DIRECTORY
+			|| !lstrcmp( FindFile.cFileName, _T(".") ) || !lstrcmp( FindFile.cFileName, _T("..") ))
+			continue;
+		if( !pfnDirectory( FindFile.cFileName, pParam ))
+			break;
+	} while( FindNextFile( hFindFile, &FindFile ));
+	FindClose( hFindFile );
+}
+
+// Mappings //
+
+BYTE *PakMapFile( LPPAKFILE pFile, const DWORD dwSize, const bool fReadOnly, LPPAKMAPPING *ppMapping )
+{
+	HANDLE hMapping = CreateFileMapping( (HANDLE)pFile, NULL, fReadOnly ? PAGE_READONLY : PAGE_READWRITE, 0, dwSize, NULL );
+	*ppMapping = NULL;
+	if( hMapping == NULL )
+	{
+		DebugWriteA( "PakMapFile: CreateFileMapping failed: %08x\n", GetLastError() );
+		return NULL;
+	}
+
+	LPBYTE pView = (LPBYTE)MapViewOfFile( hMapping, fReadOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, dwSize );
+	if( pView == NULL )
+	{
+		DebugWriteA( "PakMapFile: MapViewOfFile failed: %08x\n", GetLastError() );
+		CloseHandle( hMapping );
+		return NULL;
+	}
+	*ppMapping = (LPPAKMAPPING)hMapping;
+	return pView;
+}
+
+void PakFlushFile( const void *pView, const DWORD dwSize )
+{
+	FlushViewOfFile( pView, dwSize );
+}
+
+void PakUnmapFile( const void *pView, LPPAKMAPPING pMapping )
+{
+	if( pView != NULL )
+		UnmapViewOfFile( pView );
+	if( pMapping != NULL )
+		CloseHandle( (HANDLE)pMapping );
+}
+
+// Memory //
+
+void *PakAllocPages( const DWORD dwSize )
+{
+	return VirtualAlloc( NULL, dwSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+}
+
+void PakProtectPages( void *pPages, const DWORD dwSize, const bool fReadOnly )
+{
+	DWORD dwProtect;
+	VirtualProtect( pPages, dwSize, fReadOnly ? PAGE_READONLY : PAGE_READWRITE, &dwProtect );
+}
+
+void PakFreePages( void *pPages, const DWORD dwSize )
+{
+	VirtualFree( pPages, 0, MEM_RELEASE );
+}
+
+// Threads //
+
+// a PAKLOCK is a CRITICAL_SECTION of its own
+LPPAKLOCK PakCreateLock()
+{
+	CRITICAL_SECTION *pcs = (CRITICAL_SECTION*)P_malloc( sizeof(CRITICAL_SECTION) );
+	if( pcs != NULL )
+		InitializeCriticalSection( pcs );
+	return (LPPAKLOCK)pcs;
+}
+
+void PakDeleteLock( LPPAKLOCK pLock )
+{
+	if( pLock == NULL )
+		return;
+	DeleteCriticalSection( (CRITICAL_SECTION*)pLock );
+	P_free( pLock );
+}
+
+void PakEnterLock( LPPAKLOCK pLock )
+{
+	EnterCriticalSection( (CRITICAL_SECTION*)pLock );
+}
+
+bool PakTryEnterLock( LPPAKLOCK pLock )
+{
+	return TryEnterCriticalSection( (CRITICAL_SECTION*)pLock ) != 0;
+}
+
+void PakLeaveLock( LPPAKLOCK pLock )
+{
+	LeaveCriticalSection( (CRITICAL_SECTION*)pLock );
+}
+
+LONG PakAtomicIncrement( volatile LONG *plValue )
+{
+	return InterlockedIncrement( plValue );
+}
+
+LONG PakAtomicDecrement( volatile LONG *plValue )
+{
+	return InterlockedDecrement( plValue );
+}
+
+LONG PakAtomicAdd( volatile LONG *plValue, const LONG lAdd )
+{
+	return InterlockedExchangeAdd( plValue, lAdd ) + lAdd;
+}
+
+LONG PakAtomicCompareExchange( volatile LONG *plValue, const LONG lExchange, const LONG lComparand )
+{
+	return InterlockedCompareExchange( plValue, lExchange, lComparand );
+}
+
+typedef struct _PAKTHREAD
+{
+	HANDLE hThread;
+	PAKTHREADPROC pfnThread;
+	void *pParam;
+} PAKTHREAD;
+
+static DWORD WINAPI PakThreadMain( LPVOID lpParam )
+{
+	PAKTHREAD *pThread = (PAKTHREAD*)lpParam;
+	pThread->pfnThread( pThread->pParam );
+	return 0;
+}
+
+LPPAKTHREAD PakStartThread( PAKTHREADPROC pfnThread, void *pParam )
+{
+	PAKTHREAD *pThread = (PAKTHREAD*)P_malloc( sizeof(PAKTHREAD) );
+	if( pThread == NULL )
+		return NULL;
+	pThread->pfnThread = pfnThread;
+	pThread->pParam = pParam;
+	pThread->hThread = CreateThread( NULL, 0, PakThreadMain, pThread, 0, NULL );
+	if( pThread->hThread == NULL )
+	{
+		DebugWriteA( "PakStartThread: CreateThread failed: %08x\n", GetLastError() );
+		P_free( pThread );
+		return NULL;
+	}
+	return pThread;
+}
+
+void PakJoinThread( LPPAKTHREAD pThread )
+{
+	if( pThread == NULL )
+		return;
+	WaitForSingleObject( pThread->hThread, INFINITE );
+	CloseHandle( pThread->hThread );
+	P_free( pThread );
+}
+
+int PakRunWorkers( const int nJobs, PAKTHREADPROC pfnWorker, void *pParam )
+{
+	SYSTEM_INFO SystemInfo;
+	GetSystemInfo( &SystemInfo );
+	PAKTHREAD aThreads[MAXIMUM_WAIT_OBJECTS];
+	HANDLE ahThreads[MAXIMUM_WAIT_OBJECTS];
+	const int nWanted = min( min( (int)SystemInfo.dwNumberOfProcessors, nJobs ), MAXIMUM_WAIT_OBJECTS );
+	int nStarted = 0;
+
+	for( int i = 0; i < nWanted; i++ )
+	{
+		aThreads[nStarted].pfnThread = pfnWorker;
+		aThreads[nStarted].pParam = pParam;
+		ahThreads[nStarted] = CreateThread( NULL, 0, PakThreadMain, &aThreads[nStarted], 0, NULL );
+		if( ahThreads[nStarted] )
+			nStarted++;
+	}
+
+	if( nStarted )
+	{
+		WaitForMultipleObjects( nStarted, ahThreads, TRUE, INFINITE );
+		for( int i = 0; i < nStarted; i++ )
+			CloseHandle( ahThreads[i] );
+	}
+	else if( nJobs > 0 )
+		pfnWorker( pParam );	// no threads to be had; do it here
+	return nStarted;
+}
+
+// Time //
+
+DWORD PakTickCount()
+{
+	return GetTickCount();
+}
+
+ULONGLONG PakMicroseconds()
+{
+	LARGE_INTEGER liNow, liFreq;
+	QueryPerformanceCounter( &liNow );
+	QueryPerformanceFrequency( &liFreq );
+	return (ULONGLONG)( liNow.QuadPart / liFreq.QuadPart ) * 1000000 + (ULONGLONG)( liNow.QuadPart % liFreq.QuadPart ) * 1000000 / liFreq.QuadPart;
+}
+
+DWORD PakCurrentThreadId()
+{
+	return GetCurrentThreadId();
+}
+
+DWORD PakLastError()
+{
+	return GetLastError();
+}
+
+// Notifications //
+
+void PakNotify( const unsigned uTextID, const TCHAR *pszArg )
+{
+	TCHAR tszTitle[DEFAULT_BUFFER], tszText[DEFAULT_BUFFER], tszBuffer[MAX_PATH + DEFAULT_BUFFER];
+
+	LoadString( g_hResourceDLL, uTextID, tszText, DEFAULT_BUFFER );
+	LoadString( g_hResourceDLL, IDS_DLG_WARN_TITLE, tszTitle, DEFAULT_BUFFER );
+	if( pszArg != NULL )
+		wsprintf( tszBuffer, tszText, pszArg );
+	else
+		lstrcpy( tszBuffer, tszText );
+	MessageBox( g_strEmuInfo.hMainWindow, tszBuffer, tszTitle, MB_OK | MB_ICONWARNING );
+}
+
+void PakNotifyError( const unsigned uTextID, const DWORD dwError )
+{
+	ErrorMessage( uTextID, dwError, false );
+}
@@ -0,0 +1,162 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PAKPLATFORM_H_
+#define _PAKPLATFORM_H_
+
+// Operating system services for the pak core: the Memory Pak, Transfer Pak and GB cart code (PakIO.cpp,
+// GBCart.cpp and the modules under them) reaches files, mappings, threads and the clock only through here,
+// and only through the types below, so none of it needs windows.h.
+// PakPlatform.cpp implements this for Win32, PakPlatformPosix.cpp for everything else; CMakeLists.txt builds
+// the core with the latter.  What stays Win32 only is the plugin around the core: ControllerPak.cpp (which
+// binds paks to controllers and runs the writeback thread), DirectInput rumble, the dialogs and SITrace.
+
+#ifdef _WIN32
+#define PAK_PATH_SEPARATOR	_T('\\')
+#else
+#define PAK_PATH_SEPARATOR	_T('/')
+#endif
+
+// Files //
+
+typedef struct _PAKFILE *LPPAKFILE;
+
+#define PAK_FILE_READ		0	// existing file, read only
+#define PAK_FILE_WRITE		1	// read and write, created if it doesn't exist
+#define PAK_FILE_EXISTING	2	// existing file, read and write
+#define PAK_FILE_CREATE		3	// write only, created or emptied
+
+// Returns NULL if the file can't be opened; PakLastError says why.
+LPPAKFILE PakOpenFile( const TCHAR *pszFile, const int iMode );
+void PakCloseFile( LPPAKFILE pFile );
+// Returns the number of bytes read, 0 on error or at the end of the file.
+DWORD PakReadFile( LPPAKFILE pFile, void *pBuffer, const DWORD dwSize );
+// Returns true only if all of it was written.
+bool PakWriteFile( LPPAKFILE pFile, const void *pBuffer, const DWORD dwSize );
+bool PakSeekFile( LPPAKFILE pFile, const DWORD dwOffset );
+// 0xFFFFFFFF if the size can't be had or doesn't fit
+DWORD PakGetFileSize( LPPAKFILE pFile );
+// Cuts the file off (or pads it with zeroes) at dwSize bytes.
+bool PakSetFileSize( LPPAKFILE pFile, const DWORD dwSize );
+// Returns once what was written to the file is on disk.
+bool PakSyncFile( LPPAKFILE pFile );
+
+typedef struct _PAKFILEINFO
+{
+	ULONGLONG qwVolume;			// volume and file id together tell the file apart from any other,
+	ULONGLONG qwFileID;			// whichever path it was opened through; only PakGetFileInfo fills them in
+	ULONGLONG qwSize;
+	ULONGLONG qwLastWrite;		// in the system's own units; only good for comparing
+	bool fDirectory;
+} PAKFILEINFO, *LPPAKFILEINFO;
+
+bool PakGetFileInfo( LPPAKFILE pFile, LPPAKFILEINFO pInfo );
+bool PakGetPathInfo( const TCHAR *pszPath, LPPAKFILEINFO pInfo );
+
+// Paths //
+
+bool PakFileExists( const TCHAR *pszPath );
+bool PakDeleteFile( const TCHAR *pszPath );
+// Renames pszFrom to pszTo and returns once the rename is on disk.  An existing pszTo is replaced if
+// fReplace is set; otherwise the call fails.
+bool PakRenameFile( const TCHAR *pszFrom, const TCHAR *pszTo, const bool fReplace );
+// Succeeds if the directory is already there.
+bool PakCreateDirectory( const TCHAR *pszPath );
+// Makes pszPath absolute in pszFull (MAX_PATH+1 TCHARs).  Returns where the file name starts in pszFull,
+// or NULL if it fails or pszPath ends in a separator.
+TCHAR *PakFullPathName( const TCHAR *pszPath, TCHAR *pszFull );
+// Calls pfnFile with the name (no path) of every file in pszDirectory ending in pszSuffix, compared without
+// case; NULL for all of them.  Directories are skipped.  Stops early when pfnFile returns false.
+typedef bool (*PAKFINDPROC)( const TCHAR *pszName, void *pParam );
+void PakFindFiles( const TCHAR *pszDirectory, const TCHAR *pszSuffix, PAKFINDPROC pfnFile, void *pParam );
+// The same for the subdirectories of pszDirectory, without "." and "..".
+void PakFindDirectories( const TCHAR *pszDirectory, PAKFINDPROC pfnDirectory, void *pParam );
+
+// Mappings //
+
+typedef struct _PAKMAPPING *LPPAKMAPPING;
+
+// Maps dwSize bytes of an open file, growing the file if needed.  A dwSize of 0 maps the whole file.
+// Returns the view, or NULL on failure.  *ppMapping receives the mapping (NULL on failure).
+// pFile may be closed as soon as this returns.
+BYTE *PakMapFile( LPPAKFILE pFile, const DWORD dwSize, const bool fReadOnly, LPPAKMAPPING *ppMapping );
+// Writes dirty pages of a mapped range back to disk.  The range doesn't have to start on a page.
+void PakFlushFile( const void *pView, const DWORD dwSize );
+// Releases a view from PakMapFile along with its mapping.  pView must be the start of the view.
+void PakUnmapFile( const void *pView, LPPAKMAPPING pMapping );
+
+// Memory //
+
+// Page aligned memory straight from the system, for buffers that get write protected.
+void *PakAllocPages( const DWORD dwSize );
+void PakProtectPages( void *pPages, const DWORD dwSize, const bool fReadOnly );
+void PakFreePages( void *pPages, const DWORD dwSize );
+
+// Threads //
+
+typedef struct _PAKLOCK *LPPAKLOCK;
+
+LPPAKLOCK PakCreateLock();
+void PakDeleteLock( LPPAKLOCK pLock );
+void PakEnterLock( LPPAKLOCK pLock );
+bool PakTryEnterLock( LPPAKLOCK pLock );
+void PakLeaveLock( LPPAKLOCK pLock );
+
+// full barriers; each returns the new value, except PakAtomicCompareExchange which returns the old one
+LONG PakAtomicIncrement( volatile LONG *plValue );
+LONG PakAtomicDecrement( volatile LONG *plValue );
+LONG PakAtomicAdd( volatile LONG *plValue, const LONG lAdd );
+LONG PakAtomicCompareExchange( volatile LONG *plValue, const LONG lExchange, const LONG lComparand );
+
+typedef void (*PAKTHREADPROC)( void *pParam );
+
+// Runs pfnWorker( pParam ) on one thread per processor, but no more than nJobs, and waits for all of them.
+// The workers are expected to take their jobs off a shared PakAtomicIncrement counter.  If no thread can be
+// started, pfnWorker runs once on the calling thread.  Returns the number of threads used.
+int PakRunWorkers( const int nJobs, PAKTHREADPROC pfnWorker, void *pParam );
+
+typedef struct _PAKTHREAD *LPPAKTHREAD;
+
+// Runs pfnThread( pParam ) on a thread of its own; NULL if it can't be started.
+LPPAKTHREAD PakStartThread( PAKTHREADPROC pfnThread, void *pParam );
+// Waits for the thread to return, then releases it.
+void PakJoinThread( LPPAKTHREAD pThread );
+
+// Time //
+
+// milliseconds; wraps around every 49 days, so only compare differences
+DWORD PakTickCount();
+// microseconds from a monotonic clock, for timing
+ULONGLONG PakMicroseconds();
+DWORD PakCurrentThreadId();
+// the system's code for why the last call failed
+DWORD PakLastError();
+
+// Notifications //
+
+// Warns the player with string table entry uTextID, formatted with pszArg if it isn't NULL.
+void PakNotify( const unsigned uTextID, const TCHAR *pszArg );
+// Reports a failure with string table entry uTextID and, unless it's 0, the system error dwError.
+void PakNotifyError( const unsigned uTextID, const DWORD dwError );
+
+#endif // #ifndef _PAKPLATFORM_H_
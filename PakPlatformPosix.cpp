@@ -0,0 +1,553 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "PakPlatform.h"
+
+// PakPlatform.h for everything but Windows; built by CMakeLists.txt
+
+// Files //
+
+typedef struct _PAKFILE
+{
+	int fd;
+} PAKFILE;
+
+LPPAKFILE PakOpenFile( const TCHAR *pszFile, const int iMode )
+{
+	static const int aFlags[] = { O_RDONLY, O_RDWR | O_CREAT, O_RDWR, O_WRONLY | O_CREAT | O_TRUNC };
+
+	const int fd = open( pszFile, aFlags[iMode] | O_CLOEXEC, 0666 );
+	if( fd < 0 )
+		return NULL;
+	PAKFILE *pFile = (PAKFILE*)P_malloc( sizeof(PAKFILE) );
+	if( pFile == NULL )
+	{
+		close( fd );
+		return NULL;
+	}
+	pFile->fd = fd;
+	return pFile;
+}
+
+void PakCloseFile( LPPAKFILE pFile )
+{
+	if( pFile == NULL )
+		return;
+	close( pFile->fd );
+	P_free( pFile );
+}
+
+DWORD PakReadFile( LPPAKFILE pFile, void *pBuffer, const DWORD dwSize )
+{
+	DWORD dwRead = 0;
+	while( dwRead < dwSize )
+	{
+		const ssize_t n = read( pFile->fd, (BYTE*)pBuffer + dwRead, dwSize - dwRead );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			break;
+		dwRead += (DWORD)n;
+	}
+	return dwRead;
+}
+
+bool PakWriteFile( LPPAKFILE pFile, const void *pBuffer, const DWORD dwSize )
+{
+	DWORD dwWritten = 0;
+	while( dwWritten < dwSize )
+	{
+		const ssize_t n = write( pFile->fd, (const BYTE*)pBuffer + dwWritten, dwSize - dwWritten );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return false;
+		dwWritten += (DWORD)n;
+	}
+	return true;
+}
+
+bool PakSeekFile( LPPAKFILE pFile, const DWORD dwOffset )
+{
+	return lseek( pFile->fd, (off_t)dwOffset, SEEK_SET ) == (off_t)dwOffset;
+}
+
+DWORD PakGetFileSize( LPPAKFILE pFile )
+{
+	struct stat st;
+	if( fstat( pFile->fd, &st ) != 0 || st.st_size > 0xFFFFFFFE )
+		return 0xFFFFFFFF;
+	return (DWORD)st.st_size;
+}
+
+bool PakSetFileSize( LPPAKFILE pFile, const DWORD dwSize )
+{
+	return ftruncate( pFile->fd, (off_t)dwSize ) == 0;
+}
+
+bool PakSyncFile( LPPAKFILE pFile )
+{
+	return fsync( pFile->fd ) == 0;
+}
+
+static void StatInfo( const struct stat *pStat, LPPAKFILEINFO pInfo )
+{
+	pInfo->qwVolume = (ULONGLONG)pStat->st_dev;
+	pInfo->qwFileID = (ULONGLONG)pStat->st_ino;
+	pInfo->qwSize = (ULONGLONG)pStat->st_size;
+#ifdef __APPLE__
+	pInfo->qwLastWrite = (ULONGLONG)pStat->st_mtimespec.tv_sec * 1000000000 + (ULONGLONG)pStat->st_mtimespec.tv_nsec;
+#else
+	pInfo->qwLastWrite = (ULONGLONG)pStat->st_mtim.tv_sec * 1000000000 + (ULONGLONG)pStat->st_mtim.tv_nsec;
+#endif
+	pInfo->fDirectory = S_ISDIR( pStat->st_mode );
+}
+
+bool PakGetFileInfo( LPPAKFILE pFile, LPPAKFILEINFO pInfo )
+{
+	struct stat st;
+	if( fstat( pFile->fd, &st ) != 0 )
+		return false;
+	StatInfo( &st, pInfo );
+	return true;
+}
+
+bool PakGetPathInfo( const TCHAR *pszPath, LPPAKFILEINFO pInfo )
+{
+	struct stat st;
+	if( stat( pszPath, &st ) != 0 )
+		return false;
+	StatInfo( &st, pInfo );
+	pInfo->qwVolume = 0;	// same as Win32, where only an open file has an id
+	pInfo->qwFileID = 0;
+	return true;
+}
+
+// Paths //
+
+bool PakFileExists( const TCHAR *pszPath )
+{
+	return access( pszPath, F_OK ) == 0;
+}
+
+bool PakDeleteFile( const TCHAR *pszPath )
+{
+	return unlink( pszPath ) == 0;
+}
+
+// the rename is only durable once the directory holding the new name is synced
+static void SyncParentDirectory( const TCHAR *pszPath )
+{
+	TCHAR szDir[MAX_PATH+1];
+	lstrcpyn( szDir, pszPath, ARRAYSIZE(szDir) );
+	TCHAR *pszSlash = _tcsrchr( szDir, PAK_PATH_SEPARATOR );
+	if( pszSlash == szDir )
+		pszSlash[1] = '\0';
+	else if( pszSlash )
+		*pszSlash = '\0';
+	else
+		lstrcpy( szDir, "." );
+
+	const int fd = open( szDir, O_RDONLY | O_CLOEXEC );
+	if( fd >= 0 )
+	{
+		fsync( fd );
+		close( fd );
+	}
+}
+
+bool PakRenameFile( const TCHAR *pszFrom, const TCHAR *pszTo, const bool fReplace )
+{
+	if( fReplace )
+	{
+		if( rename( pszFrom, pszTo ) != 0 )
+			return false;
+	}
+	else
+	{
+		// link fails with EEXIST rather than replacing pszTo
+		if( link( pszFrom, pszTo ) != 0 )
+			return false;
+		unlink( pszFrom );
+	}
+	SyncParentDirectory( pszTo );
+	return true;
+}
+
+bool PakCreateDirectory( const TCHAR *pszPath )
+{
+	return mkdir( pszPath, 0777 ) == 0 || errno == EEXIST;
+}
+
+TCHAR *PakFullPathName( const TCHAR *pszPath, TCHAR *pszFull )
+{
+	if( pszPath[0] == '/' )
+	{
+		if( lstrlen( pszPath ) > MAX_PATH )
+			return NULL;
+		lstrcpy( pszFull, pszPath );
+	}
+	else
+	{
+		if( !getcwd( pszFull, MAX_PATH + 1 ))
+			return NULL;
+		const int nDir = lstrlen( pszFull );
+		if( nDir + 1 + lstrlen( pszPath ) > MAX_PATH )
+			return NULL;
+		if( nDir == 0 || pszFull[nDir - 1] != '/' )
+			lstrcat( pszFull, "/" );
+		lstrcat( pszFull, pszPath );
+	}
+
+	TCHAR *pszFilePart = _tcsrchr( pszFull, '/' ) + 1;
+	return *pszFilePart ? pszFilePart : NULL;
+}
+
+void PakFindFiles( const TCHAR *pszDirectory, const TCHAR *pszSuffix, PAKFINDPROC pfnFile, void *pParam )
+{
+	DIR *pDir = opendir( pszDirectory );
+	if( pDir == NULL )
+		return;
+
+	const int nSuffix = pszSuffix ? lstrlen( pszSuffix ) : 0;
+	const int nDirectory = lstrlen( pszDirectory );
+	struct dirent *pEntry;
+	while(( pEntry = readdir( pDir )) != NULL )
+	{
+		const int nName = lstrlen( pEntry->d_name );
+		if( nName < nSuffix || ( nSuffix && lstrcmpi( pEntry->d_name + nName - nSuffix, pszSuffix )))
+			continue;
+
+		bool fDirectory = ( pEntry->d_type == DT_DIR );
+		if( pEntry->d_type == DT_UNKNOWN || pEntry->d_type == DT_LNK )
+		{
+			TCHAR szPath[MAX_PATH+1];
+			struct stat st;
+			if( nDirectory + 1 + nName > MAX_PATH )
+				continue;
+			sprintf( szPath, "%s/%s", pszDirectory, pEntry->d_name );
+			fDirectory = ( stat( szPath, &st ) != 0 ) || S_ISDIR( st.st_mode );
+		}
+		if( !fDirectory && !pfnFile( pEntry->d_name, pParam ))
+			break;
+	}
+	closedir( pDir );
+}
+
+void PakFindDirectories( const TCHAR *pszDirectory, PAKFINDPROC pfnDirectory, void *pParam )
+{
+	DIR *pDir = opendir( pszDirectory );
+	if( pDir == NULL )
+		return;
+
+	const int nDirectory = lstrlen( pszDirectory );
+	struct dirent *pEntry;
+	while(( pEntry = readdir( pDir )) != NULL )
+	{
+		if( !lstrcmp( pEntry->d_name, "." ) || !lstrcmp( pEntry->d_name, ".." ))
+			continue;
+
+		bool fDirectory = ( pEntry->d_type == DT_DIR );
+		if( pEntry->d_type == DT_UNKNOWN )
+		{
+			// symbolic links aren't followed, so a link back up the tree can't send a walk in circles
+			TCHAR szPath[MAX_PATH+1];
+			struct stat st;
+			if( nDirectory + 1 + lstrlen( pEntry->d_name ) > MAX_PATH )
+				continue;
+			sprintf( szPath, "%s/%s", pszDirectory, pEntry->d_name );
+			fDirectory = ( lstat( szPath, &st ) == 0 ) && S_ISDIR( st.st_mode );
+		}
+		if( fDirectory && !pfnDirectory( pEntry->d_name, pParam ))
+			break;
+	}
+	closedir( pDir );
+}
+
+// Mappings //
+
+typedef struct _PAKMAPPING
+{
+	size_t nSize;		// munmap needs it
+} PAKMAPPING;
+
+BYTE *PakMapFile( LPPAKFILE pFile, const DWORD dwSize, const bool fReadOnly, LPPAKMAPPING *ppMapping )
+{
+	*ppMapping = NULL;
+
+	struct stat st;
+	if( fstat( pFile->fd, &st ) != 0 )
+		return NULL;
+	size_t nSize = dwSize ? dwSize : (size_t)st.st_size;
+	if( nSize == 0 )
+	{
+		errno = EINVAL;		// like CreateFileMapping on an empty file
+		return NULL;
+	}
+	if( (off_t)nSize > st.st_size )
+	{
+		// CreateFileMapping grows the file to the size of the mapping, and so do we
+		if( fReadOnly || ftruncate( pFile->fd, (off_t)nSize ) != 0 )
+		{
+			DebugWriteA( "PakMapFile: ftruncate failed: %d\n", errno );
+			return NULL;
+		}
+	}
+
+	PAKMAPPING *pMapping = (PAKMAPPING*)P_malloc( sizeof(PAKMAPPING) );
+	if( pMapping == NULL )
+		return NULL;
+	void *pView = mmap( NULL, nSize, fReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, pFile->fd, 0 );
+	if( pView == MAP_FAILED )
+	{
+		DebugWriteA( "PakMapFile: mmap failed: %d\n", errno );
+		P_free( pMapping );
+		return NULL;
+	}
+	pMapping->nSize = nSize;
+	*ppMapping = pMapping;
+	return (BYTE*)pView;
+}
+
+void PakFlushFile( const void *pView, const DWORD dwSize )
+{
+	// msync wants a page aligned start, FlushViewOfFile doesn't
+	const ULONG_PTR uPageMask = (ULONG_PTR)sysconf( _SC_PAGESIZE ) - 1;
+	const ULONG_PTR uStart = (ULONG_PTR)pView & ~uPageMask;
+	msync( (void*)uStart, (size_t)((ULONG_PTR)pView - uStart + dwSize ), MS_SYNC );
+}
+
+void PakUnmapFile( const void *pView, LPPAKMAPPING pMapping )
+{
+	if( pView != NULL && pMapping != NULL )
+		munmap( (void*)pView, pMapping->nSize );
+	if( pMapping != NULL )
+		P_free( pMapping );
+}
+
+// Memory //
+
+void *PakAllocPages( const DWORD dwSize )
+{
+	void *pPages = mmap( NULL, dwSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	return ( pPages == MAP_FAILED ) ? NULL : pPages;
+}
+
+void PakProtectPages( void *pPages, const DWORD dwSize, const bool fReadOnly )
+{
+	mprotect( pPages, dwSize, fReadOnly ? PROT_READ : PROT_READ | PROT_WRITE );
+}
+
+void PakFreePages( void *pPages, const DWORD dwSize )
+{
+	munmap( pPages, dwSize );
+}
+
+// Threads //
+
+// recursive, like a CRITICAL_SECTION
+typedef struct _PAKLOCK
+{
+	pthread_mutex_t Mutex;
+} PAKLOCK;
+
+LPPAKLOCK PakCreateLock()
+{
+	PAKLOCK *pLock = (PAKLOCK*)P_malloc( sizeof(PAKLOCK) );
+	if( pLock == NULL )
+		return NULL;
+	pthread_mutexattr_t Attr;
+	pthread_mutexattr_init( &Attr );
+	pthread_mutexattr_settype( &Attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( &pLock->Mutex, &Attr );
+	pthread_mutexattr_destroy( &Attr );
+	return pLock;
+}
+
+void PakDeleteLock( LPPAKLOCK pLock )
+{
+	if( pLock == NULL )
+		return;
+	pthread_mutex_destroy( &pLock->Mutex );
+	P_free( pLock );
+}
+
+void PakEnterLock( LPPAKLOCK pLock )
+{
+	pthread_mutex_lock( &pLock->Mutex );
+}
+
+bool PakTryEnterLock( LPPAKLOCK pLock )
+{
+	return pthread_mutex_trylock( &pLock->Mutex ) == 0;
+}
+
+void PakLeaveLock( LPPAKLOCK pLock )
+{
+	pthread_mutex_unlock( &pLock->Mutex );
+}
+
+LONG PakAtomicIncrement( volatile LONG *plValue )
+{
+	return __sync_add_and_fetch( plValue, 1 );
+}
+
+LONG PakAtomicDecrement( volatile LONG *plValue )
+{
+	return __sync_sub_and_fetch( plValue, 1 );
+}
+
+LONG PakAtomicAdd( volatile LONG *plValue, const LONG lAdd )
+{
+	return __sync_add_and_fetch( plValue, lAdd );
+}
+
+LONG PakAtomicCompareExchange( volatile LONG *plValue, const LONG lExchange, const LONG lComparand )
+{
+	return __sync_val_compare_and_swap( plValue, lComparand, lExchange );
+}
+
+typedef struct _PAKTHREAD
+{
+	pthread_t Thread;
+	PAKTHREADPROC pfnThread;
+	void *pParam;
+} PAKTHREAD;
+
+static void *PakThreadMain( void *pParam )
+{
+	PAKTHREAD *pThread = (PAKTHREAD*)pParam;
+	pThread->pfnThread( pThread->pParam );
+	return NULL;
+}
+
+LPPAKTHREAD PakStartThread( PAKTHREADPROC pfnThread, void *pParam )
+{
+	PAKTHREAD *pThread = (PAKTHREAD*)P_malloc( sizeof(PAKTHREAD) );
+	if( pThread == NULL )
+		return NULL;
+	pThread->pfnThread = pfnThread;
+	pThread->pParam = pParam;
+	if( pthread_create( &pThread->Thread, NULL, PakThreadMain, pThread ) != 0 )
+	{
+		P_free( pThread );
+		return NULL;
+	}
+	return pThread;
+}
+
+void PakJoinThread( LPPAKTHREAD pThread )
+{
+	if( pThread == NULL )
+		return;
+	pthread_join( pThread->Thread, NULL );
+	P_free( pThread );
+}
+
+#define PAK_MAX_WORKERS		64		// MAXIMUM_WAIT_OBJECTS on Win32
+
+int PakRunWorkers( const int nJobs, PAKTHREADPROC pfnWorker, void *pParam )
+{
+	PAKTHREAD aThreads[PAK_MAX_WORKERS];
+	const long nProcessors = sysconf( _SC_NPROCESSORS_ONLN );
+	const int nWanted = min( min( (int)max( nProcessors, 1L ), nJobs ), PAK_MAX_WORKERS );
+	int nStarted = 0;
+
+	for( int i = 0; i < nWanted; i++ )
+	{
+		aThreads[nStarted].pfnThread = pfnWorker;
+		aThreads[nStarted].pParam = pParam;
+		if( pthread_create( &aThreads[nStarted].Thread, NULL, PakThreadMain, &aThreads[nStarted] ) == 0 )
+			nStarted++;
+	}
+
+	if( nStarted )
+	{
+		for( int i = 0; i < nStarted; i++ )
+			pthread_join( aThreads[i].Thread, NULL );
+	}
+	else if( nJobs > 0 )
+		pfnWorker( pParam );	// no threads to be had; do it here
+	return nStarted;
+}
+
+// Time //
+
+DWORD PakTickCount()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (DWORD)( (ULONGLONG)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+ULONGLONG PakMicroseconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (ULONGLONG)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+DWORD PakCurrentThreadId()
+{
+#ifdef __linux__
+	return (DWORD)syscall( SYS_gettid );
+#else
+	return (DWORD)(ULONG_PTR)pthread_self();
+#endif
+}
+
+DWORD PakLastError()
+{
+	return (DWORD)errno;
+}
+
+// Notifications //
+
+// there's no string table outside of the plugin; the id is what NRagePluginV2.rc would show
+void PakNotify( const unsigned uTextID, const TCHAR *pszArg )
+{
+	if( pszArg != NULL )
+		fprintf( stderr, "nragepak: warning %u: %s\n", uTextID, pszArg );
+	else
+		fprintf( stderr, "nragepak: warning %u\n", uTextID );
+}
+
+void PakNotifyError( const unsigned uTextID, const DWORD dwError )
+{
+	if( dwError )
+		fprintf( stderr, "nragepak: error %u: %s\n", uTextID, strerror( (int)dwError ));
+	else
+		fprintf( stderr, "nragepak: error %u\n", uTextID );
+}
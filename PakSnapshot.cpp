@@ -0,0 +1,357 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "PakIO.h"
+#include "PakJournal.h"
+#include "PakPlatform.h"
+#include "PakSnapshot.h"
+
+// One page of pak memory as a snapshot saw it.  Every snapshot that saw the same content holds a reference,
+// and so does the live list below while the pak still holds it.
+typedef struct _SNAPPAGE
+{
+	LONG lRefs;
+	BYTE aData[PAK_SNAP_PAGE_SIZE];
+} SNAPPAGE, *LPSNAPPAGE;
+
+// one controller's part of a snapshot
+typedef struct _PAKSNAPSTATE
+{
+	BYTE bPakType;				// PAK_NONE if there was no pak
+	DWORD dwGeneration;			// g_aLive[].dwGeneration when it was taken
+	int nPages;
+	LPSNAPPAGE apPages[PAK_SNAP_PAGES];
+	int iMemPakBank;			// PAK_MEM
+	BYTE aMemPakTemp[0x100];
+	TRANSFERPAK TPak;			// PAK_TRANSFER; only the registers are restored, never the pointers
+} PAKSNAPSTATE, *LPPAKSNAPSTATE;
+
+typedef struct _PAKSNAPSHOT
+{
+	PAKSNAPSTATE aPaks[4];
+} PAKSNAPSHOT;
+
+// The pages each controller's pak held at the last snapshot or restore.  A page the pak marked written since
+// then is stale and gets copied by the next snapshot; all others are shared.  Guarded by LockPakSlot.
+typedef struct _SNAPLIVE
+{
+	DWORD dwGeneration;			// bumped whenever the pak is closed, so old snapshots don't restore into a new pak
+	LPSNAPPAGE apPages[PAK_SNAP_PAGES];
+} SNAPLIVE;
+
+static SNAPLIVE g_aLive[4];
+static PAKSNAPSTATS g_SnapStats;
+static LPPAKLOCK g_pSnapStatsLock = NULL;	// snapshots may be taken, restored and counted on different threads
+
+void InitPakSnapshots()
+{
+	g_pSnapStatsLock = PakCreateLock();
+}
+
+void FreePakSnapshots()
+{
+	PakDeleteLock( g_pSnapStatsLock );
+	g_pSnapStatsLock = NULL;
+}
+
+static void ReleaseSnapPage( LPSNAPPAGE pPage )
+{
+	// snapshots may be freed on another thread than the one taking them
+	if( pPage && PakAtomicDecrement( &pPage->lRefs ) == 0 )
+		P_free( pPage );
+}
+
+// The memory a snapshot covers for a pak, its size and the pak's written page bits; NULL if it has none.
+static LPBYTE GetSnapMemory( LPVOID pPakData, DWORD *pdwSize, DWORD **paWritten )
+{
+	switch( *(BYTE*)pPakData )
+	{
+	case PAK_MEM:
+		{
+			MEMPAK *mPak = (MEMPAK*)pPakData;
+			*pdwSize = mPak->nBanks * PAK_MEM_SIZE;
+			*paWritten = mPak->aSnapWritten;
+			return mPak->aMemPakBanks;
+		}
+	case PAK_TRANSFER:
+		{
+			LPTRANSFERPAK tPak = (LPTRANSFERPAK)pPakData;
+			if( !tPak->bPakInserted || !tPak->gbCart.RamData )
+				return NULL;
+			*pdwSize = min( tPak->gbCart.iRamSize, PAK_SNAP_PAGES * PAK_SNAP_PAGE_SIZE );
+			*paWritten = tPak->gbCart.aSnapWritten;
+			return tPak->gbCart.RamData;
+		}
+	default:
+		return NULL;
+	}
+}
+
+// Writes one page back through the pak's journal, 32 bytes at a time and only where it differs.
+// Returns true if anything changed.
+static bool RestoreSnapPage( LPPAKJOURNAL pJournal, LPBYTE aMemory, const DWORD dwOffset, const DWORD dwBytes, LPCBYTE aData )
+{
+	bool bChanged = false;
+	for( DWORD i = 0; i < dwBytes; i += 32 )
+		if( memcmp( &aMemory[dwOffset + i], &aData[i], 32 ))
+		{
+			PakJournalWrite( pJournal, aMemory, dwOffset + i, &aData[i] );
+			bChanged = true;
+		}
+	return bChanged;
+}
+
+EXPORT LPPAKSNAPSHOT CALL TakePakSnapshot( void )
+{
+	const ULONGLONG qwStart = PakMicroseconds();
+
+	LPPAKSNAPSHOT pSnapshot = (LPPAKSNAPSHOT)P_malloc( sizeof(PAKSNAPSHOT) );
+	if( !pSnapshot )
+		return NULL;
+
+	bool bComplete = true;
+	DWORD dwPagesCopied = 0, dwPagesShared = 0;
+	for( int i = 0; i < 4; i++ )
+	{
+		LPPAKSNAPSTATE pState = &pSnapshot->aPaks[i];
+		pState->bPakType = PAK_NONE;
+		pState->nPages = 0;
+
+		LPVOID pPakData = LockPakSlot( i );
+		if( pPakData )
+		{
+			pState->bPakType = *(BYTE*)pPakData;
+			pState->dwGeneration = g_aLive[i].dwGeneration;
+
+			DWORD dwSize = 0, *aWritten = NULL;
+			LPBYTE aMemory = GetSnapMemory( pPakData, &dwSize, &aWritten );
+			const int nPages = aMemory ? ( dwSize + PAK_SNAP_PAGE_SIZE - 1 ) / PAK_SNAP_PAGE_SIZE : 0;
+			for( int p = 0; p < nPages; p++ )
+			{
+				LPSNAPPAGE pPage = g_aLive[i].apPages[p];
+				if( !pPage || ( aWritten[p >> 5] & ( 1u << ( p & 31 ))))
+				{
+					// written since the last snapshot, so the shared page is stale
+					pPage = (LPSNAPPAGE)P_malloc( sizeof(SNAPPAGE) );
+					if( !pPage )
+					{
+						bComplete = false;
+						break;
+					}
+					const DWORD dwOffset = p * PAK_SNAP_PAGE_SIZE;
+					CopyMemory( pPage->aData, &aMemory[dwOffset], min( (DWORD)PAK_SNAP_PAGE_SIZE, dwSize - dwOffset ));
+					pPage->lRefs = 1;	// the live list's
+					ReleaseSnapPage( g_aLive[i].apPages[p] );
+					g_aLive[i].apPages[p] = pPage;
+					aWritten[p >> 5] &= ~( 1u << ( p & 31 ));
+					dwPagesCopied++;
+				}
+				else
+					dwPagesShared++;
+
+				PakAtomicIncrement( &pPage->lRefs );
+				pState->apPages[p] = pPage;
+				pState->nPages = p + 1;
+			}
+
+			if( pState->bPakType == PAK_MEM )
+			{
+				MEMPAK *mPak = (MEMPAK*)pPakData;
+				pState->iMemPakBank = mPak->iBank;
+				CopyMemory( pState->aMemPakTemp, mPak->aMemPakTemp, sizeof(pState->aMemPakTemp) );
+			}
+			else if( pState->bPakType == PAK_TRANSFER )
+				CopyMemory( &pState->TPak, pPakData, sizeof(TRANSFERPAK) );
+		}
+		UnlockPakSlot( i, 0 );
+	}
+
+	const DWORD dwMicros = (DWORD)( PakMicroseconds() - qwStart );
+	PakEnterLock( g_pSnapStatsLock );
+	g_SnapStats.dwPagesCopied += dwPagesCopied;
+	g_SnapStats.dwPagesShared += dwPagesShared;
+	if( bComplete )
+	{
+		g_SnapStats.dwSnapshots++;
+		g_SnapStats.dwMicroseconds += dwMicros;
+		g_SnapStats.dwMaxMicroseconds = max( g_SnapStats.dwMaxMicroseconds, dwMicros );
+	}
+	PakLeaveLock( g_pSnapStatsLock );
+
+	if( !bComplete )
+	{
+		DebugWriteA("TakePakSnapshot: out of memory\n");
+		FreePakSnapshot( pSnapshot );
+		return NULL;
+	}
+	return pSnapshot;
+}
+
+EXPORT BOOL CALL RestorePakSnapshot( LPPAKSNAPSHOT pSnapshot )
+{
+	if( !pSnapshot )
+		return FALSE;
+
+	BOOL bReturn = TRUE;
+	DWORD dwPagesRestored = 0;
+	for( int i = 0; i < 4; i++ )
+	{
+		LPPAKSNAPSTATE pState = &pSnapshot->aPaks[i];
+
+		LPVOID pPakData = LockPakSlot( i );
+		if( !pPakData || *(BYTE*)pPakData != pState->bPakType || pState->dwGeneration != g_aLive[i].dwGeneration )
+		{
+			// not the pak the snapshot was taken from
+			if( pPakData || pState->bPakType != PAK_NONE )
+				bReturn = FALSE;
+			UnlockPakSlot( i, 0 );
+			continue;
+		}
+
+		DWORD dwSize = 0, *aWritten = NULL;
+		LPBYTE aMemory = GetSnapMemory( pPakData, &dwSize, &aWritten );
+		LPPAKJOURNAL pJournal = NULL;
+		if( pState->bPakType == PAK_MEM )
+			pJournal = ((MEMPAK*)pPakData)->pJournal;
+		else if( pState->bPakType == PAK_TRANSFER )
+			pJournal = ((LPTRANSFERPAK)pPakData)->gbCart.pJournal;
+		DWORD dwChangedPages = 0;	// PAK_MEM_PAGE_SIZE pages, for the mempak writeback; GB_DIRTY_PAGE_SIZE is the same
+		bool bChanged = false;
+		DWORD dwSlotChanges = 0;
+
+		for( int p = 0; aMemory && p < pState->nPages; p++ )
+		{
+			LPSNAPPAGE pPage = pState->apPages[p];
+			if( pPage == g_aLive[i].apPages[p] && !( aWritten[p >> 5] & ( 1u << ( p & 31 ))))
+				continue;	// still holds what the snapshot saw
+
+			const DWORD dwOffset = p * PAK_SNAP_PAGE_SIZE;
+			if( RestoreSnapPage( pJournal, aMemory, dwOffset, min( (DWORD)PAK_SNAP_PAGE_SIZE, dwSize - dwOffset ), pPage->aData ))
+			{
+				dwChangedPages |= 1u << ( dwOffset / PAK_MEM_PAGE_SIZE );
+				bChanged = true;
+				dwPagesRestored++;
+				if( pState->bPakType == PAK_MEM )
+					MemPakRestored( (MEMPAK*)pPakData, dwOffset, min( (DWORD)PAK_SNAP_PAGE_SIZE, dwSize - dwOffset ));
+			}
+			PakAtomicIncrement( &pPage->lRefs );
+			ReleaseSnapPage( g_aLive[i].apPages[p] );
+			g_aLive[i].apPages[p] = pPage;
+			aWritten[p >> 5] &= ~( 1u << ( p & 31 ));
+		}
+
+		if( pState->bPakType == PAK_MEM )
+		{
+			MEMPAK *mPak = (MEMPAK*)pPakData;
+			if( dwChangedPages && !mPak->fReadonly )
+			{
+				const DWORD dwNow = PakTickCount();
+				if( mPak->dwDirtyPages == 0 )
+					mPak->dwFirstDirtyTick = dwNow;
+				mPak->dwLastWriteTick = dwNow;
+				mPak->dwDirtyPages |= dwChangedPages;
+			}
+			const int iBank = pState->iMemPakBank % mPak->nBanks;
+			if( iBank != mPak->iBank )
+			{
+				dwSlotChanges |= PAKSLOT_SWAPPED;	// the game has to see the pak pulled, as with SwitchMemPakBank
+				SelectMemPakBank( mPak, iBank );
+			}
+			CopyMemory( mPak->aMemPakTemp, pState->aMemPakTemp, sizeof(mPak->aMemPakTemp) );
+		}
+		else if( pState->bPakType == PAK_TRANSFER )
+		{
+			LPTRANSFERPAK tPak = (LPTRANSFERPAK)pPakData;
+			const TRANSFERPAK *pSaved = &pState->TPak;
+			tPak->iCurrentBankNo = pSaved->iCurrentBankNo;
+			tPak->iCurrentAccessMode = pSaved->iCurrentAccessMode;
+			tPak->iAccessModeChanged = pSaved->iAccessModeChanged;
+			tPak->iEnableState = pSaved->iEnableState;
+			tPak->iGBBaseOffset = pSaved->iGBBaseOffset;
+			tPak->ptrfnReadTable = pSaved->ptrfnReadTable;
+			tPak->ptrfnWriteTable = pSaved->ptrfnWriteTable;
+
+			tPak->gbCart.iCurrentRomBankNo = pSaved->gbCart.iCurrentRomBankNo;
+			tPak->gbCart.iCurrentRamBankNo = pSaved->gbCart.iCurrentRamBankNo;
+			tPak->gbCart.bRamEnableState = pSaved->gbCart.bRamEnableState;
+			tPak->gbCart.bMBC1RAMbanking = pSaved->gbCart.bMBC1RAMbanking;
+			if( memcmp( tPak->gbCart.TimerData, pSaved->gbCart.TimerData, sizeof(tPak->gbCart.TimerData) ))
+				tPak->gbCart.bSaveDirty = true;
+			CopyMemory( tPak->gbCart.TimerData, pSaved->gbCart.TimerData, sizeof(tPak->gbCart.TimerData) );
+			CopyMemory( tPak->gbCart.LatchedTimerData, pSaved->gbCart.LatchedTimerData, sizeof(tPak->gbCart.LatchedTimerData) );
+			tPak->gbCart.timerLastUpdate = pSaved->gbCart.timerLastUpdate;
+			tPak->gbCart.TimerDataLatched = pSaved->gbCart.TimerDataLatched;
+			UpdateCartMap( &tPak->gbCart );
+
+			if( bChanged )
+			{
+				tPak->gbCart.dwDirtyPages |= dwChangedPages;
+				tPak->gbCart.bSaveDirty = true;
+			}
+		}
+		if( bChanged )
+			dwSlotChanges |= PAKSLOT_MEMORY;
+		UnlockPakSlot( i, dwSlotChanges );
+	}
+
+	PakEnterLock( g_pSnapStatsLock );
+	g_SnapStats.dwRestores++;
+	g_SnapStats.dwPagesRestored += dwPagesRestored;
+	PakLeaveLock( g_pSnapStatsLock );
+	return bReturn;
+}
+
+EXPORT void CALL FreePakSnapshot( LPPAKSNAPSHOT pSnapshot )
+{
+	if( !pSnapshot )
+		return;
+
+	for( int i = 0; i < 4; i++ )
+		for( int p = 0; p < pSnapshot->aPaks[i].nPages; p++ )
+			ReleaseSnapPage( pSnapshot->aPaks[i].apPages[p] );
+	P_free( pSnapshot );
+}
+
+EXPORT void CALL GetPakSnapshotStats( LPPAKSNAPSTATS pStats )
+{
+	if( !pStats )
+		return;
+	PakEnterLock( g_pSnapStatsLock );
+	CopyMemory( pStats, &g_SnapStats, sizeof(PAKSNAPSTATS) );
+	PakLeaveLock( g_pSnapStatsLock );
+}
+
+// Caller holds the controller lock.
+void ResetPakSnapshotPages( const int iControl )
+{
+	for( int p = 0; p < PAK_SNAP_PAGES; p++ )
+	{
+		ReleaseSnapPage( g_aLive[iControl].apPages[p] );
+		g_aLive[iControl].apPages[p] = NULL;
+	}
+	g_aLive[iControl].dwGeneration++;
+}
@@ -0,0 +1,85 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PAKSNAPSHOT_H_
+#define _PAKSNAPSHOT_H_
+
+// Snapshots of the emulated pak state, for the emulator's savestates and rewind.
+//
+// A snapshot holds the registers of every pak (mempak bank, Transfer Pak bank/mode/enable, MBC banks and RTC)
+// and its memory (all banks of a mempak, the GB cart RAM) in 1 KB pages.  Pages are shared between snapshots:
+// the paks mark the pages they write, and a new snapshot only copies those, taking a reference on the page
+// the previous one stored for everything else.  Taking one every frame for rewind costs the pages the game
+// actually wrote that frame.
+// A snapshot only restores into the pak it was taken from; once a pak is pulled or swapped, its part is skipped.
+
+#define PAK_SNAP_PAGE_SIZE	0x400
+	// 128 KB: all banks of a mempak bank file, or the largest GB cart RAM (16 banks of 8 KB)
+#define PAK_SNAP_PAGES		128
+
+// Called with every write to snapshotted pak memory; dwOffset is in the mempak banks or the cart RAM.
+// Writes are 32 byte aligned, so they never straddle two pages.
+inline void MarkSnapshotPage( DWORD *aWritten, const DWORD dwOffset )
+{
+	const DWORD iPage = dwOffset / PAK_SNAP_PAGE_SIZE;
+	if( iPage < PAK_SNAP_PAGES )
+		aWritten[iPage >> 5] |= 1u << ( iPage & 31 );
+}
+
+typedef struct _PAKSNAPSTATS
+{
+	DWORD dwSnapshots;
+	DWORD dwRestores;
+	DWORD dwPagesCopied;	// pages TakePakSnapshot had to copy because they were written
+	DWORD dwPagesShared;	// pages it took over from the previous snapshot
+	DWORD dwPagesRestored;	// pages RestorePakSnapshot wrote back
+	DWORD dwMicroseconds;	// time spent in TakePakSnapshot
+	DWORD dwMaxMicroseconds;	// longest TakePakSnapshot
+} PAKSNAPSTATS, *LPPAKSNAPSTATS;
+
+typedef struct _PAKSNAPSHOT *LPPAKSNAPSHOT;		// opaque to the emulator
+
+// Captures the state of all 4 paks.  Returns NULL if out of memory.
+EXPORT LPPAKSNAPSHOT CALL TakePakSnapshot( void );
+// Puts the paks back the way they were in pSnapshot; the snapshot stays valid.
+// Returns FALSE if a pak was skipped because it isn't the one the snapshot was taken from.
+EXPORT BOOL CALL RestorePakSnapshot( LPPAKSNAPSHOT pSnapshot );
+EXPORT void CALL FreePakSnapshot( LPPAKSNAPSHOT pSnapshot );
+// Counters since the plugin was loaded, for measuring the per frame cost.
+EXPORT void CALL GetPakSnapshotStats( LPPAKSNAPSTATS pStats );
+
+void InitPakSnapshots();
+void FreePakSnapshots();
+
+// Drops the pages kept for iControl's pak; called when the pak is closed.
+void ResetPakSnapshotPages( const int iControl );
+
+// Provided by whatever the pak core is built into (ControllerPak.cpp in the plugin): the pak data of slot
+// iSlot (0-3), locked against the thread doing the pak transfers until UnlockPakSlot.  NULL if there's no pak.
+void *LockPakSlot( const int iSlot );
+// dwChanges tells what RestorePakSnapshot did to the pak, 0 for TakePakSnapshot.
+#define PAKSLOT_MEMORY		0x01	// pak memory was written back
+#define PAKSLOT_SWAPPED		0x02	// the mempak is on another bank now; the game has to see it pulled
+void UnlockPakSlot( const int iSlot, const DWORD dwChanges );
+
+#endif // #ifndef _PAKSNAPSHOT_H_
@@ -0,0 +1,447 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PakStore.h"
+
+#define STORE_MAGIC		0x4D50524E		// "NRPM"
+#define STORE_VERSION	1
+
+typedef struct _MANIFESTHEADER
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD dwPages;
+	DWORD dwReserved;
+} MANIFESTHEADER;
+
+// what FindStorePage found under a page's name
+#define STORE_PAGE_MISSING		0
+#define STORE_PAGE_SAME			1	// the same content; the page is shared
+#define STORE_PAGE_DAMAGED		2	// something that doesn't hash to its name; may be replaced
+#define STORE_PAGE_COLLISION	3	// an intact page with other content under the same hash
+
+	// the dwDirtyPages bits of a whole pak
+#define STORE_ALL_PAGES		(( 1u << ( PAK_MEM_SIZE / PAK_MEM_PAGE_SIZE )) - 1 )
+
+// Page writes and CollectPakStore exclude each other, so a page this process just stored can't be collected
+// before the manifest naming it is in place.
+static LPPAKLOCK g_pStoreLock = NULL;
+
+void InitPakStore()
+{
+	g_pStoreLock = PakCreateLock();
+}
+
+void FreePakStore()
+{
+	PakDeleteLock( g_pStoreLock );
+	g_pStoreLock = NULL;
+}
+
+// 64 bit FNV-1a of a page
+static ULONGLONG HashStorePage( LPCBYTE Data )
+{
+	ULONGLONG qwHash = 0xCBF29CE484222325ULL;
+	for( int i = 0; i < PAK_STORE_PAGE_SIZE; i++ )
+	{
+		qwHash ^= Data[i];
+		qwHash *= 0x100000001B3ULL;
+	}
+	return qwHash;
+}
+
+static void StorePagePath( LPPAKSTORE pStore, const ULONGLONG qwHash, LPTSTR pszPath )
+{
+	wsprintf( pszPath, _T("%s%08X%08X.pg"), pStore->szStoreDir, (DWORD)( qwHash >> 32 ), (DWORD)qwHash );
+}
+
+// Writes to a temporary name and renames, so a page file that exists is always complete.
+// Several emulators may share one store; whoever renames first wins, and the content is the same either way.
+static bool WriteStoreFile( LPCTSTR pszPath, LPCVOID Data, const DWORD dwSize, const bool fReplace )
+{
+	TCHAR szTemp[MAX_PATH+16];
+	wsprintf( szTemp, _T("%s.%X.tmp"), pszPath, PakCurrentThreadId() );
+
+	LPPAKFILE pFile = PakOpenFile( szTemp, PAK_FILE_CREATE );
+	if( pFile == NULL )
+		return false;
+
+	bool bReturn = PakWriteFile( pFile, Data, dwSize ) && PakSyncFile( pFile );
+	PakCloseFile( pFile );
+
+	if( bReturn )
+		bReturn = PakRenameFile( szTemp, pszPath, fReplace ) || ( !fReplace && PakFileExists( pszPath ));
+	if( PakFileExists( szTemp ))
+		PakDeleteFile( szTemp );
+	return bReturn;
+}
+
+static bool WriteManifest( LPPAKSTORE pStore )
+{
+	BYTE aManifest[sizeof(MANIFESTHEADER) + sizeof(pStore->aPageHash)];
+	MANIFESTHEADER *pHeader = (MANIFESTHEADER*)aManifest;
+	pHeader->dwMagic = STORE_MAGIC;
+	pHeader->dwVersion = STORE_VERSION;
+	pHeader->dwPages = PAK_STORE_PAGES;
+	pHeader->dwReserved = 0;
+	CopyMemory( &aManifest[sizeof(MANIFESTHEADER)], pStore->aPageHash, sizeof(pStore->aPageHash) );
+
+	return WriteStoreFile( pStore->szManifest, aManifest, sizeof(aManifest), true );
+}
+
+// reads one page and checks that it still hashes to its name
+static bool ReadStorePage( LPPAKSTORE pStore, const ULONGLONG qwHash, LPBYTE Data )
+{
+	TCHAR szPath[MAX_PATH+1];
+	StorePagePath( pStore, qwHash, szPath );
+
+	LPPAKFILE pFile = PakOpenFile( szPath, PAK_FILE_READ );
+	if( pFile == NULL )
+	{
+		DebugWrite( _T("PakStore: page %s is missing\n"), szPath );
+		return false;
+	}
+
+	bool bReturn = PakReadFile( pFile, Data, PAK_STORE_PAGE_SIZE ) == PAK_STORE_PAGE_SIZE && HashStorePage( Data ) == qwHash;
+	PakCloseFile( pFile );
+	if( !bReturn )
+		DebugWrite( _T("PakStore: page %s is damaged\n"), szPath );
+	return bReturn;
+}
+
+// The hash alone doesn't prove two pages equal, so a page is only shared after comparing it with the stored one.
+static int FindStorePage( LPCTSTR pszPath, const ULONGLONG qwHash, LPCBYTE Data )
+{
+	LPPAKFILE pFile = PakOpenFile( pszPath, PAK_FILE_READ );
+	if( pFile == NULL )
+		return PakFileExists( pszPath ) ? STORE_PAGE_DAMAGED : STORE_PAGE_MISSING;
+
+	BYTE aStored[PAK_STORE_PAGE_SIZE];
+	int iReturn = STORE_PAGE_DAMAGED;
+	if( PakReadFile( pFile, aStored, PAK_STORE_PAGE_SIZE ) == PAK_STORE_PAGE_SIZE && PakGetFileSize( pFile ) == PAK_STORE_PAGE_SIZE )
+	{
+		if( !memcmp( aStored, Data, PAK_STORE_PAGE_SIZE ))
+			iReturn = STORE_PAGE_SAME;
+		else if( HashStorePage( aStored ) == qwHash )
+			iReturn = STORE_PAGE_COLLISION;
+	}
+	PakCloseFile( pFile );
+	return iReturn;
+}
+
+// reads the page list of a manifest; false if it isn't one
+static bool ReadManifest( LPCTSTR pszManifest, ULONGLONG *aPageHash )
+{
+	LPPAKFILE pFile = PakOpenFile( pszManifest, PAK_FILE_READ );
+	if( pFile == NULL )
+		return false;
+
+	MANIFESTHEADER Header;
+	bool bReturn = PakReadFile( pFile, &Header, sizeof(Header) ) == sizeof(Header)
+					&& Header.dwMagic == STORE_MAGIC && Header.dwVersion == STORE_VERSION && Header.dwPages == PAK_STORE_PAGES
+					&& PakReadFile( pFile, aPageHash, PAK_STORE_PAGES * sizeof(ULONGLONG) ) == PAK_STORE_PAGES * sizeof(ULONGLONG);
+	PakCloseFile( pFile );
+	return bReturn;
+}
+
+bool IsPakManifest( LPCTSTR pszFile )
+{
+	LPCTSTR pcPoint = _tcsrchr( pszFile, _T('.') );
+	return pcPoint && !lstrcmpi( pcPoint, _T(".mpm") );
+}
+
+LPPAKSTORE OpenPakStore( LPCTSTR pszManifest, LPBYTE aData, const bool fCreate )
+{
+	LPPAKSTORE pStore = (LPPAKSTORE)P_malloc( sizeof(PAKSTORE) );
+	if( pStore == NULL )
+		return NULL;
+
+	lstrcpyn( pStore->szManifest, pszManifest, MAX_PATH + 1 );
+
+	// the store sits next to the manifest; paks in the same directory share it
+	lstrcpyn( pStore->szStoreDir, pszManifest, MAX_PATH - 32 );
+	TCHAR *pcSlash = _tcsrchr( pStore->szStoreDir, PAK_PATH_SEPARATOR );
+	if( pcSlash )
+		pcSlash[1] = _T('\0');
+	else
+		pStore->szStoreDir[0] = _T('\0');
+	lstrcat( pStore->szStoreDir, _T("pakstore") );
+	const TCHAR szSeparator[] = { PAK_PATH_SEPARATOR, _T('\0') };
+	lstrcat( pStore->szStoreDir, szSeparator );
+
+	if( !PakFileExists( pszManifest ))
+	{
+		ZeroMemory( pStore->aPageHash, sizeof(pStore->aPageHash) );		// matches no real page, so everything gets stored
+		pStore->fStoredData = false;
+		if( !fCreate )
+		{
+			P_free( pStore );
+			return NULL;
+		}
+		PakCreateDirectory( pStore->szStoreDir );
+		if( aData )
+		{
+			FormatMemPak( aData );
+			WritePakStore( pStore, aData, 0xFFFFFFFF, NULL );
+			if( !PakFileExists( pszManifest ))
+			{
+				DebugWrite( _T("PakStore: can't create %s\n"), pszManifest );
+				P_free( pStore );
+				return NULL;
+			}
+		}
+		return pStore;
+	}
+
+	bool bReturn = ReadManifest( pszManifest, pStore->aPageHash );
+
+	// pages that occur more than once (0xFF filled ones, mostly) are only read the first time
+	for( int i = 0; bReturn && aData && i < PAK_STORE_PAGES; i++ )
+	{
+		int j = 0;
+		while( j < i && pStore->aPageHash[j] != pStore->aPageHash[i] )
+			j++;
+		if( j < i )
+			CopyMemory( &aData[i * PAK_STORE_PAGE_SIZE], &aData[j * PAK_STORE_PAGE_SIZE], PAK_STORE_PAGE_SIZE );
+		else
+			bReturn = ReadStorePage( pStore, pStore->aPageHash[i], &aData[i * PAK_STORE_PAGE_SIZE] );
+	}
+
+	if( !bReturn )
+	{
+		DebugWrite( _T("PakStore: can't load %s\n"), pszManifest );
+		P_free( pStore );
+		return NULL;
+	}
+
+	pStore->fStoredData = ( aData != NULL );
+	if( aData )
+		CopyMemory( pStore->aStoredData, aData, PAK_MEM_SIZE );
+	return pStore;
+}
+
+DWORD WritePakStore( LPPAKSTORE pStore, LPCBYTE aData, const DWORD dwDirtyPages, DWORD *pdwFailedPages )
+{
+	BYTE aPage[PAK_STORE_PAGE_SIZE];
+	TCHAR szPath[MAX_PATH+1];
+	ULONGLONG aOldHash[PAK_STORE_PAGES];
+	DWORD dwWritten = 0, dwFailed = 0, dwStored = 0;
+
+	CopyMemory( aOldHash, pStore->aPageHash, sizeof(aOldHash) );
+	PakEnterLock( g_pStoreLock );
+
+	for( int i = 0; i < PAK_STORE_PAGES; i++ )
+	{
+		const DWORD dwPageBit = 1 << ( i * PAK_STORE_PAGE_SIZE / PAK_MEM_PAGE_SIZE );
+		if( !( dwDirtyPages & dwPageBit ))
+			continue;
+
+		// hash a copy; the emulation thread may be writing to this page right now
+		CopyMemory( aPage, &aData[i * PAK_STORE_PAGE_SIZE], PAK_STORE_PAGE_SIZE );
+		const ULONGLONG qwHash = HashStorePage( aPage );
+		LPBYTE aStored = &pStore->aStoredData[i * PAK_STORE_PAGE_SIZE];
+		if( qwHash == pStore->aPageHash[i] && pStore->fStoredData && !memcmp( aPage, aStored, PAK_STORE_PAGE_SIZE ))
+			continue;
+
+		StorePagePath( pStore, qwHash, szPath );
+		const int iFound = FindStorePage( szPath, qwHash, aPage );
+		if( iFound == STORE_PAGE_SAME && qwHash == pStore->aPageHash[i] )
+		{
+			CopyMemory( aStored, aPage, PAK_STORE_PAGE_SIZE );
+			continue;
+		}
+		if( iFound == STORE_PAGE_COLLISION )
+		{
+			// can't be stored under its name; the manifest keeps listing the old page
+			DebugWrite( _T("PakStore: hash collision on %s\n"), szPath );
+			dwFailed |= dwPageBit;
+			continue;
+		}
+		if( iFound != STORE_PAGE_SAME )
+		{
+			if( !WriteStoreFile( szPath, aPage, PAK_STORE_PAGE_SIZE, iFound == STORE_PAGE_DAMAGED ))
+			{
+				// the manifest keeps listing the old page; the caller keeps the page dirty
+				DebugWrite( _T("PakStore: can't write %s\n"), szPath );
+				dwFailed |= dwPageBit;
+				continue;
+			}
+			dwWritten += PAK_STORE_PAGE_SIZE;
+		}
+		pStore->aPageHash[i] = qwHash;
+		CopyMemory( aStored, aPage, PAK_STORE_PAGE_SIZE );
+		dwStored |= dwPageBit;
+	}
+
+	if( dwStored )
+	{
+		if( WriteManifest( pStore ))
+			dwWritten += sizeof(MANIFESTHEADER) + sizeof(pStore->aPageHash);
+		else
+		{
+			// nothing new is referenced on disk; keep what the manifest still lists so the next write retries
+			DebugWrite( _T("PakStore: can't write %s\n"), pStore->szManifest );
+			CopyMemory( pStore->aPageHash, aOldHash, sizeof(aOldHash) );
+			pStore->fStoredData = false;	// went ahead of the manifest; compare with the page files from now on
+			dwFailed |= dwStored;
+		}
+	}
+
+	// once every page went through here, aStoredData holds what the manifest lists
+	if(( dwDirtyPages & STORE_ALL_PAGES ) == STORE_ALL_PAGES && !dwFailed )
+		pStore->fStoredData = true;
+
+	PakLeaveLock( g_pStoreLock );
+	if( pdwFailedPages )
+		*pdwFailedPages = dwFailed;
+	return dwWritten;
+}
+
+void ClosePakStore( LPPAKSTORE pStore )
+{
+	if( pStore )
+		P_free( pStore );
+}
+
+// CollectPakStore //
+
+typedef struct _STOREGC
+{
+	TCHAR szDirectory[MAX_PATH+1];		// where the manifests or the pages are, ends in PAK_PATH_SEPARATOR
+	ULONGLONG *aListed;					// hashes of every page some manifest lists, sorted before the pages are looked at
+	int nListed;
+	bool fFailed;
+	int nDeleted;
+} STOREGC, *LPSTOREGC;
+
+static bool AddListedPages( const TCHAR *pszName, void *pParam )
+{
+	LPSTOREGC pGC = (LPSTOREGC)pParam;
+	TCHAR szManifest[MAX_PATH+1];
+	if( lstrlen( pGC->szDirectory ) + lstrlen( pszName ) > MAX_PATH )
+	{
+		pGC->fFailed = true;
+		return false;
+	}
+	lstrcpy( szManifest, pGC->szDirectory );
+	lstrcat( szManifest, pszName );
+
+	ULONGLONG *aGrown = (ULONGLONG*)P_realloc( pGC->aListed, ( pGC->nListed + PAK_STORE_PAGES ) * sizeof(ULONGLONG) );
+	if( !aGrown )
+	{
+		pGC->fFailed = true;
+		return false;
+	}
+	pGC->aListed = aGrown;
+	if( !ReadManifest( szManifest, &pGC->aListed[pGC->nListed] ))
+	{
+		// its pages might be anywhere in the store, so none can go
+		DebugWrite( _T("CollectPakStore: can't read %s\n"), szManifest );
+		pGC->fFailed = true;
+		return false;
+	}
+	pGC->nListed += PAK_STORE_PAGES;
+	return true;
+}
+
+static int CompareHashes( const void *p1, const void *p2 )
+{
+	const ULONGLONG qw1 = *(const ULONGLONG*)p1, qw2 = *(const ULONGLONG*)p2;
+	return ( qw1 < qw2 ) ? -1 : ( qw1 > qw2 );
+}
+
+static bool DeleteUnlistedPage( const TCHAR *pszName, void *pParam )
+{
+	LPSTOREGC pGC = (LPSTOREGC)pParam;
+
+	// only what StorePagePath names: 16 hex digits and ".pg"
+	ULONGLONG qwHash = 0;
+	int i = 0;
+	for( ; i < 16; i++ )
+	{
+		const TCHAR c = pszName[i];
+		if( c >= _T('0') && c <= _T('9') )
+			qwHash = ( qwHash << 4 ) | ( c - _T('0') );
+		else if( c >= _T('A') && c <= _T('F') )
+			qwHash = ( qwHash << 4 ) | ( c - _T('A') + 10 );
+		else
+			return true;
+	}
+	if( lstrcmpi( &pszName[i], _T(".pg") ))
+		return true;
+
+	if( bsearch( &qwHash, pGC->aListed, pGC->nListed, sizeof(ULONGLONG), CompareHashes ))
+		return true;
+
+	TCHAR szPage[MAX_PATH+1];
+	lstrcpy( szPage, pGC->szDirectory );
+	lstrcat( szPage, pszName );
+	if( PakDeleteFile( szPage ))
+		pGC->nDeleted++;
+	return true;
+}
+
+EXPORT int CALL CollectPakStore( LPCTSTR pszDirectory )
+{
+	LPSTOREGC pGC = (LPSTOREGC)P_malloc( sizeof(STOREGC) );
+	if( !pGC )
+		return -1;
+	ZeroMemory( pGC, sizeof(STOREGC) );
+	if( lstrlen( pszDirectory ) + 9 + 16 + 3 > MAX_PATH )		// "pakstore" and a separator, then a page name
+	{
+		P_free( pGC );
+		return -1;
+	}
+
+	PakEnterLock( g_pStoreLock );
+
+	lstrcpy( pGC->szDirectory, pszDirectory );
+	PakFindFiles( pGC->szDirectory, _T(".mpm"), AddListedPages, pGC );
+
+	int iReturn = -1;
+	if( !pGC->fFailed )
+	{
+		if( pGC->nListed )
+			qsort( pGC->aListed, pGC->nListed, sizeof(ULONGLONG), CompareHashes );
+
+		lstrcat( pGC->szDirectory, _T("pakstore") );
+		const TCHAR szSeparator[] = { PAK_PATH_SEPARATOR, _T('\0') };
+		lstrcat( pGC->szDirectory, szSeparator );
+		PakFindFiles( pGC->szDirectory, _T(".pg"), DeleteUnlistedPage, pGC );
+		iReturn = pGC->nDeleted;
+		DebugWrite( _T("CollectPakStore: deleted %d pages from %s\n"), iReturn, pGC->szDirectory );
+	}
+
+	PakLeaveLock( g_pStoreLock );
+
+	if( pGC->aListed )
+		P_free( pGC->aListed );
+	P_free( pGC );
+	return iReturn;
+}
@@ -0,0 +1,70 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PAKSTORE_H_
+#define _PAKSTORE_H_
+
+// Content-addressed storage for mempaks, used when the mempak file is a manifest (.mpm).
+//
+// The pak is split into 256 byte pages (one mempak block each), and every page is kept once, named by the hash
+// of its content, in a "pakstore" directory next to the manifest.  The manifest itself only lists the 128
+// page hashes, so paks that share game notes (or just empty pages) share their storage.
+// Page files are never changed once written, and a manifest is replaced in one rename after its new pages
+// are on disk, so an interrupted write leaves the previous state of the pak intact.  A page is only shared
+// with a stored one after comparing their content; the hash just names the file.  Pages no manifest lists
+// any more stay until CollectPakStore removes them.
+
+#define PAK_STORE_PAGE_SIZE		0x100
+#define PAK_STORE_PAGES			( PAK_MEM_SIZE / PAK_STORE_PAGE_SIZE )
+
+typedef struct _PAKSTORE
+{
+	ULONGLONG aPageHash[PAK_STORE_PAGES];	// the pages the manifest on disk lists
+	BYTE aStoredData[PAK_MEM_SIZE];			// their content, if fStoredData is set
+	bool fStoredData;						// else it's unknown and pages are compared against their files
+	TCHAR szManifest[MAX_PATH+1];
+	TCHAR szStoreDir[MAX_PATH+1];			// ends in PAK_PATH_SEPARATOR
+} PAKSTORE, *LPPAKSTORE;
+
+// true if pszFile names a manifest, i.e. should be opened through the store
+bool IsPakManifest( LPCTSTR pszFile );
+
+// Opens the manifest pszManifest and assembles the pak into aData.  If there is no manifest yet and fCreate is set,
+// aData is formatted and stored as a new pak.  aData may be NULL to only read the page list (a missing manifest then
+// just starts out empty).  Returns NULL if the manifest or one of its pages can't be read.
+LPPAKSTORE OpenPakStore( LPCTSTR pszManifest, LPBYTE aData, const bool fCreate );
+// Stores the pages of aData within the dirty PAK_MEM_PAGE_SIZE pages in dwDirtyPages (one bit each) whose
+// content changed, then replaces the manifest.  Returns the number of bytes written.  The pages that couldn't
+// be stored go to *pdwFailedPages (may be NULL); the caller keeps them dirty.
+DWORD WritePakStore( LPPAKSTORE pStore, LPCBYTE aData, const DWORD dwDirtyPages, DWORD *pdwFailedPages );
+void ClosePakStore( LPPAKSTORE pStore );
+
+// Deletes the page files in the store of pszDirectory (ends in PAK_PATH_SEPARATOR) that none of its manifests
+// list.  Page writes in this process wait for it, but another process writing to the same store must not be
+// running.  Nothing is deleted if a manifest can't be read.  Returns the number of pages deleted, or -1.
+EXPORT int CALL CollectPakStore( LPCTSTR pszDirectory );
+
+void InitPakStore();
+void FreePakStore();
+
+#endif // #ifndef _PAKSTORE_H_
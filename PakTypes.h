@@ -0,0 +1,146 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PAKTYPES_H_
+#define _PAKTYPES_H_
+
+// The Windows types and helpers the pak code is written with, for building it without windows.h.
+// Only commonIncludes.h includes this, and only off Windows; see PakPlatform.h and CMakeLists.txt.
+
+#ifdef _WIN32
+#error PakTypes.h is for builds without windows.h
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef uintptr_t ULONG_PTR;
+typedef uint32_t DWORD32;
+typedef unsigned char UCHAR;
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef long HRESULT;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef void VOID;
+
+typedef BYTE *LPBYTE;
+#ifndef _LPCBYTE_DEFINED
+#define _LPCBYTE_DEFINED
+typedef const unsigned char *LPCBYTE;
+#endif
+typedef WORD *LPWORD;
+typedef DWORD *LPDWORD;
+typedef LONG *LPLONG;
+typedef void *LPVOID;
+typedef const void *LPCVOID;
+typedef char *LPSTR;
+typedef const char *LPCSTR;
+typedef WCHAR *LPWSTR;
+typedef const WCHAR *LPCWSTR;
+
+// the pak code is built for ANSI here
+typedef char TCHAR;
+typedef TCHAR *LPTSTR;
+typedef const TCHAR *LPCTSTR;
+#define _T(x)		x
+#define TEXT(x)		x
+
+#ifndef TRUE
+#define TRUE		1
+#define FALSE		0
+#endif
+
+#define MAX_PATH	260
+
+#define UNALIGNED
+#define _cdecl
+#define __cdecl
+#define WINAPI
+#define CALLBACK
+
+	// nothing is exported from the static library
+#define EXPORT
+#define CALL
+
+#define FIELD_OFFSET( type, field )		offsetof( type, field )
+#define ARRAYSIZE( array )				( sizeof(array) / sizeof(array[0]) )
+#define MAKEWORD( lo, hi )				((WORD)(((BYTE)(lo)) | (((WORD)((BYTE)(hi))) << 8 )))
+#define LOBYTE( w )						((BYTE)( w ))
+#define HIBYTE( w )						((BYTE)(((WORD)( w )) >> 8 ))
+
+#ifndef min
+#define min( a, b )		((( a ) < ( b )) ? ( a ) : ( b ))
+#endif
+#ifndef max
+#define max( a, b )		((( a ) > ( b )) ? ( a ) : ( b ))
+#endif
+
+#define CopyMemory( dest, src, len )	memcpy(( dest ), ( src ), ( len ))
+#define MoveMemory( dest, src, len )	memmove(( dest ), ( src ), ( len ))
+#define FillMemory( dest, len, fill )	memset(( dest ), ( fill ), ( len ))
+#define ZeroMemory( dest, len )			memset(( dest ), 0, ( len ))
+
+#define lstrlen( s )	((int)strlen( s ))
+#define lstrlenA( s )	((int)strlen( s ))
+#define lstrcpy			strcpy
+#define lstrcpyA		strcpy
+#define lstrcat			strcat
+#define lstrcatA		strcat
+#define lstrcmp			strcmp
+#define lstrcmpA		strcmp
+#define lstrcmpi		strcasecmp
+#define lstrcmpiA		strcasecmp
+#define wsprintf		sprintf
+#define wsprintfA		sprintf
+#define _tcsrchr		strrchr
+#define _tcschr			strchr
+#define _tcsnicmp		strncasecmp
+#define _strnicmp		strncasecmp
+#define _tcsdup			strdup
+
+// lstrcpyn always terminates, and counts the terminator in iMaxLength
+inline LPTSTR lstrcpyn( LPTSTR pszTo, LPCTSTR pszFrom, int iMaxLength )
+{
+	if( iMaxLength <= 0 )
+		return pszTo;
+	int i = 0;
+	for( ; i < iMaxLength - 1 && pszFrom[i]; i++ )
+		pszTo[i] = pszFrom[i];
+	pszTo[i] = '\0';
+	return pszTo;
+}
+
+#endif // #ifndef _PAKTYPES_H_
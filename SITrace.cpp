@@ -0,0 +1,302 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "commonIncludes.h"
+#include <windows.h>
+#include <string.h>
+#include "NRagePluginV2.h"
+#include "FileAccess.h"
+#include "PakIO.h"
+#include "SITrace.h"
+
+#ifdef ENABLE_SI_TRACE
+
+#define TRACE_BUFFER_SIZE	0x10000		// a minute of 4 player mempak traffic fits in here easily
+
+static CRITICAL_SECTION g_csTrace;		// controllers record from behind their own locks, so the buffer needs its own
+static HANDLE g_hTraceFile = INVALID_HANDLE_VALUE;
+static BYTE g_aTraceBuffer[TRACE_BUFFER_SIZE];
+static DWORD g_dwTraceUsed = 0;
+static DWORD g_dwTraceFrame = 0;
+static bool g_fFrameWritten = false;
+
+// Writes out whatever is buffered; caller must hold g_csTrace.
+static void FlushSITrace()
+{
+	if( g_dwTraceUsed > 0 )
+	{
+		DWORD dwWritten;
+		if( !WriteFile( g_hTraceFile, g_aTraceBuffer, g_dwTraceUsed, &dwWritten, NULL ) || dwWritten != g_dwTraceUsed )
+			DebugWriteA( "SITrace: write failed, %u bytes lost\n", g_dwTraceUsed );
+		g_dwTraceUsed = 0;
+	}
+}
+
+// Reserves dwLength bytes in the buffer, flushing first if needed; caller must hold g_csTrace.
+static inline LPBYTE ReserveSITrace( const DWORD dwLength )
+{
+	if( g_dwTraceUsed + dwLength > TRACE_BUFFER_SIZE )
+		FlushSITrace();
+	LPBYTE pRecord = &g_aTraceBuffer[g_dwTraceUsed];
+	g_dwTraceUsed += dwLength;
+	return pRecord;
+}
+
+void InitSITrace()
+{
+	InitializeCriticalSection( &g_csTrace );
+}
+
+void FreeSITrace()
+{
+	CloseSITrace();
+	DeleteCriticalSection( &g_csTrace );
+}
+
+// Called from RomOpen; starts a new session at the end of the trace file, if there is one.
+void OpenSITrace()
+{
+	TCHAR szBuffer[MAX_PATH+1];
+	LARGE_INTEGER liFrequency;
+
+	EnterCriticalSection( &g_csTrace );
+	if( g_hTraceFile == INVALID_HANDLE_VALUE )
+	{
+		GetAbsoluteFileName( szBuffer, SITRACE_FILENAME, DIRECTORY_APPLICATION );
+		g_hTraceFile = CreateFile( szBuffer, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+		if( g_hTraceFile != INVALID_HANDLE_VALUE )
+		{
+			SetFilePointer( g_hTraceFile, 0, 0, FILE_END );
+			QueryPerformanceFrequency( &liFrequency );
+
+			LPBYTE pRecord = ReserveSITrace( 1 + sizeof(DWORD) + sizeof(WORD) + sizeof(LONGLONG) );
+			pRecord[0] = SITRACE_SESSION;
+			*(DWORD UNALIGNED *)&pRecord[1] = SITRACE_MAGIC;
+			*(WORD UNALIGNED *)&pRecord[5] = SITRACE_VERSION;
+			*(LONGLONG UNALIGNED *)&pRecord[7] = liFrequency.QuadPart;
+
+			g_dwTraceFrame = 0;
+			g_fFrameWritten = false;
+			DebugWriteA( "SITrace: recording to trace file\n" );
+		}
+	}
+	LeaveCriticalSection( &g_csTrace );
+}
+
+// Called from RomClosed and on DLL unload.
+void CloseSITrace()
+{
+	EnterCriticalSection( &g_csTrace );
+	if( g_hTraceFile != INVALID_HANDLE_VALUE )
+	{
+		FlushSITrace();
+		CloseHandle( g_hTraceFile );
+		g_hTraceFile = INVALID_HANDLE_VALUE;
+		DebugWriteA( "SITrace: closed after %u frames\n", g_dwTraceFrame );
+	}
+	LeaveCriticalSection( &g_csTrace );
+}
+
+// The emulator is done with the pif ram for this frame.
+void SITraceNextFrame()
+{
+	if( g_hTraceFile == INVALID_HANDLE_VALUE )
+		return;
+
+	EnterCriticalSection( &g_csTrace );
+	if( g_fFrameWritten )
+	{
+		g_dwTraceFrame++;
+		g_fFrameWritten = false;
+	}
+	LeaveCriticalSection( &g_csTrace );
+}
+
+// Appends one processed command.  bRecvLength is Command[1] as the emulator sent it, before we or'd in any error bits.
+void SITraceRecord( const int iControl, LPCBYTE Command, const BYTE bRecvLength )
+{
+	if( g_hTraceFile == INVALID_HANDLE_VALUE )
+		return;
+
+	const DWORD dwSend = Command[0] & 0x3F;
+	const DWORD dwRecv = bRecvLength & 0x3F;
+	LARGE_INTEGER liNow;
+	LPBYTE pRecord;
+
+	EnterCriticalSection( &g_csTrace );
+	if( g_hTraceFile != INVALID_HANDLE_VALUE )
+	{
+		if( !g_fFrameWritten )
+		{
+			QueryPerformanceCounter( &liNow );
+			pRecord = ReserveSITrace( 1 + sizeof(DWORD) + sizeof(LONGLONG) );
+			pRecord[0] = SITRACE_FRAME;
+			*(DWORD UNALIGNED *)&pRecord[1] = g_dwTraceFrame;
+			*(LONGLONG UNALIGNED *)&pRecord[5] = liNow.QuadPart;
+			g_fFrameWritten = true;
+		}
+
+		pRecord = ReserveSITrace( 4 + dwSend + dwRecv );
+		pRecord[0] = (BYTE)iControl;
+		pRecord[1] = Command[0];
+		pRecord[2] = bRecvLength;
+		pRecord[3] = Command[1];
+		CopyMemory( &pRecord[4], &Command[2], dwSend + dwRecv );
+	}
+	LeaveCriticalSection( &g_csTrace );
+}
+
+/******************************************************************
+  Function: ReplaySITrace
+  Purpose:  Feeds every command from a trace file back through the
+            pak code and checks the answers against the recording.
+  input:    - Trace file name, relative names are looked up in the
+              plugin directory.
+            - Pointer to a SITRACESTATS structure to be filled in,
+              may be NULL.
+  output:   FALSE if the trace file couldn't be read.
+  note:     Not part of the plugin specs; meant for test harnesses.
+            Call InitiateControllers and RomOpen first, with the
+            controllers set up the way they were when the trace was
+            recorded.  Replaying writes to the configured paks, so
+            point them at copies of the captured saves.
+            Controller reads depend on live input, so those are
+            replayed but not compared.
+*******************************************************************/
+EXPORT BOOL CALL ReplaySITrace( LPCTSTR pszTraceFile, LPSITRACESTATS pStats )
+{
+	TCHAR szBuffer[MAX_PATH+1];
+	SITRACESTATS stats;
+	LARGE_INTEGER liFrequency, liStart, liEnd;
+	LONGLONG llTicks = 0;
+	BYTE aCommand[2 + 0x3F + 0x3F];
+
+	ZeroMemory( &stats, sizeof(stats) );
+	GetAbsoluteFileName( szBuffer, pszTraceFile, DIRECTORY_APPLICATION );
+
+	HANDLE hFile = CreateFile( szBuffer, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( hFile == INVALID_HANDLE_VALUE )
+		return FALSE;
+
+	DWORD dwSize = GetFileSize( hFile, NULL );
+	HANDLE hMapping = ( dwSize > 0 && dwSize != INVALID_FILE_SIZE ) ? CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+	LPCBYTE pTrace = hMapping ? (LPCBYTE)MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+	if( pTrace == NULL )
+	{
+		if( hMapping )
+			CloseHandle( hMapping );
+		CloseHandle( hFile );
+		return FALSE;
+	}
+
+	QueryPerformanceFrequency( &liFrequency );
+
+	DWORD dwPos = 0;
+	bool fValid = true;
+	while( dwPos < dwSize )
+	{
+		const BYTE bTag = pTrace[dwPos];
+
+		if( bTag == SITRACE_SESSION )
+		{
+			if( dwPos + 15 > dwSize || *(DWORD UNALIGNED *)&pTrace[dwPos+1] != SITRACE_MAGIC || *(WORD UNALIGNED *)&pTrace[dwPos+5] != SITRACE_VERSION )
+			{
+				fValid = false;
+				break;
+			}
+			stats.dwSessions++;
+			dwPos += 15;
+		}
+		else if( bTag == SITRACE_FRAME )
+		{
+			if( dwPos + 13 > dwSize )
+			{
+				fValid = false;
+				break;
+			}
+			stats.dwFrames++;
+			dwPos += 13;
+		}
+		else if( bTag < 4 )
+		{
+			if( dwPos + 4 > dwSize )
+			{
+				fValid = false;
+				break;
+			}
+			const DWORD dwSend = pTrace[dwPos+1] & 0x3F;
+			const DWORD dwRecv = pTrace[dwPos+2] & 0x3F;
+			if( dwPos + 4 + dwSend + dwRecv > dwSize )
+			{
+				fValid = false;
+				break;
+			}
+			LPCBYTE pSend = &pTrace[dwPos+4];
+
+			aCommand[0] = pTrace[dwPos+1];
+			aCommand[1] = pTrace[dwPos+2];
+			CopyMemory( &aCommand[2], pSend, dwSend );
+			FillMemory( &aCommand[2 + dwSend], dwRecv, 0xFF );
+
+			EnterControllerLock( bTag );
+			QueryPerformanceCounter( &liStart );
+			ProcessControllerCommand( bTag, aCommand );
+			QueryPerformanceCounter( &liEnd );
+			LeaveControllerLock( bTag );
+			llTicks += liEnd.QuadPart - liStart.QuadPart;
+			stats.dwCommands++;
+
+			if( dwSend == 0 || pSend[0] != RD_READKEYS )
+			{
+				stats.dwCompared++;
+				if( aCommand[1] != pTrace[dwPos+3] || memcmp( &aCommand[2 + dwSend], &pSend[dwSend], dwRecv ))
+				{
+					stats.dwDivergences++;
+					DebugWriteA( "SITrace: controller %d diverged in frame %u, command %02X\n", bTag + 1, stats.dwFrames, dwSend ? pSend[0] : 0 );
+				}
+			}
+			dwPos += 4 + dwSend + dwRecv;
+		}
+		else
+		{
+			fValid = false;
+			break;
+		}
+	}
+
+	UnmapViewOfFile( pTrace );
+	CloseHandle( hMapping );
+	CloseHandle( hFile );
+
+	stats.dwMicroseconds = (DWORD)( llTicks * 1000000 / liFrequency.QuadPart );
+	DebugWriteA( "SITrace: replayed %u commands in %u frames, %u/%u compared responses diverged, %u us (%u commands/s)%s\n",
+		stats.dwCommands, stats.dwFrames, stats.dwDivergences, stats.dwCompared, stats.dwMicroseconds,
+		stats.dwMicroseconds ? (DWORD)( (ULONGLONG)stats.dwCommands * 1000000 / stats.dwMicroseconds ) : 0,
+		fValid ? "" : ", trace truncated or corrupt" );
+
+	if( pStats )
+		*pStats = stats;
+	return TRUE;
+}
+
+#endif // #ifdef ENABLE_SI_TRACE
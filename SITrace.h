@@ -0,0 +1,84 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _SITRACE_H_
+#define _SITRACE_H_
+
+// Binary trace of the raw controller commands the emulator hands us, and a replayer for it.
+//
+// Compiled in with ENABLE_SI_TRACE (see settings.h), but off at runtime: recording starts on RomOpen only if a
+// file named SITRACE_FILENAME already exists in the plugin directory; create an empty one to start capturing,
+// delete it to stop.  Every session is appended to the end.
+//
+// ReplaySITrace replays everything, inside the plugin.  Tools/SITraceReplay.cpp (sireplay) replays the Memory
+// Pak and Transfer Pak traffic of a trace without Windows, against copies of the paks, for profiling the pak
+// core elsewhere; only controller reads, which depend on live input, need the plugin.
+//
+// File layout (little endian, no padding):
+//	session:	BYTE SITRACE_SESSION, DWORD SITRACE_MAGIC, WORD SITRACE_VERSION, LONGLONG performance counter frequency
+//	frame:		BYTE SITRACE_FRAME, DWORD frame number, LONGLONG performance counter
+//	command:	BYTE controller (0-3), BYTE send length, BYTE receive length as sent, BYTE receive length as answered,
+//				send bytes, then (receive length & 0x3F) response bytes
+// A frame record is only written before the first command of a frame, so idle frames cost nothing.
+
+#define SITRACE_MAGIC		0x5453524E	// "NRST"
+#define SITRACE_VERSION		1
+
+#define SITRACE_FRAME		0xFE
+#define SITRACE_SESSION		0xFF
+
+#ifdef ENABLE_SI_TRACE
+
+#define SITRACE_FILENAME	_T("NRage-SITrace.bin")
+
+typedef struct _SITRACESTATS
+{
+	DWORD dwSessions;
+	DWORD dwFrames;
+	DWORD dwCommands;
+	DWORD dwCompared;		// commands whose response doesn't depend on live input, so they can be checked
+	DWORD dwDivergences;	// compared commands that answered differently than in the trace
+	DWORD dwMicroseconds;	// time spent in ProcessControllerCommand
+} SITRACESTATS, *LPSITRACESTATS;
+
+void InitSITrace();
+void FreeSITrace();
+void OpenSITrace();
+void CloseSITrace();
+void SITraceNextFrame();
+void SITraceRecord( const int iControl, LPCBYTE Command, const BYTE bRecvLength );
+
+EXPORT BOOL CALL ReplaySITrace( LPCTSTR pszTraceFile, LPSITRACESTATS pStats );
+
+#else // #ifndef ENABLE_SI_TRACE
+
+#define InitSITrace()
+#define FreeSITrace()
+#define OpenSITrace()
+#define CloseSITrace()
+#define SITraceNextFrame()
+#define SITraceRecord( control, command, recv )
+
+#endif // #ifdef ENABLE_SI_TRACE
+
+#endif // #ifndef _SITRACE_H_
@@ -0,0 +1,93 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+
+// the same blocks every run
+static void FillRandomBlocks( LPBYTE pData, const DWORD dwSize )
+{
+	DWORD dwSeed = 0x12345678;
+	for( DWORD i = 0; i < dwSize; i++ )
+	{
+		dwSeed = dwSeed * 1103515245 + 12345;
+		pData[i] = (BYTE)( dwSeed >> 16 );
+	}
+}
+
+// DataCRC folds 8 bytes per step and does the rest byte by byte, so every length has to agree with the bit-serial
+// original, and with the one byte per step table version
+PAKTEST( DataCRCMatchesSerial )
+{
+	BYTE aBlocks[64 * 33];
+	FillRandomBlocks( aBlocks, sizeof(aBlocks) );
+	for( int iBlock = 0; iBlock < 64; iBlock++ )
+		for( int iLength = 1; iLength <= 33; iLength++ )
+		{
+			const BYTE bSerial = DataCRCSerial( &aBlocks[iBlock * 33], iLength );
+			CHECK( DataCRC( &aBlocks[iBlock * 33], iLength ) == bSerial );
+			CHECK( DataCRCBytewise( &aBlocks[iBlock * 33], iLength ) == bSerial );
+		}
+
+	BYTE aBlock[33];
+	for( int iFill = 0; iFill < 2; iFill++ )
+	{
+		FillMemory( aBlock, sizeof(aBlock), iFill ? 0xFF : 0x00 );
+		for( int iLength = 1; iLength <= 33; iLength++ )
+		{
+			CHECK( DataCRC( aBlock, iLength ) == DataCRCSerial( aBlock, iLength ));
+			CHECK( DataCRCBytewise( aBlock, iLength ) == DataCRCSerial( aBlock, iLength ));
+		}
+	}
+}
+
+// Every pak read and write runs DataCRC on 32 bytes.  The runs are 1000 blocks each, so the microseconds
+// reported are nanoseconds per block.
+PAKBENCH( DataCRCSpeed )
+{
+	static BYTE aBlocks[1000 * 32];
+	FillRandomBlocks( aBlocks, sizeof(aBlocks) );
+
+	DWORD dwSum = 0;
+	ULONGLONG qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+		for( int i = 0; i < 1000; i++ )
+			dwSum += DataCRC( &aBlocks[i * 32], 32 );
+	PakBenchReport( "DataCRC, 1000 blocks", PakMicroseconds() - qwStart, nIterations );
+
+	DWORD dwBytewiseSum = 0;
+	qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+		for( int i = 0; i < 1000; i++ )
+			dwBytewiseSum += DataCRCBytewise( &aBlocks[i * 32], 32 );
+	PakBenchReport( "DataCRCBytewise, 1000 blocks", PakMicroseconds() - qwStart, nIterations );
+
+	DWORD dwSerialSum = 0;
+	qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+		for( int i = 0; i < 1000; i++ )
+			dwSerialSum += DataCRCSerial( &aBlocks[i * 32], 32 );
+	PakBenchReport( "DataCRCSerial, 1000 blocks", PakMicroseconds() - qwStart, nIterations );
+
+	CHECK( dwSum == dwSerialSum && dwBytewiseSum == dwSerialSum );
+}
@@ -0,0 +1,285 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "GBRomIndex.h"
+#include "goombasav/goombasav.h"
+
+static DWORD NextRandom( DWORD *pdwSeed )
+{
+	*pdwSeed = *pdwSeed * 1103515245 + 12345;
+	return *pdwSeed >> 8;
+}
+
+static bool OpenTestCart( LPGBCART pCart, const char *pszRomFile, const char *pszSaveFile )
+{
+	ZeroMemory( pCart, sizeof(GBCART) );
+	if( !LoadCart( pCart, pszRomFile, pszSaveFile, _T("") ))
+		return false;
+	// RAM that isn't saved starts out as whatever the heap had, like a real cart after power on
+	if( pCart->bHasRam && !pCart->bHasBattery && pCart->RamData )
+		ZeroMemory( pCart->RamData, pCart->iRamSize );
+	return true;
+}
+
+// one random 32 byte access anywhere in GB address space, with values the MBC registers care about
+static void RandomCartAccess( DWORD *pdwSeed, bool *pfWrite, WORD *pwAddress, LPBYTE Data )
+{
+	static const BYTE aValues[] = { 0x0A, 0x00, 0x01, 0x02, 0x03, 0x05, 0x08, 0x0C, 0x13, 0x21, 0x41, 0x81, 0xFF };
+	const DWORD dwRandom = NextRandom( pdwSeed );
+	FillMemory( Data, 32, ( dwRandom & 0x100 ) ? aValues[( dwRandom >> 9 ) % ARRAYSIZE(aValues)] : (BYTE)( dwRandom >> 12 ));
+	*pwAddress = (WORD)( NextRandom( pdwSeed ) & 0xFFE0 );
+	*pfWrite = ( dwRandom & 3 ) == 0;
+}
+
+// ReadCart and WriteCart go through the bank map where they can; the MBC handlers are what they have to match
+PAKTEST( CartMapMatchesHandlers )
+{
+	static const struct { BYTE bCartType; int nRomBanks; BYTE bRamSize; } aCarts[] = {
+		{ 0x00, 2, 0x00 },		// ROM only
+		{ 0x09, 2, 0x02 },		// ROM+RAM+BATTERY
+		{ 0x03, 16, 0x03 },		// MBC1+RAM+BATTERY
+		{ 0x06, 8, 0x00 },		// MBC2+BATTERY
+		{ 0x13, 32, 0x03 },		// MBC3+RAM+BATTERY
+		{ 0x1A, 64, 0x04 },		// MBC5+RAM, not saved
+		{ 0x1B, 8, 0x03 } };	// MBC5+RAM+BATTERY
+	char szRom[16], szMapped[16], szHandled[16];
+	InitGBRomIndex( "index.bin" );
+
+	for( int c = 0; c < ARRAYSIZE(aCarts); c++ )
+	{
+		sprintf( szRom, "%d.gb", c );
+		sprintf( szMapped, "%d.map.sav", c );
+		sprintf( szHandled, "%d.mbc.sav", c );
+		CHECK( WriteTestGBRom( szRom, aCarts[c].bCartType, aCarts[c].nRomBanks, aCarts[c].bRamSize ));
+
+		static GBCART Mapped, Handled;
+		CHECK( OpenTestCart( &Mapped, szRom, szMapped ));
+		CHECK( OpenTestCart( &Handled, szRom, szHandled ));
+		if( Mapped.ptrfnReadCart == NULL || Handled.ptrfnReadCart == NULL )
+			continue;
+
+		DWORD dwSeed = 7 + c;
+		int nDiffer = 0;
+		for( int i = 0; i < 200000; i++ )
+		{
+			BYTE aData[32], aHandledData[32];
+			bool fWrite;
+			WORD wAddress;
+			RandomCartAccess( &dwSeed, &fWrite, &wAddress, aData );
+			CopyMemory( aHandledData, aData, sizeof(aData) );
+			if( fWrite )
+			{
+				WriteCart( &Mapped, wAddress, aData );
+				Handled.ptrfnWriteCart( &Handled, wAddress, aHandledData );
+			}
+			else
+			{
+				ReadCart( &Mapped, wAddress, aData );
+				Handled.ptrfnReadCart( &Handled, wAddress, aHandledData );
+			}
+			if( memcmp( aData, aHandledData, sizeof(aData) ) || Mapped.iCurrentRomBankNo != Handled.iCurrentRomBankNo
+				|| Mapped.iCurrentRamBankNo != Handled.iCurrentRamBankNo || Mapped.bRamEnableState != Handled.bRamEnableState )
+				nDiffer++;
+		}
+		CHECK( nDiffer == 0 );
+		CHECK( Mapped.iRamSize == Handled.iRamSize && ( !Mapped.iRamSize || !memcmp( Mapped.RamData, Handled.RamData, Mapped.iRamSize )));
+		UnloadCart( &Mapped );
+		UnloadCart( &Handled );
+	}
+	FreeGBRomIndex();
+}
+
+static void WriteCartByte( LPGBCART pCart, WORD wAddress, BYTE bValue )
+{
+	BYTE aData[32];
+	FillMemory( aData, sizeof(aData), bValue );
+	WriteCart( pCart, wAddress, aData );
+}
+
+// Only writes mark RAM pages dirty, and FlushCart writes back the runs of them and nothing else.
+PAKTEST( CartFlushesDirtyPages )
+{
+	InitGBRomIndex( "index.bin" );
+	CHECK( WriteTestGBRom( "mbc5.gb", 0x1B, 4, 0x04 ));	// MBC5+RAM+BATTERY, 128 KB of RAM: every bit of dwDirtyPages
+	static BYTE aZero[0x20000];
+	CHECK( WriteTestFile( "mbc5.sav", aZero, sizeof(aZero) ));
+	static GBCART Cart;
+	CHECK( OpenTestCart( &Cart, "mbc5.gb", "mbc5.sav" ) && Cart.pRamMapping != NULL );
+	CHECK( Cart.dwDirtyPages == 0 && !Cart.bSaveDirty );
+
+	BYTE aData[32];
+	WriteCartByte( &Cart, 0x0000, 0x0A );
+	WriteCartByte( &Cart, 0x4000, 0x03 );
+	ReadCart( &Cart, 0xA000, aData );
+	ReadCart( &Cart, 0xBFE0, aData );
+	CHECK( Cart.dwDirtyPages == 0 && !Cart.bSaveDirty );	// selecting banks and reading RAM write nothing
+	CHECK( FlushCart( &Cart ) == 0 );
+
+	WriteCartByte( &Cart, 0x4000, 0x00 );
+	WriteCartByte( &Cart, 0xA000, 0x11 );		// pages 0 and 1, one run
+	WriteCartByte( &Cart, 0xBFE0, 0x22 );
+	WriteCartByte( &Cart, 0x4000, 0x05 );
+	WriteCartByte( &Cart, 0xA020, 0x33 );		// page 10, twice
+	WriteCartByte( &Cart, 0xA040, 0x44 );
+	WriteCartByte( &Cart, 0x4000, 0x0F );
+	WriteCartByte( &Cart, 0xBFE0, 0x55 );		// page 31, the last
+	CHECK( Cart.dwDirtyPages == (( 1u << 0 ) | ( 1u << 1 ) | ( 1u << 10 ) | ( 1u << 31 )) && Cart.bSaveDirty );
+	CHECK( FlushCart( &Cart ) == 4 * GB_DIRTY_PAGE_SIZE );
+	CHECK( Cart.dwDirtyPages == 0 && FlushCart( &Cart ) == 0 );
+
+	WriteCartByte( &Cart, 0x4000, 0x08 );
+	WriteCartByte( &Cart, 0xA000, 0x66 );		// page 16
+	TCHAR szNoTime[1] = { 0 };
+	CHECK( SaveCart( &Cart, szNoTime, szNoTime ) && Cart.dwDirtyPages == 0 && !Cart.bSaveDirty );
+	UnloadCart( &Cart );
+
+	// what went through the mapping is in the file
+	static BYTE aSave[0x20000];
+	CHECK( ReadTestFile( "mbc5.sav", aSave, sizeof(aSave) ) == sizeof(aSave) );
+	CHECK( aSave[0x00000] == 0x11 && aSave[0x01FE0] == 0x22 && aSave[0x0A020] == 0x33 && aSave[0x0A040] == 0x44
+		&& aSave[0x1FFE0] == 0x55 && aSave[0x10000] == 0x66 && aSave[0x06000] == 0x00 );
+	FreeGBRomIndex();
+}
+
+// A Goomba Color save holding 8 KB of SRAM for the test ROM, made the way goombasav makes them
+static bool WriteTestGoombaFile( const char *pszFile, BYTE bFill )
+{
+	static BYTE aGba[GOOMBA_COLOR_SRAM_SIZE];
+	ZeroMemory( aGba, sizeof(aGba) );
+	*(uint32_t *)aGba = GOOMBA_STATEID;
+	configdata *pConfig = (configdata *)&aGba[4];
+	pConfig->size = sizeof(configdata);
+	pConfig->type = GOOMBA_CONFIGSAVE;
+	stateheader *pHeader = (stateheader *)( pConfig + 1 );
+	pHeader->size = sizeof(stateheader) + 4;	// a placeholder; goomba_new_sav puts the real data in
+	pHeader->type = GOOMBA_SRAMSAVE;
+	pHeader->uncompressed_size = 0x2000;
+	pHeader->checksum = 0x50414B54;
+	strcpy( pHeader->title, "PAKTEST" );
+
+	static BYTE aSram[0x2000];
+	FillMemory( aSram, sizeof(aSram), bFill );
+	char *pNew = goomba_new_sav( aGba, pHeader, aSram, sizeof(aSram) );
+	if( pNew == NULL )
+		return false;
+	bool bReturn = WriteTestFile( pszFile, pNew, GOOMBA_COLOR_SRAM_SIZE );
+	free( pNew );
+	return bReturn;
+}
+
+// A session that only reads, like Pokemon Stadium's GB Tower, doesn't save.  A Goomba save would be
+// recompressed and rewritten as a whole by UpdateGoombaFile, which clears the unused space behind the
+// saves; a mark left there says whether that happened.
+PAKTEST( CartReadOnlySessionSkipsSave )
+{
+	InitGBRomIndex( "index.bin" );
+	CHECK( WriteTestGBRom( "mbc5.gb", 0x1B, 4, 0x02 ));
+	CHECK( WriteTestGoombaFile( "goomba.sav", 0x5A ));
+	static BYTE aFile[GOOMBA_COLOR_SRAM_SIZE];
+	CHECK( ReadTestFile( "goomba.sav", aFile, sizeof(aFile) ) == sizeof(aFile) );
+	strcpy( (char *)&aFile[0xD000], "untouched" );
+	CHECK( WriteTestFile( "goomba.sav", aFile, sizeof(aFile) ));
+
+	static GBCART Cart;
+	TCHAR szNoTime[1] = { 0 };
+	CHECK( OpenTestCart( &Cart, "mbc5.gb", "goomba.sav" ) && Cart.sGoombaRamPath != NULL );
+	BYTE aData[32];
+	WriteCartByte( &Cart, 0x0000, 0x0A );
+	ReadCart( &Cart, 0xA000, aData );
+	CHECK( aData[0] == 0x5A && aData[31] == 0x5A );
+	CHECK( !Cart.bSaveDirty && SaveCart( &Cart, szNoTime, szNoTime ));
+	UnloadCart( &Cart );
+	CHECK( ReadTestFile( "goomba.sav", aFile, sizeof(aFile) ) == sizeof(aFile) && !strcmp( (char *)&aFile[0xD000], "untouched" ));
+
+	// one write, and the file is rewritten with it
+	CHECK( OpenTestCart( &Cart, "mbc5.gb", "goomba.sav" ) && Cart.sGoombaRamPath != NULL );
+	WriteCartByte( &Cart, 0x0000, 0x0A );
+	WriteCartByte( &Cart, 0xA000, 0xA5 );
+	CHECK( Cart.bSaveDirty && SaveCart( &Cart, szNoTime, szNoTime ) && !Cart.bSaveDirty );
+	UnloadCart( &Cart );
+	CHECK( ReadTestFile( "goomba.sav", aFile, sizeof(aFile) ) == sizeof(aFile) && aFile[0xD000] == 0 );
+	CHECK( OpenTestCart( &Cart, "mbc5.gb", "goomba.sav" ) && Cart.sGoombaRamPath != NULL );
+	WriteCartByte( &Cart, 0x0000, 0x0A );
+	ReadCart( &Cart, 0xA000, aData );
+	CHECK( aData[0] == 0xA5 && aData[31] == 0xA5 );
+	ReadCart( &Cart, 0xA020, aData );
+	CHECK( aData[0] == 0x5A );
+	UnloadCart( &Cart );
+	FreeGBRomIndex();
+}
+
+// Random 32 byte reads of ROM and RAM, with a bank switch every so often, per 1000 reads.  Both ways get an
+// untimed round over every bank first; otherwise whichever runs first pays for faulting in the mapped ROM,
+// which at a few iterations is most of what gets measured.
+PAKBENCH( CartReads )
+{
+	InitGBRomIndex( "index.bin" );
+	CHECK( WriteTestGBRom( "mbc5.gb", 0x1B, 64, 0x03 ));
+	static GBCART Cart;
+	CHECK( OpenTestCart( &Cart, "mbc5.gb", "mbc5.sav" ));
+
+	static WORD awAddresses[1000];
+	DWORD dwSeed = 1;
+	for( int i = 0; i < 1000; i++ )
+	{
+		static const WORD awBases[] = { 0x0000, 0x4000, 0x6000, 0xA000 };
+		awAddresses[i] = (WORD)( awBases[i & 3] + ( NextRandom( &dwSeed ) & 0x1FE0 ));
+	}
+
+	BYTE aData[32];
+	int nSum = 0, nHandledSum = 0;
+	for( int n = 0; n < 32; n++ )
+	{
+		FillMemory( aData, 32, (BYTE)( 1 + n ));
+		WriteCart( &Cart, 0x2000, aData );
+		for( int i = 0; i < 1000; i++ )
+		{
+			ReadCart( &Cart, awAddresses[i], aData );
+			Cart.ptrfnReadCart( &Cart, awAddresses[i], aData );
+		}
+	}
+	for( int iPass = 0; iPass < 2; iPass++ )
+	{
+		const ULONGLONG qwStart = PakMicroseconds();
+		for( int n = 0; n < nIterations; n++ )
+		{
+			FillMemory( aData, 32, (BYTE)( 1 + ( n & 31 )));
+			WriteCart( &Cart, 0x2000, aData );	// ROM bank
+			for( int i = 0; i < 1000; i++ )
+			{
+				if( iPass == 0 )
+					ReadCart( &Cart, awAddresses[i], aData );
+				else
+					Cart.ptrfnReadCart( &Cart, awAddresses[i], aData );
+				( iPass ? nHandledSum : nSum ) += aData[i & 31];
+			}
+		}
+		PakBenchReport( iPass ? "MBC5 handler, 1000 reads" : "bank map, 1000 reads", PakMicroseconds() - qwStart, nIterations );
+	}
+	CHECK( nSum == nHandledSum );
+
+	UnloadCart( &Cart );
+	FreeGBRomIndex();
+}
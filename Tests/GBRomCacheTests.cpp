@@ -0,0 +1,69 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "GBRomCache.h"
+#include <sys/mman.h>
+
+// msync fails with ENOMEM on memory that isn't mapped; RomData is the page aligned start of its view
+static bool IsMapped( LPCBYTE RomData )
+{
+	return msync( (void *)RomData, 1, MS_ASYNC ) == 0;
+}
+
+// One ROM loaded four times, twice by the same name, once by another path to the same file and once from
+// a byte-identical copy, is one mapping and one header record; the last release unmaps it.
+PAKTEST( RomCacheSharesCopies )
+{
+	CHECK( WriteTestGBRom( "a.gb", 0x1B, 8, 0x03 ));
+	CHECK( PakCreateDirectory( "copy" ));
+	CHECK( WriteTestGBRom( "copy/a.gb", 0x1B, 8, 0x03 ));
+	CHECK( WriteTestGBRom( "b.gb", 0x1B, 16, 0x03 ));	// another ROM, which gets its own
+
+	const GBROMINFO *apInfo[4], *pOtherInfo;
+	LPCBYTE aRomData[4];
+	aRomData[0] = AcquireGBRom( "a.gb", &apInfo[0] );
+	aRomData[1] = AcquireGBRom( "a.gb", &apInfo[1] );
+	aRomData[2] = AcquireGBRom( "copy/../a.gb", &apInfo[2] );
+	aRomData[3] = AcquireGBRom( "copy/a.gb", &apInfo[3] );
+	LPCBYTE OtherRomData = AcquireGBRom( "b.gb", &pOtherInfo );
+	CHECK( aRomData[0] != NULL && OtherRomData != NULL && OtherRomData != aRomData[0] && pOtherInfo != apInfo[0] );
+	for( int i = 1; i < 4; i++ )
+		CHECK( aRomData[i] == aRomData[0] && apInfo[i] == apInfo[0] );
+	CHECK( apInfo[0]->iNumRomBanks == 8 && pOtherInfo->iNumRomBanks == 16 );
+
+	for( int i = 0; i < 3; i++ )
+		ReleaseGBRom( aRomData[i] );
+	CHECK( IsMapped( aRomData[0] ) && aRomData[3][0x4000] == (BYTE)1 );
+	ReleaseGBRom( aRomData[3] );
+	CHECK( !IsMapped( aRomData[0] ));
+	CHECK( IsMapped( OtherRomData ));
+	ReleaseGBRom( OtherRomData );
+	CHECK( !IsMapped( OtherRomData ));
+
+	// and the copy alone maps it again
+	aRomData[0] = AcquireGBRom( "copy/a.gb", &apInfo[0] );
+	CHECK( aRomData[0] != NULL && apInfo[0]->iNumRomBanks == 8 );
+	ReleaseGBRom( aRomData[0] );
+}
@@ -0,0 +1,102 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "GBRomIndex.h"
+
+static bool WriteTestRom( const char *pszFile, const char *pszTitle, const DWORD dwSize )
+{
+	static BYTE aRom[0x10000];
+	ZeroMemory( aRom, sizeof(aRom) );
+	strncpy( (char*)&aRom[0x134], pszTitle, 16 );
+	return WriteTestFile( pszFile, aRom, dwSize );
+}
+
+static DWORD CountIndexedEntries()
+{
+	GBROMINDEXHEADER Header;
+	if( ReadTestFile( "index.bin", &Header, sizeof(Header) ) != sizeof(Header) )
+		return 0;
+	return Header.nEntries;
+}
+
+PAKTEST( RomIndexAppendsMisses )
+{
+	GBROMINDEXENTRY Entry;
+	CHECK( WriteTestRom( "b.gb", "BETA", 0x8000 ));
+	CHECK( WriteTestRom( "a.gb", "ALPHA", 0x8000 ));
+
+	InitGBRomIndex( "index.bin" );
+	CHECK( GetGBRomIndexEntry( "b.gb", &Entry ));
+	CHECK( GetGBRomIndexEntry( "a.gb", &Entry ));
+	CHECK( CountIndexedEntries() == 2 );
+	CHECK( GetGBRomIndexEntry( "a.gb", &Entry ));	// a hit writes nothing
+	CHECK( CountIndexedEntries() == 2 );
+
+	// a changed ROM is appended again, and the later entry wins when the index is loaded
+	CHECK( WriteTestRom( "a.gb", "ALPHA2", 0x10000 ));
+	CHECK( GetGBRomIndexEntry( "a.gb", &Entry ));
+	CHECK( CountIndexedEntries() == 3 );
+	FreeGBRomIndex();
+
+	InitGBRomIndex( "index.bin" );
+	CHECK( GetGBRomIndexEntry( "a.gb", &Entry ));
+	CHECK( !strcmp( Entry.szTitle, "ALPHA2" ) && Entry.dwFileSize == 0x10000 );
+	CHECK( GetGBRomIndexEntry( "b.gb", &Entry ));
+	CHECK( !strcmp( Entry.szTitle, "BETA" ));
+	CHECK( CountIndexedEntries() == 3 );
+	FreeGBRomIndex();
+}
+
+PAKTEST( RomIndexRefreshesInTheBackground )
+{
+	GBROMINDEXENTRY Entry;
+	TCHAR szDirectory[MAX_PATH+1];
+	CHECK( PakCreateDirectory( "roms" ));
+	CHECK( WriteTestRom( "roms/a.gb", "ALPHA", 0x8000 ));
+	CHECK( WriteTestRom( "roms/b.gbc", "BETA", 0x8000 ));
+	CHECK( WriteTestRom( "c.gb", "GAMMA", 0x8000 ));
+	CHECK( PakFullPathName( "roms", szDirectory ) != NULL );
+	lstrcat( szDirectory, _T("/") );
+
+	InitGBRomIndex( "index.bin" );
+	CHECK( GetGBRomIndexEntry( "c.gb", &Entry ));	// from outside the directory, kept by the refresh
+	CHECK( GetGBRomIndexEntry( "roms/a.gb", &Entry ));
+	CHECK( WriteTestRom( "roms/a.gb", "ALPHA2", 0x10000 ));
+	CHECK( GetGBRomIndexEntry( "roms/a.gb", &Entry ));
+	CHECK( CountIndexedEntries() == 3 );
+
+	CHECK( StartGBRomIndexRefresh( szDirectory ));
+	WaitGBRomIndexRefresh();
+	CHECK( CountIndexedEntries() == 3 );	// written out again without the repeat
+	FreeGBRomIndex();
+
+	InitGBRomIndex( "index.bin" );
+	CHECK( GetGBRomIndexEntry( "roms/b.gbc", &Entry ));
+	CHECK( !strcmp( Entry.szTitle, "BETA" ));
+	CHECK( GetGBRomIndexEntry( "roms/a.gb", &Entry ));
+	CHECK( !strcmp( Entry.szTitle, "ALPHA2" ));
+	CHECK( CountIndexedEntries() == 3 );	// all of them were hits
+	FreeGBRomIndex();
+}
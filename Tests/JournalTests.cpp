@@ -0,0 +1,129 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "PakJournal.h"
+
+#define TEST_DATA_SIZE	0x8000
+
+typedef struct _TESTDATA
+{
+	LPPAKMAPPING pMapping;
+	LPBYTE pData;
+} TESTDATA;
+
+static bool MapTestData( TESTDATA *pData )
+{
+	LPPAKFILE pFile = PakOpenFile( "data.bin", PAK_FILE_WRITE );
+	if( pFile == NULL )
+		return false;
+	pData->pData = PakMapFile( pFile, TEST_DATA_SIZE, false, &pData->pMapping );
+	PakCloseFile( pFile );
+	return pData->pData != NULL;
+}
+
+static void WriteTestBlock( LPPAKJOURNAL pJournal, TESTDATA *pData, const DWORD dwBlock, const BYTE bFill )
+{
+	BYTE aBlock[32];
+	FillMemory( aBlock, 32, bFill );
+	PakJournalWrite( pJournal, pData->pData, dwBlock * 32 % TEST_DATA_SIZE, aBlock );
+}
+
+// what a crash leaves behind: the journal file as it is, and data that never made it to disk
+static void CrashTestData( LPPAKJOURNAL pJournal, TESTDATA *pData )
+{
+	for( int i = pJournal->nViews - 1; i >= 0; --i )
+		PakUnmapFile( pJournal->apViews[i], pJournal->apMappings[i] );
+	P_free( pJournal );
+	PakUnmapFile( pData->pData, pData->pMapping );
+
+	static BYTE aZero[TEST_DATA_SIZE];
+	WriteTestFile( "data.bin", aZero, TEST_DATA_SIZE );
+}
+
+PAKTEST( JournalGrowsForBigGroups )
+{
+	TESTDATA Data;
+	CHECK( MapTestData( &Data ));
+	LPPAKJOURNAL pJournal = OpenPakJournal( "data.bin", Data.pData, TEST_DATA_SIZE, true );
+	CHECK( pJournal != NULL );
+	const DWORD dwRecords = pJournal->dwRecords;
+	CHECK( dwRecords >= TEST_DATA_SIZE / 32 * 2 );
+
+	// one group that writes every block three and a half times over; the ring grows instead of flushing or splitting it
+	for( DWORD i = 0; i < dwRecords * 7 / 4; i++ )
+		WriteTestBlock( pJournal, &Data, i, (BYTE)( i / ( TEST_DATA_SIZE / 32 ) + 1 ));
+	PakJournalCommit( pJournal );
+	CHECK( pJournal->dwRecords == dwRecords * 2 );
+	CHECK( PakJournalMark( pJournal ) == pJournal->dwHead );
+	CHECK( PakJournalWantsCheckpoint( pJournal ));
+
+	// and an uncommitted one
+	WriteTestBlock( pJournal, &Data, 0, 0x77 );
+	CrashTestData( pJournal, &Data );
+
+	// the committed group is redone from the grown ring, the other one rolled back
+	CHECK( MapTestData( &Data ));
+	pJournal = OpenPakJournal( "data.bin", Data.pData, TEST_DATA_SIZE, false );
+	CHECK( pJournal != NULL );
+	CHECK( Data.pData[0] == 4 && Data.pData[511 * 32] == 4 && Data.pData[512 * 32] == 3 && Data.pData[TEST_DATA_SIZE - 1] == 3 );
+	CHECK( pJournal->dwRecords == dwRecords && !PakJournalWantsCheckpoint( pJournal ));
+	ClosePakJournal( pJournal );
+	PakUnmapFile( Data.pData, Data.pMapping );
+	CHECK( !PakFileExists( "data.bin.jnl" ));
+}
+
+PAKTEST( JournalDropsGroupsThatDontFit )
+{
+	TESTDATA Data;
+	CHECK( MapTestData( &Data ));
+	LPPAKJOURNAL pJournal = OpenPakJournal( "data.bin", Data.pData, TEST_DATA_SIZE, true );
+	CHECK( pJournal != NULL );
+	const DWORD dwMaxRecords = pJournal->dwRecords << PAK_JOURNAL_GROWTHS;
+
+	WriteTestBlock( pJournal, &Data, 0, 0x11 );
+	PakJournalCommit( pJournal );
+	const DWORD dwMark = PakJournalMark( pJournal );
+
+	// never checkpointed, so this outgrows the biggest ring; none of it may be committed
+	for( DWORD i = 0; i <= dwMaxRecords; i++ )
+		WriteTestBlock( pJournal, &Data, i, 0x22 );
+	CHECK( pJournal->fDropped && pJournal->dwHead == dwMark );
+	PakJournalCommit( pJournal );
+	CHECK( PakJournalMark( pJournal ) == dwMark && !pJournal->fDropped );
+
+	// the next group is journaled again, in the room the dropped one left
+	WriteTestBlock( pJournal, &Data, 1, 0x33 );
+	PakJournalCommit( pJournal );
+	CHECK( PakJournalMark( pJournal ) == dwMark + 2 );
+	CrashTestData( pJournal, &Data );
+
+	// only the last group is redone: redoing the first one would have undone the dropped writes
+	CHECK( MapTestData( &Data ));
+	pJournal = OpenPakJournal( "data.bin", Data.pData, TEST_DATA_SIZE, false );
+	CHECK( pJournal != NULL );
+	CHECK( Data.pData[0] == 0 && Data.pData[32] == 0x33 );
+	ClosePakJournal( pJournal );
+	PakUnmapFile( Data.pData, Data.pMapping );
+}
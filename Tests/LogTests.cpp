@@ -0,0 +1,165 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// The log macros as a debug build of the plugin has them (DEBUG_LOG_LEVEL is LOG_DEBUG there, see settings.h),
+// writing to a counter instead of the debug file.  The rest of paktest is built like a release build; paktrace
+// runs this file against a debug build of the core, which writes its log to the same counter.
+#define _DEBUG
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "GBRomIndex.h"
+
+int g_iLogLevel = DEBUG_LOG_LEVEL;
+DWORD g_dwLogCategories = LOG_ALL;
+
+static int g_nLogWrites = 0;
+
+void _cdecl _DebugWriteA( LPCSTR szFormat, ... )
+{
+	g_nLogWrites++;
+}
+
+static int CountEvaluation( int *pnEvaluated )
+{
+	return ++*pnEvaluated;
+}
+
+PAKTEST( LogLevelsFilter )
+{
+	int nEvaluated = 0;
+	g_nLogWrites = 0;
+	g_iLogLevel = DEBUG_LOG_LEVEL;
+	g_dwLogCategories = LOG_ALL;
+
+	// above DEBUG_LOG_LEVEL: compiled out, the arguments never run
+	LogTraceA( LOG_TPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	CHECK( nEvaluated == 0 && g_nLogWrites == 0 );
+
+	LogWarnA( LOG_TPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	LogDebugA( LOG_MEMPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	CHECK( nEvaluated == 2 && g_nLogWrites == 2 );
+
+	// filtered at runtime: no write, and the arguments don't run either
+	g_iLogLevel = LOG_WARN;
+	LogDebugA( LOG_MEMPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	LogWarnA( LOG_MEMPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	CHECK( nEvaluated == 3 && g_nLogWrites == 3 );
+
+	g_iLogLevel = DEBUG_LOG_LEVEL;
+	g_dwLogCategories = LOG_INPUT;
+	LogWarnA( LOG_TPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	LogDebugA( LOG_INPUT | LOG_TPAK, "%d\n", CountEvaluation( &nEvaluated ));
+	CHECK( nEvaluated == 4 && g_nLogWrites == 4 );
+
+	g_dwLogCategories = LOG_ALL;
+}
+
+// The MBC5 handler; the plugin only reaches it through the cart's ptrfnReadCart.
+bool ReadCartMBC5( LPGBCART Cart, WORD dwAddress, BYTE *Data );
+
+// all 32 KB of GB ROM through the Transfer Pak, banks 0 and 1
+static int ReadTPakRom( LPTRANSFERPAK pTPak )
+{
+	BYTE aData[33];
+	int nSum = 0;
+	for( int iBank = 0; iBank < 2; iBank++ )
+	{
+		FillMemory( aData, 32, (BYTE)iBank );
+		WriteTransferPak( pTPak, 0xA000, aData );
+		for( DWORD dwAddress = 0xC000; dwAddress < 0x10000; dwAddress += 32 )
+		{
+			ReadTransferPak( pTPak, (WORD)dwAddress, aData );
+			nSum += aData[31] + aData[32];
+		}
+	}
+	return nSum;
+}
+
+// the same 32 KB straight through the MBC5 handler, without DataCRC
+static int ReadMBC5Rom( LPGBCART pCart )
+{
+	BYTE aData[32];
+	int nSum = 0;
+	for( DWORD dwAddress = 0; dwAddress < 0x8000; dwAddress += 32 )
+	{
+		ReadCartMBC5( pCart, (WORD)dwAddress, aData );
+		nSum += aData[31];
+	}
+	return nSum;
+}
+
+// What the per-transfer LogTraceA calls cost the pak reads.  paktest links the core without any logging, paktrace
+// (see CMakeLists.txt) a debug build of it with LOG_TRACE compiled in, filtered out at runtime and then let through
+// to the counter above, which leaves out only the formatting and the ring.  A debug build's DataCRC also checks
+// itself against DataCRCSerial, so ReadCartMBC5 alone is the fair comparison; ReadTransferPak is what a game sees.
+PAKBENCH( TracedPakReads )
+{
+#ifdef PAKTEST_TRACED
+	static const int aLevels[] = { LOG_DEBUG, LOG_TRACE };
+	static const char * const aszReadTPak[] = { "ReadTransferPak 32 KB, tracing compiled in, filtered out", "ReadTransferPak 32 KB, tracing compiled in and on" };
+	static const char * const aszReadMBC5[] = { "ReadCartMBC5 32 KB, tracing compiled in, filtered out", "ReadCartMBC5 32 KB, tracing compiled in and on" };
+#else
+	static const int aLevels[] = { LOG_DEBUG };
+	static const char * const aszReadTPak[] = { "ReadTransferPak 32 KB, tracing compiled out" };
+	static const char * const aszReadMBC5[] = { "ReadCartMBC5 32 KB, tracing compiled out" };
+#endif
+	InitGBRomIndex( "index.bin" );
+	CHECK( WriteTestGBRom( "mbc5.gb", 0x1B, 64, 0x03 ));
+
+	static TRANSFERPAK TPak;
+	ZeroMemory( &TPak, sizeof(TPak) );
+	InitTransferPak( &TPak, "mbc5.gb", "mbc5.sav" );
+	CHECK( TPak.bPakInserted );
+	if( !TPak.bPakInserted )
+	{
+		FreeGBRomIndex();
+		return;
+	}
+	BYTE aData[33];
+	FillMemory( aData, 32, 0x84 );
+	WriteTransferPak( &TPak, 0x8000, aData );
+
+	int nFirstTPak = -1, nFirstMBC5 = -1;
+	for( int l = 0; l < ARRAYSIZE(aLevels); l++ )
+	{
+		g_iLogLevel = aLevels[l];
+		int nSum = 0;
+		ULONGLONG qwStart = PakMicroseconds();
+		for( int n = 0; n < nIterations; n++ )
+			nSum = ReadTPakRom( &TPak );
+		PakBenchReport( aszReadTPak[l], PakMicroseconds() - qwStart, nIterations );
+		CHECK( nFirstTPak < 0 || nSum == nFirstTPak );
+		nFirstTPak = nSum;
+
+		qwStart = PakMicroseconds();
+		for( int n = 0; n < nIterations; n++ )
+			nSum = ReadMBC5Rom( &TPak.gbCart );
+		PakBenchReport( aszReadMBC5[l], PakMicroseconds() - qwStart, nIterations );
+		CHECK( nFirstMBC5 < 0 || nSum == nFirstMBC5 );
+		nFirstMBC5 = nSum;
+	}
+
+	g_iLogLevel = DEBUG_LOG_LEVEL;
+	UnloadCart( &TPak.gbCart );
+	FreeGBRomIndex();
+}
@@ -0,0 +1,434 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "MemPakFormat.h"
+
+static bool OpenTestPak( LPMEMPAK mPak, const char *pszFile )
+{
+	TCHAR szFull[MAX_PATH+1];
+	ZeroMemory( mPak, sizeof(MEMPAK) );
+	return PakFullPathName( pszFile, szFull ) && OpenMemPak( mPak, szFull, pszFile );
+}
+
+// a 32 byte transfer as the game sends it: address, data, and the data CRC back from the pak
+static void WriteBlock( LPMEMPAK mPak, const WORD wAddress, const BYTE bFill )
+{
+	BYTE aData[33];
+	FillMemory( aData, 32, bFill );
+	WriteMemPak( mPak, wAddress, aData );
+}
+
+PAKTEST( NewMemPakIsFormatted )
+{
+	MEMPAK Pak;
+	CHECK( OpenTestPak( &Pak, "new.mpk" ));
+	CHECK( Pak.pMapping != NULL && !Pak.fReadonly && Pak.nBanks == 1 );
+
+	MEMPAKCHECK Check;
+	CHECK( !( ValidateMemPak( Pak.aMemPakData, &Check ) & MPERR_DAMAGED ));
+	CHECK( Check.nNotes == 0 );
+	CHECK( MemPakRemainingBlocks( Pak.pModel ) == 123 );
+	CloseMemPak( &Pak );
+
+	PAKFILEINFO Info;
+	CHECK( PakGetPathInfo( "new.mpk", &Info ) && Info.qwSize == PAK_MEM_SIZE );
+}
+
+PAKTEST( MemPakWriteRead )
+{
+	MEMPAK Pak;
+	BYTE aData[33];
+	CHECK( OpenTestPak( &Pak, "rw.mpk" ));
+	WriteBlock( &Pak, 0x1000, 0xA5 );
+	CHECK( Pak.dwDirtyPages == 0x02 );
+
+	CHECK( ReadMemPak( &Pak, 0x1000, aData, NULL ) == RD_OK );
+	CHECK( aData[0] == 0xA5 && aData[31] == 0xA5 );
+	CHECK( aData[32] == DataCRC( aData, 32 ));
+	SaveMemPak( &Pak );
+	CloseMemPak( &Pak );
+
+	CHECK( OpenTestPak( &Pak, "rw.mpk" ));
+	CHECK( ReadMemPak( &Pak, 0x1000, aData, NULL ) == RD_OK && aData[0] == 0xA5 );
+	CloseMemPak( &Pak );
+}
+
+PAKTEST( ModelTracksNotes )
+{
+	MEMPAK Pak;
+	CHECK( OpenTestPak( &Pak, "notes.mpk" ));
+	CHECK( !Pak.pModel->aNotes[1].fUsed );
+
+	BYTE aEntry[33];
+	ZeroMemory( aEntry, sizeof(aEntry) );
+	CopyMemory( &aEntry[0x00], "NSME", 4 );
+	CopyMemory( &aEntry[0x04], "01", 2 );
+	aEntry[0x07] = 0x05;
+	aEntry[0x0C] = 0x1A;
+	aEntry[0x10] = 0x1D;
+	WriteMemPak( &Pak, 0x320, aEntry );
+
+	const MEMPAKNOTE *pNote = &Pak.pModel->aNotes[1];
+	CHECK( pNote->fUsed && !memcmp( pNote->aGameCode, "NSME", 4 ) && !memcmp( pNote->aPublisher, "01", 2 ));
+	CHECK( pNote->bFirstBlock == 0x05 && pNote->aExtension[0] == 0x1A && pNote->aName[0] == 0x1D );
+	CHECK( !Pak.pModel->aNotes[0].fUsed && !Pak.pModel->aNotes[2].fUsed );
+
+	MEMPAKMODEL Model;
+	BuildMemPakModel( &Model, Pak.aMemPakData );
+	CHECK( !memcmp( &Model.aNotes[1], pNote, sizeof(MEMPAKNOTE) ));
+	CloseMemPak( &Pak );
+}
+
+PAKTEST( DexDriveHeader )
+{
+	MEMPAK Pak;
+	CHECK( OpenTestPak( &Pak, "dex.n64" ));
+	CHECK( Pak.fDexSave );
+	WriteBlock( &Pak, 0x0400, 0x11 );
+	SaveMemPak( &Pak );
+	CloseMemPak( &Pak );
+
+	BYTE aFile[PAK_MEM_DEXOFFSET + PAK_MEM_SIZE];
+	CHECK( ReadTestFile( "dex.n64", aFile, sizeof(aFile) ) == sizeof(aFile) );
+	CHECK( !memcmp( aFile, "123-456-STD", 11 ));
+	CHECK( aFile[PAK_MEM_DEXOFFSET + 0x0400] == 0x11 );
+}
+
+PAKTEST( ConvertFormats )
+{
+	MEMPAK Pak;
+	CHECK( OpenTestPak( &Pak, "src.mpk" ));
+	WriteBlock( &Pak, 0x2000, 0x3C );
+	SaveMemPak( &Pak );
+	CloseMemPak( &Pak );
+
+	CHECK( ConvertMemPakFile( "src.mpk", "dst.n64" ));
+	CHECK( ConvertMemPakFile( "dst.n64", "dst.mpm" ));
+	CHECK( ConvertMemPakFile( "dst.mpm", "back.mpk" ));
+	CHECK( !ConvertMemPakFile( "src.mpk", "src.mpk" ));
+
+	static BYTE aSource[PAK_MEM_SIZE], aBack[PAK_MEM_SIZE];
+	CHECK( ReadTestFile( "src.mpk", aSource, PAK_MEM_SIZE ) == PAK_MEM_SIZE );
+	CHECK( ReadTestFile( "back.mpk", aBack, PAK_MEM_SIZE ) == PAK_MEM_SIZE );
+	CHECK( !memcmp( aSource, aBack, PAK_MEM_SIZE ));
+	CHECK( aBack[0x2000] == 0x3C );
+
+	CHECK( ConvertMemPakFiles( ".", _T(".mpk"), _T(".n64") ) == 2 );
+	CHECK( PakFileExists( "src.n64" ) && PakFileExists( "back.n64" ));
+	CHECK( ConvertMemPakFiles( ".", _T(".mpk"), _T(".n64") ) == 0 );	// existing targets are left alone
+}
+
+PAKTEST( BankSwapKeepsModels )
+{
+	MEMPAK Pak;
+	BYTE aData[33];
+	CONTROLLERSTATS Stats;
+	ZeroMemory( &Stats, sizeof(Stats) );
+	CHECK( OpenTestPak( &Pak, "swap.mpb" ));
+	CHECK( Pak.nBanks == PAK_MEM_BANKS_DEFAULT );
+
+	CHECK( SelectMemPakBank( &Pak, 1 ));
+	WriteBlock( &Pak, 0x300, 0x41 );
+	CHECK( Pak.pModel == &Pak.aModels[1] && Pak.pModel->aNotes[0].fUsed );
+	CHECK( ReadMemPak( &Pak, 0x300, aData, &Stats ) == RD_OK && Stats.dwMemPakCRCHits == 1 );
+
+	// every bank was parsed when the pak was opened; a swap only moves pointers
+	CHECK( SelectMemPakBank( &Pak, 0 ));
+	CHECK( Pak.pModel == &Pak.aModels[0] && !Pak.pModel->aNotes[0].fUsed );
+	CHECK( ReadMemPak( &Pak, 0x300, aData, &Stats ) == RD_OK && aData[0] != 0x41 );
+	CHECK( SelectMemPakBank( &Pak, 1 ));
+	CHECK( Pak.pModel->aNotes[0].fUsed );
+	CHECK( ReadMemPak( &Pak, 0x300, aData, &Stats ) == RD_OK && aData[0] == 0x41 && Stats.dwMemPakCRCHits == 2 );
+	CloseMemPak( &Pak );
+}
+
+PAKTEST( ConvertRefusesBanks )
+{
+	MEMPAK Pak;
+	CHECK( OpenTestPak( &Pak, "one.mpk" ));
+	CloseMemPak( &Pak );
+
+	CHECK( ConvertMemPakFile( "one.mpk", "one.mpb" ));
+	PAKFILEINFO Info;
+	CHECK( PakGetPathInfo( "one.mpb", &Info ) && Info.qwSize == PAK_MEM_SIZE );
+
+	// a bank file with a second bank in it won't squeeze into a single pak
+	static BYTE aBanks[2 * PAK_MEM_SIZE];
+	FillMemory( aBanks, sizeof(aBanks), 0xFF );
+	CHECK( WriteTestFile( "two.mpb", aBanks, sizeof(aBanks) ));
+	CHECK( !ConvertMemPakFile( "two.mpb", "two.mpk" ));
+	CHECK( !PakFileExists( "two.mpk" ));
+	CHECK( !ConvertMemPakFile( "two.mpb", "two.mpm" ));
+	CHECK( ConvertMemPakFile( "two.mpb", "copy.mpb" ));
+}
+
+static bool CountPage( const TCHAR *pszName, void *pParam )
+{
+	(*(int*)pParam)++;
+	return true;
+}
+
+PAKTEST( ManifestSharesPages )
+{
+	MEMPAK Pak;
+	CHECK( OpenTestPak( &Pak, "a.mpm" ));
+	CHECK( Pak.pStore != NULL );
+	CloseMemPak( &Pak );
+	CHECK( OpenTestPak( &Pak, "b.mpm" ));
+	CloseMemPak( &Pak );
+
+	// two freshly formatted paks only differ in their ID blocks' random serial
+	int nPages = 0;
+	PakFindFiles( "pakstore", _T(".pg"), CountPage, &nPages );
+	CHECK( nPages > 0 && nPages < 2 * 8 );
+}
+
+static DWORD PakErrors( LPCBYTE aMemPak )
+{
+	MEMPAKCHECK Check;
+	return ValidateMemPak( aMemPak, &Check );
+}
+
+// a fresh pak whose index checksum is off, which RepairMemPak can fix
+static void WriteDamagedPak( const char *pszFile )
+{
+	MEMPAK Pak;
+	BYTE aFile[PAK_MEM_DEXOFFSET + PAK_MEM_SIZE];
+	OpenTestPak( &Pak, pszFile );
+	CloseMemPak( &Pak );
+	const int nSize = ReadTestFile( pszFile, aFile, sizeof(aFile) );
+	aFile[MemPakFormatOffset( MemPakFormatFromName( pszFile )) + 0x101] ^= 0x5A;
+	WriteTestFile( pszFile, aFile, nSize );
+}
+
+PAKTEST( MountLeavesDamageAlone )
+{
+	MEMPAK Pak;
+	BYTE aImage[PAK_MEM_SIZE];
+	WriteDamagedPak( "damaged.mpk" );
+
+	// mounting only looks
+	CHECK( OpenTestPak( &Pak, "damaged.mpk" ));
+	CHECK( Pak.dwDirtyPages == 0 );
+	CHECK( PakErrors( Pak.aMemPakData ) & MPERR_CHECKSUM );
+	CloseMemPak( &Pak );
+	CHECK( ReadTestFile( "damaged.mpk", aImage, PAK_MEM_SIZE ) == PAK_MEM_SIZE );
+	CHECK( PakErrors( aImage ) & MPERR_CHECKSUM );
+
+	// repairs are asked for
+	CHECK( OpenTestPak( &Pak, "damaged.mpk" ));
+	CHECK( RepairMemPakBanks( &Pak ) == 1 );
+	CHECK( Pak.dwDirtyPages == 1 && !( PakErrors( Pak.aMemPakData ) & MPERR_DAMAGED ));
+	CHECK( IsMemPakIndexValid( Pak.pModel ));
+	CloseMemPak( &Pak );
+	CHECK( ReadTestFile( "damaged.mpk", aImage, PAK_MEM_SIZE ) == PAK_MEM_SIZE );
+	CHECK( !( PakErrors( aImage ) & MPERR_DAMAGED ));
+}
+
+typedef struct _TREEREPORT
+{
+	int nFiles;
+	int nDamaged;
+	int nRepaired;
+} TREEREPORT;
+
+static void CountTreeReport( LPCTSTR pszFile, const MEMPAKFILECHECK *pCheck, void *pParam )
+{
+	TREEREPORT *pReport = (TREEREPORT*)pParam;
+	pReport->nFiles++;
+	for( int i = 0; pCheck && i < pCheck->nBanks; i++ )
+	{
+		if( pCheck->aBanks[i].dwErrors & MPERR_DAMAGED )
+			pReport->nDamaged++;
+		if( pCheck->aRepaired[i] )
+			pReport->nRepaired++;
+	}
+}
+
+PAKTEST( CheckMemPakTree )
+{
+	MEMPAK Pak;
+	CHECK( PakCreateDirectory( "a" ) && PakCreateDirectory( "a/b" ) && PakCreateDirectory( "a/pakstore" ));
+	CHECK( OpenTestPak( &Pak, "a/good.mpk" ));
+	CloseMemPak( &Pak );
+	CHECK( OpenTestPak( &Pak, "a/b/banks.mpb" ));
+	CloseMemPak( &Pak );
+	WriteDamagedPak( "a/b/damaged.n64" );
+	CHECK( WriteTestFile( "a/notes.txt", "not a pak", 9 ));
+	CHECK( WriteTestFile( "a/pakstore/0123456789abcdef.mpk", "not a pak either", 16 ));
+
+	MEMPAKFILECHECK Check;
+	CHECK( CheckMemPakFile( "a/b/damaged.n64", false, &Check ));
+	CHECK( Check.iFormat == MPF_DEXDRIVE && Check.nBanks == 1 && !Check.fShort && ( Check.aLeft[0] & MPERR_CHECKSUM ));
+	CHECK( CheckMemPakFile( "a/b/banks.mpb", false, &Check ) && Check.nBanks == PAK_MEM_BANKS_DEFAULT );
+
+	TREEREPORT Report;
+	ZeroMemory( &Report, sizeof(Report) );
+	CHECK( CheckMemPakFiles( ".", false, false, CountTreeReport, &Report ) == 0 );
+	CHECK( CheckMemPakFiles( ".", true, false, CountTreeReport, &Report ) == 3 );
+	CHECK( Report.nFiles == 3 && Report.nDamaged == 1 && Report.nRepaired == 0 );
+
+	ZeroMemory( &Report, sizeof(Report) );
+	CHECK( CheckMemPakFiles( "a", true, true, CountTreeReport, &Report ) == 3 );
+	CHECK( Report.nDamaged == 1 && Report.nRepaired == 1 );
+	CHECK( CheckMemPakFile( "a/b/damaged.n64", false, &Check ) && Check.aLeft[0] == 0 );
+}
+
+// a formatted pak holding one 3 block note in blocks 5 to 7, with everything an .a64 file carries filled in
+static void MakeNotePak( LPBYTE aMemPak )
+{
+	FormatMemPak( aMemPak );
+	LPBYTE aNote = &aMemPak[0x300];
+	CopyMemory( &aNote[0x00], "NSME", 4 );
+	CopyMemory( &aNote[0x04], "01", 2 );
+	aNote[0x07] = 5;
+	aNote[0x08] = 0x12;
+	aNote[0x09] = 0x34;
+	aNote[0x0A] = 3;
+	aNote[0x0C] = 0x1B;											// "B"
+	static const BYTE aName[] = { 0x2D, 0x1E, 0x2C, 0x2D, 0x11 };	// "TEST1"
+	CopyMemory( &aNote[0x10], aName, sizeof(aName) );
+
+	aMemPak[0x101 + 5*2] = 6;
+	aMemPak[0x101 + 6*2] = 7;
+	aMemPak[0x101 + 7*2] = 0x01;
+	int iSum = 0;
+	for( int i = 0x10A; i < 0x200; i++ )
+		iSum += aMemPak[i];
+	aMemPak[0x101] = (BYTE)iSum;
+	CopyMemory( &aMemPak[0x200], &aMemPak[0x100], 0x100 );
+
+	DWORD dwSeed = 0x600D;
+	for( int i = 5 * 0x100; i < 8 * 0x100; i++ )
+	{
+		dwSeed = dwSeed * 1103515245 + 12345;
+		aMemPak[i] = (BYTE)( dwSeed >> 16 );
+	}
+}
+
+// imports pszFile into a freshly formatted pak; true if it took and came out the same as aSource
+static bool NoteImportMatches( const char *pszFile, LPCBYTE aSource, bool *pfImported )
+{
+	static BYTE aTarget[PAK_MEM_SIZE];
+	FormatMemPak( aTarget );
+	*pfImported = InsertNoteFile( aTarget, pszFile );
+	return *pfImported && !memcmp( &aSource[0x100], &aTarget[0x100], PAK_MEM_SIZE - 0x100 );
+}
+
+// replaces the line after "a64-crc" in pszFile, keeping the rest
+static bool SetNoteFileCRC( const char *pszFile, const char *pszCRC )
+{
+	static char szText[0x4000];
+	const int nLength = ReadTestFile( pszFile, szText, sizeof(szText) - 1 );
+	if( nLength <= 0 )
+		return false;
+	szText[nLength] = '\0';
+	char *pszLine = strstr( szText, "a64-crc\r\n" );
+	if( !pszLine || strlen( pszLine ) < 9 + 8 )
+		return false;
+	CopyMemory( pszLine + 9, pszCRC, 8 );
+	return WriteTestFile( pszFile, szText, nLength );
+}
+
+// SaveNoteFileA and InsertNoteFile must carry a note over unchanged: its table entry, its blocks, and the index
+// and backup index it ends up in.  A wrong a64-crc only gets logged, the 00000000 older exports wrote is taken
+// as it is, and a file that ends early doesn't touch the pak.
+PAKTEST( NoteFileRoundTrip )
+{
+	static BYTE aSource[PAK_MEM_SIZE];
+	MakeNotePak( aSource );
+	MEMPAKCHECK Check;
+	CHECK( !( ValidateMemPak( aSource, &Check ) & MPERR_DAMAGED ) && Check.nNotes == 1 );
+
+	CHECK( SaveNoteFileA( aSource, 0, "note.a64" ));
+	bool fImported;
+	CHECK( NoteImportMatches( "note.a64", aSource, &fImported ));
+
+	static char szText[0x4000];
+	const int nLength = ReadTestFile( "note.a64", szText, sizeof(szText) - 1 );
+	CHECK( nLength > 0 );
+	szText[nLength > 0 ? nLength : 0] = '\0';
+	char szCRC[32];
+	sprintf( szCRC, "a64-crc\r\n%08X\r\n", CRC32( 0, &aSource[5 * 0x100], 3 * 0x100 ));
+	CHECK( strstr( szText, szCRC ) != NULL );
+	CHECK( strstr( szText, "\r\nNSME 01 1234 3 {b} {test1}\r\n" ) != NULL );
+
+	// a crc that doesn't match
+	CHECK( WriteTestFile( "badcrc.a64", szText, nLength ) && SetNoteFileCRC( "badcrc.a64", "DEADBEEF" ));
+	CHECK( NoteImportMatches( "badcrc.a64", aSource, &fImported ));
+
+	// the placeholder of older exports
+	CHECK( WriteTestFile( "legacy.a64", szText, nLength ) && SetNoteFileCRC( "legacy.a64", "00000000" ));
+	CHECK( NoteImportMatches( "legacy.a64", aSource, &fImported ));
+
+	// cut inside the header, inside a data line, after a whole block, and just before the crc
+	const char *pszData = strstr( szText, "a64-data\r\n" );
+	const char *pszCRCLine = strstr( szText, "a64-crc" );
+	CHECK( pszData && pszCRCLine );
+	if( !pszData || !pszCRCLine )
+		return;
+	const int aCuts[] = { (int)( pszData - szText ) + 14, (int)( pszData - szText ) + 10 + 30 + 66 * 3 + 20,
+							(int)( pszCRCLine - szText ) - 66 * 16, (int)( pszCRCLine - szText ) };
+	for( int i = 0; i < ARRAYSIZE(aCuts); i++ )
+	{
+		CHECK( WriteTestFile( "short.a64", szText, aCuts[i] ));
+		static BYTE aTarget[PAK_MEM_SIZE], aFormatted[PAK_MEM_SIZE];
+		FormatMemPak( aTarget );
+		CopyMemory( aFormatted, aTarget, PAK_MEM_SIZE );
+		CHECK( !InsertNoteFile( aTarget, "short.a64" ));
+		CHECK( !memcmp( aTarget, aFormatted, PAK_MEM_SIZE ));
+	}
+}
+
+PAKBENCH( CheckMemPakTreeSpeed )
+{
+	// nIterations paks in 16 directories, one in 8 of them damaged
+	MEMPAK Pak;
+	char szFile[MAX_PATH+1];
+	CHECK( OpenTestPak( &Pak, "template.mpk" ));
+	CloseMemPak( &Pak );
+	BYTE aImage[PAK_MEM_SIZE];
+	CHECK( ReadTestFile( "template.mpk", aImage, PAK_MEM_SIZE ) == PAK_MEM_SIZE );
+	PakCreateDirectory( "tree" );
+	for( int i = 0; i < 16; i++ )
+	{
+		snprintf( szFile, sizeof(szFile), "tree/%02d", i );
+		PakCreateDirectory( szFile );
+	}
+	for( int i = 0; i < nIterations; i++ )
+	{
+		aImage[0x101] ^= ( i % 8 ) ? 0 : 0x5A;
+		snprintf( szFile, sizeof(szFile), "tree/%02d/%05d.mpk", i % 16, i );
+		WriteTestFile( szFile, aImage, PAK_MEM_SIZE );
+		aImage[0x101] ^= ( i % 8 ) ? 0 : 0x5A;
+	}
+
+	TREEREPORT Report;
+	ZeroMemory( &Report, sizeof(Report) );
+	const ULONGLONG qwStart = PakMicroseconds();
+	CHECK( CheckMemPakFiles( "tree", true, false, CountTreeReport, &Report ) == nIterations );
+	PakBenchReport( "CheckMemPakFiles, per image", PakMicroseconds() - qwStart, nIterations );
+	CHECK( Report.nDamaged == ( nIterations + 7 ) / 8 );
+}
@@ -0,0 +1,272 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "PackedFile.h"
+#include "GBRomCache.h"
+#include "GBRomIndex.h"
+
+// WriteTestGBRom( "x", 0x1B, 16, 0x03 ), packed with gzip -9
+static const BYTE g_aRom16Gz[1441] =
+{
+	0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xED, 0xD1, 0x45, 0xB0, 0x96, 0x05,
+	0x00, 0x85, 0xE1, 0x1F, 0x2F, 0x48, 0xB7, 0x84, 0x80, 0x74, 0x4A, 0x08, 0x28, 0xAD, 0xC0, 0xA5,
+	0x3B, 0x2F, 0x88, 0x80, 0xB4, 0x20, 0xD2, 0x1D, 0xD2, 0x4A, 0x77, 0x28, 0xDD, 0xDD, 0x26, 0x29,
+	0x29, 0x4A, 0x4A, 0xA3, 0x12, 0x4A, 0x77, 0x37, 0x52, 0xC2, 0x92, 0x35, 0x33, 0xCC, 0xB7, 0xE0,
+	0x39, 0x8B, 0xB3, 0x7F, 0xE6, 0x0D, 0x45, 0x7A, 0x23, 0x2C, 0x72, 0x94, 0x37, 0xA3, 0x46, 0x8B,
+	0x1E, 0x23, 0x66, 0xAC, 0xD8, 0x71, 0xE2, 0xC6, 0x8B, 0x9F, 0x20, 0xE1, 0x5B, 0x89, 0x12, 0x27,
+	0x49, 0xFA, 0x76, 0xB2, 0xE4, 0x29, 0xDE, 0x49, 0x99, 0x2A, 0x75, 0x9A, 0xB4, 0xE9, 0xD2, 0x67,
+	0xC8, 0x98, 0x29, 0x73, 0x96, 0x77, 0xB3, 0x66, 0xCB, 0x9E, 0xE3, 0xBD, 0x9C, 0xB9, 0x72, 0xBF,
+	0xFF, 0x41, 0x9E, 0xBC, 0xF9, 0xF2, 0x17, 0x28, 0x58, 0xE8, 0xC3, 0x8F, 0x0A, 0x17, 0x29, 0x1A,
+	0x5E, 0xAC, 0x78, 0x89, 0x92, 0xA5, 0x4A, 0x97, 0x29, 0x5B, 0xAE, 0x7C, 0x85, 0x8A, 0x95, 0x2A,
+	0x57, 0xA9, 0x5A, 0xAD, 0x7A, 0x44, 0x8D, 0x9A, 0x1F, 0xD7, 0xFA, 0xA4, 0x76, 0x9D, 0xBA, 0x9F,
+	0xD6, 0xAB, 0xDF, 0xA0, 0x61, 0xA3, 0xC6, 0x4D, 0x3E, 0x6B, 0xDA, 0xEC, 0xF3, 0xE6, 0x5F, 0xB4,
+	0x68, 0xD9, 0xAA, 0x75, 0x9B, 0xB6, 0xED, 0xDA, 0x77, 0xE8, 0xD8, 0xA9, 0x73, 0x97, 0xAE, 0xDD,
+	0xBA, 0x7F, 0xD9, 0xA3, 0x67, 0xAF, 0xDE, 0x7D, 0xFA, 0xF6, 0xFB, 0xEA, 0xEB, 0xFE, 0x03, 0x06,
+	0x0E, 0x1A, 0x3C, 0x64, 0xE8, 0xB0, 0xE1, 0x23, 0x46, 0x8E, 0x1A, 0x3D, 0x66, 0xEC, 0xB8, 0x6F,
+	0xBE, 0x1D, 0x3F, 0x61, 0xE2, 0xA4, 0xC9, 0x53, 0xA6, 0x4E, 0x9B, 0x3E, 0x63, 0xE6, 0xAC, 0xD9,
+	0x73, 0xE6, 0xCE, 0x9B, 0xBF, 0x60, 0xE1, 0xA2, 0xC5, 0x4B, 0x96, 0x2E, 0x5B, 0xFE, 0xDD, 0xF7,
+	0x3F, 0xFC, 0xF8, 0xD3, 0xCF, 0x2B, 0x56, 0xAE, 0x5A, 0xBD, 0x66, 0xED, 0x2F, 0xEB, 0xD6, 0x6F,
+	0xD8, 0xB8, 0x69, 0xF3, 0xAF, 0x5B, 0x7E, 0xFB, 0x7D, 0xEB, 0xB6, 0xED, 0x3B, 0x76, 0xEE, 0xFA,
+	0x63, 0xF7, 0x9E, 0xBD, 0xFB, 0xF6, 0x1F, 0x38, 0x78, 0xE8, 0xCF, 0xBF, 0xFE, 0x3E, 0x7C, 0xE4,
+	0xE8, 0xB1, 0x7F, 0xFE, 0x3D, 0x7E, 0xE2, 0xE4, 0xA9, 0xD3, 0x67, 0xCE, 0x9E, 0x3B, 0x7F, 0xE1,
+	0xE2, 0xA5, 0xCB, 0x57, 0xAE, 0x5E, 0xBB, 0x7E, 0xE3, 0xE6, 0xAD, 0xDB, 0x77, 0xEE, 0xDE, 0xBB,
+	0xFF, 0xE0, 0xBF, 0x87, 0x8F, 0x1E, 0x3F, 0x79, 0xFA, 0x7F, 0xE8, 0x25, 0xFC, 0x55, 0xC2, 0xCB,
+	0x47, 0x94, 0xAC, 0x1E, 0x11, 0x7A, 0x61, 0xC9, 0xC3, 0xC2, 0x9E, 0xFF, 0xA2, 0x50, 0xE8, 0x75,
+	0xF0, 0xBF, 0xEE, 0xFD, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0x5F, 0x85, 0x5F, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0xFE, 0xE0, 0xFD, 0xF2, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0x07, 0xEF, 0x97, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x3F, 0x78, 0xBF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xC1, 0xFB, 0xE5, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0x0F, 0xDE, 0x2F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x7F, 0xF0, 0x7E, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0x83, 0xF7, 0xCB, 0xCF, 0xCF, 0xCF,
+	0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF,
+	0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF,
+	0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF,
+	0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0x1F, 0xBC, 0x5F, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0xFE, 0xE0, 0xFD, 0xF2,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3,
+	0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0xF3, 0x07, 0xEF,
+	0x97, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F,
+	0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x9F, 0x3F,
+	0x78, 0xBF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+	0xFC, 0xC1, 0xFB, 0xE5, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7, 0xE7,
+	0xE7, 0xE7, 0x0F, 0xDE, 0x2F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F,
+	0x3F, 0x3F, 0x3F, 0x7F, 0xF0, 0x7E, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0xF9,
+	0xF9, 0xF9, 0xF9, 0xF9, 0xF9, 0x83, 0xF7, 0x3F, 0x03, 0x88, 0xF3, 0xEA, 0x22, 0x00, 0x00, 0x04,
+	0x00,
+};
+
+// a stored readme.txt, then WriteTestGBRom( "x", 0x00, 2, 0x00 ) deflated as rom.gb
+static const BYTE g_aRom2Zip[728] =
+{
+	0x50, 0x4B, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x50, 0x41, 0x45,
+	0xB2, 0xB2, 0x0C, 0x00, 0x00, 0x00, 0x0C, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x72, 0x65,
+	0x61, 0x64, 0x6D, 0x65, 0x2E, 0x74, 0x78, 0x74, 0x6E, 0x6F, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20,
+	0x52, 0x4F, 0x4D, 0x0A, 0x50, 0x4B, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+	0x21, 0x50, 0xD1, 0xD7, 0x86, 0xB0, 0xFE, 0x01, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x06, 0x00,
+	0x00, 0x00, 0x72, 0x6F, 0x6D, 0x2E, 0x67, 0x62, 0xED, 0xD1, 0x77, 0x33, 0xD7, 0x01, 0x00, 0x80,
+	0xF1, 0xAF, 0xA2, 0xCC, 0x86, 0x24, 0x25, 0x0D, 0x23, 0xA5, 0x25, 0x23, 0x8A, 0x86, 0x8A, 0x84,
+	0xA2, 0xFC, 0x5A, 0x5A, 0x46, 0x21, 0xA3, 0x50, 0xA2, 0x29, 0xDA, 0xD1, 0x22, 0x2A, 0x22, 0x25,
+	0xA2, 0xA5, 0x22, 0x34, 0x49, 0x2A, 0xA5, 0xB2, 0x1A, 0x0A, 0x11, 0x4A, 0x85, 0x68, 0xEF, 0xF1,
+	0x02, 0xFA, 0xAF, 0xBB, 0xEE, 0xBA, 0xFB, 0x3D, 0xCF, 0x3B, 0xF8, 0xDC, 0x23, 0x48, 0xB4, 0x6A,
+	0x2D, 0x29, 0xD5, 0xA6, 0xAD, 0xB4, 0x8C, 0xAC, 0x9C, 0xBC, 0x42, 0xBB, 0xF6, 0x1D, 0x3A, 0x2A,
+	0x76, 0x52, 0xEA, 0xAC, 0xDC, 0x45, 0xA5, 0x6B, 0x37, 0xD5, 0xEE, 0x6A, 0x3D, 0x7A, 0xF6, 0xEA,
+	0xAD, 0xAE, 0xA1, 0xA9, 0xD5, 0x47, 0xBB, 0x6F, 0x3F, 0x9D, 0xFE, 0x03, 0x06, 0x0E, 0x1A, 0xAC,
+	0x3B, 0x44, 0x4F, 0xDF, 0xC0, 0x70, 0xA8, 0x91, 0xF1, 0xB0, 0xE1, 0x26, 0xA6, 0x23, 0x46, 0x8E,
+	0x1A, 0x6D, 0x36, 0x66, 0xEC, 0x38, 0x73, 0x8B, 0xF1, 0x96, 0x13, 0xAC, 0xAC, 0x6D, 0x26, 0x4E,
+	0xB2, 0xB5, 0x9B, 0x3C, 0xC5, 0x5E, 0x34, 0x75, 0xDA, 0xF4, 0x19, 0x33, 0x1D, 0x66, 0xCD, 0x9E,
+	0x33, 0x77, 0x9E, 0xA3, 0x93, 0xB3, 0xCB, 0xFC, 0x05, 0xAE, 0x6E, 0xEE, 0x0B, 0x3D, 0x3C, 0xBD,
+	0xBC, 0x17, 0x2D, 0xF6, 0xF1, 0xF5, 0x5B, 0xB2, 0xD4, 0x7F, 0x59, 0x40, 0xE0, 0xF2, 0x15, 0x2B,
+	0x57, 0xAD, 0x5E, 0x13, 0xB4, 0x36, 0x38, 0x64, 0xDD, 0xFA, 0x0D, 0x1B, 0x37, 0x6D, 0xDE, 0xB2,
+	0x35, 0x34, 0x6C, 0xDB, 0xF6, 0x1D, 0x3B, 0x77, 0x85, 0x47, 0xEC, 0x8E, 0x8C, 0xDA, 0xB3, 0x77,
+	0x5F, 0x74, 0xCC, 0xFE, 0xD8, 0xB8, 0x03, 0xF1, 0x07, 0x0F, 0x25, 0x1C, 0x4E, 0x4C, 0x3A, 0x92,
+	0x9C, 0x72, 0xF4, 0xD8, 0xF1, 0x13, 0x27, 0x53, 0x4F, 0x9D, 0x3E, 0x93, 0x96, 0x7E, 0x36, 0x23,
+	0x33, 0xEB, 0xDC, 0xF9, 0x0B, 0x17, 0x2F, 0x5D, 0xCE, 0xCE, 0xB9, 0x92, 0x7B, 0x35, 0xEF, 0xDA,
+	0xF5, 0x1B, 0xF9, 0x37, 0x6F, 0x15, 0xDC, 0xBE, 0x73, 0xB7, 0xB0, 0xA8, 0xB8, 0xA4, 0xF4, 0xDE,
+	0xFD, 0x07, 0x0F, 0xCB, 0x1E, 0x3D, 0x2E, 0xAF, 0xA8, 0x7C, 0x52, 0x55, 0xFD, 0xB4, 0xA6, 0xB6,
+	0xEE, 0xD9, 0xF3, 0xFA, 0x17, 0x2F, 0x5F, 0x35, 0x34, 0x36, 0xBD, 0x6E, 0x6E, 0x79, 0xF3, 0xF6,
+	0xDD, 0xFB, 0x0F, 0x1F, 0x3F, 0x7D, 0xFE, 0xF2, 0xF5, 0xDB, 0xF7, 0x1F, 0x3F, 0x7F, 0x09, 0x7F,
+	0xE1, 0xB7, 0x33, 0xB3, 0x16, 0x99, 0xDB, 0x8B, 0x84, 0x3F, 0x2A, 0x10, 0x04, 0x71, 0xF0, 0x8B,
+	0xFB, 0x7F, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7,
+	0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1,
+	0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC,
+	0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F,
+	0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xFF, 0x17, 0x7E, 0x31, 0xE7, 0x8B, 0xFB, 0x7E, 0xFC, 0xF8, 0xF1,
+	0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC,
+	0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F,
+	0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F,
+	0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3, 0xC7, 0x8F, 0x1F, 0x3F, 0x7E, 0xFC, 0xF8, 0xF1, 0xE3,
+	0xC7, 0xFF, 0x9F, 0xF8, 0x7F, 0x03, 0x50, 0x4B, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x21, 0x50, 0x41, 0x45, 0xB2, 0xB2, 0x0C, 0x00, 0x00, 0x00, 0x0C, 0x00,
+	0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x72, 0x65, 0x61, 0x64, 0x6D, 0x65, 0x2E, 0x74, 0x78, 0x74, 0x50, 0x4B,
+	0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x21, 0x50, 0xD1, 0xD7,
+	0x86, 0xB0, 0xFE, 0x01, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01, 0x34, 0x00, 0x00, 0x00, 0x72, 0x6F, 0x6D, 0x2E,
+	0x67, 0x62, 0x50, 0x4B, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x00, 0x6C, 0x00,
+	0x00, 0x00, 0x56, 0x02, 0x00, 0x00, 0x00, 0x00,
+};
+
+// what AcquireGBRom makes of pszPacked has to be exactly what WriteTestGBRom wrote to pszRaw
+static bool UnpacksTo( const char *pszPacked, const char *pszRaw, const DWORD dwSize )
+{
+	LPBYTE pRaw = (LPBYTE)P_malloc( dwSize );
+	const GBROMINFO *pInfo = NULL;
+	bool bReturn = pRaw && ReadTestFile( pszRaw, pRaw, dwSize ) == (int)dwSize;
+	LPCBYTE RomData = bReturn ? AcquireGBRom( pszPacked, &pInfo ) : NULL;
+	bReturn = RomData && pInfo->iStatus == GBROM_OK && !memcmp( RomData, pRaw, dwSize );
+	if( RomData )
+		ReleaseGBRom( RomData );
+	if( pRaw )
+		P_free( pRaw );
+	return bReturn;
+}
+
+// writes g_aRom16Gz with the byte at iOffset flipped, or cut off at iOffset if bTruncate
+static bool WriteDamagedGz( const char *pszFile, const DWORD dwOffset, const bool bTruncate )
+{
+	BYTE aGz[sizeof(g_aRom16Gz)];
+	CopyMemory( aGz, g_aRom16Gz, sizeof(aGz) );
+	if( !bTruncate )
+		aGz[dwOffset] ^= 0x10;
+	return WriteTestFile( pszFile, aGz, bTruncate ? dwOffset : sizeof(aGz) );
+}
+
+PAKTEST( PackedRomsUnpack )
+{
+	CHECK( WriteTestGBRom( "rom16.gb", 0x1B, 16, 0x03 ));
+	CHECK( WriteTestFile( "rom16.gb.gz", g_aRom16Gz, sizeof(g_aRom16Gz) ));
+	CHECK( UnpacksTo( "rom16.gb.gz", "rom16.gb", 16 * 0x4000 ));
+
+	// the archive's first member isn't a ROM, the .gb after it is
+	CHECK( WriteTestGBRom( "rom2.gb", 0x00, 2, 0x00 ));
+	CHECK( WriteTestFile( "rom2.zip", g_aRom2Zip, sizeof(g_aRom2Zip) ));
+	CHECK( UnpacksTo( "rom2.zip", "rom2.gb", 2 * 0x4000 ));
+
+	// damage anywhere is caught by the CRC or the size, and never gets into the cache
+	const GBROMINFO *pInfo;
+	CHECK( WriteDamagedGz( "crc.gb.gz", sizeof(g_aRom16Gz) - 8, false ));
+	CHECK( AcquireGBRom( "crc.gb.gz", &pInfo ) == NULL );
+	CHECK( WriteDamagedGz( "data.gb.gz", sizeof(g_aRom16Gz) / 2, false ));
+	CHECK( AcquireGBRom( "data.gb.gz", &pInfo ) == NULL );
+	CHECK( WriteDamagedGz( "short.gb.gz", sizeof(g_aRom16Gz) - 100, true ));
+	CHECK( AcquireGBRom( "short.gb.gz", &pInfo ) == NULL );
+
+	// and a Transfer Pak can load one, header from the index and all
+	static GBCART Cart;
+	ZeroMemory( &Cart, sizeof(Cart) );
+	InitGBRomIndex( "index.bin" );
+	CHECK( LoadCart( &Cart, "rom16.gb.gz", "rom16.sav", _T("") ));
+	CHECK( Cart.iNumRomBanks == 16 && Cart.iCartType == GB_MBC5 );
+	UnloadCart( &Cart );
+	FreeGBRomIndex();
+}
+
+// Loading a 256 KB ROM: mapping it, unpacking it from gzip, and taking it from the cache when it was unpacked before.
+PAKBENCH( PackedRomLoad )
+{
+	const GBROMINFO *pInfo;
+	CHECK( WriteTestGBRom( "mapped.gb", 0x19, 16, 0x00 ));	// not the same ROM, which the cache would share
+	CHECK( WriteTestFile( "rom16.gb.gz", g_aRom16Gz, sizeof(g_aRom16Gz) ));
+
+	ULONGLONG qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+	{
+		LPCBYTE RomData = AcquireGBRom( "mapped.gb", &pInfo );
+		CHECK( RomData != NULL );
+		ReleaseGBRom( RomData );
+	}
+	PakBenchReport( "mapped .gb", PakMicroseconds() - qwStart, nIterations );
+
+	LPBYTE pOut = (LPBYTE)P_malloc( 16 * 0x4000 );
+	qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+	{
+		PACKEDFILE Packed;
+		LPPAKFILE pFile = PakOpenFile( "rom16.gb.gz", PAK_FILE_READ );
+		CHECK( pFile && GetPackedFile( pFile, &Packed ) && Packed.iFormat == PACKED_GZIP );
+		CHECK( UnpackFile( pFile, &Packed, pOut, Packed.dwSize ) == Packed.dwSize && CRC32( 0, pOut, Packed.dwSize ) == Packed.dwCRC );
+		PakCloseFile( pFile );
+	}
+	PakBenchReport( "unpacked .gz", PakMicroseconds() - qwStart, nIterations );
+	P_free( pOut );
+
+	LPCBYTE RomData = AcquireGBRom( "rom16.gb.gz", &pInfo );	// unpacked once, cached from then on
+	CHECK( RomData != NULL );
+	ReleaseGBRom( RomData );
+	qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+	{
+		RomData = AcquireGBRom( "rom16.gb.gz", &pInfo );
+		CHECK( RomData != NULL );
+		ReleaseGBRom( RomData );
+	}
+	PakBenchReport( "cached .gz", PakMicroseconds() - qwStart, nIterations );
+}
@@ -0,0 +1,76 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PAKTEST_H_
+#define _PAKTEST_H_
+
+// A small test runner for the pak core, built by CMakeLists.txt without Windows.
+//
+// PAKTEST( Name ) { ... } defines a test; tests register themselves and run in the order their files were
+// linked, each in an empty directory of its own (the current directory while it runs).  CHECK records a
+// failure and carries on.  PakTestMain.cpp provides main() and the LockPakSlot/UnlockPakSlot the core
+// expects from the plugin, handing out PakTestSlots.
+//
+// PAKBENCH( Name ) { ... } defines a benchmark, run by "paktest --bench [-n iterations] [names]" the same
+// way; the body gets nIterations and reports its timings with PakBenchReport.  ctest runs them with a few
+// iterations only, to keep them working.
+
+#include "commonIncludes.h"
+#include "PakIO.h"
+
+typedef void (*PAKTESTPROC)();
+typedef void (*PAKBENCHPROC)( const int nIterations );
+
+struct PAKTESTCASE
+{
+	const char *pszName;
+	PAKTESTPROC pfnTest;
+	PAKBENCHPROC pfnBench;
+	PAKTESTCASE *pNext;
+	PAKTESTCASE( const char *pszTestName, PAKTESTPROC pfnTestProc );
+	PAKTESTCASE( const char *pszBenchName, PAKBENCHPROC pfnBenchProc );
+};
+
+void PakTestFailed( const char *pszFile, const int iLine, const char *pszExpression );
+
+#define PAKTEST( name )		static void name(); static PAKTESTCASE g_PakTest_##name( #name, name ); static void name()
+#define PAKBENCH( name )	static void name( const int nIterations ); static PAKTESTCASE g_PakBench_##name( #name, name ); static void name( const int nIterations )
+#define CHECK( expr )		do { if( !( expr )) PakTestFailed( __FILE__, __LINE__, #expr ); } while( 0 )
+
+// prints qwMicros spent on nIterations runs of pszWhat, per run
+void PakBenchReport( const char *pszWhat, const ULONGLONG qwMicros, const int nIterations );
+
+// pak data LockPakSlot hands out, NULL for an empty slot; cleared before every test
+extern void *PakTestSlots[4];
+// the dwChanges UnlockPakSlot was called with, or'd together; cleared before every test
+extern DWORD PakTestSlotChanges[4];
+
+// writes dwSize bytes to pszFile, replacing it
+bool WriteTestFile( const char *pszFile, const void *pData, const DWORD dwSize );
+// reads up to dwSize bytes of pszFile; returns how many, or -1 if it can't be opened
+int ReadTestFile( const char *pszFile, void *pData, const DWORD dwSize );
+// writes a GB ROM of nRomBanks (2 to 128, a power of 2) 16 KB banks whose header has bCartType (0x147) and
+// bRamSize (0x149); every other byte is its bank number plus its offset, so what a read returns shows where it came from
+bool WriteTestGBRom( const char *pszFile, const BYTE bCartType, const int nRomBanks, const BYTE bRamSize );
+
+#endif // #ifndef _PAKTEST_H_
@@ -0,0 +1,208 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "PakSnapshot.h"
+#include "PakStore.h"
+#include "GBRomCache.h"
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+static PAKTESTCASE *g_pFirstTest = NULL, **g_ppLastTest = &g_pFirstTest;
+static int g_nFailures = 0;
+
+void *PakTestSlots[4];
+DWORD PakTestSlotChanges[4];
+
+PAKTESTCASE::PAKTESTCASE( const char *pszTestName, PAKTESTPROC pfnTestProc )
+{
+	pszName = pszTestName;
+	pfnTest = pfnTestProc;
+	pfnBench = NULL;
+	pNext = NULL;
+	*g_ppLastTest = this;
+	g_ppLastTest = &pNext;
+}
+
+PAKTESTCASE::PAKTESTCASE( const char *pszBenchName, PAKBENCHPROC pfnBenchProc )
+{
+	pszName = pszBenchName;
+	pfnTest = NULL;
+	pfnBench = pfnBenchProc;
+	pNext = NULL;
+	*g_ppLastTest = this;
+	g_ppLastTest = &pNext;
+}
+
+void PakBenchReport( const char *pszWhat, const ULONGLONG qwMicros, const int nIterations )
+{
+	printf( "    %-36s %10.2f us  (%d runs)\n", pszWhat, nIterations ? (double)qwMicros / nIterations : 0.0, nIterations );
+}
+
+void PakTestFailed( const char *pszFile, const int iLine, const char *pszExpression )
+{
+	fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", pszFile, iLine, pszExpression );
+	g_nFailures++;
+}
+
+void *LockPakSlot( const int iSlot )
+{
+	return PakTestSlots[iSlot];
+}
+
+void UnlockPakSlot( const int iSlot, const DWORD dwChanges )
+{
+	PakTestSlotChanges[iSlot] |= dwChanges;
+}
+
+bool WriteTestFile( const char *pszFile, const void *pData, const DWORD dwSize )
+{
+	LPPAKFILE pFile = PakOpenFile( pszFile, PAK_FILE_CREATE );
+	if( pFile == NULL )
+		return false;
+	bool bReturn = PakWriteFile( pFile, pData, dwSize );
+	PakCloseFile( pFile );
+	return bReturn;
+}
+
+int ReadTestFile( const char *pszFile, void *pData, const DWORD dwSize )
+{
+	LPPAKFILE pFile = PakOpenFile( pszFile, PAK_FILE_READ );
+	if( pFile == NULL )
+		return -1;
+	int nRead = (int)PakReadFile( pFile, pData, dwSize );
+	PakCloseFile( pFile );
+	return nRead;
+}
+
+bool WriteTestGBRom( const char *pszFile, const BYTE bCartType, const int nRomBanks, const BYTE bRamSize )
+{
+	const DWORD dwSize = nRomBanks * 0x4000;
+	LPBYTE pRom = (LPBYTE)P_malloc( dwSize );
+	if( pRom == NULL )
+		return false;
+	for( DWORD i = 0; i < dwSize; i++ )
+		pRom[i] = (BYTE)(( i >> 14 ) + i );
+
+	ZeroMemory( &pRom[0x134], 0x150 - 0x134 );
+	strcpy( (char*)&pRom[0x134], "PAKTEST" );
+	pRom[0x147] = bCartType;
+	for( int n = 2; n < nRomBanks; n <<= 1 )
+		pRom[0x148]++;
+	pRom[0x149] = bRamSize;
+	for( int i = 0x134; i <= 0x14C; i++ )
+		pRom[0x14D] = pRom[0x14D] - pRom[i] - 1;
+
+	bool bReturn = WriteTestFile( pszFile, pRom, dwSize );
+	P_free( pRom );
+	return bReturn;
+}
+
+static int RemoveTestFile( const char *pszPath, const struct stat *pStat, int iFlag, struct FTW *pFTW )
+{
+	return remove( pszPath );
+}
+
+// Runs every test, or only those named on the command line.  With --bench, the benchmarks instead.
+int main( int argc, char *argv[] )
+{
+	bool bBench = false;
+	int nIterations = 1000;
+	int iFirstName = 1;
+	for( ; iFirstName < argc && argv[iFirstName][0] == '-'; iFirstName++ )
+	{
+		if( !strcmp( argv[iFirstName], "--bench" ))
+			bBench = true;
+		else if( !strcmp( argv[iFirstName], "-n" ) && iFirstName + 1 < argc )
+		{
+			nIterations = atoi( argv[++iFirstName] );
+			if( nIterations < 1 )
+				nIterations = 1;
+		}
+		else
+		{
+			fprintf( stderr, "usage: %s [--bench [-n iterations]] [name...]\n", argv[0] );
+			return 2;
+		}
+	}
+
+	char szRoot[MAX_PATH+1], szDirectory[MAX_PATH+1];
+	const char *pszTemp = getenv( "TMPDIR" );
+	snprintf( szRoot, sizeof(szRoot), "%s/paktest.XXXXXX", pszTemp ? pszTemp : "/tmp" );
+	if( !mkdtemp( szRoot ))
+	{
+		perror( "mkdtemp" );
+		return 2;
+	}
+
+	InitPakCRCTables();
+	InitPakSnapshots();
+	InitPakStore();
+	InitGBRomCache();
+
+	int nRun = 0, nFailed = 0;
+	for( PAKTESTCASE *pTest = g_pFirstTest; pTest != NULL; pTest = pTest->pNext )
+	{
+		if(( bBench ? (void*)pTest->pfnBench : (void*)pTest->pfnTest ) == NULL )
+			continue;
+		bool bWanted = ( iFirstName >= argc );
+		for( int i = iFirstName; i < argc && !bWanted; i++ )
+			bWanted = !strcmp( argv[i], pTest->pszName );
+		if( !bWanted )
+			continue;
+
+		snprintf( szDirectory, sizeof(szDirectory), "%s/%s", szRoot, pTest->pszName );
+		if( mkdir( szDirectory, 0755 ) != 0 || chdir( szDirectory ) != 0 )
+		{
+			perror( szDirectory );
+			return 2;
+		}
+		ZeroMemory( PakTestSlots, sizeof(PakTestSlots) );
+		ZeroMemory( PakTestSlotChanges, sizeof(PakTestSlotChanges) );
+
+		const int nBefore = g_nFailures;
+		if( bBench )
+		{
+			printf( "%s\n", pTest->pszName );
+			pTest->pfnBench( nIterations );
+		}
+		else
+			pTest->pfnTest();
+		nRun++;
+		if( g_nFailures != nBefore )
+			nFailed++;
+		printf( "%-40s %s\n", pTest->pszName, ( g_nFailures != nBefore ) ? "FAILED" : "ok" );
+	}
+
+	printf( "%d of %d %s passed\n", nRun - nFailed, nRun, bBench ? "benchmarks" : "tests" );
+	if( nFailed )
+		printf( "files are left in %s\n", szRoot );
+	else if( chdir( "/" ) == 0 )
+		nftw( szRoot, RemoveTestFile, 16, FTW_DEPTH | FTW_PHYS );
+	FreeGBRomCache();
+	FreePakSnapshots();
+	FreePakStore();
+	return nFailed ? 1 : 0;
+}
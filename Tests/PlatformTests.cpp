@@ -0,0 +1,142 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+
+PAKTEST( FileReadWrite )
+{
+	BYTE aData[300], aRead[300];
+	for( int i = 0; i < sizeof(aData); i++ )
+		aData[i] = (BYTE)i;
+	CHECK( WriteTestFile( "a.bin", aData, sizeof(aData) ));
+	CHECK( PakFileExists( "a.bin" ));
+
+	LPPAKFILE pFile = PakOpenFile( "a.bin", PAK_FILE_EXISTING );
+	CHECK( pFile != NULL );
+	CHECK( PakGetFileSize( pFile ) == sizeof(aData) );
+	CHECK( PakSeekFile( pFile, 100 ));
+	CHECK( PakReadFile( pFile, aRead, sizeof(aRead) ) == 200 );
+	CHECK( !memcmp( aRead, &aData[100], 200 ));
+	CHECK( PakSetFileSize( pFile, 50 ));
+	CHECK( PakGetFileSize( pFile ) == 50 );
+	PakCloseFile( pFile );
+
+	CHECK( PakOpenFile( "missing.bin", PAK_FILE_READ ) == NULL );
+	CHECK( PakOpenFile( "missing.bin", PAK_FILE_EXISTING ) == NULL );
+	CHECK( !PakFileExists( "missing.bin" ));
+}
+
+PAKTEST( RenameFile )
+{
+	char aRead[4];
+	CHECK( WriteTestFile( "from", "one", 4 ));
+	CHECK( WriteTestFile( "to", "two", 4 ));
+	CHECK( !PakRenameFile( "from", "to", false ));
+	CHECK( ReadTestFile( "to", aRead, 4 ) == 4 && !strcmp( aRead, "two" ));
+	CHECK( PakRenameFile( "from", "to", true ));
+	CHECK( ReadTestFile( "to", aRead, 4 ) == 4 && !strcmp( aRead, "one" ));
+	CHECK( !PakFileExists( "from" ));
+	CHECK( PakDeleteFile( "to" ));
+	CHECK( !PakFileExists( "to" ));
+}
+
+static bool CountFile( const TCHAR *pszName, void *pParam )
+{
+	(*(int*)pParam)++;
+	return true;
+}
+
+PAKTEST( FindFiles )
+{
+	CHECK( WriteTestFile( "a.mpk", "", 0 ));
+	CHECK( WriteTestFile( "b.MPK", "", 0 ));
+	CHECK( WriteTestFile( "c.n64", "", 0 ));
+	CHECK( PakCreateDirectory( "d.mpk" ));
+	CHECK( PakCreateDirectory( "d.mpk" ));		// already there is fine
+
+	int nFound = 0;
+	PakFindFiles( ".", _T(".mpk"), CountFile, &nFound );
+	CHECK( nFound == 2 );
+	nFound = 0;
+	PakFindFiles( ".", NULL, CountFile, &nFound );
+	CHECK( nFound == 3 );
+
+	PAKFILEINFO Info;
+	CHECK( PakGetPathInfo( "d.mpk", &Info ) && Info.fDirectory );
+	CHECK( PakGetPathInfo( "a.mpk", &Info ) && !Info.fDirectory && Info.qwSize == 0 );
+
+	TCHAR szFull[MAX_PATH+1];
+	TCHAR *pszName = PakFullPathName( "a.mpk", szFull );
+	CHECK( pszName != NULL && szFull[0] == PAK_PATH_SEPARATOR && !strcmp( pszName, "a.mpk" ));
+}
+
+PAKTEST( MapFile )
+{
+	LPPAKFILE pFile = PakOpenFile( "map.bin", PAK_FILE_WRITE );
+	CHECK( pFile != NULL );
+	LPPAKMAPPING pMapping = NULL;
+	LPBYTE pView = PakMapFile( pFile, 0x3000, false, &pMapping );
+	CHECK( pView != NULL && pMapping != NULL );
+	CHECK( PakGetFileSize( pFile ) == 0x3000 );		// grown to fit
+	PakCloseFile( pFile );
+
+	pView[0x2FFF] = 0x5A;
+	PakFlushFile( &pView[0x2FF0], 0x10 );
+	PakUnmapFile( pView, pMapping );
+
+	BYTE aRead[0x3000];
+	CHECK( ReadTestFile( "map.bin", aRead, sizeof(aRead) ) == 0x3000 && aRead[0x2FFF] == 0x5A );
+}
+
+typedef struct _WORKJOB
+{
+	LONG iNext;
+	LONG nDone;
+	LONG aDone[100];
+} WORKJOB;
+
+static void TestWorker( void *pParam )
+{
+	WORKJOB *pJob = (WORKJOB*)pParam;
+	LONG i;
+	while(( i = PakAtomicIncrement( &pJob->iNext ) - 1 ) < 100 )
+	{
+		PakAtomicIncrement( &pJob->aDone[i] );
+		PakAtomicAdd( &pJob->nDone, 1 );
+	}
+}
+
+PAKTEST( RunWorkers )
+{
+	static WORKJOB Job;
+	ZeroMemory( &Job, sizeof(Job) );
+	CHECK( PakRunWorkers( 100, TestWorker, &Job ) >= 1 );
+	CHECK( Job.nDone == 100 );
+	for( int i = 0; i < 100; i++ )
+		CHECK( Job.aDone[i] == 1 );
+
+	LONG lValue = 5;
+	CHECK( PakAtomicCompareExchange( &lValue, 7, 4 ) == 5 && lValue == 5 );
+	CHECK( PakAtomicCompareExchange( &lValue, 7, 5 ) == 5 && lValue == 7 );
+}
@@ -0,0 +1,131 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "PakSnapshot.h"
+
+static bool OpenSlotPak( const int iSlot, LPMEMPAK mPak, const char *pszFile )
+{
+	TCHAR szFull[MAX_PATH+1];
+	ZeroMemory( mPak, sizeof(MEMPAK) );
+	if( !PakFullPathName( pszFile, szFull ) || !OpenMemPak( mPak, szFull, pszFile ))
+		return false;
+	PakTestSlots[iSlot] = mPak;
+	return true;
+}
+
+static void CloseSlotPak( const int iSlot, LPMEMPAK mPak )
+{
+	PakTestSlots[iSlot] = NULL;
+	ResetPakSnapshotPages( iSlot );
+	CloseMemPak( mPak );
+}
+
+static void WriteBlock( LPMEMPAK mPak, const WORD wAddress, const BYTE bFill )
+{
+	BYTE aData[33];
+	FillMemory( aData, 32, bFill );
+	WriteMemPak( mPak, wAddress, aData );
+}
+
+PAKTEST( RestoreSwapsBank )
+{
+	MEMPAK Pak;
+	CHECK( OpenSlotPak( 0, &Pak, "banks.mpb" ));
+	CHECK( Pak.nBanks == PAK_MEM_BANKS_DEFAULT );
+
+	LPPAKSNAPSHOT pSnapshot = TakePakSnapshot();
+	CHECK( pSnapshot != NULL );
+	CHECK( SelectMemPakBank( &Pak, 2 ));
+	WriteBlock( &Pak, 0x1000, 0x5A );
+
+	// same bank: the memory comes back, the pak stays in
+	PakTestSlotChanges[0] = 0;
+	LPPAKSNAPSHOT pOnBank2 = TakePakSnapshot();
+	WriteBlock( &Pak, 0x1000, 0x33 );
+	CHECK( RestorePakSnapshot( pOnBank2 ));
+	CHECK( PakTestSlotChanges[0] == PAKSLOT_MEMORY );
+	CHECK( Pak.aMemPakData[0x1000] == 0x5A );
+
+	// another bank: the game has to see the pak pulled
+	PakTestSlotChanges[0] = 0;
+	CHECK( RestorePakSnapshot( pSnapshot ));
+	CHECK( PakTestSlotChanges[0] & PAKSLOT_SWAPPED );
+	CHECK( Pak.iBank == 0 && Pak.aMemPakData == Pak.aMemPakBanks && Pak.pModel == &Pak.aModels[0] );
+
+	PAKSNAPSTATS Stats;
+	GetPakSnapshotStats( &Stats );
+	CHECK( Stats.dwSnapshots >= 2 && Stats.dwRestores >= 2 );
+
+	FreePakSnapshot( pOnBank2 );
+	FreePakSnapshot( pSnapshot );
+	CloseSlotPak( 0, &Pak );
+}
+
+// What a rewind buffer costs per frame with a mempak in every controller: each frame the game writes a few
+// blocks to every pak and the emulator takes a snapshot, dropping the one from 60 frames ago.
+PAKBENCH( SnapshotPerFrame )
+{
+	static MEMPAK aPaks[4];
+	const char *apszFiles[4] = { "p1.mpb", "p2.mpb", "p3.mpk", "p4.mpk" };
+	for( int i = 0; i < 4; i++ )
+		CHECK( OpenSlotPak( i, &aPaks[i], apszFiles[i] ));
+
+	LPPAKSNAPSHOT apRing[60];
+	ZeroMemory( apRing, sizeof(apRing) );
+	ULONGLONG qwSnapMicros = 0, qwRestoreMicros = 0;
+
+	for( int iFrame = 0; iFrame < nIterations; iFrame++ )
+	{
+		for( int i = 0; i < 4; i++ )
+			for( int b = 0; b < 4; b++ )
+				WriteBlock( &aPaks[i], (WORD)(( 0x0100 + ( iFrame * 4 + b ) * 0x20 ) & 0x7FE0 ), (BYTE)iFrame );
+
+		const ULONGLONG qwStart = PakMicroseconds();
+		LPPAKSNAPSHOT pSnapshot = TakePakSnapshot();
+		qwSnapMicros += PakMicroseconds() - qwStart;
+		CHECK( pSnapshot != NULL );
+
+		LPPAKSNAPSHOT *ppSlot = &apRing[iFrame % ARRAYSIZE(apRing)];
+		FreePakSnapshot( *ppSlot );
+		*ppSlot = pSnapshot;
+	}
+
+	// rewinding a whole second
+	const int nRestores = min( nIterations, (int)ARRAYSIZE(apRing) );
+	for( int r = 0; r < nRestores; r++ )
+	{
+		const ULONGLONG qwStart = PakMicroseconds();
+		RestorePakSnapshot( apRing[( nIterations - 1 - r ) % ARRAYSIZE(apRing)] );
+		qwRestoreMicros += PakMicroseconds() - qwStart;
+	}
+
+	PakBenchReport( "TakePakSnapshot, 4 paks", qwSnapMicros, nIterations );
+	PakBenchReport( "RestorePakSnapshot, 4 paks", qwRestoreMicros, nRestores );
+
+	for( int r = 0; r < (int)ARRAYSIZE(apRing); r++ )
+		FreePakSnapshot( apRing[r] );
+	for( int i = 0; i < 4; i++ )
+		CloseSlotPak( i, &aPaks[i] );
+}
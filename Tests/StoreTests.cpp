@@ -0,0 +1,147 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "PakStore.h"
+#include <unistd.h>
+
+// the name StorePagePath gives a page of this content (64 bit FNV-1a)
+static void PageFile( LPCBYTE Data, char *pszPath )
+{
+	ULONGLONG qwHash = 0xCBF29CE484222325ULL;
+	for( int i = 0; i < PAK_STORE_PAGE_SIZE; i++ )
+	{
+		qwHash ^= Data[i];
+		qwHash *= 0x100000001B3ULL;
+	}
+	sprintf( pszPath, "pakstore/%08X%08X.pg", (DWORD)( qwHash >> 32 ), (DWORD)qwHash );
+}
+
+static bool CountPage( const TCHAR *pszName, void *pParam )
+{
+	(*(int*)pParam)++;
+	return true;
+}
+
+static int CountPages()
+{
+	int nPages = 0;
+	PakFindFiles( "pakstore/", ".pg", CountPage, &nPages );
+	return nPages;
+}
+
+PAKTEST( StoreReplacesDamagedPage )
+{
+	static BYTE aPak[PAK_MEM_SIZE], aLoaded[PAK_MEM_SIZE];
+	LPPAKSTORE pStore = OpenPakStore( "a.mpm", aPak, true );
+	CHECK( pStore != NULL );
+
+	// a page file under the name the new content hashes to, but holding something else
+	FillMemory( &aPak[0x1000], PAK_STORE_PAGE_SIZE, 0x42 );
+	char szPage[MAX_PATH];
+	PageFile( &aPak[0x1000], szPage );
+	CHECK( WriteTestFile( szPage, "not this page", 13 ));
+
+	DWORD dwFailed = 0xFFFFFFFF;
+	CHECK( WritePakStore( pStore, aPak, 0x02, &dwFailed ) > 0 );
+	CHECK( dwFailed == 0 );
+	ClosePakStore( pStore );
+
+	BYTE aStored[PAK_STORE_PAGE_SIZE];
+	CHECK( ReadTestFile( szPage, aStored, sizeof(aStored) ) == PAK_STORE_PAGE_SIZE );
+	CHECK( !memcmp( aStored, &aPak[0x1000], PAK_STORE_PAGE_SIZE ));
+
+	pStore = OpenPakStore( "a.mpm", aLoaded, false );
+	CHECK( pStore != NULL && !memcmp( aLoaded, aPak, PAK_MEM_SIZE ));
+	ClosePakStore( pStore );
+}
+
+PAKTEST( StoreKeepsFailedPages )
+{
+	static BYTE aPak[PAK_MEM_SIZE], aLoaded[PAK_MEM_SIZE];
+	LPPAKSTORE pStore = OpenPakStore( "b.mpm", aPak, true );
+	CHECK( pStore != NULL );
+
+	// a directory where the page file has to go, so it can't be written
+	FillMemory( &aPak[0x2000], PAK_STORE_PAGE_SIZE, 0x17 );
+	FillMemory( &aPak[0x3000], PAK_STORE_PAGE_SIZE, 0x18 );
+	char szPage[MAX_PATH];
+	PageFile( &aPak[0x2000], szPage );
+	CHECK( PakCreateDirectory( szPage ));
+
+	DWORD dwFailed = 0;
+	WritePakStore( pStore, aPak, 0x0C, &dwFailed );
+	CHECK( dwFailed == 0x04 );
+
+	// the page that did go in is listed, the other one still has its old content
+	ClosePakStore( pStore );
+	pStore = OpenPakStore( "b.mpm", aLoaded, false );
+	CHECK( pStore != NULL );
+	CHECK( aLoaded[0x3000] == 0x18 && aLoaded[0x2000] != 0x17 );
+
+	// once it can be written, the retry stores it
+	CHECK( rmdir( szPage ) == 0 );
+	WritePakStore( pStore, aPak, dwFailed, &dwFailed );
+	CHECK( dwFailed == 0 );
+	ClosePakStore( pStore );
+	pStore = OpenPakStore( "b.mpm", aLoaded, false );
+	CHECK( pStore != NULL && !memcmp( aLoaded, aPak, PAK_MEM_SIZE ));
+	ClosePakStore( pStore );
+}
+
+PAKTEST( CollectStore )
+{
+	static BYTE aPak[PAK_MEM_SIZE], aLoaded[PAK_MEM_SIZE];
+	LPPAKSTORE pFirst = OpenPakStore( "one.mpm", aPak, true );
+	LPPAKSTORE pSecond = OpenPakStore( "two.mpm", aPak, true );
+	CHECK( pFirst != NULL && pSecond != NULL );
+	const int nShared = CountPages();
+
+	FillMemory( &aPak[0x4000], PAK_STORE_PAGE_SIZE, 0x61 );
+	WritePakStore( pSecond, aPak, 0x10, NULL );
+	FillMemory( &aPak[0x4000], PAK_STORE_PAGE_SIZE, 0x62 );
+	WritePakStore( pSecond, aPak, 0x10, NULL );
+	CHECK( CountPages() == nShared + 2 );
+	ClosePakStore( pSecond );
+
+	// the 0x61 page isn't listed anywhere any more
+	CHECK( CollectPakStore( "./" ) == 1 );
+	CHECK( CountPages() == nShared + 1 );
+
+	pSecond = OpenPakStore( "two.mpm", aLoaded, false );
+	CHECK( pSecond != NULL && !memcmp( aLoaded, aPak, PAK_MEM_SIZE ));
+	ClosePakStore( pSecond );
+
+	// without its manifest, the changed page of two.mpm goes too
+	CHECK( PakDeleteFile( "two.mpm" ));
+	CHECK( CollectPakStore( "./" ) == 1 );
+	CHECK( CountPages() == nShared );
+
+	// nothing is collected while a manifest can't be read
+	CHECK( WriteTestFile( "broken.mpm", "NRPM", 4 ));
+	CHECK( PakDeleteFile( "one.mpm" ));
+	CHECK( CollectPakStore( "./" ) == -1 );
+	CHECK( CountPages() == nShared );
+	ClosePakStore( pFirst );
+}
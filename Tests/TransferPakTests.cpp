@@ -0,0 +1,272 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "PakTest.h"
+#include "PakPlatform.h"
+#include "GBRomIndex.h"
+
+// The Transfer Pak as ReadTransferPak and WriteTransferPak had it before they went through handler tables:
+// a switch on dwAddress >> 12 that tests iEnableState and works out the GB address on every access, over
+// the cart's MBC handlers.  The reference the tables are checked against.
+typedef struct _OLDTPAK
+{
+	int iCurrentBankNo;
+	int iCurrentAccessMode;
+	int iAccessModeChanged;
+	bool iEnableState;
+	bool bPakInserted;
+	GBCART gbCart;
+} OLDTPAK;
+
+static void OldTPakRead( OLDTPAK *tPak, const WORD dwAddress, LPBYTE Data )
+{
+	switch( dwAddress >> 12 )
+	{
+	case 0x8:
+		if( tPak->iEnableState == false )
+			ZeroMemory( Data, 32 );
+		else
+			FillMemory( Data, 32, 0x84 );
+		break;
+	case 0xB:
+		if( tPak->iEnableState == true )
+		{
+			if( tPak->bPakInserted )
+			{
+				FillMemory( Data, 32, ( tPak->iCurrentAccessMode == 1 ) ? 0x89 : 0x80 );
+				Data[0] = Data[0] | (BYTE)tPak->iAccessModeChanged;
+			}
+			else
+				FillMemory( Data, 32, 0x40 );
+			tPak->iAccessModeChanged = 0;
+		}
+		break;
+	case 0xC:
+	case 0xD:
+	case 0xE:
+	case 0xF:
+		if( tPak->iEnableState == true )
+			tPak->gbCart.ptrfnReadCart( &tPak->gbCart, (( dwAddress & 0xFFE0 ) - 0xC000 ) + (( tPak->iCurrentBankNo & 3 ) * 0x4000 ), Data );
+		break;
+	}
+	Data[32] = DataCRC( Data, 32 );
+}
+
+static void OldTPakWrite( OLDTPAK *tPak, const WORD dwAddress, LPBYTE Data )
+{
+	switch( dwAddress >> 12 )
+	{
+	case 0x8:
+		if( Data[0] == 0xFE )
+			tPak->iEnableState = false;
+		else if( Data[0] == 0x84 )
+			tPak->iEnableState = true;
+		break;
+	case 0xA:
+		if( tPak->iEnableState == true )
+			tPak->iCurrentBankNo = Data[0];
+		break;
+	case 0xB:
+		if( tPak->iEnableState == true )
+		{
+			tPak->iCurrentAccessMode = Data[0] & 1;
+			tPak->iAccessModeChanged = 4;
+		}
+		break;
+	case 0xC:
+	case 0xD:
+	case 0xE:
+	case 0xF:
+		tPak->gbCart.ptrfnWriteCart( &tPak->gbCart, (( dwAddress & 0xFFE0 ) - 0xC000 ) + (( tPak->iCurrentBankNo & 3 ) * 0x4000 ), Data );
+		break;
+	}
+	Data[32] = DataCRC( Data, 32 );
+}
+
+static bool OpenOldTPak( OLDTPAK *tPak, const char *pszRomFile, const char *pszSaveFile )
+{
+	ZeroMemory( tPak, sizeof(OLDTPAK) );
+	tPak->iAccessModeChanged = 0x44;
+	tPak->bPakInserted = LoadCart( &tPak->gbCart, pszRomFile, pszSaveFile, _T("") );
+	return tPak->bPakInserted;
+}
+
+static DWORD NextRandom( DWORD *pdwSeed )
+{
+	*pdwSeed = *pdwSeed * 1103515245 + 12345;
+	return *pdwSeed >> 8;
+}
+
+// one random access: mostly cart reads and writes, with enable, bank and mode changes and the odd unused address
+static void RandomTPakAccess( DWORD *pdwSeed, bool *pfWrite, WORD *pwAddress, LPBYTE Data )
+{
+	static const BYTE aValues[] = { 0x0A, 0x00, 0x01, 0x02, 0x03, 0x05, 0x13, 0x84, 0xFE };
+	const DWORD dwRandom = NextRandom( pdwSeed );
+	const DWORD dwOffset = NextRandom( pdwSeed ) & 0x3FE0;
+	FillMemory( Data, 32, ( dwRandom & 0x100 ) ? aValues[( dwRandom >> 9 ) % ARRAYSIZE(aValues)] : (BYTE)( dwRandom >> 12 ));
+	Data[32] = 0;
+
+	switch( dwRandom & 0xF )
+	{
+	case 0:		*pfWrite = true;	*pwAddress = 0x8000; Data[0] = ( dwRandom & 0x30 ) ? 0x84 : 0xFE; break;
+	case 1:		*pfWrite = true;	*pwAddress = 0xA000; Data[0] = (BYTE)( dwRandom >> 4 ) & 7; break;
+	case 2:		*pfWrite = true;	*pwAddress = 0xB000; Data[0] = (BYTE)( dwRandom >> 4 ) % 3; break;
+	case 3:		*pfWrite = false;	*pwAddress = 0x8000; break;
+	case 4:		*pfWrite = false;	*pwAddress = 0xB000; break;
+	case 5:		*pfWrite = ( dwRandom & 0x10 ) != 0;	*pwAddress = (WORD)( dwOffset & 0x7FE0 ); break;	// nothing there
+	case 6:
+	case 7:
+	case 8:		*pfWrite = true;	*pwAddress = (WORD)( 0xC000 + dwOffset ); break;
+	default:	*pfWrite = false;	*pwAddress = (WORD)( 0xC000 + dwOffset ); break;
+	}
+}
+
+PAKTEST( TransferPakTablesMatchSwitch )
+{
+	static const struct { BYTE bCartType; int nRomBanks; BYTE bRamSize; } aCarts[] = {
+		{ 0x03, 8, 0x03 },		// MBC1+RAM+BATTERY
+		{ 0x06, 4, 0x00 },		// MBC2+BATTERY
+		{ 0x13, 16, 0x03 },		// MBC3+RAM+BATTERY
+		{ 0x1B, 8, 0x03 } };	// MBC5+RAM+BATTERY
+	char szRom[16], szNew[16], szOld[16];
+	InitGBRomIndex( "index.bin" );
+
+	for( int c = 0; c < ARRAYSIZE(aCarts); c++ )
+	{
+		sprintf( szRom, "%d.gb", c );
+		sprintf( szNew, "%d.new.sav", c );
+		sprintf( szOld, "%d.old.sav", c );
+		CHECK( WriteTestGBRom( szRom, aCarts[c].bCartType, aCarts[c].nRomBanks, aCarts[c].bRamSize ));
+
+		static TRANSFERPAK TPak;
+		static OLDTPAK OldTPak;
+		ZeroMemory( &TPak, sizeof(TPak) );
+		InitTransferPak( &TPak, szRom, szNew );
+		CHECK( TPak.bPakInserted );
+		CHECK( OpenOldTPak( &OldTPak, szRom, szOld ));
+		if( !TPak.bPakInserted || !OldTPak.bPakInserted )
+			continue;
+
+		DWORD dwSeed = 1 + c;
+		int nDiffer = 0;
+		for( int i = 0; i < 100000; i++ )
+		{
+			BYTE aData[33], aOldData[33];
+			bool fWrite;
+			WORD wAddress;
+			RandomTPakAccess( &dwSeed, &fWrite, &wAddress, aData );
+			CopyMemory( aOldData, aData, sizeof(aData) );
+			if( fWrite )
+			{
+				WriteTransferPak( &TPak, wAddress, aData );
+				OldTPakWrite( &OldTPak, wAddress, aOldData );
+			}
+			else
+			{
+				ReadTransferPak( &TPak, wAddress, aData );
+				OldTPakRead( &OldTPak, wAddress, aOldData );
+			}
+			if( memcmp( aData, aOldData, sizeof(aData) ) || TPak.iEnableState != OldTPak.iEnableState
+				|| TPak.iCurrentBankNo != OldTPak.iCurrentBankNo || TPak.iCurrentAccessMode != OldTPak.iCurrentAccessMode )
+				nDiffer++;
+		}
+		CHECK( nDiffer == 0 );
+		UnloadCart( &TPak.gbCart );
+		UnloadCart( &OldTPak.gbCart );
+
+		// and the cart RAM ended up the same
+		static BYTE aNewRam[0x8000], aOldRam[0x8000];
+		const int nNew = ReadTestFile( szNew, aNewRam, sizeof(aNewRam) );
+		CHECK( nNew == ReadTestFile( szOld, aOldRam, sizeof(aOldRam) ) && !memcmp( aNewRam, aOldRam, nNew > 0 ? nNew : 0 ));
+	}
+	FreeGBRomIndex();
+}
+
+// A game copying all 32 KB of cart RAM through the Transfer Pak: per RAM bank, one MBC register write to
+// select it and 256 reads of 32 bytes.
+static int CopyCartRam( void *pTPak, const bool fOld )
+{
+	BYTE aData[33];
+	int nSum = 0;
+	for( int iRamBank = 0; iRamBank < 4; iRamBank++ )
+	{
+		FillMemory( aData, 32, 1 );				// TPak bank 1 holds GB 0x4000 - 0x7FFF
+		fOld ? OldTPakWrite( (OLDTPAK*)pTPak, 0xA000, aData ) : (void)WriteTransferPak( (LPTRANSFERPAK)pTPak, 0xA000, aData );
+		FillMemory( aData, 32, (BYTE)iRamBank );	// RAM bank select at GB 0x4000
+		fOld ? OldTPakWrite( (OLDTPAK*)pTPak, 0xC000, aData ) : (void)WriteTransferPak( (LPTRANSFERPAK)pTPak, 0xC000, aData );
+		FillMemory( aData, 32, 2 );				// TPak bank 2 holds the RAM at GB 0xA000 - 0xBFFF
+		fOld ? OldTPakWrite( (OLDTPAK*)pTPak, 0xA000, aData ) : (void)WriteTransferPak( (LPTRANSFERPAK)pTPak, 0xA000, aData );
+		for( WORD wAddress = 0xE000; wAddress != 0; wAddress += 32 )
+		{
+			if( fOld )
+				OldTPakRead( (OLDTPAK*)pTPak, wAddress, aData );
+			else
+				ReadTransferPak( (LPTRANSFERPAK)pTPak, wAddress, aData );
+			nSum += aData[32];
+		}
+	}
+	return nSum;
+}
+
+// Both take about as long: DataCRC and the copy dominate, and the tables save no measurable time over the
+// switch (20-28 us against 20-23 us per copy in a release build).  They're there for the dispatch being
+// bound once per enable state, not for speed.
+PAKBENCH( TransferPakRamCopy )
+{
+	InitGBRomIndex( "index.bin" );
+	CHECK( WriteTestGBRom( "mbc5.gb", 0x1B, 64, 0x03 ));
+
+	static TRANSFERPAK TPak;
+	static OLDTPAK OldTPak;
+	ZeroMemory( &TPak, sizeof(TPak) );
+	InitTransferPak( &TPak, "mbc5.gb", "new.sav" );
+	CHECK( TPak.bPakInserted && OpenOldTPak( &OldTPak, "mbc5.gb", "old.sav" ));
+
+	// enable the cart, and its RAM (GB 0x0000 in TPak bank 0)
+	BYTE aData[33];
+	FillMemory( aData, 32, 0x84 );
+	WriteTransferPak( &TPak, 0x8000, aData );
+	OldTPakWrite( &OldTPak, 0x8000, aData );
+	FillMemory( aData, 32, 0x00 );
+	WriteTransferPak( &TPak, 0xA000, aData );
+	OldTPakWrite( &OldTPak, 0xA000, aData );
+	FillMemory( aData, 32, 0x0A );
+	WriteTransferPak( &TPak, 0xC000, aData );
+	OldTPakWrite( &OldTPak, 0xC000, aData );
+
+	int nSum = 0, nOldSum = 0;
+	ULONGLONG qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+		nSum += CopyCartRam( &TPak, false );
+	PakBenchReport( "32 KB through the handler tables", PakMicroseconds() - qwStart, nIterations );
+
+	qwStart = PakMicroseconds();
+	for( int n = 0; n < nIterations; n++ )
+		nOldSum += CopyCartRam( &OldTPak, true );
+	PakBenchReport( "32 KB through the switch", PakMicroseconds() - qwStart, nIterations );
+	CHECK( nSum == nOldSum );
+
+	UnloadCart( &TPak.gbCart );
+	UnloadCart( &OldTPak.gbCart );
+	FreeGBRomIndex();
+}
@@ -0,0 +1,220 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// mpkcheck: checks (and on request repairs) the Memory Pak files of whole directory trees, without the
+// plugin, and reports on every image as tab separated values.  See Usage() for the command line.
+
+#include "commonIncludes.h"
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PakSnapshot.h"
+#include "PakStore.h"
+#include "MemPakFormat.h"
+
+// the pak core hands snapshots the paks of the controllers; there are none here
+void *LockPakSlot( const int iSlot )
+{
+	return NULL;
+}
+
+void UnlockPakSlot( const int iSlot, const DWORD dwChanges )
+{
+}
+
+typedef struct _CHECKTOTALS
+{
+	int nFiles;
+	int nDamaged;			// images still damaged when we're done with them
+	int nRepaired;
+	int nUnreadable;
+} CHECKTOTALS;
+
+static const char *FormatName( const int iFormat )
+{
+	switch( iFormat )
+	{
+	case MPF_DEXDRIVE:	return "n64";
+	case MPF_BANKS:		return "mpb";
+	case MPF_MANIFEST:	return "mpm";
+	default:			return "mpk";
+	}
+}
+
+// the MPERR_ bits by name, comma separated, "-" for none
+static void ErrorNames( const DWORD dwErrors, char *pszNames )
+{
+	static const struct { DWORD dwBit; const char *pszName; } aNames[] = {
+		{ MPERR_IDBLOCK, "idblock" }, { MPERR_NOIDBLOCK, "noidblock" }, { MPERR_CHECKSUM, "checksum" }, { MPERR_CHAIN, "chain" },
+		{ MPERR_LOOP, "loop" }, { MPERR_CROSSLINK, "crosslink" }, { MPERR_LOSTBLOCK, "lostblock" } };
+
+	*pszNames = '\0';
+	for( int i = 0; i < ARRAYSIZE(aNames); i++ )
+		if( dwErrors & aNames[i].dwBit )
+		{
+			if( *pszNames )
+				strcat( pszNames, "," );
+			strcat( pszNames, aNames[i].pszName );
+		}
+	if( !*pszNames )
+		strcpy( pszNames, "-" );
+}
+
+// one line per image: file, format, bank, status, errors found, notes, used blocks, bad note, bad block, errors left
+static void ReportFile( LPCTSTR pszFile, const MEMPAKFILECHECK *pCheck, void *pParam )
+{
+	CHECKTOTALS *pTotals = (CHECKTOTALS*)pParam;
+	pTotals->nFiles++;
+	if( !pCheck )
+	{
+		printf( "%s\t-\t-\tunreadable\t-\t-\t-\t-\t-\t-\n", pszFile );
+		pTotals->nUnreadable++;
+		return;
+	}
+
+	char szFound[64], szLeft[64];
+	for( int i = 0; i < pCheck->nBanks; i++ )
+	{
+		const MEMPAKCHECK *pBank = &pCheck->aBanks[i];
+		const char *pszStatus = "ok";
+		if( pCheck->aRepaired[i] )
+		{
+			pszStatus = "repaired";
+			pTotals->nRepaired++;
+		}
+		else if( pBank->dwErrors & MPERR_DAMAGED )
+		{
+			pszStatus = "damaged";
+			pTotals->nDamaged++;
+		}
+		ErrorNames( pBank->dwErrors, szFound );
+		ErrorNames( pCheck->aLeft[i], szLeft );
+		printf( "%s\t%s\t%d\t%s\t%s\t%d\t%u\t%d\t%d\t%s\n", pszFile, FormatName( pCheck->iFormat ), i, pszStatus, szFound,
+				pBank->nNotes, pBank->wUsedBlocks, pBank->iBadNote, pBank->iBadNote >= 0 ? pBank->bBadBlock : -1, szLeft );
+	}
+	if( pCheck->fShort )
+	{
+		printf( "%s\t%s\t%d\tshort\t-\t-\t-\t-\t-\t-\n", pszFile, FormatName( pCheck->iFormat ), pCheck->nBanks );
+		pTotals->nDamaged++;
+	}
+}
+
+// collects the store of every directory in the tree that has one
+static bool CollectStores( const TCHAR *pszName, void *pParam );
+
+static void CollectTree( LPTSTR pszDirectory, const bool fRecurse )
+{
+	TCHAR szStore[MAX_PATH+1];
+	snprintf( szStore, sizeof(szStore), "%spakstore", pszDirectory );
+	PAKFILEINFO Info;
+	if( PakGetPathInfo( szStore, &Info ))
+	{
+		const int nDeleted = CollectPakStore( pszDirectory );
+		if( nDeleted < 0 )
+			fprintf( stderr, "mpkcheck: can't collect %s, a manifest is unreadable\n", szStore );
+		else
+			fprintf( stderr, "mpkcheck: %d unlisted pages deleted from %s\n", nDeleted, szStore );
+	}
+	if( fRecurse )
+		PakFindDirectories( pszDirectory, CollectStores, pszDirectory );
+}
+
+static bool CollectStores( const TCHAR *pszName, void *pParam )
+{
+	LPTSTR pszDirectory = (LPTSTR)pParam;
+	const int nLength = lstrlen( pszDirectory );
+	if( !lstrcmpi( pszName, "pakstore" ) || nLength + lstrlen( pszName ) + 2 + 9 + 16 + 3 > MAX_PATH )
+		return true;
+
+	sprintf( pszDirectory + nLength, "%s%c", pszName, PAK_PATH_SEPARATOR );
+	CollectTree( pszDirectory, true );
+	pszDirectory[nLength] = '\0';
+	return true;
+}
+
+static void Usage()
+{
+	fprintf( stderr,
+		"usage: mpkcheck [--repair] [--gc] [--flat] directory...\n"
+		"  Checks every .mpk, .n64, .mpb and .mpm file in the directories and the ones below them, on all\n"
+		"  processors, and prints one tab separated line per image:\n"
+		"    file format bank status found notes used_blocks bad_note bad_block left\n"
+		"  status is ok, damaged, repaired, short (the file ends partway into the image) or unreadable;\n"
+		"  found and left are the errors before and after a repair.\n"
+		"  --repair  writes back the images that can be repaired (manifests are only checked)\n"
+		"  --gc      deletes the store pages no manifest lists, see CollectPakStore; no plugin may be running\n"
+		"  --flat    leaves out the directories below\n"
+		"  Exits with 1 if anything is left damaged or unreadable.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	bool fRepair = false, fCollect = false, fRecurse = true;
+	int iFirst = 1;
+	for( ; iFirst < argc && argv[iFirst][0] == '-'; iFirst++ )
+	{
+		if( !strcmp( argv[iFirst], "--repair" ))
+			fRepair = true;
+		else if( !strcmp( argv[iFirst], "--gc" ))
+			fCollect = true;
+		else if( !strcmp( argv[iFirst], "--flat" ))
+			fRecurse = false;
+		else
+		{
+			Usage();
+			return 2;
+		}
+	}
+	if( iFirst >= argc )
+	{
+		Usage();
+		return 2;
+	}
+
+	InitPakCRCTables();
+	InitPakSnapshots();
+	InitPakStore();
+
+	CHECKTOTALS Totals;
+	ZeroMemory( &Totals, sizeof(Totals) );
+	const ULONGLONG qwStart = PakMicroseconds();
+	printf( "file\tformat\tbank\tstatus\tfound\tnotes\tused_blocks\tbad_note\tbad_block\tleft\n" );
+	for( int i = iFirst; i < argc; i++ )
+	{
+		CheckMemPakFiles( argv[i], fRecurse, fRepair, ReportFile, &Totals );
+		if( fCollect && lstrlen( argv[i] ) + 2 <= MAX_PATH )
+		{
+			TCHAR szDirectory[MAX_PATH+1];
+			lstrcpy( szDirectory, argv[i] );
+			const int nLength = lstrlen( szDirectory );
+			if( nLength && szDirectory[nLength - 1] != PAK_PATH_SEPARATOR )
+				sprintf( szDirectory + nLength, "%c", PAK_PATH_SEPARATOR );
+			CollectTree( szDirectory, fRecurse );
+		}
+	}
+	fprintf( stderr, "mpkcheck: %d files in %.2f s, %d images damaged, %d repaired, %d files unreadable\n", Totals.nFiles,
+				(double)( PakMicroseconds() - qwStart ) / 1000000.0, Totals.nDamaged, Totals.nRepaired, Totals.nUnreadable );
+
+	FreePakSnapshots();
+	FreePakStore();
+	return ( Totals.nDamaged || Totals.nUnreadable ) ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// mpkconvert: converts every Memory Pak file of one format in a directory to another format, without the plugin,
+// through ConvertMemPakFiles.  See Usage() for the command line.
+
+#include "commonIncludes.h"
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PakSnapshot.h"
+#include "PakStore.h"
+#include "MemPakFormat.h"
+
+// the pak core hands snapshots the paks of the controllers; there are none here
+void *LockPakSlot( const int iSlot )
+{
+	return NULL;
+}
+
+void UnlockPakSlot( const int iSlot, const DWORD dwChanges )
+{
+}
+
+// "mpk" and ".mpk" both become ".mpk"; false if it isn't a Memory Pak extension
+static bool GetExtension( const char *pszArg, LPTSTR pszExt )
+{
+	if( lstrlen( pszArg ) > 8 )
+		return false;
+	sprintf( pszExt, "%s%s", pszArg[0] == '.' ? "" : ".", pszArg );
+	const int iFormat = MemPakFormatFromName( pszExt );
+	return iFormat != MPF_UNKNOWN && iFormat != MPF_NOTE;
+}
+
+static void Usage()
+{
+	fprintf( stderr,
+		"usage: mpkconvert directory from to\n"
+		"  Converts every file with the extension from (mpk, n64, mpb or mpm) in the directory to the format of\n"
+		"  the extension to, next to it, on all processors.  Existing targets are left alone; bank files holding\n"
+		"  more than one bank are only converted to bank files.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	TCHAR szFrom[16], szTo[16];
+	if( argc != 4 || argv[1][0] == '-' || !GetExtension( argv[2], szFrom ) || !GetExtension( argv[3], szTo ) || !lstrcmpi( szFrom, szTo ))
+	{
+		Usage();
+		return 2;
+	}
+
+	InitPakCRCTables();
+	InitPakSnapshots();
+	InitPakStore();
+
+	const ULONGLONG qwStart = PakMicroseconds();
+	const int nConverted = ConvertMemPakFiles( argv[1], szFrom, szTo );
+	fprintf( stderr, "mpkconvert: %d %s files converted to %s in %.2f s\n", nConverted, szFrom, szTo,
+				(double)( PakMicroseconds() - qwStart ) / 1000000.0 );
+
+	FreePakSnapshots();
+	FreePakStore();
+	return 0;
+}
@@ -0,0 +1,307 @@
+/*	
+	N-Rage`s Dinput8 Plugin
+    (C) 2002, 2006  Norbert Wladyka
+
+	Author`s Email: norbert.wladyka@chello.at
+	Website: http://go.to/nrage
+
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// sireplay: replays the Memory Pak and Transfer Pak traffic of an SI trace (see SITrace.h) through the pak core,
+// without the plugin or Windows, and checks every answer against the recording.  See Usage() for the command line.
+
+#include "commonIncludes.h"
+#include "PakIO.h"
+#include "PakPlatform.h"
+#include "PakJournal.h"
+#include "PakSnapshot.h"
+#include "PakStore.h"
+#include "GBRomCache.h"
+#include "GBRomIndex.h"
+#include "SITrace.h"
+
+// the pak core hands snapshots the paks of the controllers; there are none here
+void *LockPakSlot( const int iSlot )
+{
+	return NULL;
+}
+
+void UnlockPakSlot( const int iSlot, const DWORD dwChanges )
+{
+}
+
+// the pak behind one controller; at most one of the two is set
+typedef struct _REPLAYPAK
+{
+	LPMEMPAK pMemPak;
+	LPTRANSFERPAK pTransferPak;
+	TCHAR szSave[MAX_PATH+1];		// the Transfer Pak's cart RAM file
+} REPLAYPAK;
+
+typedef struct _REPLAYSTATS
+{
+	DWORD dwSessions;
+	DWORD dwFrames;
+	DWORD dwCommands;
+	DWORD dwReplayed;		// pak reads and writes of controllers that have a pak here
+	DWORD dwDivergences;	// replayed ones that answered differently than in the trace
+	ULONGLONG qwMicros;		// time spent in ReadMemPak, WriteMemPak, ReadTransferPak and WriteTransferPak
+	CONTROLLERSTATS aStats[4];
+} REPLAYSTATS;
+
+static DWORD ReadTraceDword( LPCBYTE pData )
+{
+	return pData[0] | ( pData[1] << 8 ) | ( pData[2] << 16 ) | ( (DWORD)pData[3] << 24 );
+}
+
+// one command record; pSend is the command byte and what follows it, pRecv the answer in the trace
+static void ReplayCommand( REPLAYPAK *aPaks, const int iControl, LPCBYTE pSend, const DWORD dwSend, LPCBYTE pRecv, const DWORD dwRecv, REPLAYSTATS *pStats )
+{
+	BYTE aData[33];
+	pStats->dwCommands++;
+	LPMEMPAK pMemPak = aPaks[iControl].pMemPak;
+	LPTRANSFERPAK pTransferPak = aPaks[iControl].pTransferPak;
+	if(( !pMemPak && !pTransferPak ) || dwSend < 3 )
+		return;
+	const bool fRead = ( pSend[0] == RD_READPAK && dwRecv == 33 );
+	const bool fWrite = ( pSend[0] == RD_WRITEPAK && dwSend == 35 && dwRecv == 1 );
+	if( !fRead && !fWrite )
+		return;
+
+	const WORD dwAddress = ( pSend[1] << 8 ) + ( pSend[2] & 0xE0 );
+	const ULONGLONG qwStart = PakMicroseconds();
+	if( fRead && pMemPak )
+		ReadMemPak( pMemPak, dwAddress, aData, &pStats->aStats[iControl] );
+	else if( fRead )
+		ReadTransferPak( pTransferPak, dwAddress, aData );
+	else
+	{
+		CopyMemory( aData, &pSend[3], 32 );
+		if( pMemPak )
+			WriteMemPak( pMemPak, dwAddress, aData );
+		else
+			WriteTransferPak( pTransferPak, dwAddress, aData );
+	}
+	pStats->qwMicros += PakMicroseconds() - qwStart;
+	pStats->dwReplayed++;
+
+	if( fRead ? memcmp( aData, pRecv, 33 ) != 0 : aData[32] != pRecv[0] )
+	{
+		pStats->dwDivergences++;
+		fprintf( stderr, "sireplay: controller %d diverged in frame %u, %s of %04X\n", iControl + 1, pStats->dwFrames,
+					fRead ? "read" : "write", dwAddress );
+	}
+}
+
+// false if the trace ends partway into a record or has one it doesn't know
+static bool ReplayTrace( LPCBYTE pTrace, const DWORD dwSize, REPLAYPAK *aPaks, REPLAYSTATS *pStats )
+{
+	DWORD dwPos = 0;
+	while( dwPos < dwSize )
+	{
+		const BYTE bTag = pTrace[dwPos];
+		if( bTag == SITRACE_SESSION )
+		{
+			if( dwPos + 15 > dwSize || ReadTraceDword( &pTrace[dwPos+1] ) != SITRACE_MAGIC
+				|| ( pTrace[dwPos+5] | ( pTrace[dwPos+6] << 8 )) != SITRACE_VERSION )
+				return false;
+			pStats->dwSessions++;
+			dwPos += 15;
+		}
+		else if( bTag == SITRACE_FRAME )
+		{
+			if( dwPos + 13 > dwSize )
+				return false;
+			// the emulator is done with the pif ram, the plugin commits the journals here
+			for( int i = 0; i < 4; i++ )
+			{
+				if( aPaks[i].pMemPak )
+					PakJournalCommit( aPaks[i].pMemPak->pJournal );
+				else if( aPaks[i].pTransferPak )
+					PakJournalCommit( aPaks[i].pTransferPak->gbCart.pJournal );
+			}
+			pStats->dwFrames++;
+			dwPos += 13;
+		}
+		else if( bTag < 4 )
+		{
+			if( dwPos + 4 > dwSize )
+				return false;
+			const DWORD dwSend = pTrace[dwPos+1] & 0x3F;
+			const DWORD dwRecv = pTrace[dwPos+2] & 0x3F;
+			if( dwPos + 4 + dwSend + dwRecv > dwSize )
+				return false;
+			ReplayCommand( aPaks, bTag, &pTrace[dwPos+4], dwSend, &pTrace[dwPos+4+dwSend], dwRecv, pStats );
+			dwPos += 4 + dwSend + dwRecv;
+		}
+		else
+			return false;
+	}
+	return true;
+}
+
+static LPBYTE ReadTrace( LPCTSTR pszFile, DWORD *pdwSize )
+{
+	LPPAKFILE pFile = PakOpenFile( pszFile, PAK_FILE_READ );
+	if( pFile == NULL )
+		return NULL;
+	*pdwSize = PakGetFileSize( pFile );
+	LPBYTE pTrace = (LPBYTE)P_malloc( *pdwSize ? *pdwSize : 1 );
+	if( pTrace && PakReadFile( pFile, pTrace, *pdwSize ) != *pdwSize )
+	{
+		P_free( pTrace );
+		pTrace = NULL;
+	}
+	PakCloseFile( pFile );
+	return pTrace;
+}
+
+static bool IsTransferPakRom( LPCTSTR pszArg )
+{
+	TCHAR szRom[MAX_PATH+1];
+	lstrcpyn( szRom, pszArg, ARRAYSIZE(szRom) );
+	LPTSTR pszComma = _tcschr( szRom, _T(',') );
+	if( pszComma )
+		*pszComma = _T('\0');
+	LPCTSTR pcPoint = _tcsrchr( szRom, _T('.') );
+	return pcPoint && ( !lstrcmpi( pcPoint, _T(".gb") ) || !lstrcmpi( pcPoint, _T(".gbc") )
+						|| !lstrcmpi( pcPoint, _T(".gz") ) || !lstrcmpi( pcPoint, _T(".zip") ));
+}
+
+// rom[,save]; without a save the cart RAM starts empty and isn't kept
+static bool OpenReplayTransferPak( REPLAYPAK *pPak, LPTRANSFERPAK pTransferPak, LPCTSTR pszArg )
+{
+	TCHAR szRom[MAX_PATH+1];
+	lstrcpyn( szRom, pszArg, ARRAYSIZE(szRom) );
+	pPak->szSave[0] = _T('\0');
+	LPTSTR pszComma = _tcschr( szRom, _T(',') );
+	if( pszComma )
+	{
+		*pszComma = _T('\0');
+		lstrcpyn( pPak->szSave, pszComma + 1, ARRAYSIZE(pPak->szSave) );
+	}
+
+	ZeroMemory( pTransferPak, sizeof(TRANSFERPAK) );
+	InitTransferPak( pTransferPak, szRom, pPak->szSave );
+	if( !pTransferPak->bPakInserted )
+		return false;
+	pPak->pTransferPak = pTransferPak;
+	return true;
+}
+
+static void Usage()
+{
+	fprintf( stderr,
+		"usage: sireplay trace [pak1 [pak2 [pak3 [pak4]]]]\n"
+		"  Replays the pak reads and writes of an SI trace against the paks given for controllers 1 to 4\n"
+		"  (\"-\" for none) and compares every answer with the recording; the other commands are skipped.\n"
+		"  A pak is a Memory Pak file, or a Transfer Pak given as rom.gb[,save.sav] (.gb, .gbc, .gz or .zip).\n"
+		"  The paks are written to, so give it copies of the ones the trace was recorded with.\n"
+		"  Exits with 1 if an answer diverged or the trace is damaged.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	if( argc < 2 || argc > 6 || argv[1][0] == '-' )
+	{
+		Usage();
+		return 2;
+	}
+
+	InitPakCRCTables();
+	InitPakSnapshots();
+	InitPakStore();
+	InitGBRomIndex( _T("") );	// no index file; the headers are read on load
+	InitGBRomCache();
+
+	DWORD dwSize = 0;
+	LPBYTE pTrace = ReadTrace( argv[1], &dwSize );
+	if( pTrace == NULL )
+	{
+		fprintf( stderr, "sireplay: can't read %s\n", argv[1] );
+		return 2;
+	}
+
+	static MEMPAK aMemPaks[4];
+	static TRANSFERPAK aTransferPaks[4];
+	static REPLAYPAK aPaks[4];
+	int iReturn = 0;
+	for( int i = 0; i < 4 && i + 2 < argc; i++ )
+	{
+		if( !strcmp( argv[i + 2], "-" ))
+			continue;
+		bool bOpened;
+		if( IsTransferPakRom( argv[i + 2] ))
+			bOpened = OpenReplayTransferPak( &aPaks[i], &aTransferPaks[i], argv[i + 2] );
+		else
+		{
+			LPCTSTR pszName = _tcsrchr( argv[i + 2], PAK_PATH_SEPARATOR );
+			bOpened = OpenMemPak( &aMemPaks[i], argv[i + 2], pszName ? pszName + 1 : argv[i + 2] );
+			if( bOpened )
+				aPaks[i].pMemPak = &aMemPaks[i];
+		}
+		if( !bOpened )
+		{
+			fprintf( stderr, "sireplay: can't open %s\n", argv[i + 2] );
+			iReturn = 2;
+			break;
+		}
+	}
+
+	REPLAYSTATS Stats;
+	ZeroMemory( &Stats, sizeof(Stats) );
+	if( iReturn == 0 )
+	{
+		const bool fValid = ReplayTrace( pTrace, dwSize, aPaks, &Stats );
+		DWORD dwHits = 0, dwMisses = 0;
+		for( int i = 0; i < 4; i++ )
+		{
+			dwHits += Stats.aStats[i].dwMemPakCRCHits;
+			dwMisses += Stats.aStats[i].dwMemPakCRCMisses;
+		}
+		printf( "%u sessions, %u frames, %u commands, %u pak transfers replayed in %llu us (%.0f per second), %u diverged, CRC cache %u hits %u misses%s\n",
+				Stats.dwSessions, Stats.dwFrames, Stats.dwCommands, Stats.dwReplayed, (unsigned long long)Stats.qwMicros,
+				Stats.qwMicros ? (double)Stats.dwReplayed * 1000000.0 / (double)Stats.qwMicros : 0.0, Stats.dwDivergences, dwHits, dwMisses,
+				fValid ? "" : ", trace truncated or corrupt" );
+		iReturn = ( !fValid || Stats.dwDivergences ) ? 1 : 0;
+	}
+
+	for( int i = 0; i < 4; i++ )
+	{
+		if( aPaks[i].pMemPak )
+		{
+			PakJournalCommit( aPaks[i].pMemPak->pJournal );
+			SaveMemPak( aPaks[i].pMemPak );
+			CloseMemPak( aPaks[i].pMemPak );
+		}
+		else if( aPaks[i].pTransferPak )
+		{
+			LPGBCART pCart = &aPaks[i].pTransferPak->gbCart;
+			PakJournalCommit( pCart->pJournal );
+			TCHAR szNoTime[1] = _T("");
+			if( pCart->pRamMapping != NULL || pCart->sGoombaRamPath != NULL )
+				SaveCart( pCart, aPaks[i].szSave, szNoTime );
+			UnloadCart( pCart );
+		}
+	}
+	P_free( pTrace );
+	FreeGBRomCache();
+	FreeGBRomIndex();
+	FreePakSnapshots();
+	FreePakStore();
+	return iReturn;
+}
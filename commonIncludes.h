@@ -25,11 +25,16 @@
 #define _COMMONINCLUDES_H_
 
 #include "settings.h"
+#ifdef _WIN32
 #include <tchar.h>
 #include <wtypes.h>
+#else
+#include "PakTypes.h"
+#endif // #ifdef _WIN32
 #include "resource.h"
 #include "Debug.h"
 
+#ifdef _WIN32
 #if SPECS_VERSION == 0x0100
 #include "./ControllerSpecs/Controller #1.0.h"
 #endif // #if SPECS_VERSION == 0x0100
@@ -38,12 +43,19 @@
 #include "./ControllerSpecs/Controller #1.1.h"
 #endif // #if SPECS_VERSION == 0x0100
 
-
 #define P_malloc( size ) HeapAlloc( g_hHeap, 0, size )
 #define P_free( memory ) HeapFree( g_hHeap, 0, memory )
 #define P_realloc( memory, size ) \
 	( (memory == NULL) ? P_malloc(size) : HeapReAlloc( g_hHeap, 0, memory, size ) )
 
+extern HANDLE g_hHeap;
+#else
+	// the pak core outside of the plugin uses the C heap
+#define P_malloc( size ) malloc( size )
+#define P_free( memory ) free( memory )
+#define P_realloc( memory, size ) realloc( memory, size )
+#endif // #ifdef _WIN32
+
 #ifdef ARRAYSIZE
 #undef ARRAYSIZE
 #define ARRAYSIZE( array ) (sizeof(array) / sizeof(array[0]))
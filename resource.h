@@ -163,6 +163,8 @@
 #define IDS_DLG_TPAK_READONLY           267
 #define IDS_STRING268                   268
 #define IDS_P_SWITCHING                 268
+#define IDS_P_MEMPAKBANK                269
+#define IDS_ERR_GOOMBASAVE              270
 #define IDC_ROMDESC                     1003
 #define IDC_ROMCONFIG                   1004
 #define IDC_AUTOCONFIG                  1005
@@ -361,6 +363,10 @@
 #define IDC_XC_DPAD                     1193
 #define IDC_XC_LTS                      1194
 #define IDC_XC_RTS                      1195
+#define IDC_CYCLEBANK_P1                1196
+#define IDC_CYCLEBANK_P2                1197
+#define IDC_CYCLEBANK_P3                1198
+#define IDC_CYCLEBANK_P4                1199
 
 // Next default values for new objects
 // 
@@ -368,7 +374,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        147
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1196
+#define _APS_NEXT_CONTROL_VALUE         1200
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
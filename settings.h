@@ -67,8 +67,6 @@ typedef const unsigned char *LPCBYTE;
 	// remove unimplemented Elements of the GUI
 // #define HIDEUNIMPLEMENTED
 
-  	// check controllercommands for valid CRC
-// #define MAKEADRESSCRCCHECK
  	// display Button for writing Shortcuts binary
 // #define RAWPROFILEWRITE
 
@@ -76,6 +74,12 @@ typedef const unsigned char *LPCBYTE;
 // #define V_TRANSFERPAK
   	// enable selection of VoicePak
 // #define V_VOICEPAK
+
+	// binary trace of ReadController commands, see SITrace.h
+// #define ENABLE_SI_TRACE
+
+	// highest log level compiled in: LOG_WARN, LOG_DEBUG or LOG_TRACE
+// #define DEBUG_LOG_LEVEL LOG_TRACE
 // ----------------------------------------------------------------------------
 
 #else
@@ -90,8 +94,6 @@ typedef const unsigned char *LPCBYTE;
    	// remove unimplemented Elements of the GUI
 // #define HIDEUNIMPLEMENTED
 
-	// check controllercommands for valid CRC
-#define MAKEADRESSCRCCHECK
 	// display Button for writing Shortcuts binary
 #define RAWPROFILEWRITE
 
@@ -103,6 +105,15 @@ typedef const unsigned char *LPCBYTE;
 // spits out loads of extra info for ControllerCommand and ReadController
 // #define ENABLE_RAWPAK_DEBUG
 
+	// highest log level compiled in: LOG_WARN, LOG_DEBUG or LOG_TRACE (per-transfer pak and input logging);
+	// may also come from the command line (/DDEBUG_LOG_LEVEL=LOG_TRACE)
+#ifndef DEBUG_LOG_LEVEL
+#define DEBUG_LOG_LEVEL LOG_DEBUG
+#endif
+
+	// binary trace of ReadController commands, see SITrace.h
+#define ENABLE_SI_TRACE
+
 // ----------------------------------------------------------------------------
 
 #else
@@ -114,8 +125,6 @@ typedef const unsigned char *LPCBYTE;
    	// remove unimplemented Elements of the GUI
 #define HIDEUNIMPLEMENTED
 
-  	// check controllercommands for valid CRC
-// #define MAKEADRESSCRCCHECK
  	// display Button for writing Shortcuts binary
 // #define RAWPROFILEWRITE
 
@@ -124,6 +133,10 @@ typedef const unsigned char *LPCBYTE;
   	// enable selection of VoicePak
 // #define V_VOICEPAK
 
+	// binary trace of ReadController commands, see SITrace.h; off until NRage-SITrace.bin exists, and then
+	// it only costs a file existence check on every RomOpen and a branch on every command
+#define ENABLE_SI_TRACE
+
 // ----------------------------------------------------------------------------
 
 #endif // #ifdef _DEBUG